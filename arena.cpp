@@ -0,0 +1,296 @@
+///////////////////////////////////////////////////////////////////////////////
+// arena.cpp
+// ========
+// frame-scoped linear allocators: one bump arena per job thread, emptied
+// once per frame, an STL allocator adaptor for containers of per-frame data,
+// and a count of heap allocations to check that frames no longer make any
+//
+// An arena is one block that allocations are carved from in order. When a
+// frame needs more than the block holds, the rest comes from the heap and
+// the next Reset() replaces the block with one large enough for that frame,
+// so after the first few frames the arenas stop touching the heap at all.
+//
+// Builds with OPENGL3D_COUNT_ALLOCATIONS defined replace the global operator
+// new and delete here to count heap allocations, which is how the main loop
+// checks (--check-allocations) that steady-state frames make none. Other
+// builds keep the runtime's own heap, and its debug checks, untouched.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#include "arena.h"
+#include "jobs.h"
+
+#include <atomic>
+#include <cstdint>
+#include <cstdlib>
+#include <iostream>
+
+namespace {
+	// A grown block has this much headroom over the largest frame seen
+	const size_t GROWTH_MARGIN_DIVISOR = 4;
+#ifdef OPENGL3D_COUNT_ALLOCATIONS
+
+	std::atomic<unsigned long long> gHeapAllocations{ 0 };
+
+	void* CountedAllocate(size_t size) {
+		gHeapAllocations.fetch_add(1, std::memory_order_relaxed);
+		return malloc(size ? size : 1);
+	}
+
+	void* CountedAllocateAligned(size_t size, size_t alignment) {
+		gHeapAllocations.fetch_add(1, std::memory_order_relaxed);
+		if (size == 0)
+			size = 1;
+#ifdef _MSC_VER
+		return _aligned_malloc(size, alignment);
+#else
+		return aligned_alloc(alignment, (size + alignment - 1) / alignment * alignment);
+#endif
+	}
+
+	void FreeAligned(void* pointer) {
+#ifdef _MSC_VER
+		_aligned_free(pointer);
+#else
+		free(pointer);
+#endif
+	}
+#endif
+}
+
+///////////////////////////////////////////////////
+//	Initialize(size_t)
+//
+//	capacity: bytes of the block; it grows on its own if
+//	a frame needs more
+///////////////////////////////////////////////////
+void FrameArena::Initialize(size_t capacity) {
+	Shutdown();
+	gCapacity = capacity;
+	gBlock = gCapacity ? (char*)::operator new(gCapacity) : nullptr;
+}
+
+///////////////////////////////////////////////////
+//	Shutdown()
+//
+//	Free the block. Nothing allocated from the arena may
+//	be used afterwards.
+///////////////////////////////////////////////////
+void FrameArena::Shutdown() {
+	FreeOverflow();
+	gOffset = gUsed = 0;
+	::operator delete(gBlock);
+	gBlock = nullptr;
+	gCapacity = 0;
+}
+
+///////////////////////////////////////////////////
+//	Allocate(size_t, size_t)
+//
+//	alignment: a power of two
+//
+//	Returns memory valid until the next Reset(). Only the
+//	thread owning the arena may call this.
+///////////////////////////////////////////////////
+void* FrameArena::Allocate(size_t size, size_t alignment) {
+	if (gBlock) {
+		const uintptr_t base = (uintptr_t)gBlock;
+		const uintptr_t aligned = (base + gOffset + alignment - 1) & ~(uintptr_t)(alignment - 1);
+		if (aligned + size <= base + gCapacity) {
+			gUsed += aligned + size - (base + gOffset);
+			gOffset = aligned + size - base;
+			return (void*)aligned;
+		}
+	}
+
+	// Full: take this one from the heap, and remember how much the frame needed
+	const size_t header = (sizeof(Overflow) + alignment - 1) & ~(alignment - 1);
+	char* memory = (char*)::operator new(header + size + alignment);
+	Overflow* overflow = (Overflow*)memory;
+	overflow->next = gOverflow;
+	gOverflow = overflow;
+	gUsed += size + alignment;
+
+	const uintptr_t aligned = ((uintptr_t)memory + header + alignment - 1) & ~(uintptr_t)(alignment - 1);
+	return (void*)aligned;
+}
+
+///////////////////////////////////////////////////
+//	Reset()
+//
+//	Release everything allocated since the last Reset().
+//	If the frame overflowed the block, the block is
+//	replaced by a larger one; returns true when it grew.
+///////////////////////////////////////////////////
+bool FrameArena::Reset() {
+	if (gUsed > gHighWater)
+		gHighWater = gUsed;
+
+	bool grew = false;
+	if (gOverflow) {
+		FreeOverflow();
+		::operator delete(gBlock);
+		gCapacity = gHighWater + gHighWater / GROWTH_MARGIN_DIVISOR;
+		gBlock = (char*)::operator new(gCapacity);
+		grew = true;
+	}
+
+	gOffset = 0;
+	gUsed = 0;
+	return grew;
+}
+
+void FrameArena::FreeOverflow() {
+	while (gOverflow) {
+		Overflow* next = gOverflow->next;
+		::operator delete(gOverflow);
+		gOverflow = next;
+	}
+}
+
+///////////////////////////////////////////////////
+//	Initialize(unsigned int, size_t)
+//
+//	threadCount: job threads, JobSystem::ThreadCount()
+//	capacity: initial bytes per thread
+///////////////////////////////////////////////////
+void FrameArenas::Initialize(unsigned int threadCount, size_t capacity) {
+	Shutdown();
+	if (threadCount == 0)
+		threadCount = 1;
+
+	// Separate allocations keep the arenas' bookkeeping off each other's cache lines
+	gArenas.resize(threadCount);
+	for (FrameArena*& arena : gArenas) {
+		arena = new FrameArena;
+		arena->Initialize(capacity);
+	}
+}
+
+void FrameArenas::Shutdown() {
+	for (FrameArena* arena : gArenas)
+		delete arena;
+	gArenas.clear();
+}
+
+///////////////////////////////////////////////////
+//	Get(unsigned int)
+//
+//	Arena of a job thread, or nullptr (heap) for threads
+//	outside the job system
+///////////////////////////////////////////////////
+FrameArena* FrameArenas::Get(unsigned int thread) {
+	return thread < gArenas.size() ? gArenas[thread] : nullptr;
+}
+
+FrameArena* FrameArenas::Get() {
+	return Get(JobSystem::ThreadIndex());
+}
+
+///////////////////////////////////////////////////
+//	Reset()
+//
+//	Empty every arena. Call once per frame, when nothing
+//	allocated during the frame is used any more and no
+//	job is running.
+///////////////////////////////////////////////////
+void FrameArenas::Reset() {
+	for (size_t i = 0; i < gArenas.size(); i++)
+		if (gArenas[i]->Reset())
+			std::cout << "INFO: Frame arena " << i << " grew to " << gArenas[i]->Capacity() / 1024 << " KB" << std::endl;
+}
+
+///////////////////////////////////////////////////
+//	Report()
+//
+//	Print the most memory each thread used in a frame
+///////////////////////////////////////////////////
+void FrameArenas::Report() const {
+	for (size_t i = 0; i < gArenas.size(); i++)
+		std::cout << "INFO: Frame arena " << i << ": high water " << gArenas[i]->HighWater() / 1024.0 << " KB of "
+			<< gArenas[i]->Capacity() / 1024 << " KB" << std::endl;
+}
+
+///////////////////////////////////////////////////
+//	HeapAllocationCount()
+//
+//	Calls to operator new since the program started.
+//	Compare it before and after a frame to find frames
+//	that allocate. Always 0 unless counting is compiled in.
+///////////////////////////////////////////////////
+unsigned long long HeapAllocationCount() {
+#ifdef OPENGL3D_COUNT_ALLOCATIONS
+	return gHeapAllocations.load(std::memory_order_relaxed);
+#else
+	return 0;
+#endif
+}
+
+///////////////////////////////////////////////////
+//	HeapAllocationCountingEnabled()
+//
+//	True when this build defines OPENGL3D_COUNT_ALLOCATIONS
+//	and so replaces operator new to count allocations
+///////////////////////////////////////////////////
+bool HeapAllocationCountingEnabled() {
+#ifdef OPENGL3D_COUNT_ALLOCATIONS
+	return true;
+#else
+	return false;
+#endif
+}
+
+#ifdef OPENGL3D_COUNT_ALLOCATIONS
+
+// Counting replacements of the global allocation functions
+
+void* operator new(size_t size) {
+	if (void* pointer = CountedAllocate(size))
+		return pointer;
+	throw std::bad_alloc();
+}
+
+void* operator new[](size_t size) {
+	return operator new(size);
+}
+
+void* operator new(size_t size, const std::nothrow_t&) noexcept {
+	return CountedAllocate(size);
+}
+
+void* operator new[](size_t size, const std::nothrow_t&) noexcept {
+	return CountedAllocate(size);
+}
+
+void operator delete(void* pointer) noexcept { free(pointer); }
+void operator delete[](void* pointer) noexcept { free(pointer); }
+void operator delete(void* pointer, size_t) noexcept { free(pointer); }
+void operator delete[](void* pointer, size_t) noexcept { free(pointer); }
+void operator delete(void* pointer, const std::nothrow_t&) noexcept { free(pointer); }
+void operator delete[](void* pointer, const std::nothrow_t&) noexcept { free(pointer); }
+
+void* operator new(size_t size, std::align_val_t alignment) {
+	if (void* pointer = CountedAllocateAligned(size, (size_t)alignment))
+		return pointer;
+	throw std::bad_alloc();
+}
+
+void* operator new[](size_t size, std::align_val_t alignment) {
+	return operator new(size, alignment);
+}
+
+void* operator new(size_t size, std::align_val_t alignment, const std::nothrow_t&) noexcept {
+	return CountedAllocateAligned(size, (size_t)alignment);
+}
+
+void* operator new[](size_t size, std::align_val_t alignment, const std::nothrow_t&) noexcept {
+	return CountedAllocateAligned(size, (size_t)alignment);
+}
+
+void operator delete(void* pointer, std::align_val_t) noexcept { FreeAligned(pointer); }
+void operator delete[](void* pointer, std::align_val_t) noexcept { FreeAligned(pointer); }
+void operator delete(void* pointer, size_t, std::align_val_t) noexcept { FreeAligned(pointer); }
+void operator delete[](void* pointer, size_t, std::align_val_t) noexcept { FreeAligned(pointer); }
+void operator delete(void* pointer, std::align_val_t, const std::nothrow_t&) noexcept { FreeAligned(pointer); }
+void operator delete[](void* pointer, std::align_val_t, const std::nothrow_t&) noexcept { FreeAligned(pointer); }
+#endif
@@ -0,0 +1,123 @@
+///////////////////////////////////////////////////////////////////////////////
+// arena.h
+// ========
+// frame-scoped linear allocators: one bump arena per job thread, emptied
+// once per frame, an STL allocator adaptor for containers of per-frame data,
+// and a count of heap allocations to check that frames no longer make any
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <cstddef>
+#include <new>
+#include <type_traits>
+#include <vector>
+
+// Bump allocator. Allocate() moves a pointer; nothing is freed until Reset().
+class FrameArena {
+
+public:
+	FrameArena() = default;
+	FrameArena(const FrameArena&) = delete;
+	FrameArena& operator=(const FrameArena&) = delete;
+	~FrameArena() { Shutdown(); }
+
+	void Initialize(size_t capacity);
+	void Shutdown();
+
+	void* Allocate(size_t size, size_t alignment = alignof(std::max_align_t));
+	bool Reset();
+
+	size_t Used() const { return gUsed; }
+	size_t HighWater() const { return gHighWater; }
+	size_t Capacity() const { return gCapacity; }
+
+private:
+	// Taken from the heap when the block is full; freed by the next Reset()
+	struct Overflow {
+		Overflow* next;
+	};
+
+	void FreeOverflow();
+
+	char* gBlock = nullptr;
+	size_t gCapacity = 0;
+	size_t gOffset = 0;				// Into gBlock
+	size_t gUsed = 0;				// This frame, overflow included
+	size_t gHighWater = 0;			// Most used by any frame
+	Overflow* gOverflow = nullptr;
+};
+
+// One arena per job thread, indexed by JobSystem::ThreadIndex()
+class FrameArenas {
+
+public:
+	void Initialize(unsigned int threadCount, size_t capacity);
+	void Shutdown();
+
+	FrameArena* Get(unsigned int thread);
+	FrameArena* Get();
+	void Reset();
+	void Report() const;
+
+	unsigned int ThreadCount() const { return (unsigned int)gArenas.size(); }
+
+private:
+	std::vector<FrameArena*> gArenas;
+};
+
+///////////////////////////////////////////////////
+//	ArenaAllocator<T>
+//
+//	STL allocator drawing from a FrameArena, for
+//	containers that live no longer than a frame:
+//
+//	  std::vector<int, ArenaAllocator<int>> list{ ArenaAllocator<int>(arena) };
+//
+//	Deallocation is a no-op; the memory comes back at the
+//	arena's Reset(). A null arena falls back to the heap.
+///////////////////////////////////////////////////
+template <class T>
+class ArenaAllocator {
+
+public:
+	typedef T value_type;
+
+	// Containers adopt the allocator of the container they are assigned or swapped from
+	typedef std::true_type propagate_on_container_copy_assignment;
+	typedef std::true_type propagate_on_container_move_assignment;
+	typedef std::true_type propagate_on_container_swap;
+
+	FrameArena* gArena = nullptr;
+
+public:
+	ArenaAllocator() = default;
+	explicit ArenaAllocator(FrameArena* arena) : gArena(arena) {}
+	template <class U>
+	ArenaAllocator(const ArenaAllocator<U>& other) : gArena(other.gArena) {}
+
+	T* allocate(size_t count) {
+		if (gArena)
+			return (T*)gArena->Allocate(count * sizeof(T), alignof(T));
+		return (T*)::operator new(count * sizeof(T));
+	}
+
+	void deallocate(T* pointer, size_t) {
+		if (!gArena)
+			::operator delete(pointer);
+	}
+
+	template <class U>
+	bool operator==(const ArenaAllocator<U>& other) const { return gArena == other.gArena; }
+	template <class U>
+	bool operator!=(const ArenaAllocator<U>& other) const { return gArena != other.gArena; }
+};
+
+template <class T>
+using ArenaVector = std::vector<T, ArenaAllocator<T>>;
+
+// Number of operator new calls so far, on any thread; only counted in builds
+// that define OPENGL3D_COUNT_ALLOCATIONS
+unsigned long long HeapAllocationCount();
+bool HeapAllocationCountingEnabled();
@@ -0,0 +1,564 @@
+///////////////////////////////////////////////////////////////////////////////
+// bvh.cpp
+// ========
+// bounding volume hierarchy over axis aligned boxes: binned SAH build,
+// 4-wide nodes in a flat array, refit or rebuild as the boxes move, and
+// frustum, ray, box and sphere queries
+//
+// The tree is first built as a binary tree, splitting each range of boxes
+// where the surface area heuristic is lowest among a few evenly spaced
+// candidate planes (bins) along the widest centroid axis. It is then
+// collapsed into nodes of four children whose boxes are stored lane by lane,
+// so one node is tested with a handful of 4-wide operations.
+//
+// When boxes move the tree is refitted: same topology, bounds recomputed
+// bottom up. Refitting lets the tree degrade as objects drift apart, so it is
+// rebuilt once its SAH cost grows too far past that of a fresh build.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#include "bvh.h"
+
+#include <algorithm>
+#include <cfloat>
+
+#if defined(_M_X64) || defined(__SSE2__)
+#include <emmintrin.h>
+#define BVH_SSE 1
+#endif
+
+namespace {
+	const int BIN_COUNT = 16;
+	const int MAX_LEAF_SIZE = 4;
+
+	// Relative cost of visiting a node versus testing one primitive
+	const float TRAVERSAL_COST = 1.0f;
+
+	// Refitted trees are rebuilt when their cost exceeds a fresh build's by this factor
+	const float REBUILD_RATIO = 1.5f;
+
+	// Below this depth ranges are split at the median, which keeps the tree
+	// (and so the traversal stacks) shallow for any input
+	const int MAX_SAH_DEPTH = 48;
+
+	AABB EmptyBox() {
+		AABB box;
+		box.min = glm::vec3(FLT_MAX);
+		box.max = glm::vec3(-FLT_MAX);
+		return box;
+	}
+
+	void Grow(AABB& box, const AABB& other) {
+		box.min = glm::min(box.min, other.min);
+		box.max = glm::max(box.max, other.max);
+	}
+
+	float HalfArea(const AABB& box) {
+		const glm::vec3 size = box.max - box.min;
+		if (size.x < 0.0f)
+			return 0.0f;
+		return size.x * size.y + size.y * size.z + size.z * size.x;
+	}
+
+	// Squared distance from a point to the closest point of a box
+	float DistanceSquared(const AABB& box, const glm::vec3& point) {
+		const glm::vec3 outside = glm::max(glm::max(box.min - point, point - box.max), glm::vec3(0.0f));
+		return glm::dot(outside, outside);
+	}
+
+	AABB LaneBox(const BVH::Node& node, int lane) {
+		AABB box;
+		box.min = glm::vec3(node.minX[lane], node.minY[lane], node.minZ[lane]);
+		box.max = glm::vec3(node.maxX[lane], node.maxY[lane], node.maxZ[lane]);
+		return box;
+	}
+}
+
+void BVH::SetLane(Node& node, int lane, const AABB& box) const {
+	node.minX[lane] = box.min.x;
+	node.minY[lane] = box.min.y;
+	node.minZ[lane] = box.min.z;
+	node.maxX[lane] = box.max.x;
+	node.maxY[lane] = box.max.y;
+	node.maxZ[lane] = box.max.z;
+}
+
+///////////////////////////////////////////////////
+//	Build(const std::vector<AABB>&)
+//
+//	bounds: box of every primitive; the primitive index
+//	is what the queries report
+//
+//	Builds a new tree from scratch
+///////////////////////////////////////////////////
+void BVH::Build(const std::vector<AABB>& bounds) {
+	gNodes.clear();
+	gBounds = &bounds;
+	gPrimitiveCount = bounds.size();
+	gIndices.resize(bounds.size());
+	for (size_t i = 0; i < bounds.size(); i++)
+		gIndices[i] = (int)i;
+
+	gCost = gBuildCost = 0.0f;
+	if (bounds.empty())
+		return;
+
+	std::vector<glm::vec3>& centroids = gCentroids;
+	centroids.resize(bounds.size());
+	for (size_t i = 0; i < bounds.size(); i++)
+		centroids[i] = (bounds[i].min + bounds[i].max) * 0.5f;
+
+	std::vector<BuildNode>& buildNodes = gBuildNodes;
+	buildNodes.clear();
+	buildNodes.reserve(bounds.size() * 2);
+	BuildRecursive(buildNodes, bounds, centroids, 0, (int)bounds.size(), 0);
+
+	gNodes.reserve(buildNodes.size() / 2 + 1);
+	if (buildNodes[0].left < 0) {
+		// A single leaf still needs a node to hang from
+		Node root;
+		for (int lane = 0; lane < 4; lane++) {
+			SetLane(root, lane, EmptyBox());
+			root.child[lane] = -1;
+			root.count[lane] = 0;
+		}
+		SetLane(root, 0, buildNodes[0].bounds);
+		root.child[0] = buildNodes[0].first;
+		root.count[0] = buildNodes[0].count;
+		gNodes.push_back(root);
+	}
+	else {
+		Collapse(buildNodes, 0);
+	}
+
+	gCost = gBuildCost = ComputeCost();
+}
+
+int BVH::BuildRecursive(std::vector<BuildNode>& nodes, const std::vector<AABB>& bounds,
+	const std::vector<glm::vec3>& centroids, int first, int count, int depth) {
+	const int index = (int)nodes.size();
+	nodes.push_back(BuildNode());
+
+	AABB box = EmptyBox();
+	AABB centroidBox = EmptyBox();
+	for (int i = first; i < first + count; i++) {
+		Grow(box, bounds[gIndices[i]]);
+		centroidBox.min = glm::min(centroidBox.min, centroids[gIndices[i]]);
+		centroidBox.max = glm::max(centroidBox.max, centroids[gIndices[i]]);
+	}
+
+	nodes[index].bounds = box;
+	nodes[index].left = nodes[index].right = -1;
+	nodes[index].first = first;
+	nodes[index].count = count;
+	if (count <= 1)
+		return index;
+
+	// Widest centroid axis
+	const glm::vec3 extent = centroidBox.max - centroidBox.min;
+	int axis = 0;
+	if (extent.y > extent[axis])
+		axis = 1;
+	if (extent.z > extent[axis])
+		axis = 2;
+
+	int middle = first;
+	if (extent[axis] <= 0.0f || depth >= MAX_SAH_DEPTH) {
+		// All centroids coincide, or the tree got deep: halve the range
+		if (count <= MAX_LEAF_SIZE)
+			return index;
+		middle = first + count / 2;
+		std::nth_element(&gIndices[first], &gIndices[middle], &gIndices[first] + count,
+			[&](int a, int b) { return centroids[a][axis] < centroids[b][axis]; });
+	}
+	else {
+		struct Bin {
+			AABB bounds;
+			int count;
+		};
+		Bin bins[BIN_COUNT];
+		for (Bin& bin : bins) {
+			bin.bounds = EmptyBox();
+			bin.count = 0;
+		}
+
+		const float scale = BIN_COUNT / extent[axis];
+		auto binOf = [&](int primitive) {
+			int bin = (int)((centroids[primitive][axis] - centroidBox.min[axis]) * scale);
+			return std::min(bin, BIN_COUNT - 1);
+		};
+		for (int i = first; i < first + count; i++) {
+			Bin& bin = bins[binOf(gIndices[i])];
+			Grow(bin.bounds, bounds[gIndices[i]]);
+			bin.count++;
+		}
+
+		// Sweep from the right, then from the left, costing every plane between bins
+		float rightArea[BIN_COUNT - 1];
+		int rightCount[BIN_COUNT - 1];
+		AABB accumulated = EmptyBox();
+		int accumulatedCount = 0;
+		for (int plane = BIN_COUNT - 1; plane > 0; plane--) {
+			Grow(accumulated, bins[plane].bounds);
+			accumulatedCount += bins[plane].count;
+			rightArea[plane - 1] = HalfArea(accumulated);
+			rightCount[plane - 1] = accumulatedCount;
+		}
+
+		int bestPlane = -1;
+		float bestCost = FLT_MAX;
+		accumulated = EmptyBox();
+		accumulatedCount = 0;
+		for (int plane = 0; plane < BIN_COUNT - 1; plane++) {
+			Grow(accumulated, bins[plane].bounds);
+			accumulatedCount += bins[plane].count;
+			if (accumulatedCount == 0 || rightCount[plane] == 0)
+				continue;
+			float cost = HalfArea(accumulated) * accumulatedCount + rightArea[plane] * rightCount[plane];
+			if (cost < bestCost) {
+				bestCost = cost;
+				bestPlane = plane;
+			}
+		}
+
+		// Splitting must beat testing every primitive here
+		const float leafCost = HalfArea(box) * count;
+		const float splitCost = HalfArea(box) * TRAVERSAL_COST + bestCost;
+		if (bestPlane < 0 || (count <= MAX_LEAF_SIZE && splitCost >= leafCost))
+			return index;
+
+		int* split = std::partition(&gIndices[first], &gIndices[first] + count,
+			[&](int primitive) { return binOf(primitive) <= bestPlane; });
+		middle = (int)(split - &gIndices[0]);
+	}
+
+	int left = BuildRecursive(nodes, bounds, centroids, first, middle - first, depth + 1);
+	int right = BuildRecursive(nodes, bounds, centroids, middle, first + count - middle, depth + 1);
+	nodes[index].left = left;
+	nodes[index].right = right;
+	return index;
+}
+
+///////////////////////////////////////////////////
+//	Collapse(const std::vector<BuildNode>&, int)
+//
+//	Turn an inner binary node into a 4-wide node: its
+//	children are opened up, largest surface first, until
+//	there are four of them or only leaves are left.
+//	Returns the index of the new node.
+///////////////////////////////////////////////////
+int BVH::Collapse(const std::vector<BuildNode>& nodes, int buildNode) {
+	int children[4] = { nodes[buildNode].left, nodes[buildNode].right, -1, -1 };
+	int childCount = 2;
+
+	while (childCount < 4) {
+		int largest = -1;
+		float largestArea = -1.0f;
+		for (int i = 0; i < childCount; i++) {
+			const BuildNode& child = nodes[children[i]];
+			if (child.left >= 0 && HalfArea(child.bounds) > largestArea) {
+				largestArea = HalfArea(child.bounds);
+				largest = i;
+			}
+		}
+		if (largest < 0)
+			break;
+
+		const BuildNode& opened = nodes[children[largest]];
+		children[largest] = opened.left;
+		children[childCount++] = opened.right;
+	}
+
+	const int index = (int)gNodes.size();
+	gNodes.push_back(Node());
+	for (int lane = 0; lane < 4; lane++) {
+		Node& node = gNodes[index];
+		if (lane >= childCount) {
+			SetLane(node, lane, EmptyBox());
+			node.child[lane] = -1;
+			node.count[lane] = 0;
+			continue;
+		}
+
+		const BuildNode& child = nodes[children[lane]];
+		SetLane(node, lane, child.bounds);
+		if (child.left < 0) {
+			node.child[lane] = child.first;
+			node.count[lane] = child.count;
+		}
+		else {
+			// gNodes may grow, so the node is looked up again afterwards
+			int childNode = Collapse(nodes, children[lane]);
+			gNodes[index].child[lane] = childNode;
+			gNodes[index].count[lane] = 0;
+		}
+	}
+	return index;
+}
+
+///////////////////////////////////////////////////
+//	Refit(const std::vector<AABB>&)
+//
+//	bounds: the same primitives as the last Build(), at
+//	their new positions
+//
+//	Recompute every node's boxes, keeping the topology.
+//	Children come after their parents in gNodes, so one
+//	backwards pass updates each node after its children.
+///////////////////////////////////////////////////
+void BVH::Refit(const std::vector<AABB>& bounds) {
+	gBounds = &bounds;
+	for (size_t n = gNodes.size(); n-- > 0;) {
+		Node& node = gNodes[n];
+		for (int lane = 0; lane < 4; lane++) {
+			if (node.child[lane] < 0)
+				continue;
+
+			AABB box = EmptyBox();
+			if (node.count[lane] > 0) {
+				for (int p = node.child[lane]; p < node.child[lane] + node.count[lane]; p++)
+					Grow(box, bounds[gIndices[p]]);
+			}
+			else {
+				const Node& child = gNodes[node.child[lane]];
+				for (int childLane = 0; childLane < 4; childLane++)
+					if (child.child[childLane] >= 0)
+						Grow(box, LaneBox(child, childLane));
+			}
+			SetLane(node, lane, box);
+		}
+	}
+	gCost = ComputeCost();
+}
+
+///////////////////////////////////////////////////
+//	Update(const std::vector<AABB>&)
+//
+//	Refit the tree to the new boxes, or rebuild it when
+//	the primitive count changed or refitting has made it
+//	too slow to traverse. Returns true if it was rebuilt.
+///////////////////////////////////////////////////
+bool BVH::Update(const std::vector<AABB>& bounds) {
+	if (bounds.size() != gPrimitiveCount || gNodes.empty()) {
+		Build(bounds);
+		return true;
+	}
+
+	Refit(bounds);
+	if (gCost > gBuildCost * REBUILD_RATIO) {
+		Build(bounds);
+		return true;
+	}
+	return false;
+}
+
+// Expected cost of a random query: the area of every box relative to the
+// root's, weighted by what is tested once inside it
+float BVH::ComputeCost() const {
+	if (gNodes.empty())
+		return 0.0f;
+
+	const Node& root = gNodes[0];
+	AABB rootBox = EmptyBox();
+	for (int lane = 0; lane < 4; lane++)
+		if (root.child[lane] >= 0)
+			Grow(rootBox, LaneBox(root, lane));
+	const float rootArea = HalfArea(rootBox);
+	if (rootArea <= 0.0f)
+		return 0.0f;
+
+	float cost = TRAVERSAL_COST;
+	for (const Node& node : gNodes)
+		for (int lane = 0; lane < 4; lane++)
+			if (node.child[lane] >= 0)
+				cost += HalfArea(LaneBox(node, lane)) / rootArea * (node.count[lane] > 0 ? node.count[lane] : TRAVERSAL_COST);
+	return cost;
+}
+
+///////////////////////////////////////////////////
+//	IntersectRay4(const Node&, const glm::vec3&, const glm::vec3&, float, float[4])
+//
+//	Slab test of a ray against the four boxes of a node.
+//	Returns a bit per lane that is hit before maxDistance
+//	and stores where the ray enters each box.
+///////////////////////////////////////////////////
+unsigned int BVH::IntersectRay4(const Node& node, const glm::vec3& origin, const glm::vec3& inverseDirection,
+	float maxDistance, float entry[4]) {
+	unsigned int mask = 0;
+#ifdef BVH_SSE
+	__m128 tNear = _mm_setzero_ps();
+	__m128 tFar = _mm_set1_ps(maxDistance);
+
+	const float* mins[3] = { node.minX, node.minY, node.minZ };
+	const float* maxs[3] = { node.maxX, node.maxY, node.maxZ };
+	for (int axis = 0; axis < 3; axis++) {
+		const __m128 o = _mm_set1_ps(origin[axis]);
+		const __m128 inverse = _mm_set1_ps(inverseDirection[axis]);
+		const __m128 t0 = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(mins[axis]), o), inverse);
+		const __m128 t1 = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(maxs[axis]), o), inverse);
+		tNear = _mm_max_ps(tNear, _mm_min_ps(t0, t1));
+		tFar = _mm_min_ps(tFar, _mm_max_ps(t0, t1));
+	}
+	mask = (unsigned int)_mm_movemask_ps(_mm_cmple_ps(tNear, tFar));
+	_mm_storeu_ps(entry, tNear);
+#else
+	for (int lane = 0; lane < 4; lane++) {
+		const float mins[3] = { node.minX[lane], node.minY[lane], node.minZ[lane] };
+		const float maxs[3] = { node.maxX[lane], node.maxY[lane], node.maxZ[lane] };
+		float tNear = 0.0f;
+		float tFar = maxDistance;
+		for (int axis = 0; axis < 3; axis++) {
+			float t0 = (mins[axis] - origin[axis]) * inverseDirection[axis];
+			float t1 = (maxs[axis] - origin[axis]) * inverseDirection[axis];
+			tNear = std::max(tNear, std::min(t0, t1));
+			tFar = std::min(tFar, std::max(t0, t1));
+		}
+		entry[lane] = tNear;
+		if (tNear <= tFar)
+			mask |= 1u << lane;
+	}
+#endif
+	// Empty lanes have inverted boxes and never pass, but skip them anyway
+	for (int lane = 0; lane < 4; lane++)
+		if (node.child[lane] < 0)
+			mask &= ~(1u << lane);
+	return mask;
+}
+
+///////////////////////////////////////////////////
+//	QueryFrustum(const Frustum&, std::vector<int>&)
+//
+//	Appends every primitive whose box is not entirely
+//	outside the frustum (as conservative as
+//	Frustum::Intersects). Subtrees entirely inside are
+//	taken whole, without testing the boxes below them.
+///////////////////////////////////////////////////
+void BVH::QueryFrustum(const Frustum& frustum, std::vector<int>& results) const {
+	if (gNodes.empty())
+		return;
+
+	struct Entry {
+		int node;
+		bool inside;
+	};
+	Entry stack[MAX_STACK];
+	int stackSize = 0;
+	stack[stackSize++] = { 0, false };
+
+	while (stackSize > 0) {
+		const Entry entry = stack[--stackSize];
+		const Node& node = gNodes[entry.node];
+
+		// Lanes start out inside and are cleared by the plane tests
+		unsigned int intersecting = 0xF;
+		unsigned int inside = 0xF;
+		if (!entry.inside) {
+			for (const glm::vec4& plane : frustum.gPlanes) {
+				for (int lane = 0; lane < 4; lane++) {
+					// Box corners furthest along and against the normal
+					const float farX = plane.x >= 0.0f ? node.maxX[lane] : node.minX[lane];
+					const float farY = plane.y >= 0.0f ? node.maxY[lane] : node.minY[lane];
+					const float farZ = plane.z >= 0.0f ? node.maxZ[lane] : node.minZ[lane];
+					const float nearX = plane.x >= 0.0f ? node.minX[lane] : node.maxX[lane];
+					const float nearY = plane.y >= 0.0f ? node.minY[lane] : node.maxY[lane];
+					const float nearZ = plane.z >= 0.0f ? node.minZ[lane] : node.maxZ[lane];
+					if (plane.x * farX + plane.y * farY + plane.z * farZ + plane.w < 0.0f)
+						intersecting &= ~(1u << lane);
+					if (plane.x * nearX + plane.y * nearY + plane.z * nearZ + plane.w < 0.0f)
+						inside &= ~(1u << lane);
+				}
+			}
+		}
+
+		for (int lane = 0; lane < 4; lane++) {
+			if (node.child[lane] < 0 || !(intersecting & (1u << lane)))
+				continue;
+
+			const bool laneInside = entry.inside || (inside & (1u << lane)) != 0;
+			if (node.count[lane] == 0) {
+				stack[stackSize++] = { node.child[lane], laneInside };
+				continue;
+			}
+
+			// A leaf box can overlap the frustum while some of its primitives do not
+			for (int p = node.child[lane]; p < node.child[lane] + node.count[lane]; p++)
+				if (laneInside || frustum.Intersects((*gBounds)[gIndices[p]]))
+					results.push_back(gIndices[p]);
+		}
+	}
+}
+
+///////////////////////////////////////////////////
+//	QueryBox(const AABB&, std::vector<int>&)
+//
+//	Appends every primitive whose box overlaps box
+///////////////////////////////////////////////////
+void BVH::QueryBox(const AABB& box, std::vector<int>& results) const {
+	if (gNodes.empty())
+		return;
+
+	int stack[MAX_STACK];
+	int stackSize = 0;
+	stack[stackSize++] = 0;
+
+	while (stackSize > 0) {
+		const Node& node = gNodes[stack[--stackSize]];
+		for (int lane = 0; lane < 4; lane++) {
+			if (node.child[lane] < 0 ||
+				node.minX[lane] > box.max.x || node.maxX[lane] < box.min.x ||
+				node.minY[lane] > box.max.y || node.maxY[lane] < box.min.y ||
+				node.minZ[lane] > box.max.z || node.maxZ[lane] < box.min.z)
+				continue;
+
+			if (node.count[lane] == 0) {
+				stack[stackSize++] = node.child[lane];
+				continue;
+			}
+
+			// Leaf boxes can be larger than the primitives in them
+			for (int p = node.child[lane]; p < node.child[lane] + node.count[lane]; p++) {
+				const AABB& primitive = (*gBounds)[gIndices[p]];
+				if (primitive.min.x <= box.max.x && primitive.max.x >= box.min.x &&
+					primitive.min.y <= box.max.y && primitive.max.y >= box.min.y &&
+					primitive.min.z <= box.max.z && primitive.max.z >= box.min.z)
+					results.push_back(gIndices[p]);
+			}
+		}
+	}
+}
+
+///////////////////////////////////////////////////
+//	QuerySphere(const glm::vec3&, float, std::vector<int>&)
+//
+//	Appends every primitive whose box comes within radius
+//	of center
+///////////////////////////////////////////////////
+void BVH::QuerySphere(const glm::vec3& center, float radius, std::vector<int>& results) const {
+	if (gNodes.empty())
+		return;
+
+	const float radiusSquared = radius * radius;
+	int stack[MAX_STACK];
+	int stackSize = 0;
+	stack[stackSize++] = 0;
+
+	while (stackSize > 0) {
+		const Node& node = gNodes[stack[--stackSize]];
+		for (int lane = 0; lane < 4; lane++) {
+			if (node.child[lane] < 0)
+				continue;
+
+			if (DistanceSquared(LaneBox(node, lane), center) > radiusSquared)
+				continue;
+
+			if (node.count[lane] == 0) {
+				stack[stackSize++] = node.child[lane];
+				continue;
+			}
+
+			for (int p = node.child[lane]; p < node.child[lane] + node.count[lane]; p++)
+				if (DistanceSquared((*gBounds)[gIndices[p]], center) <= radiusSquared)
+					results.push_back(gIndices[p]);
+		}
+	}
+}
@@ -0,0 +1,141 @@
+///////////////////////////////////////////////////////////////////////////////
+// bvh.h
+// ========
+// bounding volume hierarchy over axis aligned boxes: binned SAH build,
+// 4-wide nodes in a flat array, refit or rebuild as the boxes move, and
+// frustum, ray, box and sphere queries
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include "glm/glm.hpp"
+#include "culling.h"
+
+#include <vector>
+
+class BVH {
+
+public:
+	// Four child boxes side by side, one lane each, so all four are tested at once
+	struct Node {
+		float minX[4], minY[4], minZ[4];
+		float maxX[4], maxY[4], maxZ[4];
+		int child[4];		// Node index, first entry in gIndices for leaves, -1 for an empty lane
+		int count[4];		// Primitive count of a leaf lane, 0 for inner nodes
+	};
+
+	std::vector<Node> gNodes;		// Parents before children; gNodes[0] is the root
+	std::vector<int> gIndices;		// Primitive indices, leaves refer to ranges of it
+
+	// Pending nodes a traversal can hold; the build keeps trees shallow enough
+	static const int MAX_STACK = 256;
+
+public:
+	void Build(const std::vector<AABB>& bounds);
+	void Refit(const std::vector<AABB>& bounds);
+	bool Update(const std::vector<AABB>& bounds);
+
+	void QueryFrustum(const Frustum& frustum, std::vector<int>& results) const;
+	void QueryBox(const AABB& box, std::vector<int>& results) const;
+	void QuerySphere(const glm::vec3& center, float radius, std::vector<int>& results) const;
+
+	template <class PrimitiveTest>
+	int Raycast(const glm::vec3& origin, const glm::vec3& direction, float& distance, const PrimitiveTest& test) const;
+
+	size_t PrimitiveCount() const { return gPrimitiveCount; }
+	float Cost() const { return gCost; }
+
+private:
+	// Binary node of the SAH build, collapsed into Nodes afterwards
+	struct BuildNode {
+		AABB bounds;
+		int left, right;	// Children, -1 for leaves
+		int first, count;	// Range of gIndices for leaves
+	};
+
+	int BuildRecursive(std::vector<BuildNode>& nodes, const std::vector<AABB>& bounds,
+		const std::vector<glm::vec3>& centroids, int first, int count, int depth);
+	int Collapse(const std::vector<BuildNode>& nodes, int buildNode);
+	void SetLane(Node& node, int lane, const AABB& box) const;
+	float ComputeCost() const;
+
+	static unsigned int IntersectRay4(const Node& node, const glm::vec3& origin, const glm::vec3& inverseDirection,
+		float maxDistance, float entry[4]);
+
+	// Boxes passed to the last Build() or Refit(), for the exact tests at the
+	// leaves; the caller keeps them alive for as long as it queries the tree
+	const std::vector<AABB>* gBounds = nullptr;
+	// Build scratch space, kept so rebuilds of a tree do not allocate
+	std::vector<glm::vec3> gCentroids;
+	std::vector<BuildNode> gBuildNodes;
+
+	size_t gPrimitiveCount = 0;
+	float gCost = 0.0f;			// SAH cost of the tree
+	float gBuildCost = 0.0f;	// SAH cost right after the last Build()
+};
+
+///////////////////////////////////////////////////
+//	Raycast(const glm::vec3&, const glm::vec3&, float&, const PrimitiveTest&)
+//
+//	direction: need not be normalized; distances are in
+//	multiples of it
+//	distance: in, the farthest hit to accept; out, the
+//	distance of the nearest hit
+//	test: called as test(primitive, distance) for every
+//	primitive whose box the ray enters before distance;
+//	returns true and shortens distance on a nearer hit
+//
+//	Returns the nearest primitive hit, or -1. Children
+//	are visited nearest first, so most far subtrees are
+//	skipped once something was hit.
+///////////////////////////////////////////////////
+template <class PrimitiveTest>
+int BVH::Raycast(const glm::vec3& origin, const glm::vec3& direction, float& distance, const PrimitiveTest& test) const {
+	if (gNodes.empty())
+		return -1;
+
+	const glm::vec3 inverseDirection(1.0f / direction.x, 1.0f / direction.y, 1.0f / direction.z);
+
+	struct Entry {
+		int node;
+		float distance;
+	};
+	Entry stack[MAX_STACK];
+	int stackSize = 0;
+	stack[stackSize++] = { 0, 0.0f };
+
+	int hit = -1;
+	while (stackSize > 0) {
+		const Entry entry = stack[--stackSize];
+		if (entry.distance > distance)
+			continue;
+
+		const Node& node = gNodes[entry.node];
+		float entryDistance[4];
+		unsigned int mask = IntersectRay4(node, origin, inverseDirection, distance, entryDistance);
+
+		// Push the farthest lanes first so the nearest is popped next
+		int lanes[4];
+		int laneCount = 0;
+		for (int lane = 0; lane < 4; lane++)
+			if (mask & (1u << lane))
+				lanes[laneCount++] = lane;
+		for (int i = 1; i < laneCount; i++)
+			for (int j = i; j > 0 && entryDistance[lanes[j]] > entryDistance[lanes[j - 1]]; j--)
+				std::swap(lanes[j], lanes[j - 1]);
+
+		for (int i = 0; i < laneCount; i++) {
+			const int lane = lanes[i];
+			if (node.count[lane] > 0) {
+				for (int p = node.child[lane]; p < node.child[lane] + node.count[lane]; p++)
+					if (test(gIndices[p], distance))
+						hit = gIndices[p];
+			}
+			else {
+				stack[stackSize++] = { node.child[lane], entryDistance[lane] };
+			}
+		}
+	}
+	return hit;
+}
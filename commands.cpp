@@ -0,0 +1,233 @@
+///////////////////////////////////////////////////////////////////////////////
+// commands.cpp
+// ========
+// deferred draw commands: any job thread records compact draw commands into
+// its own linear buffer, the GL thread merges, sorts and executes them,
+// turning runs of identical draws into instanced draws
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#include "commands.h"
+#include "jobs.h"
+
+#include <algorithm>
+#include <cstring>
+
+///////////////////////////////////////////////////
+//	Begin(unsigned int, FrameArenas*)
+//
+//	threadCount: job threads that may call Record()
+//	arenas: per-thread frame arenas to record into, or
+//	nullptr to keep growing heap buffers
+//
+//	Empties the buffers for a new frame. Either way
+//	recording does not allocate from the heap once the
+//	buffers (or arenas) have grown to the scene's size.
+//	Arena buffers are sized for last frame's commands and
+//	must be executed before the arenas are reset.
+///////////////////////////////////////////////////
+void CommandQueue::Begin(unsigned int threadCount, FrameArenas* arenas) {
+	if (threadCount == 0)
+		threadCount = 1;
+	if (gBuffers.size() != threadCount)
+		gBuffers.resize(threadCount);
+
+	gArenas = arenas;
+	for (unsigned int thread = 0; thread < threadCount; thread++) {
+		ThreadBuffer& buffer = gBuffers[thread];
+		buffer.lastCount = buffer.commands.size();
+		if (!arenas) {
+			buffer.commands.clear();
+			continue;
+		}
+
+		// Last frame's arena memory is gone; start over in this frame's
+		ArenaVector<DrawCommand> commands{ ArenaAllocator<DrawCommand>(arenas->Get(thread)) };
+		commands.reserve(buffer.lastCount);
+		buffer.commands.swap(commands);
+	}
+}
+
+///////////////////////////////////////////////////
+//	Record(const DrawCommand&)
+//
+//	Appends a command to the calling job thread's buffer.
+//	Safe to call from every job thread at once; threads
+//	outside the job system must not call it.
+///////////////////////////////////////////////////
+void CommandQueue::Record(const DrawCommand& command) {
+	unsigned int thread = JobSystem::ThreadIndex();
+	if (thread >= gBuffers.size())
+		thread = 0;
+	gBuffers[thread].commands.push_back(command);
+}
+
+///////////////////////////////////////////////////
+//	MakeKey(GLuint, GLuint, GLuint, int, float)
+//
+//	range: which of a mesh's draw ranges (0-3)
+//
+//	Sort key grouping commands by program, then texture,
+//	then vertex array, then draw range, and front to back
+//	within a group. Sorting the ranges of a mesh apart
+//	puts the same range of every object next to each
+//	other, ready to be instanced. Names are truncated to
+//	16 bits, which only affects how well the groups are
+//	formed, never correctness.
+///////////////////////////////////////////////////
+unsigned long long CommandQueue::MakeKey(GLuint program, GLuint texture, GLuint vao, int range, float depth) {
+	// Non-negative floats sort like their bit patterns; keep the top 14 bits
+	if (!(depth > 0.0f))
+		depth = 0.0f;
+	unsigned int depthBits;
+	memcpy(&depthBits, &depth, sizeof(depthBits));
+
+	return ((unsigned long long)(program & 0xFFFF) << 48) |
+		((unsigned long long)(texture & 0xFFFF) << 32) |
+		((unsigned long long)(vao & 0xFFFF) << 16) |
+		((unsigned long long)(range & 0x3) << 14) |
+		(unsigned long long)(depthBits >> 18);
+}
+
+namespace {
+	// Shortest run of identical draws worth an instanced draw
+	const size_t MIN_INSTANCES = 2;
+
+	const GLsizeiptr MATRIX_SIZE = 16 * sizeof(float);
+
+	// Everything but the model matrix is the same
+	bool SameBatch(const DrawCommand& a, const DrawCommand& b) {
+		return a.program == b.program && a.instancedProgram == b.instancedProgram &&
+			a.texture == b.texture && a.sampler == b.sampler && a.vao == b.vao &&
+			a.mode == b.mode && a.first == b.first && a.count == b.count && a.indexed == b.indexed &&
+			memcmp(a.color, b.color, sizeof(a.color)) == 0;
+	}
+}
+
+///////////////////////////////////////////////////
+//	Execute(const Samplers&, void (*)(GLuint), StreamBuffer*)
+//
+//	useProgram: makes a program current and sets its
+//	per-frame uniforms
+//	instanceData: buffer for the model matrices of
+//	instanced draws, nullptr to draw one by one
+//
+//	GL thread only, after every Record() of the frame has
+//	returned. Merges the thread buffers, sorts them by key
+//	and issues the draws, skipping redundant state changes.
+//	Runs of draws differing only in the model matrix become
+//	one instanced draw when the command has an instanced
+//	program; their matrices feed attributes 3-6.
+///////////////////////////////////////////////////
+void CommandQueue::Execute(const Samplers& samplers, void (*useProgram)(GLuint programId), StreamBuffer* instanceData) {
+	size_t total = 0;
+	for (const ThreadBuffer& buffer : gBuffers)
+		total += buffer.commands.size();
+
+	if (gArenas) {
+		ArenaVector<SortEntry> sorted{ ArenaAllocator<SortEntry>(gArenas->Get()) };
+		gSorted.swap(sorted);
+	}
+	gSorted.clear();
+	gSorted.reserve(total);
+	for (const ThreadBuffer& buffer : gBuffers)
+		for (const DrawCommand& command : buffer.commands)
+			gSorted.push_back({ command.key, (unsigned int)gSorted.size(), &command });
+
+	// Equal keys keep their recording order. (std::stable_sort would allocate a merge buffer every frame.)
+	std::sort(gSorted.begin(), gSorted.end(), [](const SortEntry& a, const SortEntry& b) {
+		return a.key != b.key ? a.key < b.key : a.order < b.order;
+	});
+
+	GLuint currentProgram = 0;
+	GLuint currentVao = 0;
+	GLuint currentTexture = 0;
+	int currentSampler = -1;
+	float currentColor[3] = { -1.0f, -1.0f, -1.0f };
+	GLint modelLoc = -1;
+	GLint colorLoc = -1;
+	gStateChanges = 0;
+	gDrawCalls = 0;
+	gInstancedDraws = 0;
+
+	for (size_t i = 0; i < gSorted.size();) {
+		const DrawCommand& command = *gSorted[i].command;
+
+		size_t runEnd = i + 1;
+		if (instanceData && command.instancedProgram)
+			while (runEnd < gSorted.size() && SameBatch(command, *gSorted[runEnd].command))
+				runEnd++;
+
+		float* models = nullptr;
+		GLintptr modelsOffset = 0;
+		if (runEnd - i >= MIN_INSTANCES)
+			models = (float*)instanceData->Allocate((runEnd - i) * MATRIX_SIZE, MATRIX_SIZE, modelsOffset);
+		if (!models)
+			runEnd = i + 1;
+
+		const GLuint program = models ? command.instancedProgram : command.program;
+		if (program != currentProgram) {
+			currentProgram = program;
+			useProgram(currentProgram);
+			modelLoc = glGetUniformLocation(currentProgram, "Model");
+			colorLoc = glGetUniformLocation(currentProgram, "color");
+			currentColor[0] = -1.0f;	// Uniforms are per program
+			gStateChanges++;
+		}
+		if (command.texture != currentTexture) {
+			currentTexture = command.texture;
+			glBindTexture(GL_TEXTURE_2D, currentTexture);
+			gStateChanges++;
+		}
+		if ((int)command.sampler != currentSampler) {
+			currentSampler = (int)command.sampler;
+			samplers.Bind(0, command.sampler);
+			gStateChanges++;
+		}
+		if (command.vao != currentVao) {
+			currentVao = command.vao;
+			glBindVertexArray(currentVao);
+			gStateChanges++;
+		}
+		if (memcmp(command.color, currentColor, sizeof(currentColor)) != 0) {
+			memcpy(currentColor, command.color, sizeof(currentColor));
+			glUniform3fv(colorLoc, 1, currentColor);
+		}
+
+		const void* indices = (const void*)(sizeof(GLuint) * command.first);
+		gDrawCalls++;
+
+		if (!models) {
+			glUniformMatrix4fv(modelLoc, 1, GL_FALSE, command.model);
+			if (command.indexed)
+				glDrawElements(command.mode, command.count, GL_UNSIGNED_INT, indices);
+			else
+				glDrawArrays(command.mode, command.first, command.count);
+			i++;
+			continue;
+		}
+
+		const GLsizei instances = (GLsizei)(runEnd - i);
+		for (; i < runEnd; i++, models += 16)
+			memcpy(models, gSorted[i].command->model, MATRIX_SIZE);
+		instanceData->Flush();
+
+		// The VAO is shared with non-instanced draws, whose programs ignore these attributes
+		glBindBuffer(GL_ARRAY_BUFFER, instanceData->Buffer());
+		for (GLuint column = 0; column < 4; column++) {
+			glEnableVertexAttribArray(3 + column);
+			glVertexAttribPointer(3 + column, 4, GL_FLOAT, GL_FALSE, (GLsizei)MATRIX_SIZE,
+				(const void*)(modelsOffset + column * 4 * sizeof(float)));
+			glVertexAttribDivisor(3 + column, 1);
+		}
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+		if (command.indexed)
+			glDrawElementsInstanced(command.mode, command.count, GL_UNSIGNED_INT, indices, instances);
+		else
+			glDrawArraysInstanced(command.mode, command.first, command.count, instances);
+		gInstancedDraws++;
+	}
+
+	glBindVertexArray(0);
+}
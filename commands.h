@@ -0,0 +1,70 @@
+///////////////////////////////////////////////////////////////////////////////
+// commands.h
+// ========
+// deferred draw commands: any job thread records compact draw commands into
+// its own linear buffer, the GL thread merges, sorts and executes them,
+// turning runs of identical draws into instanced draws
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include "GL/glew.h"
+#include "arena.h"
+#include "samplers.h"
+#include "streambuffer.h"
+
+#include <cstddef>
+#include <vector>
+
+// Everything needed to issue one draw call. Plain data, so recording is a
+// copy into a buffer and no GL call is made until Execute().
+struct DrawCommand {
+	unsigned long long key;		// Commands execute in increasing key order, see MakeKey()
+	const float* model;			// Column-major model matrix, must stay valid until Execute()
+	GLuint program;
+	GLuint instancedProgram;	// Same shader reading the model matrix from attributes 3-6, 0 if not available
+	GLuint vao;
+	GLuint texture;				// 0 for untextured
+	Samplers::Preset sampler;
+	float color[3];
+	GLenum mode;				// Primitive type
+	GLint first;				// First vertex (arrays) or index (elements)
+	GLsizei count;
+	bool indexed;				// glDrawElements with GL_UNSIGNED_INT indices, else glDrawArrays
+};
+
+class CommandQueue {
+
+public:
+	void Begin(unsigned int threadCount, FrameArenas* arenas = nullptr);
+	void Record(const DrawCommand& command);
+	void Execute(const Samplers& samplers, void (*useProgram)(GLuint programId), StreamBuffer* instanceData);
+
+	size_t CommandCount() const { return gSorted.size(); }
+	size_t StateChangeCount() const { return gStateChanges; }
+	size_t DrawCallCount() const { return gDrawCalls; }
+	size_t InstancedDrawCount() const { return gInstancedDraws; }
+
+	static unsigned long long MakeKey(GLuint program, GLuint texture, GLuint vao, int range, float depth);
+
+private:
+	// One linear buffer per job thread, on separate cache lines
+	struct alignas(64) ThreadBuffer {
+		ArenaVector<DrawCommand> commands;
+		size_t lastCount = 0;		// Commands recorded last frame, reserved up front
+	};
+
+	struct SortEntry {
+		unsigned long long key;
+		unsigned int order;			// Recording order, to keep the sort stable
+		const DrawCommand* command;
+	};
+
+	std::vector<ThreadBuffer> gBuffers;
+	ArenaVector<SortEntry> gSorted;
+	FrameArenas* gArenas = nullptr;	// Per-frame memory of the buffers, or nullptr to keep them on the heap
+	size_t gStateChanges = 0;
+	size_t gDrawCalls = 0;
+	size_t gInstancedDraws = 0;
+};
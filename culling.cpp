@@ -0,0 +1,168 @@
+///////////////////////////////////////////////////////////////////////////////
+// culling.cpp
+// ========
+// view frustum culling: world space bounding boxes of every object and a
+// visibility flag per object, computed in parallel on the job system or by
+// walking a bounding volume hierarchy
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#include "culling.h"
+#include "bvh.h"
+#include "jobs.h"
+
+#include <atomic>
+
+namespace {
+	// Objects per job
+	const unsigned int CULL_GRAIN = 128;
+}
+
+///////////////////////////////////////////////////
+//	Extract(const glm::mat4&)
+//
+//	Planes of the clip volume in world space, read off
+//	the rows of the view-projection matrix
+///////////////////////////////////////////////////
+void Frustum::Extract(const glm::mat4& viewProjection) {
+	const glm::mat4& m = viewProjection;
+	glm::vec4 rows[4];
+	for (int r = 0; r < 4; r++)
+		rows[r] = glm::vec4(m[0][r], m[1][r], m[2][r], m[3][r]);
+
+	gPlanes[0] = rows[3] + rows[0];		// left
+	gPlanes[1] = rows[3] - rows[0];		// right
+	gPlanes[2] = rows[3] + rows[1];		// bottom
+	gPlanes[3] = rows[3] - rows[1];		// top
+	gPlanes[4] = rows[3] + rows[2];		// near
+
+	for (glm::vec4& plane : gPlanes) {
+		float length = glm::length(glm::vec3(plane));
+		plane = plane / length;
+	}
+}
+
+///////////////////////////////////////////////////
+//	Intersects(const AABB&)
+//
+//	Conservative: false only when the box is entirely
+//	outside one of the planes
+///////////////////////////////////////////////////
+bool Frustum::Intersects(const AABB& box) const {
+	for (const glm::vec4& plane : gPlanes) {
+		// Corner of the box furthest along the plane normal
+		glm::vec3 corner(
+			plane.x >= 0.0f ? box.max.x : box.min.x,
+			plane.y >= 0.0f ? box.max.y : box.min.y,
+			plane.z >= 0.0f ? box.max.z : box.min.z);
+		if (glm::dot(glm::vec3(plane), corner) + plane.w < 0.0f)
+			return false;
+	}
+	return true;
+}
+
+///////////////////////////////////////////////////
+//	TransformBounds(const AABB&, const glm::mat4&)
+//
+//	Box enclosing the transformed box, from its center
+//	and half extents (no need to transform all 8 corners)
+///////////////////////////////////////////////////
+AABB Culling::TransformBounds(const AABB& box, const glm::mat4& matrix) {
+	const glm::vec3 center = (box.min + box.max) * 0.5f;
+	const glm::vec3 extent = (box.max - box.min) * 0.5f;
+
+	glm::vec3 worldCenter = glm::vec3(matrix[3]);
+	glm::vec3 worldExtent(0.0f);
+	for (int axis = 0; axis < 3; axis++) {
+		const glm::vec3 column = glm::vec3(matrix[axis]);
+		worldCenter += column * center[axis];
+		worldExtent += glm::abs(column) * extent[axis];
+	}
+
+	AABB result;
+	result.min = worldCenter - worldExtent;
+	result.max = worldCenter + worldExtent;
+	return result;
+}
+
+///////////////////////////////////////////////////
+//	Update(world, objectMesh, meshBounds, viewProjection, jobs, bvh, changed)
+//
+//	world: world matrix of every object
+//	objectMesh: mesh of every object, index into meshBounds
+//	meshBounds: local space bounds of every mesh
+//	jobs: spreads the objects over its threads, or nullptr
+//	bvh: tree over gWorldBounds to cull with, or nullptr
+//	to test every object
+//	changed: objects whose world matrix changed since the
+//	last call (indices past the objects are ignored), or
+//	nullptr if any may have. Only their bounds (and then
+//	the tree) are updated.
+///////////////////////////////////////////////////
+void Culling::Update(const std::vector<glm::mat4>& world, const std::vector<int>& objectMesh,
+	const std::vector<AABB>& meshBounds, const glm::mat4& viewProjection, JobSystem* jobs,
+	BVH* bvh, const std::vector<int>* changed) {
+	const unsigned int count = (unsigned int)objectMesh.size();
+	gFrustum.Extract(viewProjection);
+
+	if (bvh) {
+		if (!changed || gWorldBounds.size() != count) {
+			gWorldBounds.resize(count);
+			auto boundsRange = [&](unsigned int begin, unsigned int end) {
+				for (unsigned int i = begin; i < end; i++)
+					gWorldBounds[i] = TransformBounds(meshBounds[objectMesh[i]], world[i]);
+			};
+			if (jobs)
+				jobs->ParallelFor(count, CULL_GRAIN, boundsRange);
+			else
+				boundsRange(0, count);
+
+			bvh->Update(gWorldBounds);
+		}
+		else if (!changed->empty()) {
+			auto boundsRange = [&](unsigned int begin, unsigned int end) {
+				for (unsigned int c = begin; c < end; c++) {
+					const int i = (*changed)[c];
+					if (i < (int)count)
+						gWorldBounds[i] = TransformBounds(meshBounds[objectMesh[i]], world[i]);
+				}
+			};
+			if (jobs)
+				jobs->ParallelFor((unsigned int)changed->size(), CULL_GRAIN, boundsRange);
+			else
+				boundsRange(0, (unsigned int)changed->size());
+
+			bvh->Update(gWorldBounds);
+		}
+
+		gVisibleList.clear();
+		bvh->QueryFrustum(gFrustum, gVisibleList);
+
+		gVisible.assign(count, 0);
+		for (int object : gVisibleList)
+			gVisible[object] = 1;
+		gVisibleCount = gVisibleList.size();
+		return;
+	}
+
+	gWorldBounds.resize(count);
+	gVisible.resize(count);
+
+	std::atomic<size_t> visibleCount{ 0 };
+	auto cullRange = [&](unsigned int begin, unsigned int end) {
+		size_t visible = 0;
+		for (unsigned int i = begin; i < end; i++) {
+			gWorldBounds[i] = TransformBounds(meshBounds[objectMesh[i]], world[i]);
+			gVisible[i] = gFrustum.Intersects(gWorldBounds[i]) ? 1 : 0;
+			visible += gVisible[i];
+		}
+		visibleCount.fetch_add(visible, std::memory_order_relaxed);
+	};
+
+	if (jobs)
+		jobs->ParallelFor(count, CULL_GRAIN, cullRange);
+	else
+		cullRange(0, count);
+
+	gVisibleCount = visibleCount.load(std::memory_order_relaxed);
+}
@@ -0,0 +1,58 @@
+///////////////////////////////////////////////////////////////////////////////
+// culling.h
+// ========
+// view frustum culling: world space bounding boxes of every object and a
+// visibility flag per object, computed in parallel on the job system or by
+// walking a bounding volume hierarchy
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include "glm/glm.hpp"
+
+#include <vector>
+
+class BVH;
+class JobSystem;
+
+// Axis aligned bounding box
+struct AABB {
+	glm::vec3 min;
+	glm::vec3 max;
+};
+
+class Frustum {
+
+public:
+	// Side and near planes as (normal, distance), normals pointing inwards.
+	// The projection has no far plane, so none is tested.
+	glm::vec4 gPlanes[5];
+
+public:
+	void Extract(const glm::mat4& viewProjection);
+	bool Intersects(const AABB& box) const;
+};
+
+class Culling {
+
+public:
+	// Per-object results of the last Update(), indexed by object number
+	std::vector<AABB> gWorldBounds;
+	std::vector<unsigned char> gVisible;
+
+	Frustum gFrustum;
+
+public:
+	void Update(const std::vector<glm::mat4>& world, const std::vector<int>& objectMesh,
+		const std::vector<AABB>& meshBounds, const glm::mat4& viewProjection, JobSystem* jobs,
+		BVH* bvh = nullptr, const std::vector<int>* changed = nullptr);
+
+	size_t VisibleCount() const { return gVisibleCount; }
+
+	static AABB TransformBounds(const AABB& box, const glm::mat4& matrix);
+
+private:
+	std::vector<int> gVisibleList;		// Scratch space for BVH queries
+	size_t gVisibleCount = 0;
+};
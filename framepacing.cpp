@@ -0,0 +1,169 @@
+///////////////////////////////////////////////////////////////////////////////
+// framepacing.cpp
+// ========
+// presentation control: vsync mode, frame rate cap, a bound on how many
+// frames the CPU may run ahead of the GPU, and frame time statistics
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#include "framepacing.h"
+
+#include <GLFW/glfw3.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <thread>
+
+namespace {
+	// The OS scheduler may oversleep by about this much; the rest of the
+	// wait is spent spinning on the clock
+	const double SPIN_MARGIN = 0.002;
+
+	// Seconds between frame time reports
+	const double REPORT_INTERVAL = 5.0;
+
+	const char* const VSYNC_NAMES[] = { "off", "on", "adaptive" };
+}
+
+const char* FramePacer::VsyncName(VsyncMode mode) {
+	return VSYNC_NAMES[mode];
+}
+
+bool FramePacer::FindVsyncMode(const char* name, VsyncMode& mode) {
+	for (int i = 0; i <= VSYNC_ADAPTIVE; i++) {
+		if (strcmp(name, VSYNC_NAMES[i]) == 0) {
+			mode = (VsyncMode)i;
+			return true;
+		}
+	}
+	return false;
+}
+
+///////////////////////////////////////////////////
+//	Initialize(VsyncMode, double, int)
+//
+//	vsync: presentation mode; adaptive falls back to on
+//	when swap_control_tear is missing
+//	fpsCap: frames per second limit, 0 for none
+//	maxFramesAhead: frames the CPU may queue before it
+//	waits for the GPU, 0 to leave it to the driver
+//
+//	Needs the window's context to be current
+///////////////////////////////////////////////////
+bool FramePacer::Initialize(VsyncMode vsync, double fpsCap, int maxFramesAhead) {
+	if (vsync == VSYNC_ADAPTIVE &&
+		!glfwExtensionSupported("WGL_EXT_swap_control_tear") && !glfwExtensionSupported("GLX_EXT_swap_control_tear")) {
+		std::cout << "WARNING: Adaptive vsync (swap_control_tear) not supported, using vsync on" << std::endl;
+		vsync = VSYNC_ON;
+	}
+	gVsync = vsync;
+	glfwSwapInterval(vsync == VSYNC_OFF ? 0 : vsync == VSYNC_ON ? 1 : -1);
+
+	gFrameInterval = fpsCap > 0.0 ? 1.0 / fpsCap : 0.0;
+	gFramesAhead = std::min(std::max(maxFramesAhead, 0), MAX_FRAMES_AHEAD);
+	gFenceIndex = 0;
+
+	gFrameStart = gLastReport = gNextFrame = glfwGetTime();
+	gFrameTimes.clear();
+	gFrameTimes.reserve(1024);
+	gGpuWait = 0.0;
+
+	std::cout << "INFO: Frame pacing: vsync " << VsyncName(gVsync);
+	if (gFrameInterval > 0.0)
+		std::cout << ", capped at " << fpsCap << " fps";
+	std::cout << ", at most " << gFramesAhead << " frames ahead of the GPU" << std::endl;
+	return true;
+}
+
+///////////////////////////////////////////////////
+//	Shutdown()
+//
+//	Release the fences
+///////////////////////////////////////////////////
+void FramePacer::Shutdown() {
+	for (GLsync& fence : gFences) {
+		if (fence)
+			glDeleteSync(fence);
+		fence = 0;
+	}
+}
+
+///////////////////////////////////////////////////
+//	BeginFrame()
+//
+//	Call before sampling input. Waits until the frame
+//	cap allows a new frame and until the GPU has caught
+//	up to within the allowed number of frames, so the
+//	input that is sampled next is as fresh as possible.
+///////////////////////////////////////////////////
+void FramePacer::BeginFrame() {
+	if (gFrameInterval > 0.0) {
+		double now = glfwGetTime();
+		double remaining = gNextFrame - now;
+		if (remaining > SPIN_MARGIN)
+			std::this_thread::sleep_for(std::chrono::duration<double>(remaining - SPIN_MARGIN));
+		while (glfwGetTime() < gNextFrame)
+			;
+
+		// A late frame moves the schedule instead of being followed by a burst
+		now = glfwGetTime();
+		gNextFrame = std::max(gNextFrame + gFrameInterval, now);
+	}
+
+	GLsync& fence = gFences[gFenceIndex];
+	if (gFramesAhead > 0 && fence) {
+		double waitStart = glfwGetTime();
+		while (glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000) == GL_TIMEOUT_EXPIRED)
+			;
+		gGpuWait += glfwGetTime() - waitStart;
+		glDeleteSync(fence);
+		fence = 0;
+	}
+
+	double now = glfwGetTime();
+	gFrameTimes.push_back((float)(now - gFrameStart));
+	gFrameStart = now;
+
+	if (now - gLastReport >= REPORT_INTERVAL)
+		Report(now);
+}
+
+///////////////////////////////////////////////////
+//	EndFrame()
+//
+//	Call after the buffers were swapped. Marks the end
+//	of the frame's GPU work.
+///////////////////////////////////////////////////
+void FramePacer::EndFrame() {
+	if (gFramesAhead == 0)
+		return;
+
+	gFences[gFenceIndex] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	gFenceIndex = (gFenceIndex + 1) % gFramesAhead;
+}
+
+// Print the frame time distribution since the last report
+void FramePacer::Report(double now) {
+	if (gFrameTimes.empty())
+		return;
+
+	std::sort(gFrameTimes.begin(), gFrameTimes.end());
+	double total = 0.0;
+	for (float time : gFrameTimes)
+		total += time;
+
+	const size_t count = gFrameTimes.size();
+	const double average = total / count;
+	const float p99 = gFrameTimes[std::min(count - 1, count * 99 / 100)];
+
+	std::cout << "INFO: Frame time (vsync " << VsyncName(gVsync) << "): " << 1000.0 * average << " ms avg, "
+		<< 1000.0f * gFrameTimes.front() << " min, " << 1000.0f * p99 << " 99th percentile, "
+		<< 1000.0f * gFrameTimes.back() << " max, " << count / (now - gLastReport) << " fps, "
+		<< 1000.0 * gGpuWait / count << " ms/frame waiting for the GPU" << std::endl;
+
+	gFrameTimes.clear();
+	gGpuWait = 0.0;
+	gLastReport = now;
+}
@@ -0,0 +1,53 @@
+///////////////////////////////////////////////////////////////////////////////
+// framepacing.h
+// ========
+// presentation control: vsync mode, frame rate cap, a bound on how many
+// frames the CPU may run ahead of the GPU, and frame time statistics
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include "GL/glew.h"
+
+#include <vector>
+
+class FramePacer {
+
+public:
+	enum VsyncMode {
+		VSYNC_OFF,			// present immediately, tearing allowed
+		VSYNC_ON,			// wait for vertical blank
+		VSYNC_ADAPTIVE,		// wait for vertical blank unless the frame is late (swap_control_tear)
+	};
+
+	static const int MAX_FRAMES_AHEAD = 8;
+
+public:
+	bool Initialize(VsyncMode vsync, double fpsCap, int maxFramesAhead);
+	void Shutdown();
+
+	void BeginFrame();
+	void EndFrame();
+
+	static const char* VsyncName(VsyncMode mode);
+	static bool FindVsyncMode(const char* name, VsyncMode& mode);
+
+private:
+	void Report(double now);
+
+	VsyncMode gVsync = VSYNC_ON;
+	double gFrameInterval = 0.0;		// Seconds per frame at the cap, 0 for uncapped
+	double gNextFrame = 0.0;			// Earliest start of the next frame when capped
+
+	// Fence after each of the last frames, oldest first once the ring is full
+	GLsync gFences[MAX_FRAMES_AHEAD] = {};
+	int gFramesAhead = 0;
+	int gFenceIndex = 0;
+
+	// Frame times since the last report
+	std::vector<float> gFrameTimes;
+	double gFrameStart = 0.0;
+	double gLastReport = 0.0;
+	double gGpuWait = 0.0;				// Time spent in fence waits since the last report
+};
@@ -0,0 +1,801 @@
+///////////////////////////////////////////////////////////////////////////////
+// gltfloader.cpp
+// ========
+// glTF 2.0 importer (.glb and .gltf): buffers are memory-mapped and vertex
+// data compatible with the renderer's attributes is handed to GL straight
+// from the mapping; meshes, materials, images and node transforms come out
+// as Meshes::GLMesh primitives, base colors, textures and matrices
+//
+// The renderer reads position (location 0), normal (1) and uv (2). When a
+// primitive has float positions and normals, and float or normalized integer
+// uvs, its VAO points into the buffer views as they are: each view is
+// uploaded once, with glBufferData straight from the mapped file, and
+// shared by every primitive that uses it, whatever its stride or
+// interleaving. Index data is handed over the same way when it is a
+// triangle list of 32-bit indices, which is what the draw path expects.
+// Anything else (missing normals, other index types, strips and fans) is
+// converted, and primitives without normals are repacked into the
+// interleaved layout of Meshes::UCreateIndexedMesh with smooth normals.
+//
+// Only the base color of a material is used: its factor, and its texture,
+// which must use the first uv set. glTF images have their first row at
+// v = 0, so unlike the scene's own textures they are not flipped. Sparse
+// accessors, data: URIs and quantized positions are not supported.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#include "gltfloader.h"
+#include "json.h"
+
+#include "glm/gtc/matrix_transform.hpp"
+#include "glm/gtc/quaternion.hpp"
+#include "stb_image.h"
+
+#include <algorithm>
+#include <chrono>
+#include <climits>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+
+namespace {
+	// GLB container: a header, then a JSON chunk and an optional binary one
+	const uint32_t GLB_MAGIC = 0x46546C67;		// "glTF"
+	const uint32_t GLB_VERSION = 2;
+	const uint32_t CHUNK_JSON = 0x4E4F534A;		// "JSON"
+	const uint32_t CHUNK_BIN = 0x004E4942;		// "BIN\0"
+	const size_t GLB_HEADER_SIZE = 12;
+	const size_t CHUNK_HEADER_SIZE = 8;
+
+	const int FLOATS_PER_VERTEX = 8;
+
+	uint32_t ReadU32(const unsigned char* p) {
+		uint32_t value;
+		memcpy(&value, p, sizeof(value));
+		return value;
+	}
+
+	size_t ComponentSize(GLenum componentType) {
+		switch (componentType) {
+		case GL_BYTE:
+		case GL_UNSIGNED_BYTE: return 1;
+		case GL_SHORT:
+		case GL_UNSIGNED_SHORT: return 2;
+		case GL_UNSIGNED_INT:
+		case GL_FLOAT: return 4;
+		default: return 0;
+		}
+	}
+
+	int ComponentCount(const char* type) {
+		const char* const types[] = { "SCALAR", "VEC2", "VEC3", "VEC4", "MAT2", "MAT3", "MAT4" };
+		const int counts[] = { 1, 2, 3, 4, 4, 9, 16 };
+		for (int i = 0; i < 7; i++)
+			if (strcmp(type, types[i]) == 0)
+				return counts[i];
+		return 0;
+	}
+
+	// URIs are relative to the model and may escape spaces and other characters as %XX
+	std::string DecodeUri(const std::string& directory, const char* uri) {
+		std::string path = directory;
+		for (const char* p = uri; *p; p++) {
+			unsigned int code;
+			if (*p == '%' && p[1] && p[2] && sscanf(p + 1, "%2x", &code) == 1) {
+				path.push_back((char)code);
+				p += 2;
+			}
+			else
+				path.push_back(*p);
+		}
+		return path;
+	}
+
+	// Array of numbers of the given length, or nullptr
+	const JsonValue* FindNumbers(const JsonValue& object, const char* key, size_t count) {
+		const JsonValue* array = object.Find(key);
+		if (!array || !array->IsArray() || array->Size() != count)
+			return nullptr;
+		for (size_t i = 0; i < count; i++)
+			if ((*array)[i].gType != JsonValue::JSON_NUMBER)
+				return nullptr;
+		return array;
+	}
+
+	// Byte offset, length, stride or element count; 0 if absent. Anything but a
+	// non-negative integer is rejected before it is cast, as the cast would be undefined.
+	bool FindSize(const JsonValue& object, const char* key, size_t& size) {
+		const JsonValue* value = object.Find(key);
+		size = 0;
+		if (!value)
+			return true;
+		// Whole numbers up to 2^53 are exact in a double
+		const double limit = std::min(9007199254740992.0, (double)SIZE_MAX);
+		if (value->gType != JsonValue::JSON_NUMBER || !(value->gNumber >= 0.0 && value->gNumber <= limit) ||
+			value->gNumber != std::floor(value->gNumber))
+			return false;
+		size = (size_t)value->gNumber;
+		return true;
+	}
+
+	// Index into another array (e.g. a node's children); -1 for anything but a
+	// whole number in the int range, so a malformed entry is skipped, not cast
+	int FindIndex(const JsonValue& value) {
+		if (value.gType != JsonValue::JSON_NUMBER || !(value.gNumber >= 0.0 && value.gNumber <= INT_MAX) ||
+			value.gNumber != std::floor(value.gNumber))
+			return -1;
+		return (int)value.gNumber;
+	}
+
+	void ReportError(const char* error, const char* filename, const std::string& message) {
+		std::cout << "ERROR::GLTF::" << error << " " << filename << ": " << message << std::endl;
+	}
+
+	double Megabytes(size_t size) {
+		return size / (1024.0 * 1024.0);
+	}
+}
+
+///////////////////////////////////////////////////
+//	Load(const char*)
+//
+//	filename: .glb file, or .gltf file with its buffers
+//	in external files
+//
+//	Creates the GL objects of every mesh and embedded
+//	image; the caller takes them over. Returns false
+//	(after reporting why, and with nothing created) if
+//	the file cannot be read or uses something this
+//	importer does not support.
+///////////////////////////////////////////////////
+bool GltfLoader::Load(const char* filename) {
+	Release();
+	gFilename = filename;
+	gDirectBytes = gRepackedBytes = 0;
+	gDirectPrimitives = 0;
+
+	const auto start = std::chrono::steady_clock::now();
+	if (!gFile.Open(filename))
+		return false;
+
+	const unsigned char* bytes = (const unsigned char*)gFile.Data();
+	const size_t size = gFile.Size();
+	const char* json = gFile.Data();
+	size_t jsonLength = size;
+	Buffer binaryChunk = { nullptr, 0 };
+
+	if (size >= GLB_HEADER_SIZE && ReadU32(bytes) == GLB_MAGIC) {
+		if (ReadU32(bytes + 4) != GLB_VERSION) {
+			ReportError("UNSUPPORTED", filename, "GLB version " + std::to_string(ReadU32(bytes + 4)));
+			Release();
+			return false;
+		}
+
+		const size_t length = std::min((size_t)ReadU32(bytes + 8), size);
+		json = nullptr;
+		for (size_t offset = GLB_HEADER_SIZE; offset + CHUNK_HEADER_SIZE <= length;) {
+			const size_t chunkLength = ReadU32(bytes + offset);
+			const uint32_t chunkType = ReadU32(bytes + offset + 4);
+			const unsigned char* chunk = bytes + offset + CHUNK_HEADER_SIZE;
+			if (chunkLength > length - offset - CHUNK_HEADER_SIZE)
+				break;
+
+			// The JSON chunk comes first; unknown chunks are skipped
+			if (offset == GLB_HEADER_SIZE && chunkType == CHUNK_JSON) {
+				json = (const char*)chunk;
+				jsonLength = chunkLength;
+			}
+			else if (chunkType == CHUNK_BIN && !binaryChunk.data)
+				binaryChunk = { chunk, chunkLength };
+			offset += CHUNK_HEADER_SIZE + chunkLength;
+		}
+		if (!json) {
+			ReportError("PARSE_FAILED", filename, "no JSON chunk");
+			Release();
+			return false;
+		}
+	}
+
+	JsonValue root;
+	std::string error;
+	if (!JsonValue::Parse(json, jsonLength, root, error)) {
+		ReportError("PARSE_FAILED", filename, error);
+		Release();
+		return false;
+	}
+
+	const JsonValue* asset = root.Find("asset");
+	const char* version = asset ? asset->String("version", "") : "";
+	if (version[0] != '2' || version[1] != '.') {
+		ReportError("UNSUPPORTED", filename, std::string("glTF version ") + version);
+		Release();
+		return false;
+	}
+
+	// Extensions a file requires must be understood to draw it correctly
+	const JsonValue* required = root.Find("extensionsRequired");
+	for (size_t i = 0; required && i < required->Size(); i++) {
+		if ((*required)[i].gString != "KHR_materials_unlit") {
+			ReportError("UNSUPPORTED", filename, "extension " + (*required)[i].gString);
+			Release();
+			return false;
+		}
+	}
+
+	const char* separator = strrchr(filename, '/');
+	const char* backslash = strrchr(filename, '\\');
+	if (backslash && (!separator || backslash > separator))
+		separator = backslash;
+	const std::string directory(filename, separator ? separator + 1 - filename : 0);
+
+	if (!ParseBuffers(root, directory, binaryChunk) || !ParseAccessors(root)) {
+		Release();
+		return false;
+	}
+	ParseImages(root, directory);
+	ParseMaterials(root);
+	if (!ParseMeshes(root)) {
+		Release();
+		return false;
+	}
+	ParseNodes(root);
+
+	// Everything GL needed has been uploaded; the file is not needed anymore
+	gAccessors.clear();
+	gViews.clear();
+	gBufferData.clear();
+	gBinFiles.clear();
+	gFile.Close();
+
+	const double milliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+	const std::streamsize precision = std::cout.precision(1);
+	std::cout << std::fixed << "INFO: Loaded model " << filename << " (" << gMeshes.size() << " meshes, "
+		<< gPrimitives.size() << " primitives, " << gDirectPrimitives << " drawn from the file's buffers as they are, "
+		<< gImages.size() << " images, " << gNodes.size() << " instances): " << Megabytes(gDirectBytes)
+		<< " MB uploaded straight from the file, " << Megabytes(gRepackedBytes) << " MB converted, in "
+		<< milliseconds << " ms" << std::defaultfloat << std::endl;
+	std::cout.precision(precision);
+	return true;
+}
+
+///////////////////////////////////////////////////
+//	Release()
+//
+//	Delete the GL objects created by the last Load().
+//	Not for objects that have been handed on.
+///////////////////////////////////////////////////
+void GltfLoader::Release() {
+	for (Primitive& primitive : gPrimitives) {
+		glDeleteVertexArrays(1, &primitive.mesh.vao);
+		glDeleteBuffers(2, primitive.mesh.vbos);
+	}
+	if (!gBuffers.empty())
+		glDeleteBuffers((GLsizei)gBuffers.size(), gBuffers.data());
+	for (Image& image : gImages)
+		if (image.texture)
+			glDeleteTextures(1, &image.texture);
+
+	gMaterials.clear();
+	gImages.clear();
+	gPrimitives.clear();
+	gMeshes.clear();
+	gNodes.clear();
+	gBuffers.clear();
+
+	gAccessors.clear();
+	gViews.clear();
+	gBufferData.clear();
+	gBinFiles.clear();
+	gFile.Close();
+}
+
+// Buffers (the GLB binary chunk or mapped .bin files) and the views into them
+bool GltfLoader::ParseBuffers(const JsonValue& root, const std::string& directory, const Buffer& binaryChunk) {
+	const JsonValue* buffers = root.Find("buffers");
+	for (size_t i = 0; buffers && i < buffers->Size(); i++) {
+		const JsonValue& buffer = (*buffers)[i];
+		size_t byteLength;
+		if (!FindSize(buffer, "byteLength", byteLength)) {
+			ReportError("PARSE_FAILED", gFilename, "buffer " + std::to_string(i) + " has an invalid byteLength");
+			return false;
+		}
+		const char* uri = buffer.String("uri", nullptr);
+
+		Buffer data = { nullptr, 0 };
+		if (!uri) {
+			// Only the first buffer of a GLB file can be its binary chunk
+			if (i != 0 || !binaryChunk.data) {
+				ReportError("PARSE_FAILED", gFilename, "buffer " + std::to_string(i) + " has no data");
+				return false;
+			}
+			data = binaryChunk;
+		}
+		else if (strncmp(uri, "data:", 5) == 0) {
+			ReportError("UNSUPPORTED", gFilename, "buffer " + std::to_string(i) + " is a data: URI");
+			return false;
+		}
+		else {
+			gBinFiles.emplace_back(new MappedFile);
+			if (!gBinFiles.back()->Open(DecodeUri(directory, uri).c_str()))
+				return false;
+			data = { (const unsigned char*)gBinFiles.back()->Data(), gBinFiles.back()->Size() };
+		}
+
+		if (data.size < byteLength) {
+			ReportError("PARSE_FAILED", gFilename, "buffer " + std::to_string(i) + " is truncated");
+			return false;
+		}
+		data.size = byteLength;
+		gBufferData.push_back(data);
+	}
+
+	const JsonValue* views = root.Find("bufferViews");
+	for (size_t i = 0; views && i < views->Size(); i++) {
+		const JsonValue& view = (*views)[i];
+		BufferView entry;
+		entry.buffer = view.Int("buffer", -1);
+		entry.glBuffer = 0;
+		if (!FindSize(view, "byteOffset", entry.offset) || !FindSize(view, "byteLength", entry.length) ||
+			!FindSize(view, "byteStride", entry.stride)) {
+			ReportError("PARSE_FAILED", gFilename, "buffer view " + std::to_string(i) + " has an invalid size");
+			return false;
+		}
+		if (entry.buffer < 0 || entry.buffer >= (int)gBufferData.size() ||
+			entry.offset > gBufferData[entry.buffer].size || entry.length > gBufferData[entry.buffer].size - entry.offset) {
+			ReportError("PARSE_FAILED", gFilename, "buffer view " + std::to_string(i) + " is outside its buffer");
+			return false;
+		}
+		gViews.push_back(entry);
+	}
+	return true;
+}
+
+// Typed element ranges; every one is checked against its view here, so reads need no checks
+bool GltfLoader::ParseAccessors(const JsonValue& root) {
+	const JsonValue* accessors = root.Find("accessors");
+	for (size_t i = 0; accessors && i < accessors->Size(); i++) {
+		const JsonValue& accessor = (*accessors)[i];
+		Accessor entry;
+		entry.view = accessor.Find("sparse") ? -1 : accessor.Int("bufferView", -1);
+		entry.data = nullptr;
+		if (!FindSize(accessor, "byteOffset", entry.offset) || !FindSize(accessor, "count", entry.count)) {
+			ReportError("PARSE_FAILED", gFilename, "accessor " + std::to_string(i) + " has an invalid offset or count");
+			return false;
+		}
+		entry.componentType = (GLenum)accessor.Int("componentType", 0);
+		entry.components = ComponentCount(accessor.String("type", ""));
+		entry.normalized = accessor.Bool("normalized", false);
+
+		const size_t elementSize = ComponentSize(entry.componentType) * entry.components;
+		if (elementSize == 0) {
+			ReportError("PARSE_FAILED", gFilename, "accessor " + std::to_string(i) + " has an unknown type");
+			return false;
+		}
+
+		entry.stride = elementSize;
+		if (entry.view >= (int)gViews.size())
+			entry.view = -1;
+		if (entry.view >= 0) {
+			const BufferView& view = gViews[entry.view];
+			if (view.stride)
+				entry.stride = view.stride;
+			// The last element must end inside the view; divided rather than
+			// multiplied, so a huge count cannot wrap around and pass
+			if (entry.count && (entry.offset > view.length || elementSize > view.length - entry.offset ||
+				entry.count - 1 > (view.length - entry.offset - elementSize) / entry.stride)) {
+				ReportError("ACCESSOR_OUT_OF_RANGE", gFilename, "accessor " + std::to_string(i));
+				return false;
+			}
+			entry.data = gBufferData[view.buffer].data + view.offset + entry.offset;
+		}
+		gAccessors.push_back(entry);
+	}
+	return true;
+}
+
+// Embedded images are decoded and uploaded now; files are left to the caller
+void GltfLoader::ParseImages(const JsonValue& root, const std::string& directory) {
+	const JsonValue* images = root.Find("images");
+	for (size_t i = 0; images && i < images->Size(); i++) {
+		const JsonValue& image = (*images)[i];
+		Image entry = { std::string(), 0 };
+
+		const char* uri = image.String("uri", nullptr);
+		const int view = image.Int("bufferView", -1);
+		if (uri && strncmp(uri, "data:", 5) != 0)
+			entry.filename = DecodeUri(directory, uri);
+		else if (view >= 0 && view < (int)gViews.size()) {
+			const unsigned char* data = gBufferData[gViews[view].buffer].data + gViews[view].offset;
+			int width, height, channels;
+			unsigned char* pixels = stbi_load_from_memory(data, (int)gViews[view].length, &width, &height, &channels, 4);
+			if (pixels) {
+				glGenTextures(1, &entry.texture);
+				glBindTexture(GL_TEXTURE_2D, entry.texture);
+				glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+				glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+				glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+				glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+				glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, pixels);
+				glGenerateMipmap(GL_TEXTURE_2D);
+				glBindTexture(GL_TEXTURE_2D, 0);
+				stbi_image_free(pixels);
+			}
+		}
+
+		if (entry.filename.empty() && !entry.texture)
+			std::cout << "WARNING: Image " << i << " of " << gFilename << " could not be read; its materials are untextured" << std::endl;
+		gImages.push_back(entry);
+	}
+}
+
+// Base color factor and texture; textures lead to an image and a sampler
+void GltfLoader::ParseMaterials(const JsonValue& root) {
+	const JsonValue* materials = root.Find("materials");
+	const JsonValue* textures = root.Find("textures");
+	const JsonValue* samplers = root.Find("samplers");
+
+	for (size_t i = 0; materials && i < materials->Size(); i++) {
+		const JsonValue& material = (*materials)[i];
+		Material entry = { glm::vec3(1.0f), -1, false, false };
+
+		const JsonValue* pbr = material.Find("pbrMetallicRoughness");
+		if (pbr) {
+			if (const JsonValue* factor = FindNumbers(*pbr, "baseColorFactor", 4))
+				entry.color = glm::vec3((float)(*factor)[0].gNumber, (float)(*factor)[1].gNumber, (float)(*factor)[2].gNumber);
+
+			const JsonValue* baseColor = pbr->Find("baseColorTexture");
+			const int texture = baseColor ? baseColor->Int("index", -1) : -1;
+			if (texture >= 0 && textures && texture < (int)textures->Size()) {
+				const int image = (*textures)[texture].Int("source", -1);
+				if (image >= 0 && image < (int)gImages.size() && (!gImages[image].filename.empty() || gImages[image].texture))
+					entry.image = image;
+				if (baseColor->Int("texCoord", 0) != 0)
+					std::cout << "WARNING: Material " << i << " of " << gFilename << " uses a second uv set; the first is used instead" << std::endl;
+
+				const int sampler = (*textures)[texture].Int("sampler", -1);
+				if (sampler >= 0 && samplers && sampler < (int)samplers->Size())
+					entry.nearest = (*samplers)[sampler].Int("magFilter", GL_LINEAR) == GL_NEAREST;
+			}
+		}
+
+		const JsonValue* extensions = material.Find("extensions");
+		entry.unlit = extensions && extensions->Find("KHR_materials_unlit");
+		gMaterials.push_back(entry);
+	}
+}
+
+bool GltfLoader::ParseMeshes(const JsonValue& root) {
+	const JsonValue* meshes = root.Find("meshes");
+	for (size_t i = 0; meshes && i < meshes->Size(); i++) {
+		const JsonValue& mesh = (*meshes)[i];
+		Mesh entry;
+		entry.name = mesh.String("name", "");
+		entry.firstPrimitive = (int)gPrimitives.size();
+
+		const JsonValue* primitives = mesh.Find("primitives");
+		for (size_t p = 0; primitives && p < primitives->Size(); p++)
+			if (!LoadPrimitive((*primitives)[p], (int)i))
+				return false;
+
+		entry.primitiveCount = (int)gPrimitives.size() - entry.firstPrimitive;
+		gMeshes.push_back(entry);
+	}
+	return true;
+}
+
+///////////////////////////////////////////////////
+//	LoadPrimitive(const JsonValue&, int)
+//
+//	Upload one primitive as an indexed triangle list.
+//	Point and line primitives are skipped. Returns false
+//	if the primitive is malformed or its positions are
+//	in an unsupported format.
+///////////////////////////////////////////////////
+bool GltfLoader::LoadPrimitive(const JsonValue& primitive, int meshIndex) {
+	const std::string where = "mesh " + std::to_string(meshIndex);
+	const GLenum mode = (GLenum)primitive.Int("mode", GL_TRIANGLES);
+	if (mode != GL_TRIANGLES && mode != GL_TRIANGLE_STRIP && mode != GL_TRIANGLE_FAN) {
+		std::cout << "WARNING: Skipped a point or line primitive of " << where << " in " << gFilename << std::endl;
+		return true;
+	}
+
+	const JsonValue* attributes = primitive.Find("attributes");
+	auto findAccessor = [this, attributes](const char* name) -> const Accessor* {
+		const int accessor = attributes ? attributes->Int(name, -1) : -1;
+		return accessor >= 0 && accessor < (int)gAccessors.size() && gAccessors[accessor].view >= 0 ? &gAccessors[accessor] : nullptr;
+	};
+	const Accessor* positions = findAccessor("POSITION");
+	const Accessor* normals = findAccessor("NORMAL");
+	const Accessor* uvs = findAccessor("TEXCOORD_0");
+
+	if (!positions || positions->componentType != GL_FLOAT || positions->components != 3) {
+		ReportError("UNSUPPORTED", gFilename, where + " has no float positions (sparse or quantized data is not supported)");
+		return false;
+	}
+	const size_t vertexCount = positions->count;
+	if (normals && (normals->components != 3 || normals->count != vertexCount))
+		normals = nullptr;
+	if (uvs && (uvs->components != 2 || uvs->count != vertexCount))
+		uvs = nullptr;
+
+	const int indexAccessor = primitive.Int("indices", -1);
+	const Accessor* indexData = indexAccessor >= 0 && indexAccessor < (int)gAccessors.size() ? &gAccessors[indexAccessor] : nullptr;
+	if (indexAccessor >= 0 && (!indexData || indexData->view < 0 || indexData->components != 1 || indexData->componentType == GL_FLOAT)) {
+		ReportError("PARSE_FAILED", gFilename, where + " has unreadable indices");
+		return false;
+	}
+
+	// Triangle list of 32-bit indices: used from the mapping as it is. Otherwise the
+	// indices are widened, and strips, fans and unindexed triangles turned into lists.
+	const GLuint* indices = nullptr;
+	size_t indexCount = 0;
+	std::vector<GLuint> converted;
+	const bool directIndices = indexData && mode == GL_TRIANGLES && indexData->componentType == GL_UNSIGNED_INT &&
+		indexData->stride == sizeof(GLuint) && (uintptr_t)indexData->data % sizeof(GLuint) == 0;
+	if (directIndices) {
+		indices = (const GLuint*)indexData->data;
+		indexCount = indexData->count - indexData->count % 3;
+	}
+	else {
+		const size_t sourceCount = indexData ? indexData->count : vertexCount;
+		auto source = [indexData](size_t i) { return indexData ? ReadIndex(*indexData, i) : (GLuint)i; };
+		if (mode == GL_TRIANGLES) {
+			converted.resize(sourceCount - sourceCount % 3);
+			for (size_t i = 0; i < converted.size(); i++)
+				converted[i] = source(i);
+		}
+		else {
+			// Every other strip triangle is flipped to keep the winding
+			for (size_t i = 2; i < sourceCount; i++) {
+				const GLuint a = mode == GL_TRIANGLE_FAN ? source(0) : source(i - 2 + (i & 1));
+				const GLuint b = mode == GL_TRIANGLE_FAN ? source(i - 1) : source(i - 1 - (i & 1));
+				converted.push_back(a);
+				converted.push_back(b);
+				converted.push_back(source(i));
+			}
+		}
+		indices = converted.data();
+		indexCount = converted.size();
+	}
+
+	if (indexCount == 0) {
+		std::cout << "WARNING: Skipped an empty primitive of " << where << " in " << gFilename << std::endl;
+		return true;
+	}
+
+	// An index past the vertices would make GL read outside the buffers
+	for (size_t i = 0; i < indexCount; i++) {
+		if (indices[i] >= vertexCount) {
+			ReportError("INDEX_OUT_OF_RANGE", gFilename, where);
+			return false;
+		}
+	}
+
+	Primitive entry;
+	entry.material = primitive.Int("material", -1);
+	if (entry.material >= (int)gMaterials.size())
+		entry.material = -1;
+	Meshes::GLMesh& mesh = entry.mesh;
+
+	if (!Direct(positions, false) || !Direct(normals, false) || (uvs && !Direct(uvs, true))) {
+		// Repack into position, normal, uv per vertex
+		std::vector<GLfloat> verts(vertexCount * FLOATS_PER_VERTEX, 0.0f);
+		for (size_t v = 0; v < vertexCount; v++) {
+			GLfloat* vertex = &verts[v * FLOATS_PER_VERTEX];
+			for (int c = 0; c < 3; c++) {
+				vertex[c] = ReadComponent(*positions, v, c);
+				if (normals)
+					vertex[3 + c] = ReadComponent(*normals, v, c);
+			}
+			if (uvs) {
+				vertex[6] = ReadComponent(*uvs, v, 0);
+				vertex[7] = ReadComponent(*uvs, v, 1);
+			}
+		}
+
+		// Smooth normals, weighted by triangle area
+		if (!normals) {
+			for (size_t t = 0; t < indexCount; t += 3) {
+				GLfloat* a = &verts[indices[t] * FLOATS_PER_VERTEX];
+				GLfloat* b = &verts[indices[t + 1] * FLOATS_PER_VERTEX];
+				GLfloat* c = &verts[indices[t + 2] * FLOATS_PER_VERTEX];
+				const glm::vec3 normal = glm::cross(glm::vec3(b[0] - a[0], b[1] - a[1], b[2] - a[2]),
+					glm::vec3(c[0] - a[0], c[1] - a[1], c[2] - a[2]));
+				for (GLfloat* vertex : { a, b, c })
+					for (int k = 0; k < 3; k++)
+						vertex[3 + k] += normal[k];
+			}
+			for (size_t v = 0; v < vertexCount; v++) {
+				GLfloat* vertex = &verts[v * FLOATS_PER_VERTEX];
+				const glm::vec3 normal(vertex[3], vertex[4], vertex[5]);
+				const float length = glm::length(normal);
+				const glm::vec3 unit = length > 0.0f ? normal / length : glm::vec3(0.0f, 1.0f, 0.0f);
+				vertex[3] = unit.x;
+				vertex[4] = unit.y;
+				vertex[5] = unit.z;
+			}
+		}
+
+		Meshes::UCreateIndexedMesh(mesh, verts.data(), (GLuint)vertexCount, indices, (GLuint)indexCount);
+		gRepackedBytes += verts.size() * sizeof(GLfloat) + indexCount * sizeof(GLuint);
+		gPrimitives.push_back(entry);
+		return true;
+	}
+
+	// Attributes point into the views as they are in the file
+	glGenVertexArrays(1, &mesh.vao);
+	glBindVertexArray(mesh.vao);
+
+	const Accessor* vertexAttributes[3] = { positions, normals, uvs };
+	for (GLuint location = 0; location < 3; location++) {
+		const Accessor* attribute = vertexAttributes[location];
+		if (!attribute)
+			continue;		// Missing uvs read as 0
+		glBindBuffer(GL_ARRAY_BUFFER, ViewBuffer(attribute->view));
+		glVertexAttribPointer(location, attribute->components, attribute->componentType,
+			attribute->normalized ? GL_TRUE : GL_FALSE, (GLsizei)attribute->stride, (const void*)attribute->offset);
+		glEnableVertexAttribArray(location);
+	}
+
+	glGenBuffers(1, &mesh.vbos[1]);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, mesh.vbos[1]);
+	glBufferData(GL_ELEMENT_ARRAY_BUFFER, (GLsizeiptr)(indexCount * sizeof(GLuint)), indices, GL_STATIC_DRAW);
+	glBindVertexArray(0);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+	(directIndices ? gDirectBytes : gRepackedBytes) += indexCount * sizeof(GLuint);
+	gDirectPrimitives++;
+
+	mesh.vbos[0] = 0;
+	mesh.nVertices = (GLuint)vertexCount;
+	mesh.nIndices = (GLuint)indexCount;
+	mesh.mode = GL_TRIANGLES;
+	gPrimitives.push_back(entry);
+	return true;
+}
+
+// GL buffer holding a whole buffer view, uploaded straight from the mapping on first use
+GLuint GltfLoader::ViewBuffer(int view) {
+	BufferView& entry = gViews[view];
+	if (!entry.glBuffer) {
+		glGenBuffers(1, &entry.glBuffer);
+		glBindBuffer(GL_ARRAY_BUFFER, entry.glBuffer);
+		glBufferData(GL_ARRAY_BUFFER, (GLsizeiptr)entry.length, gBufferData[entry.buffer].data + entry.offset, GL_STATIC_DRAW);
+		gBuffers.push_back(entry.glBuffer);
+		gDirectBytes += entry.length;
+	}
+	return entry.glBuffer;
+}
+
+// The attribute can be read by the renderer's shaders straight from its view
+bool GltfLoader::Direct(const Accessor* accessor, bool allowNormalized) const {
+	if (!accessor)
+		return false;
+	if (accessor->componentType == GL_FLOAT)
+		return true;
+	return allowNormalized && accessor->normalized &&
+		(accessor->componentType == GL_UNSIGNED_BYTE || accessor->componentType == GL_UNSIGNED_SHORT);
+}
+
+// Component of an element as a float; normalized integers map to [0, 1] (or [-1, 1] if signed)
+float GltfLoader::ReadComponent(const Accessor& accessor, size_t element, int component) {
+	const unsigned char* p = accessor.data + element * accessor.stride;
+	switch (accessor.componentType) {
+	case GL_FLOAT: {
+		float value;
+		memcpy(&value, p + component * sizeof(float), sizeof(value));
+		return value;
+	}
+	case GL_UNSIGNED_BYTE:
+		return accessor.normalized ? p[component] / 255.0f : p[component];
+	case GL_BYTE: {
+		const float value = (float)(signed char)p[component];
+		return accessor.normalized ? std::max(value / 127.0f, -1.0f) : value;
+	}
+	case GL_UNSIGNED_SHORT: {
+		unsigned short value;
+		memcpy(&value, p + component * sizeof(value), sizeof(value));
+		return accessor.normalized ? value / 65535.0f : value;
+	}
+	case GL_SHORT: {
+		short value;
+		memcpy(&value, p + component * sizeof(value), sizeof(value));
+		return accessor.normalized ? std::max(value / 32767.0f, -1.0f) : value;
+	}
+	case GL_UNSIGNED_INT: {
+		unsigned int value;
+		memcpy(&value, p + component * sizeof(value), sizeof(value));
+		return (float)value;
+	}
+	default:
+		return 0.0f;
+	}
+}
+
+GLuint GltfLoader::ReadIndex(const Accessor& accessor, size_t element) {
+	const unsigned char* p = accessor.data + element * accessor.stride;
+	switch (accessor.componentType) {
+	case GL_UNSIGNED_BYTE:
+		return p[0];
+	case GL_UNSIGNED_SHORT: {
+		unsigned short value;
+		memcpy(&value, p, sizeof(value));
+		return value;
+	}
+	default: {
+		GLuint value;
+		memcpy(&value, p, sizeof(value));
+		return value;
+	}
+	}
+}
+
+///////////////////////////////////////////////////
+//	ParseNodes(const JsonValue&)
+//
+//	Walk the node hierarchy of the default scene (or of
+//	every root node when there is none) and record each
+//	node with a mesh, with its accumulated transform
+///////////////////////////////////////////////////
+void GltfLoader::ParseNodes(const JsonValue& root) {
+	const JsonValue* nodes = root.Find("nodes");
+	if (!nodes || !nodes->IsArray())
+		return;
+	std::vector<unsigned char> visited(nodes->Size(), 0);
+
+	const JsonValue* scenes = root.Find("scenes");
+	const int scene = root.Int("scene", 0);
+	if (scenes && scene >= 0 && scene < (int)scenes->Size()) {
+		const JsonValue* roots = (*scenes)[scene].Find("nodes");
+		for (size_t i = 0; roots && i < roots->Size(); i++)
+			AddNode(*nodes, FindIndex((*roots)[i]), glm::mat4(1.0f), visited);
+		return;
+	}
+
+	std::vector<unsigned char> child(nodes->Size(), 0);
+	for (size_t i = 0; i < nodes->Size(); i++) {
+		const JsonValue* children = (*nodes)[i].Find("children");
+		for (size_t c = 0; children && c < children->Size(); c++) {
+			const int index = FindIndex((*children)[c]);
+			if (index >= 0 && index < (int)child.size())
+				child[index] = 1;
+		}
+	}
+	for (size_t i = 0; i < nodes->Size(); i++)
+		if (!child[i])
+			AddNode(*nodes, (int)i, glm::mat4(1.0f), visited);
+}
+
+// Nodes reached twice (a malformed file) are only placed the first time
+void GltfLoader::AddNode(const JsonValue& nodes, int node, const glm::mat4& parent, std::vector<unsigned char>& visited) {
+	if (node < 0 || node >= (int)nodes.Size() || visited[node])
+		return;
+	visited[node] = 1;
+	const JsonValue& entry = nodes[node];
+
+	// Either a column-major matrix or translation * rotation * scale
+	glm::mat4 local(1.0f);
+	if (const JsonValue* matrix = FindNumbers(entry, "matrix", 16)) {
+		for (int i = 0; i < 16; i++)
+			local[i / 4][i % 4] = (float)(*matrix)[i].gNumber;
+	}
+	else {
+		if (const JsonValue* translation = FindNumbers(entry, "translation", 3))
+			local = glm::translate(local, glm::vec3((float)(*translation)[0].gNumber, (float)(*translation)[1].gNumber, (float)(*translation)[2].gNumber));
+		if (const JsonValue* rotation = FindNumbers(entry, "rotation", 4))
+			local = local * glm::mat4_cast(glm::quat((float)(*rotation)[3].gNumber, (float)(*rotation)[0].gNumber, (float)(*rotation)[1].gNumber, (float)(*rotation)[2].gNumber));
+		if (const JsonValue* scale = FindNumbers(entry, "scale", 3))
+			local = glm::scale(local, glm::vec3((float)(*scale)[0].gNumber, (float)(*scale)[1].gNumber, (float)(*scale)[2].gNumber));
+	}
+	const glm::mat4 world = parent * local;
+
+	const int mesh = entry.Int("mesh", -1);
+	if (mesh >= 0 && mesh < (int)gMeshes.size())
+		gNodes.push_back({ entry.String("name", ("node" + std::to_string(node)).c_str()), mesh, world });
+
+	const JsonValue* children = entry.Find("children");
+	for (size_t c = 0; children && c < children->Size(); c++)
+		AddNode(nodes, FindIndex((*children)[c]), world, visited);
+}
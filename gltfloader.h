@@ -0,0 +1,121 @@
+///////////////////////////////////////////////////////////////////////////////
+// gltfloader.h
+// ========
+// glTF 2.0 importer (.glb and .gltf): buffers are memory-mapped and vertex
+// data compatible with the renderer's attributes is handed to GL straight
+// from the mapping; meshes, materials, images and node transforms come out
+// as Meshes::GLMesh primitives, base colors, textures and matrices
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include "GL/glew.h"
+#include "glm/glm.hpp"
+#include "mappedfile.h"
+#include "meshes.h"
+
+#include <memory>
+#include <string>
+#include <vector>
+
+class JsonValue;
+
+class GltfLoader {
+
+public:
+	// Base color of a material, and the image it comes from when textured
+	struct Material {
+		glm::vec3 color;			// baseColorFactor
+		int image;					// Index into gImages, -1 for untextured
+		bool nearest;				// The texture asks for nearest filtering
+		bool unlit;					// KHR_materials_unlit
+	};
+
+	// Image file next to the model, or an image embedded in a buffer, already uploaded
+	struct Image {
+		std::string filename;		// Empty for embedded images
+		GLuint texture;				// Embedded images only, with its full mip chain; 0 otherwise
+	};
+
+	// One draw of a mesh: an indexed triangle list with a single material
+	struct Primitive {
+		Meshes::GLMesh mesh;		// vbos[0] is 0 when the attributes live in gBuffers
+		int material;				// Index into gMaterials, -1 for the default material
+	};
+
+	struct Mesh {
+		std::string name;
+		int firstPrimitive;			// Range in gPrimitives
+		int primitiveCount;
+	};
+
+	// Node that places a mesh, with its transform relative to the scene root
+	struct Node {
+		std::string name;
+		int mesh;					// Index into gMeshes
+		glm::mat4 world;
+	};
+
+	std::vector<Material> gMaterials;
+	std::vector<Image> gImages;
+	std::vector<Primitive> gPrimitives;
+	std::vector<Mesh> gMeshes;
+	std::vector<Node> gNodes;
+	std::vector<GLuint> gBuffers;			// Buffer views uploaded as they are, shared by the primitives
+
+public:
+	bool Load(const char* filename);
+	void Release();
+
+private:
+	// Bytes of a glTF buffer: the GLB binary chunk or a mapped .bin file
+	struct Buffer {
+		const unsigned char* data;
+		size_t size;
+	};
+
+	struct BufferView {
+		int buffer;
+		size_t offset;
+		size_t length;
+		size_t stride;				// 0 for tightly packed
+		GLuint glBuffer;			// Uploaded on first use by a vertex attribute, 0 until then
+	};
+
+	struct Accessor {
+		int view;					// -1 for sparse or view-less accessors, which are not supported
+		size_t offset;				// Within the view
+		const unsigned char* data;	// First element
+		size_t count;
+		size_t stride;				// Bytes between elements
+		GLenum componentType;
+		int components;
+		bool normalized;
+	};
+
+	bool ParseBuffers(const JsonValue& root, const std::string& directory, const Buffer& binaryChunk);
+	bool ParseAccessors(const JsonValue& root);
+	void ParseImages(const JsonValue& root, const std::string& directory);
+	void ParseMaterials(const JsonValue& root);
+	bool ParseMeshes(const JsonValue& root);
+	bool LoadPrimitive(const JsonValue& primitive, int meshIndex);
+	void ParseNodes(const JsonValue& root);
+	void AddNode(const JsonValue& nodes, int node, const glm::mat4& parent, std::vector<unsigned char>& visited);
+
+	GLuint ViewBuffer(int view);
+	bool Direct(const Accessor* accessor, bool allowNormalized) const;
+	static float ReadComponent(const Accessor& accessor, size_t element, int component);
+	static GLuint ReadIndex(const Accessor& accessor, size_t element);
+
+	const char* gFilename = nullptr;
+	MappedFile gFile;
+	std::vector<std::unique_ptr<MappedFile>> gBinFiles;	// External buffers of .gltf files
+	std::vector<Buffer> gBufferData;
+	std::vector<BufferView> gViews;
+	std::vector<Accessor> gAccessors;
+
+	size_t gDirectBytes = 0;				// Uploaded straight from the mapping
+	size_t gRepackedBytes = 0;				// Converted to the renderer's layout first
+	int gDirectPrimitives = 0;
+};
@@ -0,0 +1,391 @@
+///////////////////////////////////////////////////////////////////////////////
+// gpuculling.cpp
+// ========
+// GPU-driven culling: object bounds and transforms in storage buffers, a
+// compute shader that culls them and writes indirect draw commands
+//
+// Objects are grouped into batches (same mesh, same material). Every frame
+// the batches' indirect commands are reset from a template, the compute
+// shader in shaders/cull.comp frustum culls every object and appends the
+// world matrices of the visible ones to their batch's range of the instance
+// buffer, counting them in the batch's command. Each batch is then drawn
+// with glMultiDrawElementsIndirectCount, whose draw count the shader set to
+// 0 or 1, so empty batches cost the GPU nothing and the CPU never reads the
+// results back. The matrices feed attributes 3-6 of the SHADER_INSTANCED
+// variants, indexed through the commands' baseInstance.
+//
+// Only indexed meshes can be drawn indirectly; the others stay on the CPU
+// path.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#include "gpuculling.h"
+
+#include <cstring>
+#include <iostream>
+#include <map>
+#include <utility>
+
+namespace {
+	const GLuint WORKGROUP_SIZE = 64;		// local_size_x in shaders/cull.comp
+
+	// Frames between validation reports
+	const unsigned int VALIDATION_REPORT_INTERVAL = 300;
+
+	// When more than this fraction of the matrices changed, they are uploaded in one call
+	const size_t FULL_UPLOAD_DIVISOR = 8;
+}
+
+///////////////////////////////////////////////////
+//	IsSupported()
+//
+//	Compute shaders, storage buffers and indirect draws
+//	with baseInstance: OpenGL 4.3
+///////////////////////////////////////////////////
+bool GpuCulling::IsSupported() {
+	return GLEW_VERSION_4_3;
+}
+
+///////////////////////////////////////////////////
+//	Initialize(const char*, GpuResources*)
+//
+//	computeShaderSource: contents of shaders/cull.comp
+//	resources: pool the culling program is added to
+///////////////////////////////////////////////////
+bool GpuCulling::Initialize(const char* computeShaderSource, GpuResources* resources) {
+	if (!IsSupported()) {
+		std::cout << "WARNING: GPU culling needs OpenGL 4.3, using CPU culling" << std::endl;
+		return false;
+	}
+
+	gResources = resources;
+	gProgram = LinkProgram(computeShaderSource);
+	if (gProgram.IsNull())
+		return false;
+
+	const GLuint programId = gResources->Program(gProgram);
+	gPlanesLoc = glGetUniformLocation(programId, "planes");
+	gObjectCountLoc = glGetUniformLocation(programId, "objectCount");
+
+	glGenBuffers(BUFFER_COUNT, gBuffers);
+	gWorldCapacity = 0;
+
+	// Without indirect parameters every batch is drawn, with zero instances when culled
+	gIndirectCount = GLEW_VERSION_4_6 || GLEW_ARB_indirect_parameters;
+
+	std::cout << "INFO: GPU culling enabled" << (gIndirectCount ? "" : " (without indirect draw counts)") << std::endl;
+	return true;
+}
+
+///////////////////////////////////////////////////
+//	Reload(const char*)
+//
+//	computeShaderSource: edited contents of shaders/cull.comp
+//
+//	Relink the culling program. Frames already submitted
+//	keep the old one until the pool deletes it; if the new
+//	source fails to build, the old program stays in use.
+///////////////////////////////////////////////////
+bool GpuCulling::Reload(const char* computeShaderSource) {
+	if (gProgram.IsNull())
+		return false;
+
+	const ProgramHandle program = LinkProgram(computeShaderSource);
+	if (program.IsNull()) {
+		std::cout << "WARNING: Culling shader rebuild failed, keeping the previous program" << std::endl;
+		return false;
+	}
+
+	gResources->Destroy(gProgram);
+	gProgram = program;
+	const GLuint programId = gResources->Program(gProgram);
+	gPlanesLoc = glGetUniformLocation(programId, "planes");
+	gObjectCountLoc = glGetUniformLocation(programId, "objectCount");
+	std::cout << "INFO: Reloaded the culling shader" << std::endl;
+	return true;
+}
+
+// Compile and link a compute program into the pool; a null handle if either step fails
+ProgramHandle GpuCulling::LinkProgram(const char* computeShaderSource) {
+	int success = 0;
+	char infoLog[512];
+
+	GLuint shaderId = glCreateShader(GL_COMPUTE_SHADER);
+	glShaderSource(shaderId, 1, &computeShaderSource, NULL);
+	glCompileShader(shaderId);
+	glGetShaderiv(shaderId, GL_COMPILE_STATUS, &success);
+	if (!success) {
+		glGetShaderInfoLog(shaderId, sizeof(infoLog), NULL, infoLog);
+		std::cout << "ERROR::SHADER::COMPUTE::COMPILATION_FAILED\n" << infoLog << std::endl;
+		glDeleteShader(shaderId);
+		return ProgramHandle();
+	}
+
+	const GLuint programId = glCreateProgram();
+	const ProgramHandle program = gResources->AddProgram(programId);
+	glAttachShader(programId, shaderId);
+	glLinkProgram(programId);
+	glDeleteShader(shaderId);
+	glGetProgramiv(programId, GL_LINK_STATUS, &success);
+	if (!success) {
+		glGetProgramInfoLog(programId, sizeof(infoLog), NULL, infoLog);
+		std::cout << "ERROR::SHADER::PROGRAM::LINKING_FAILED\n" << infoLog << std::endl;
+		gResources->Destroy(program);
+		return ProgramHandle();
+	}
+	return program;
+}
+
+///////////////////////////////////////////////////
+//	Shutdown()
+//
+//	Release the program and buffers. The program goes back
+//	to the pool, which deletes it once the GPU is done.
+///////////////////////////////////////////////////
+void GpuCulling::Shutdown() {
+	if (!gProgram.IsNull()) {
+		gResources->Destroy(gProgram);
+		glDeleteBuffers(BUFFER_COUNT, gBuffers);
+	}
+	gProgram = ProgramHandle();
+	for (GLuint& buffer : gBuffers)
+		buffer = 0;
+	gBatches.clear();
+	gObjects.clear();
+	gGpuDrawn.clear();
+	gCpuDrawn.clear();
+}
+
+///////////////////////////////////////////////////
+//	SetObjects(objectMesh, objectMaterial, meshBounds, meshVaos, meshIndexCounts, meshModes)
+//
+//	objectMesh, objectMaterial: mesh and material of every scene object
+//	meshBounds, meshVaos: local bounds and vertex array of every mesh
+//	meshIndexCounts: index count of every mesh, 0 for meshes without indices
+//	meshModes: primitive type of every mesh's indices
+//
+//	Build the batches and the static per-object data.
+//	Call again whenever objects are added or removed.
+///////////////////////////////////////////////////
+void GpuCulling::SetObjects(const std::vector<int>& objectMesh, const std::vector<int>& objectMaterial,
+	const std::vector<AABB>& meshBounds, const std::vector<GLuint>& meshVaos, const std::vector<GLsizei>& meshIndexCounts,
+	const std::vector<GLenum>& meshModes) {
+	gBatches.clear();
+	gObjects.clear();
+	gGpuDrawn.assign(objectMesh.size(), 0);
+	gCpuDrawn.clear();
+	if (gProgram.IsNull()) {
+		for (size_t i = 0; i < objectMesh.size(); i++)
+			gCpuDrawn.push_back((int)i);
+		return;
+	}
+
+	// Group the objects, then give each batch a contiguous range of instance slots
+	std::map<std::pair<int, int>, int> batchIndex;
+	std::vector<int> objectBatch(objectMesh.size(), -1);
+	for (size_t i = 0; i < objectMesh.size(); i++) {
+		const int mesh = objectMesh[i];
+		if (meshIndexCounts[mesh] == 0) {
+			gCpuDrawn.push_back((int)i);
+			continue;
+		}
+
+		auto found = batchIndex.insert(std::make_pair(std::make_pair(mesh, objectMaterial[i]), (int)gBatches.size()));
+		if (found.second)
+			gBatches.push_back({ objectMaterial[i], meshVaos[mesh], meshModes[mesh], meshIndexCounts[mesh], 0, 0 });
+		objectBatch[i] = found.first->second;
+		gBatches[objectBatch[i]].objectCount++;
+		gGpuDrawn[i] = 1;
+	}
+
+	unsigned int firstInstance = 0;
+	std::vector<DrawElementsIndirectCommand> commands;
+	for (Batch& batch : gBatches) {
+		batch.firstInstance = firstInstance;
+		firstInstance += batch.objectCount;
+		commands.push_back({ (GLuint)batch.indexCount, 0, 0, 0, batch.firstInstance });
+	}
+
+	for (size_t i = 0; i < objectMesh.size(); i++) {
+		if (objectBatch[i] < 0)
+			continue;
+
+		const AABB& bounds = meshBounds[objectMesh[i]];
+		ObjectData data = {};
+		data.boundsMin[0] = bounds.min.x; data.boundsMin[1] = bounds.min.y; data.boundsMin[2] = bounds.min.z;
+		data.boundsMax[0] = bounds.max.x; data.boundsMax[1] = bounds.max.y; data.boundsMax[2] = bounds.max.z;
+		data.object = (GLuint)i;
+		data.batch = (GLuint)objectBatch[i];
+		gObjects.push_back(data);
+	}
+
+	if (gObjects.empty())
+		return;
+
+	const GLsizeiptr commandsSize = commands.size() * sizeof(DrawElementsIndirectCommand);
+	const GLsizeiptr countsSize = gBatches.size() * sizeof(GLuint);
+
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, gBuffers[OBJECTS]);
+	glBufferData(GL_SHADER_STORAGE_BUFFER, gObjects.size() * sizeof(ObjectData), gObjects.data(), GL_STATIC_DRAW);
+
+	// Template the commands and draw counts are reset from every frame
+	std::vector<unsigned char> reset(commandsSize + countsSize, 0);
+	memcpy(reset.data(), commands.data(), commandsSize);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, gBuffers[RESET]);
+	glBufferData(GL_COPY_WRITE_BUFFER, reset.size(), reset.data(), GL_STATIC_DRAW);
+
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, gBuffers[COMMANDS]);
+	glBufferData(GL_SHADER_STORAGE_BUFFER, commandsSize, nullptr, GL_DYNAMIC_COPY);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, gBuffers[DRAW_COUNTS]);
+	glBufferData(GL_SHADER_STORAGE_BUFFER, countsSize, nullptr, GL_DYNAMIC_COPY);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, gBuffers[INSTANCES]);
+	glBufferData(GL_SHADER_STORAGE_BUFFER, gObjects.size() * sizeof(glm::mat4), nullptr, GL_DYNAMIC_COPY);
+
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+
+	std::cout << "INFO: GPU culling " << gObjects.size() << " objects in " << gBatches.size() << " batches" << std::endl;
+}
+
+///////////////////////////////////////////////////
+//	Cull(const std::vector<glm::mat4>&, const std::vector<int>&, const Frustum&)
+//
+//	world: world matrix of every scene object
+//	changed: indices into world of the matrices changed
+//	since the last call
+//	frustum: planes to cull against
+//
+//	Dispatch the culling shader. The CPU work grows with
+//	the number of changed matrices, not with the objects.
+///////////////////////////////////////////////////
+void GpuCulling::Cull(const std::vector<glm::mat4>& world, const std::vector<int>& changed, const Frustum& frustum) {
+	if (gObjects.empty())
+		return;
+
+	const GLsizeiptr worldSize = world.size() * sizeof(glm::mat4);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, gBuffers[WORLD]);
+	if (world.size() > gWorldCapacity) {
+		glBufferData(GL_SHADER_STORAGE_BUFFER, worldSize, world.data(), GL_DYNAMIC_DRAW);
+		gWorldCapacity = world.size();
+	}
+	else if (changed.size() * FULL_UPLOAD_DIVISOR > world.size())
+		glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, worldSize, world.data());
+	else {
+		for (const int t : changed)
+			if (t < (int)world.size())
+				glBufferSubData(GL_SHADER_STORAGE_BUFFER, t * sizeof(glm::mat4), sizeof(glm::mat4), &world[t]);
+	}
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+	// Zero instance and draw counts
+	const GLsizeiptr commandsSize = gBatches.size() * sizeof(DrawElementsIndirectCommand);
+	const GLsizeiptr countsSize = gBatches.size() * sizeof(GLuint);
+	glBindBuffer(GL_COPY_READ_BUFFER, gBuffers[RESET]);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, gBuffers[COMMANDS]);
+	glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, commandsSize);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, gBuffers[DRAW_COUNTS]);
+	glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, commandsSize, 0, countsSize);
+	glBindBuffer(GL_COPY_READ_BUFFER, 0);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, gBuffers[OBJECTS]);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, gBuffers[WORLD]);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, gBuffers[COMMANDS]);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 3, gBuffers[DRAW_COUNTS]);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 4, gBuffers[INSTANCES]);
+
+	glUseProgram(gResources->Program(gProgram));
+	glUniform4fv(gPlanesLoc, 5, &frustum.gPlanes[0].x);
+	glUniform1ui(gObjectCountLoc, (GLuint)gObjects.size());
+	glDispatchCompute(((GLuint)gObjects.size() + WORKGROUP_SIZE - 1) / WORKGROUP_SIZE, 1, 1);
+	glUseProgram(0);
+
+	// The draws read the commands and the instance matrices the shader wrote; Validate()
+	// reads them back and the next frame's reset copy overwrites them
+	glMemoryBarrier(GL_COMMAND_BARRIER_BIT | GL_VERTEX_ATTRIB_ARRAY_BARRIER_BIT | GL_SHADER_STORAGE_BARRIER_BIT |
+		GL_BUFFER_UPDATE_BARRIER_BIT);
+}
+
+///////////////////////////////////////////////////
+//	Draw(void (*)(int))
+//
+//	bindMaterial: makes the SHADER_INSTANCED program of
+//	a material current and binds its texture, sampler
+//	and color
+///////////////////////////////////////////////////
+void GpuCulling::Draw(void (*bindMaterial)(int material)) {
+	if (gObjects.empty())
+		return;
+
+	glBindBuffer(GL_DRAW_INDIRECT_BUFFER, gBuffers[COMMANDS]);
+	if (gIndirectCount)
+		glBindBuffer(GL_PARAMETER_BUFFER_ARB, gBuffers[DRAW_COUNTS]);
+
+	for (size_t b = 0; b < gBatches.size(); b++) {
+		const Batch& batch = gBatches[b];
+		bindMaterial(batch.material);
+		glBindVertexArray(batch.vao);
+
+		// baseInstance of the command selects the batch's matrices
+		glBindBuffer(GL_ARRAY_BUFFER, gBuffers[INSTANCES]);
+		for (GLuint column = 0; column < 4; column++) {
+			glEnableVertexAttribArray(3 + column);
+			glVertexAttribPointer(3 + column, 4, GL_FLOAT, GL_FALSE, sizeof(glm::mat4), (const void*)(column * sizeof(glm::vec4)));
+			glVertexAttribDivisor(3 + column, 1);
+		}
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+		const void* command = (const void*)(b * sizeof(DrawElementsIndirectCommand));
+		if (gIndirectCount)
+			glMultiDrawElementsIndirectCountARB(batch.mode, GL_UNSIGNED_INT, command, (GLintptr)(b * sizeof(GLuint)), 1, 0);
+		else
+			glDrawElementsIndirect(batch.mode, GL_UNSIGNED_INT, command);
+	}
+
+	glBindVertexArray(0);
+	glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+	if (gIndirectCount)
+		glBindBuffer(GL_PARAMETER_BUFFER_ARB, 0);
+}
+
+///////////////////////////////////////////////////
+//	Validate(const std::vector<unsigned char>&)
+//
+//	cpuVisible: frustum culling result of Culling for the
+//	same frame (before occlusion culling)
+//
+//	Read the instance counts back (a full GPU sync, for
+//	testing only, e.g. on llvmpipe) and compare them with
+//	the CPU result batch by batch. Mismatches are reported
+//	as they happen, totals every few hundred frames.
+///////////////////////////////////////////////////
+bool GpuCulling::Validate(const std::vector<unsigned char>& cpuVisible) {
+	if (gObjects.empty())
+		return true;
+
+	std::vector<DrawElementsIndirectCommand> commands(gBatches.size());
+	glBindBuffer(GL_COPY_READ_BUFFER, gBuffers[COMMANDS]);
+	glGetBufferSubData(GL_COPY_READ_BUFFER, 0, commands.size() * sizeof(DrawElementsIndirectCommand), commands.data());
+	glBindBuffer(GL_COPY_READ_BUFFER, 0);
+
+	std::vector<GLuint> expected(gBatches.size(), 0);
+	for (const ObjectData& data : gObjects)
+		expected[data.batch] += cpuVisible[data.object];
+
+	bool matches = true;
+	for (size_t b = 0; b < gBatches.size(); b++) {
+		if (commands[b].instanceCount != expected[b]) {
+			std::cout << "WARNING: GPU culling batch " << b << " drew " << commands[b].instanceCount
+				<< " instances, CPU culling found " << expected[b] << " visible" << std::endl;
+			matches = false;
+		}
+	}
+
+	gValidatedFrames++;
+	if (!matches)
+		gMismatchedFrames++;
+	if (gValidatedFrames % VALIDATION_REPORT_INTERVAL == 0)
+		std::cout << "INFO: GPU culling validated over " << gValidatedFrames << " frames, "
+			<< gMismatchedFrames << " differed from the CPU" << std::endl;
+	return matches;
+}
@@ -0,0 +1,97 @@
+///////////////////////////////////////////////////////////////////////////////
+// gpuculling.h
+// ========
+// GPU-driven culling: object bounds and transforms in storage buffers, a
+// compute shader that culls them and writes indirect draw commands
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include "GL/glew.h"
+#include "glm/glm.hpp"
+#include "culling.h"
+#include "gpuresources.h"
+
+#include <vector>
+
+class GpuCulling {
+
+public:
+	// Objects sharing a mesh and a material, drawn by one indirect command
+	struct Batch {
+		int material;
+		GLuint vao;
+		GLenum mode;					// Primitive type of the mesh's indices
+		GLsizei indexCount;
+		unsigned int firstInstance;		// First slot in the instance buffer
+		unsigned int objectCount;
+	};
+
+	std::vector<Batch> gBatches;
+
+public:
+	static bool IsSupported();
+
+	bool Initialize(const char* computeShaderSource, GpuResources* resources);
+	bool Reload(const char* computeShaderSource);
+	void Shutdown();
+
+	void SetObjects(const std::vector<int>& objectMesh, const std::vector<int>& objectMaterial,
+		const std::vector<AABB>& meshBounds, const std::vector<GLuint>& meshVaos, const std::vector<GLsizei>& meshIndexCounts,
+		const std::vector<GLenum>& meshModes);
+
+	void Cull(const std::vector<glm::mat4>& world, const std::vector<int>& changed, const Frustum& frustum);
+	void Draw(void (*bindMaterial)(int material));
+	bool Validate(const std::vector<unsigned char>& cpuVisible);
+
+	// Objects left to the CPU path (meshes without indices)
+	bool IsGpuDrawn(size_t object) const { return gGpuDrawn[object] != 0; }
+	const std::vector<int>& CpuDrawnObjects() const { return gCpuDrawn; }
+
+private:
+	// std430 layout of ObjectData in shaders/cull.comp
+	struct ObjectData {
+		float boundsMin[4];
+		float boundsMax[4];
+		GLuint object;
+		GLuint batch;
+		GLuint pad[2];
+	};
+
+	// Layout glDrawElementsIndirect reads
+	struct DrawElementsIndirectCommand {
+		GLuint count;
+		GLuint instanceCount;
+		GLuint firstIndex;
+		GLint baseVertex;
+		GLuint baseInstance;
+	};
+
+	enum BufferName {
+		OBJECTS,			// ObjectData per GPU drawn object
+		WORLD,				// World matrix per object
+		COMMANDS,			// One indirect command per batch
+		DRAW_COUNTS,		// 0 or 1 per batch: the draw count of its multi-draw
+		INSTANCES,			// Model matrices of the visible objects, grouped by batch
+		RESET,				// Initial contents of COMMANDS followed by zeroed DRAW_COUNTS
+		BUFFER_COUNT
+	};
+
+	ProgramHandle LinkProgram(const char* computeShaderSource);
+
+	GpuResources* gResources = nullptr;		// Owns the program
+	ProgramHandle gProgram;
+	GLint gPlanesLoc = -1;
+	GLint gObjectCountLoc = -1;
+	GLuint gBuffers[BUFFER_COUNT] = {};
+
+	std::vector<ObjectData> gObjects;
+	std::vector<unsigned char> gGpuDrawn;	// Per scene object
+	std::vector<int> gCpuDrawn;				// Scene objects with gGpuDrawn 0
+	size_t gWorldCapacity = 0;				// Matrices the WORLD buffer holds
+	bool gIndirectCount = false;			// ARB_indirect_parameters available
+
+	unsigned int gValidatedFrames = 0;
+	unsigned int gMismatchedFrames = 0;
+};
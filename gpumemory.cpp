@@ -0,0 +1,386 @@
+///////////////////////////////////////////////////////////////////////////////
+// gpumemory.cpp
+// ========
+// GPU memory accounting: buffer and texture sizes per category, the driver's
+// own numbers where it reports them, and a budget enforced by dropping the
+// top mip levels of the least recently used streamable textures
+//
+// Sizes are read back from GL when an object is tracked, so the owner only
+// names the object and its category. A texture is evicted one level at a
+// time: its remaining levels are copied into a new, smaller texture that
+// takes over the texture's handle, and the old one is retired through
+// GpuResources once the frames using it are done. Each step frees three
+// quarters of the texture. The copy stays on the GPU when
+// glCopyImageSubData is available and goes through system memory
+// otherwise, which stalls but only happens while over budget.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#include "gpumemory.h"
+
+#include <iostream>
+#include <vector>
+
+namespace {
+	const int MAX_TEXTURE_LEVELS = 16;
+
+	// Textures are not shrunk below this many texels on a side
+	const int MIN_EVICTED_SIZE = 32;
+
+	// Bounds the stall of a frame that finds itself over budget
+	const int MAX_EVICTIONS_PER_FRAME = 4;
+
+	double Megabytes(size_t bytes) {
+		return bytes / (1024.0 * 1024.0);
+	}
+
+	// Bytes of one texel of an uncompressed level, from the component sizes
+	size_t TexelBytes(GLint level) {
+		const GLenum components[] = { GL_TEXTURE_RED_SIZE, GL_TEXTURE_GREEN_SIZE, GL_TEXTURE_BLUE_SIZE,
+			GL_TEXTURE_ALPHA_SIZE, GL_TEXTURE_DEPTH_SIZE, GL_TEXTURE_STENCIL_SIZE };
+		GLint bits = 0;
+		for (GLenum component : components) {
+			GLint size = 0;
+			glGetTexLevelParameteriv(GL_TEXTURE_2D, level, component, &size);
+			bits += size;
+		}
+
+		// Three byte formats are padded to four
+		size_t bytes = (bits + 7) / 8;
+		return bytes == 3 ? 4 : bytes;
+	}
+}
+
+///////////////////////////////////////////////////
+//	Initialize(GpuResources*, size_t)
+//
+//	resources: owns the textures that can be evicted
+//	budget: bytes the tracked allocations may use; 0 for
+//	no limit
+///////////////////////////////////////////////////
+void GpuMemory::Initialize(GpuResources* resources, size_t budget) {
+	gResources = resources;
+	gBudget = budget;
+	gCopyImage = GLEW_VERSION_4_3 || GLEW_ARB_copy_image;
+}
+
+void GpuMemory::Add(MemoryCategory category, size_t bytes) {
+	gCategoryTotals[category] += bytes;
+	gTotal += bytes;
+}
+
+void GpuMemory::Subtract(MemoryCategory category, size_t bytes) {
+	gCategoryTotals[category] -= bytes;
+	gTotal -= bytes;
+}
+
+///////////////////////////////////////////////////
+//	TrackBuffer(GLuint, MemoryCategory)
+//
+//	Record a buffer with its current size. Track it
+//	again after reallocating its storage.
+///////////////////////////////////////////////////
+void GpuMemory::TrackBuffer(GLuint buffer, MemoryCategory category) {
+	if (!buffer)
+		return;
+	UntrackBuffer(buffer);
+
+	GLint previous = 0;
+	glGetIntegerv(GL_COPY_READ_BUFFER_BINDING, &previous);
+	glBindBuffer(GL_COPY_READ_BUFFER, buffer);
+	GLint64 size = 0;
+	glGetBufferParameteri64v(GL_COPY_READ_BUFFER, GL_BUFFER_SIZE, &size);
+	glBindBuffer(GL_COPY_READ_BUFFER, previous);
+
+	gBuffers[buffer] = { category, (size_t)size };
+	Add(category, (size_t)size);
+}
+
+void GpuMemory::UntrackBuffer(GLuint buffer) {
+	auto found = gBuffers.find(buffer);
+	if (found == gBuffers.end())
+		return;
+
+	Subtract(found->second.category, found->second.bytes);
+	gBuffers.erase(found);
+}
+
+///////////////////////////////////////////////////
+//	TextureBytes(GLuint, int*)
+//
+//	Size of a 2D texture with all its allocated mip
+//	levels, whose count goes to levels if given. Levels
+//	below GL_TEXTURE_BASE_LEVEL may be unallocated.
+///////////////////////////////////////////////////
+size_t GpuMemory::TextureBytes(GLuint texture, int* levels) {
+	GLint previous = 0;
+	glGetIntegerv(GL_TEXTURE_BINDING_2D, &previous);
+	glBindTexture(GL_TEXTURE_2D, texture);
+
+	size_t bytes = 0;
+	int allocated = 0;
+	for (int level = 0; level < MAX_TEXTURE_LEVELS; level++) {
+		GLint width = 0, height = 0, compressed = GL_FALSE;
+		glGetTexLevelParameteriv(GL_TEXTURE_2D, level, GL_TEXTURE_WIDTH, &width);
+		glGetTexLevelParameteriv(GL_TEXTURE_2D, level, GL_TEXTURE_HEIGHT, &height);
+		if (width == 0 || height == 0)
+			continue;
+
+		glGetTexLevelParameteriv(GL_TEXTURE_2D, level, GL_TEXTURE_COMPRESSED, &compressed);
+		if (compressed) {
+			GLint size = 0;
+			glGetTexLevelParameteriv(GL_TEXTURE_2D, level, GL_TEXTURE_COMPRESSED_IMAGE_SIZE, &size);
+			bytes += size;
+		}
+		else {
+			bytes += (size_t)width * height * TexelBytes(level);
+		}
+		allocated++;
+	}
+
+	glBindTexture(GL_TEXTURE_2D, previous);
+	if (levels)
+		*levels = allocated;
+	return bytes;
+}
+
+///////////////////////////////////////////////////
+//	TrackTexture(TextureHandle, MemoryCategory, bool)
+//
+//	evictable: the texture may lose its top mip levels
+//	when over budget (it must have a full mip chain)
+///////////////////////////////////////////////////
+void GpuMemory::TrackTexture(TextureHandle texture, MemoryCategory category, bool evictable) {
+	const GLuint name = gResources ? gResources->Texture(texture) : 0;
+	if (!name)
+		return;
+	UntrackTexture(texture);
+
+	TextureEntry entry;
+	entry.handle = texture;
+	entry.category = category;
+	entry.bytes = TextureBytes(name, &entry.levels);
+	entry.evictable = evictable && entry.levels > 1;
+	entry.lastUsed = gFrame;
+
+	GLint previous = 0;
+	glGetIntegerv(GL_TEXTURE_BINDING_2D, &previous);
+	glBindTexture(GL_TEXTURE_2D, name);
+	glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_WIDTH, &entry.width);
+	glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_HEIGHT, &entry.height);
+	glBindTexture(GL_TEXTURE_2D, previous);
+
+	gTextures[texture.index] = entry;
+	Add(category, entry.bytes);
+}
+
+void GpuMemory::UntrackTexture(TextureHandle texture) {
+	auto found = gTextures.find(texture.index);
+	if (found == gTextures.end() || found->second.handle != texture)
+		return;
+
+	Subtract(found->second.category, found->second.bytes);
+	gTextures.erase(found);
+}
+
+///////////////////////////////////////////////////
+//	Touch(TextureHandle)
+//
+//	Mark a texture as used this frame; textures touched
+//	least recently are evicted first. Main thread only.
+///////////////////////////////////////////////////
+void GpuMemory::Touch(TextureHandle texture) {
+	auto found = gTextures.find(texture.index);
+	if (found != gTextures.end() && found->second.handle == texture)
+		found->second.lastUsed = gFrame;
+}
+
+///////////////////////////////////////////////////
+//	Enforce()
+//
+//	Call once per frame, before drawing. While the
+//	tracked total is over budget, drops the top level of
+//	the least recently used evictable texture (the larger
+//	one on ties). Returns the number of levels dropped.
+///////////////////////////////////////////////////
+int GpuMemory::Enforce() {
+	int evicted = 0;
+	while (gBudget && gTotal > gBudget && evicted < MAX_EVICTIONS_PER_FRAME) {
+		TextureEntry* victim = nullptr;
+		for (auto& texture : gTextures) {
+			TextureEntry& entry = texture.second;
+			if (!entry.evictable)
+				continue;
+			if (!victim || entry.lastUsed < victim->lastUsed ||
+				(entry.lastUsed == victim->lastUsed && entry.bytes > victim->bytes))
+				victim = &entry;
+		}
+
+		if (!victim) {
+			if (!gWarnedExhausted) {
+				const std::streamsize precision = std::cout.precision(1);
+				std::cout << "WARNING: GPU memory over budget with nothing left to evict (" << std::fixed
+					<< Megabytes(gTotal) << " of " << Megabytes(gBudget) << " MB)" << std::defaultfloat << std::endl;
+				std::cout.precision(precision);
+			}
+			gWarnedExhausted = true;
+			break;
+		}
+
+		// Textures that cannot shrink any further stay as they are
+		if (DropTopLevel(*victim))
+			evicted++;
+		else
+			victim->evictable = false;
+	}
+
+	if (gTotal <= gBudget)
+		gWarnedExhausted = false;
+	gFrame++;
+	return evicted;
+}
+
+bool GpuMemory::DropTopLevel(TextureEntry& entry) {
+	const GLuint source = gResources->Texture(entry.handle);
+	if (!source || entry.levels < 2 || entry.width / 2 < MIN_EVICTED_SIZE || entry.height / 2 < MIN_EVICTED_SIZE)
+		return false;
+
+	GLint previous = 0;
+	glGetIntegerv(GL_TEXTURE_BINDING_2D, &previous);
+	glBindTexture(GL_TEXTURE_2D, source);
+
+	GLint internalFormat = GL_RGBA8, compressed = GL_FALSE;
+	glGetTexLevelParameteriv(GL_TEXTURE_2D, 1, GL_TEXTURE_INTERNAL_FORMAT, &internalFormat);
+	glGetTexLevelParameteriv(GL_TEXTURE_2D, 1, GL_TEXTURE_COMPRESSED, &compressed);
+
+	// Parameters used when no sampler object is bound
+	const GLenum parameters[] = { GL_TEXTURE_MIN_FILTER, GL_TEXTURE_MAG_FILTER, GL_TEXTURE_WRAP_S, GL_TEXTURE_WRAP_T };
+	GLint values[4];
+	for (int i = 0; i < 4; i++)
+		glGetTexParameteriv(GL_TEXTURE_2D, parameters[i], &values[i]);
+
+	const int levels = entry.levels - 1;
+	GLint widths[MAX_TEXTURE_LEVELS], heights[MAX_TEXTURE_LEVELS], sizes[MAX_TEXTURE_LEVELS] = {};
+	for (int level = 0; level < levels; level++) {
+		glGetTexLevelParameteriv(GL_TEXTURE_2D, level + 1, GL_TEXTURE_WIDTH, &widths[level]);
+		glGetTexLevelParameteriv(GL_TEXTURE_2D, level + 1, GL_TEXTURE_HEIGHT, &heights[level]);
+		if (compressed)
+			glGetTexLevelParameteriv(GL_TEXTURE_2D, level + 1, GL_TEXTURE_COMPRESSED_IMAGE_SIZE, &sizes[level]);
+	}
+
+	GLuint target;
+	glGenTextures(1, &target);
+	glBindTexture(GL_TEXTURE_2D, target);
+	for (int i = 0; i < 4; i++)
+		glTexParameteri(GL_TEXTURE_2D, parameters[i], values[i]);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, 0);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, levels - 1);
+
+	// Allocate the levels, then copy level n + 1 of the source into level n
+	for (int level = 0; level < levels; level++) {
+		if (compressed)
+			glCompressedTexImage2D(GL_TEXTURE_2D, level, internalFormat, widths[level], heights[level], 0, sizes[level], nullptr);
+		else
+			glTexImage2D(GL_TEXTURE_2D, level, internalFormat, widths[level], heights[level], 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+	}
+
+	if (gCopyImage) {
+		for (int level = 0; level < levels; level++)
+			glCopyImageSubData(source, GL_TEXTURE_2D, level + 1, 0, 0, 0, target, GL_TEXTURE_2D, level, 0, 0, 0,
+				widths[level], heights[level], 1);
+	}
+	else {
+		GLint packAlignment = 4, unpackAlignment = 4;
+		glGetIntegerv(GL_PACK_ALIGNMENT, &packAlignment);
+		glGetIntegerv(GL_UNPACK_ALIGNMENT, &unpackAlignment);
+		glPixelStorei(GL_PACK_ALIGNMENT, 1);
+		glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+
+		std::vector<unsigned char> pixels;
+		for (int level = 0; level < levels; level++) {
+			glBindTexture(GL_TEXTURE_2D, source);
+			if (compressed) {
+				pixels.resize(sizes[level]);
+				glGetCompressedTexImage(GL_TEXTURE_2D, level + 1, pixels.data());
+			}
+			else {
+				pixels.resize((size_t)widths[level] * heights[level] * 4);
+				glGetTexImage(GL_TEXTURE_2D, level + 1, GL_RGBA, GL_UNSIGNED_BYTE, pixels.data());
+			}
+
+			glBindTexture(GL_TEXTURE_2D, target);
+			if (compressed)
+				glCompressedTexSubImage2D(GL_TEXTURE_2D, level, 0, 0, widths[level], heights[level], internalFormat,
+					sizes[level], pixels.data());
+			else
+				glTexSubImage2D(GL_TEXTURE_2D, level, 0, 0, widths[level], heights[level], GL_RGBA, GL_UNSIGNED_BYTE, pixels.data());
+		}
+
+		glPixelStorei(GL_PACK_ALIGNMENT, packAlignment);
+		glPixelStorei(GL_UNPACK_ALIGNMENT, unpackAlignment);
+	}
+
+	glBindTexture(GL_TEXTURE_2D, previous);
+
+	if (!gResources->ReplaceTexture(entry.handle, target)) {
+		glDeleteTextures(1, &target);
+		return false;
+	}
+
+	const size_t bytes = TextureBytes(target);
+	Subtract(entry.category, entry.bytes - bytes);
+	gEvictedBytes += entry.bytes - bytes;
+	entry.bytes = bytes;
+	entry.levels = levels;
+	entry.width = widths[0];
+	entry.height = heights[0];
+	return true;
+}
+
+///////////////////////////////////////////////////
+//	QueryDriverMemory(size_t&, size_t&)
+//
+//	Dedicated video memory and how much of it is free,
+//	in bytes, from GL_NVX_gpu_memory_info or (free
+//	texture memory only, total 0) GL_ATI_meminfo.
+//	Returns false when the driver reports neither.
+///////////////////////////////////////////////////
+bool GpuMemory::QueryDriverMemory(size_t& total, size_t& available) const {
+	if (GLEW_NVX_gpu_memory_info) {
+		GLint totalKb = 0, availableKb = 0;
+		glGetIntegerv(GL_GPU_MEMORY_INFO_DEDICATED_VIDMEM_NVX, &totalKb);
+		glGetIntegerv(GL_GPU_MEMORY_INFO_CURRENT_AVAILABLE_VIDMEM_NVX, &availableKb);
+		total = (size_t)totalKb * 1024;
+		available = (size_t)availableKb * 1024;
+		return true;
+	}
+	if (GLEW_ATI_meminfo) {
+		// Free memory in the pool, largest free block, and the same for auxiliary memory
+		GLint free[4] = {};
+		glGetIntegerv(GL_TEXTURE_FREE_MEMORY_ATI, free);
+		total = 0;
+		available = (size_t)free[0] * 1024;
+		return true;
+	}
+	return false;
+}
+
+void GpuMemory::Report() const {
+	const std::streamsize precision = std::cout.precision(1);
+	std::cout << std::fixed
+		<< "INFO: GPU memory: " << Megabytes(gTotal) << " MB tracked (meshes " << Megabytes(gCategoryTotals[MEMORY_MESHES])
+		<< ", textures " << Megabytes(gCategoryTotals[MEMORY_TEXTURES])
+		<< ", streaming " << Megabytes(gCategoryTotals[MEMORY_STREAMING])
+		<< ", other " << Megabytes(gCategoryTotals[MEMORY_OTHER]) << ")";
+	if (gBudget)
+		std::cout << ", budget " << Megabytes(gBudget) << " MB, " << Megabytes(gEvictedBytes) << " MB evicted";
+
+	size_t total, available;
+	if (QueryDriverMemory(total, available)) {
+		std::cout << ", driver reports " << Megabytes(available) << " MB free";
+		if (total)
+			std::cout << " of " << Megabytes(total) << " MB";
+	}
+	std::cout << std::defaultfloat << std::endl;
+	std::cout.precision(precision);
+}
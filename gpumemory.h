@@ -0,0 +1,81 @@
+///////////////////////////////////////////////////////////////////////////////
+// gpumemory.h
+// ========
+// GPU memory accounting: buffer and texture sizes per category, the driver's
+// own numbers where it reports them, and a budget enforced by dropping the
+// top mip levels of the least recently used streamable textures
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include "GL/glew.h"
+#include "gpuresources.h"
+
+#include <cstddef>
+#include <unordered_map>
+
+enum MemoryCategory {
+	MEMORY_MESHES,			// Vertex and index buffers
+	MEMORY_TEXTURES,		// Textures with their mip chains
+	MEMORY_STREAMING,		// Per-frame ring buffers
+	MEMORY_OTHER,
+	MEMORY_CATEGORY_COUNT,
+};
+
+class GpuMemory {
+
+public:
+	void Initialize(GpuResources* resources, size_t budget = 0);
+	void SetBudget(size_t budget) { gBudget = budget; }
+
+	void TrackBuffer(GLuint buffer, MemoryCategory category);
+	void UntrackBuffer(GLuint buffer);
+	void TrackTexture(TextureHandle texture, MemoryCategory category, bool evictable);
+	void UntrackTexture(TextureHandle texture);
+
+	void Touch(TextureHandle texture);
+	int Enforce();
+
+	bool QueryDriverMemory(size_t& total, size_t& available) const;
+	void Report() const;
+
+	size_t Total() const { return gTotal; }
+	size_t CategoryTotal(MemoryCategory category) const { return gCategoryTotals[category]; }
+	size_t Budget() const { return gBudget; }
+
+	static size_t TextureBytes(GLuint texture, int* levels = nullptr);
+
+private:
+	struct Allocation {
+		MemoryCategory category;
+		size_t bytes;
+	};
+
+	struct TextureEntry {
+		TextureHandle handle;
+		MemoryCategory category;
+		size_t bytes;
+		int levels;					// Mip levels currently resident
+		int width;					// Size of the top resident level
+		int height;
+		bool evictable;				// Top levels may be dropped to meet the budget
+		unsigned int lastUsed;		// Frame of the last Touch()
+	};
+
+	void Add(MemoryCategory category, size_t bytes);
+	void Subtract(MemoryCategory category, size_t bytes);
+	bool DropTopLevel(TextureEntry& entry);
+
+	GpuResources* gResources = nullptr;
+	std::unordered_map<GLuint, Allocation> gBuffers;			// By GL name
+	std::unordered_map<unsigned int, TextureEntry> gTextures;	// By handle index
+
+	size_t gCategoryTotals[MEMORY_CATEGORY_COUNT] = {};
+	size_t gTotal = 0;
+	size_t gBudget = 0;							// 0 for no budget
+	size_t gEvictedBytes = 0;					// Freed by Enforce() so far
+	unsigned int gFrame = 0;
+	bool gCopyImage = false;					// glCopyImageSubData is available
+	bool gWarnedExhausted = false;				// Reported that nothing is left to evict
+};
@@ -0,0 +1,202 @@
+///////////////////////////////////////////////////////////////////////////////
+// gpuresources.cpp
+// ========
+// generation-checked handles for GL objects (textures, meshes, programs,
+// buffers) kept in dense pools, with destruction deferred until the GPU has
+// finished every frame that may still use the object
+//
+// Destroying a handle invalidates it at once, but its GL names are only
+// queued. At the end of the frame the queue gets a fence, and the names are
+// deleted once that fence has signaled, so nothing is deleted (and no name
+// reused) while queued GPU work may still refer to it.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#include "gpuresources.h"
+
+#include <iostream>
+
+TextureHandle GpuResources::AddTexture(GLuint texture) {
+	return gTextures.Add(texture);
+}
+
+MeshHandle GpuResources::AddMesh(GLuint vao, GLuint vertexBuffer, GLuint indexBuffer) {
+	return gMeshes.Add({ vao, vertexBuffer, indexBuffer });
+}
+
+ProgramHandle GpuResources::AddProgram(GLuint program) {
+	return gPrograms.Add(program);
+}
+
+BufferHandle GpuResources::AddBuffer(GLuint buffer) {
+	return gBuffers.Add(buffer);
+}
+
+///////////////////////////////////////////////////
+//	Texture(TextureHandle)
+//
+//	The GL name behind a handle, 0 for null or stale
+//	handles (so a destroyed texture binds nothing). The
+//	lookups only read, so job threads may use them while
+//	no handle is being added or destroyed.
+///////////////////////////////////////////////////
+GLuint GpuResources::Texture(TextureHandle handle) const {
+	const GLuint* texture = gTextures.Get(handle);
+	return texture ? *texture : 0;
+}
+
+const GpuResources::Mesh* GpuResources::FindMesh(MeshHandle handle) const {
+	return gMeshes.Get(handle);
+}
+
+GLuint GpuResources::Program(ProgramHandle handle) const {
+	const GLuint* program = gPrograms.Get(handle);
+	return program ? *program : 0;
+}
+
+GLuint GpuResources::Buffer(BufferHandle handle) const {
+	const GLuint* buffer = gBuffers.Get(handle);
+	return buffer ? *buffer : 0;
+}
+
+///////////////////////////////////////////////////
+//	Destroy(TextureHandle)
+//
+//	Invalidate the handle now; the texture is deleted
+//	when the GPU is done with the current frame. Stale
+//	handles are ignored, so destroying twice is harmless.
+///////////////////////////////////////////////////
+void GpuResources::Destroy(TextureHandle handle) {
+	GLuint texture;
+	if (gTextures.Remove(handle, texture))
+		Retire(KIND_TEXTURE, texture);
+}
+
+void GpuResources::Destroy(MeshHandle handle) {
+	Mesh mesh;
+	if (gMeshes.Remove(handle, mesh))
+		Retire(KIND_MESH, mesh.vao, mesh.vertexBuffer, mesh.indexBuffer);
+}
+
+void GpuResources::Destroy(ProgramHandle handle) {
+	GLuint program;
+	if (gPrograms.Remove(handle, program))
+		Retire(KIND_PROGRAM, program);
+}
+
+void GpuResources::Destroy(BufferHandle handle) {
+	GLuint buffer;
+	if (gBuffers.Remove(handle, buffer))
+		Retire(KIND_BUFFER, buffer);
+}
+
+///////////////////////////////////////////////////
+//	ReplaceTexture(TextureHandle, GLuint)
+//
+//	Point a live handle at a new texture (e.g. the same
+//	image with fewer mip levels) and retire the old one.
+//	Returns false, leaving texture to the caller, if the
+//	handle is stale.
+///////////////////////////////////////////////////
+bool GpuResources::ReplaceTexture(TextureHandle handle, GLuint texture) {
+	GLuint* current = gTextures.Get(handle);
+	if (!current)
+		return false;
+
+	Retire(KIND_TEXTURE, *current);
+	*current = texture;
+	return true;
+}
+
+void GpuResources::Retire(Kind kind, GLuint first, GLuint second, GLuint third) {
+	gRetiring.push_back({ kind, { first, second, third }, nullptr });
+}
+
+void GpuResources::Delete(const Retired& retired) {
+	switch (retired.kind) {
+	case KIND_TEXTURE:
+		glDeleteTextures(1, &retired.names[0]);
+		break;
+	case KIND_MESH:
+		glDeleteVertexArrays(1, &retired.names[0]);
+		glDeleteBuffers(2, &retired.names[1]);		// Zero names are ignored
+		break;
+	case KIND_PROGRAM:
+		glDeleteProgram(retired.names[0]);
+		break;
+	case KIND_BUFFER:
+		glDeleteBuffers(1, &retired.names[0]);
+		break;
+	}
+}
+
+///////////////////////////////////////////////////
+//	EndFrame()
+//
+//	Call once per frame after its last GL command. Fences
+//	what was destroyed during the frame and deletes what
+//	earlier frames destroyed once their fence signaled.
+///////////////////////////////////////////////////
+void GpuResources::EndFrame() {
+	if (!gRetiring.empty()) {
+		GLsync fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+		for (Retired& retired : gRetiring) {
+			retired.fence = fence;
+			gPending.push_back(retired);
+		}
+		gRetiring.clear();
+	}
+
+	// Fences signal in order, so stop at the first one still pending
+	size_t done = 0;
+	while (done < gPending.size()) {
+		GLsync fence = gPending[done].fence;
+		GLenum status = glClientWaitSync(fence, 0, 0);
+		if (status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED)
+			break;
+
+		// Every entry retired in the same frame shares the fence
+		while (done < gPending.size() && gPending[done].fence == fence)
+			Delete(gPending[done++]);
+		glDeleteSync(fence);
+	}
+	gPending.erase(gPending.begin(), gPending.begin() + done);
+}
+
+///////////////////////////////////////////////////
+//	Shutdown()
+//
+//	Wait for the GPU and delete everything: retired names
+//	and any resource still alive, which is reported, since
+//	its owner should have destroyed it
+///////////////////////////////////////////////////
+void GpuResources::Shutdown() {
+	const size_t leaked = LiveCount();
+	if (leaked)
+		std::cout << "WARNING: " << leaked << " GPU resources were never destroyed ("
+			<< gTextures.Count() << " textures, " << gMeshes.Count() << " meshes, "
+			<< gPrograms.Count() << " programs, " << gBuffers.Count() << " buffers)" << std::endl;
+
+	gTextures.Drain([this](GLuint texture) { Retire(KIND_TEXTURE, texture); });
+	gMeshes.Drain([this](const Mesh& mesh) { Retire(KIND_MESH, mesh.vao, mesh.vertexBuffer, mesh.indexBuffer); });
+	gPrograms.Drain([this](GLuint program) { Retire(KIND_PROGRAM, program); });
+	gBuffers.Drain([this](GLuint buffer) { Retire(KIND_BUFFER, buffer); });
+
+	glFinish();
+	GLsync lastFence = nullptr;
+	for (const Retired& retired : gPending) {
+		Delete(retired);
+		if (retired.fence != lastFence) {
+			glDeleteSync(retired.fence);
+			lastFence = retired.fence;
+		}
+	}
+	for (const Retired& retired : gRetiring)
+		Delete(retired);
+	gPending.clear();
+	gRetiring.clear();
+}
+
+size_t GpuResources::LiveCount() const {
+	return gTextures.Count() + gMeshes.Count() + gPrograms.Count() + gBuffers.Count();
+}
@@ -0,0 +1,176 @@
+///////////////////////////////////////////////////////////////////////////////
+// gpuresources.h
+// ========
+// generation-checked handles for GL objects (textures, meshes, programs,
+// buffers) kept in dense pools, with destruction deferred until the GPU has
+// finished every frame that may still use the object
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include "GL/glew.h"
+
+#include <cstddef>
+#include <vector>
+
+// Refers to a pool slot as it was when the handle was made. Once the
+// resource is destroyed the slot's generation moves on, so stale handles
+// resolve to nothing instead of to whatever reuses the slot.
+template <class Tag>
+struct Handle {
+	unsigned int index = 0;
+	unsigned int generation = 0;	// 0 is never live: a default handle is null
+
+	bool IsNull() const { return generation == 0; }
+	bool operator==(const Handle& other) const { return index == other.index && generation == other.generation; }
+	bool operator!=(const Handle& other) const { return !(*this == other); }
+};
+
+struct TextureTag {};
+struct MeshTag {};
+struct ProgramTag {};
+struct BufferTag {};
+
+typedef Handle<TextureTag> TextureHandle;
+typedef Handle<MeshTag> MeshHandle;
+typedef Handle<ProgramTag> ProgramHandle;
+typedef Handle<BufferTag> BufferHandle;
+
+// Slots stored contiguously; freed slots are reused, with a new generation
+template <class Tag, class Resource>
+class HandlePool {
+
+public:
+	Handle<Tag> Add(const Resource& resource) {
+		unsigned int index;
+		if (!gFree.empty()) {
+			index = gFree.back();
+			gFree.pop_back();
+		}
+		else {
+			index = (unsigned int)gResources.size();
+			gResources.push_back(Resource());
+			gGenerations.push_back(1);
+			gLive.push_back(0);
+		}
+
+		gResources[index] = resource;
+		gLive[index] = 1;
+		gCount++;
+
+		Handle<Tag> handle;
+		handle.index = index;
+		handle.generation = gGenerations[index];
+		return handle;
+	}
+
+	// nullptr for null and stale handles
+	const Resource* Get(Handle<Tag> handle) const {
+		if (handle.index >= gResources.size() || !gLive[handle.index] || gGenerations[handle.index] != handle.generation)
+			return nullptr;
+		return &gResources[handle.index];
+	}
+
+	Resource* Get(Handle<Tag> handle) {
+		return const_cast<Resource*>(static_cast<const HandlePool*>(this)->Get(handle));
+	}
+
+	// Frees the slot and hands back what it held; false for stale handles
+	bool Remove(Handle<Tag> handle, Resource& resource) {
+		if (!Get(handle))
+			return false;
+
+		resource = gResources[handle.index];
+		gLive[handle.index] = 0;
+		if (++gGenerations[handle.index] == 0)
+			gGenerations[handle.index] = 1;
+		gFree.push_back(handle.index);
+		gCount--;
+		return true;
+	}
+
+	// Hands every live resource to visit(resource) and empties the pool
+	template <class Visit>
+	void Drain(const Visit& visit) {
+		for (size_t i = 0; i < gResources.size(); i++) {
+			if (gLive[i]) {
+				Handle<Tag> handle;
+				handle.index = (unsigned int)i;
+				handle.generation = gGenerations[i];
+				Resource resource;
+				Remove(handle, resource);
+				visit(resource);
+			}
+		}
+	}
+
+	size_t Count() const { return gCount; }
+
+private:
+	std::vector<Resource> gResources;
+	std::vector<unsigned int> gGenerations;
+	std::vector<unsigned char> gLive;
+	std::vector<unsigned int> gFree;
+	size_t gCount = 0;
+};
+
+class GpuResources {
+
+public:
+	// Vertex array with its vertex and (optional) index buffer
+	struct Mesh {
+		GLuint vao;
+		GLuint vertexBuffer;
+		GLuint indexBuffer;
+	};
+
+public:
+	TextureHandle AddTexture(GLuint texture);
+	MeshHandle AddMesh(GLuint vao, GLuint vertexBuffer, GLuint indexBuffer = 0);
+	ProgramHandle AddProgram(GLuint program);
+	BufferHandle AddBuffer(GLuint buffer);
+
+	GLuint Texture(TextureHandle handle) const;
+	const Mesh* FindMesh(MeshHandle handle) const;
+	GLuint Program(ProgramHandle handle) const;
+	GLuint Buffer(BufferHandle handle) const;
+
+	void Destroy(TextureHandle handle);
+	void Destroy(MeshHandle handle);
+	void Destroy(ProgramHandle handle);
+	void Destroy(BufferHandle handle);
+	bool ReplaceTexture(TextureHandle handle, GLuint texture);
+
+	void EndFrame();
+	void Shutdown();
+
+	size_t LiveCount() const;
+	size_t PendingCount() const { return gRetiring.size() + gPending.size(); }
+
+private:
+	enum Kind {
+		KIND_TEXTURE,
+		KIND_MESH,
+		KIND_PROGRAM,
+		KIND_BUFFER,
+	};
+
+	// GL names waiting for the GPU to be done with them
+	struct Retired {
+		Kind kind;
+		GLuint names[3];
+		GLsync fence;		// Signaled once the frame that retired them is finished
+	};
+
+	void Retire(Kind kind, GLuint first, GLuint second = 0, GLuint third = 0);
+	static void Delete(const Retired& retired);
+
+	HandlePool<TextureTag, GLuint> gTextures;
+	HandlePool<MeshTag, Mesh> gMeshes;
+	HandlePool<ProgramTag, GLuint> gPrograms;
+	HandlePool<BufferTag, GLuint> gBuffers;
+
+	std::vector<Retired> gRetiring;		// Destroyed this frame, no fence yet
+	std::vector<Retired> gPending;		// Fenced, oldest first
+};
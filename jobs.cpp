@@ -0,0 +1,270 @@
+///////////////////////////////////////////////////////////////////////////////
+// jobs.cpp
+// ========
+// fixed-size work-stealing job system: one Chase-Lev deque per thread,
+// completion counters for dependencies and a parallel-for helper
+//
+// Each thread pushes and pops jobs at the bottom of its own deque without
+// locking; idle threads steal from the top of another thread's deque. A
+// thread waiting on a counter keeps executing jobs instead of blocking, so
+// jobs may safely submit and wait on more jobs.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#include "jobs.h"
+
+#include <chrono>
+#include <iostream>
+
+namespace {
+	const unsigned int NOT_A_JOB_THREAD = ~0u;
+
+	// Idle workers yield this many times before going to sleep
+	const int SPIN_COUNT = 64;
+
+	thread_local unsigned int tThreadIndex = NOT_A_JOB_THREAD;
+}
+
+///////////////////////////////////////////////////
+//	Push(const Job&)
+//
+//	Owner thread only. Returns false when the deque is full.
+///////////////////////////////////////////////////
+bool JobSystem::WorkQueue::Push(const Job& job) {
+	long bottom = gBottom.load(std::memory_order_relaxed);
+	long top = gTop.load(std::memory_order_acquire);
+	if (bottom - top >= CAPACITY)
+		return false;
+
+	gJobs[bottom & (CAPACITY - 1)] = job;
+	std::atomic_thread_fence(std::memory_order_release);
+	gBottom.store(bottom + 1, std::memory_order_relaxed);
+	return true;
+}
+
+///////////////////////////////////////////////////
+//	Pop(Job&)
+//
+//	Owner thread only. Takes the most recently pushed job;
+//	races with thieves only for the very last one.
+///////////////////////////////////////////////////
+bool JobSystem::WorkQueue::Pop(Job& job) {
+	long bottom = gBottom.load(std::memory_order_relaxed) - 1;
+	gBottom.store(bottom, std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_seq_cst);
+	long top = gTop.load(std::memory_order_relaxed);
+
+	if (top > bottom) {
+		// Empty
+		gBottom.store(bottom + 1, std::memory_order_relaxed);
+		return false;
+	}
+
+	job = gJobs[bottom & (CAPACITY - 1)];
+	if (top < bottom)
+		return true;
+
+	// Last job: whoever moves gTop first gets it
+	bool taken = gTop.compare_exchange_strong(top, top + 1, std::memory_order_seq_cst, std::memory_order_relaxed);
+	gBottom.store(bottom + 1, std::memory_order_relaxed);
+	return taken;
+}
+
+///////////////////////////////////////////////////
+//	Steal(Job&)
+//
+//	Any thread. Takes the oldest job. The copy is only
+//	used if gTop was not moved by someone else meanwhile,
+//	so a slot overwritten during the copy is discarded.
+///////////////////////////////////////////////////
+bool JobSystem::WorkQueue::Steal(Job& job) {
+	long top = gTop.load(std::memory_order_acquire);
+	std::atomic_thread_fence(std::memory_order_seq_cst);
+	long bottom = gBottom.load(std::memory_order_acquire);
+	if (top >= bottom)
+		return false;
+
+	job = gJobs[top & (CAPACITY - 1)];
+	return gTop.compare_exchange_strong(top, top + 1, std::memory_order_seq_cst, std::memory_order_relaxed);
+}
+
+///////////////////////////////////////////////////
+//	Initialize(unsigned int)
+//
+//	workerCount: threads to start besides the calling
+//	one; 0 uses one per hardware thread, minus the caller
+//
+//	The calling thread becomes job thread 0 and must be
+//	the one that calls Shutdown()
+///////////////////////////////////////////////////
+bool JobSystem::Initialize(unsigned int workerCount) {
+	if (!gQueues.empty())
+		return true;
+
+	if (workerCount == 0) {
+		unsigned int hardwareThreads = std::thread::hardware_concurrency();
+		workerCount = hardwareThreads > 1 ? hardwareThreads - 1 : 0;
+	}
+
+	gStopping = false;
+	gQueued = 0;
+
+	gQueues.resize(workerCount + 1);
+	for (unsigned int i = 0; i < gQueues.size(); i++) {
+		gQueues[i] = new ThreadState;
+		gQueues[i]->stealSeed = i * 2654435761u + 1;
+	}
+	tThreadIndex = 0;
+
+	gWorkers.reserve(workerCount);
+	for (unsigned int i = 1; i <= workerCount; i++)
+		gWorkers.emplace_back(&JobSystem::WorkerMain, this, i);
+
+	std::cout << "INFO: Job system running on " << gQueues.size() << " threads" << std::endl;
+	return true;
+}
+
+///////////////////////////////////////////////////
+//	Shutdown()
+//
+//	Stop and join the workers. Every counter must have
+//	been waited on before this is called.
+///////////////////////////////////////////////////
+void JobSystem::Shutdown() {
+	if (gQueues.empty())
+		return;
+
+	{
+		std::lock_guard<std::mutex> lock(gSleepMutex);
+		gStopping = true;
+	}
+	gWake.notify_all();
+
+	for (std::thread& worker : gWorkers)
+		worker.join();
+	gWorkers.clear();
+
+	for (ThreadState* state : gQueues)
+		delete state;
+	gQueues.clear();
+
+	tThreadIndex = NOT_A_JOB_THREAD;
+}
+
+///////////////////////////////////////////////////
+//	ThreadIndex()
+//
+//	Returns the job thread the caller is running on:
+//	0 for the thread that called Initialize(), 1..n for
+//	the workers. Useful to index per-thread scratch data.
+///////////////////////////////////////////////////
+unsigned int JobSystem::ThreadIndex() {
+	return tThreadIndex;
+}
+
+///////////////////////////////////////////////////
+//	Run(function, const void*, unsigned int, unsigned int, JobCounter&)
+//
+//	function: called as function(data, begin, end)
+//	counter: incremented now, decremented when the job is done
+//
+//	Queues a job on the calling thread's deque. Threads
+//	outside the job system, and callers whose deque is
+//	full, run the job immediately instead.
+///////////////////////////////////////////////////
+void JobSystem::Run(void (*function)(const void*, unsigned int, unsigned int), const void* data,
+	unsigned int begin, unsigned int end, JobCounter& counter) {
+	Job job = { function, data, begin, end, &counter };
+	counter.pending.fetch_add(1, std::memory_order_relaxed);
+
+	const unsigned int thread = tThreadIndex;
+	if (thread >= gQueues.size() || !gQueues[thread]->queue.Push(job)) {
+		Execute(job);
+		return;
+	}
+
+	gQueued.fetch_add(1, std::memory_order_release);
+	gWake.notify_one();
+}
+
+///////////////////////////////////////////////////
+//	Wait(JobCounter&)
+//
+//	Returns once every job counted by counter has
+//	finished, executing queued jobs in the meantime
+///////////////////////////////////////////////////
+void JobSystem::Wait(JobCounter& counter) {
+	const unsigned int thread = tThreadIndex;
+	Job job;
+	while (counter.pending.load(std::memory_order_acquire) > 0) {
+		if (FindJob(thread, job))
+			Execute(job);
+		else
+			std::this_thread::yield();
+	}
+}
+
+// Own deque first, then steal from the others starting at a random victim
+bool JobSystem::FindJob(unsigned int thread, Job& job) {
+	const unsigned int threadCount = (unsigned int)gQueues.size();
+	unsigned int start = 0;
+
+	if (thread < threadCount) {
+		ThreadState* state = gQueues[thread];
+		if (state->queue.Pop(job)) {
+			gQueued.fetch_sub(1, std::memory_order_relaxed);
+			return true;
+		}
+
+		// xorshift32
+		unsigned int seed = state->stealSeed;
+		seed ^= seed << 13;
+		seed ^= seed >> 17;
+		seed ^= seed << 5;
+		state->stealSeed = seed;
+		start = seed;
+	}
+
+	for (unsigned int i = 0; i < threadCount; i++) {
+		unsigned int victim = (start + i) % threadCount;
+		if (victim == thread)
+			continue;
+		if (gQueues[victim]->queue.Steal(job)) {
+			gQueued.fetch_sub(1, std::memory_order_relaxed);
+			return true;
+		}
+	}
+	return false;
+}
+
+void JobSystem::Execute(const Job& job) {
+	job.function(job.data, job.begin, job.end);
+	job.counter->pending.fetch_sub(1, std::memory_order_release);
+}
+
+void JobSystem::WorkerMain(unsigned int thread) {
+	tThreadIndex = thread;
+
+	Job job;
+	int idleSpins = 0;
+	while (!gStopping.load(std::memory_order_relaxed)) {
+		if (FindJob(thread, job)) {
+			Execute(job);
+			idleSpins = 0;
+			continue;
+		}
+
+		if (++idleSpins < SPIN_COUNT) {
+			std::this_thread::yield();
+			continue;
+		}
+
+		// Nothing to do: sleep until a job is queued. The timeout covers a
+		// notification sent between the check and the wait.
+		std::unique_lock<std::mutex> lock(gSleepMutex);
+		gWake.wait_for(lock, std::chrono::milliseconds(1), [this] {
+			return gQueued.load(std::memory_order_acquire) > 0 || gStopping.load(std::memory_order_relaxed);
+		});
+		idleSpins = 0;
+	}
+}
@@ -0,0 +1,117 @@
+///////////////////////////////////////////////////////////////////////////////
+// jobs.h
+// ========
+// fixed-size work-stealing job system: one Chase-Lev deque per thread,
+// completion counters for dependencies and a parallel-for helper
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Number of unfinished jobs in a group; Wait() on it to join the group
+struct JobCounter {
+	std::atomic<int> pending{ 0 };
+};
+
+// One unit of work: a function applied to the index range [begin, end)
+struct Job {
+	void (*function)(const void* data, unsigned int begin, unsigned int end);
+	const void* data;
+	unsigned int begin;
+	unsigned int end;
+	JobCounter* counter;	// Decremented when the job finishes
+};
+
+class JobSystem {
+
+public:
+	bool Initialize(unsigned int workerCount = 0);
+	void Shutdown();
+
+	void Run(void (*function)(const void*, unsigned int, unsigned int), const void* data,
+		unsigned int begin, unsigned int end, JobCounter& counter);
+	void Wait(JobCounter& counter);
+
+	template <class Body>
+	void ParallelFor(unsigned int count, unsigned int grain, const Body& body);
+
+	unsigned int ThreadCount() const { return (unsigned int)gQueues.size(); }
+	static unsigned int ThreadIndex();
+
+private:
+	// Chase-Lev work-stealing deque: the owner pushes and pops at the
+	// bottom, other threads steal from the top. Jobs are stored by value,
+	// so no job records have to be allocated or recycled.
+	class WorkQueue {
+	public:
+		static const long CAPACITY = 4096;
+
+		bool Push(const Job& job);
+		bool Pop(Job& job);
+		bool Steal(Job& job);
+
+	private:
+		alignas(64) std::atomic<long> gTop{ 0 };
+		alignas(64) std::atomic<long> gBottom{ 0 };
+		Job gJobs[CAPACITY];
+	};
+
+	// Per-thread deque and stealing state
+	struct ThreadState {
+		WorkQueue queue;
+		unsigned int stealSeed = 0;
+	};
+
+	template <class Body>
+	static void InvokeBody(const void* data, unsigned int begin, unsigned int end) {
+		(*(const Body*)data)(begin, end);
+	}
+
+	bool FindJob(unsigned int thread, Job& job);
+	void Execute(const Job& job);
+	void WorkerMain(unsigned int thread);
+
+	std::vector<ThreadState*> gQueues;	// Index 0 belongs to the thread that called Initialize()
+	std::vector<std::thread> gWorkers;
+
+	std::atomic<int> gQueued{ 0 };		// Jobs pushed but not yet taken, to let idle workers sleep
+	std::atomic<bool> gStopping{ false };
+	std::mutex gSleepMutex;
+	std::condition_variable gWake;
+};
+
+///////////////////////////////////////////////////
+//	ParallelFor(unsigned int, unsigned int, const Body&)
+//
+//	count: number of items
+//	grain: items per job (at least 1)
+//	body: callable as body(begin, end) for an item range
+//
+//	Splits [0, count) into jobs, runs them on every thread
+//	(the caller included) and returns when all are done
+///////////////////////////////////////////////////
+template <class Body>
+void JobSystem::ParallelFor(unsigned int count, unsigned int grain, const Body& body) {
+	if (grain == 0)
+		grain = 1;
+
+	// Not worth a round trip through the queues
+	if (count <= grain || gQueues.size() <= 1) {
+		if (count)
+			body(0u, count);
+		return;
+	}
+
+	JobCounter counter;
+	for (unsigned int begin = 0; begin < count; begin += grain) {
+		unsigned int end = count - begin > grain ? begin + grain : count;
+		Run(&InvokeBody<Body>, &body, begin, end, counter);
+	}
+	Wait(counter);
+}
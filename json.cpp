@@ -0,0 +1,304 @@
+///////////////////////////////////////////////////////////////////////////////
+// json.cpp
+// ========
+// minimal JSON reader: parses a document into a tree of values, enough for
+// asset descriptions such as glTF
+//
+// A recursive descent parser over the whole text. Objects keep their members
+// in file order and are searched linearly, which is fast enough for the few
+// members asset objects have. Numbers are read with std::from_chars, so the
+// result does not depend on the locale. \u escapes are stored as UTF-8.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#include "json.h"
+
+#include <charconv>
+#include <climits>
+#include <cstring>
+
+namespace {
+	// Deeper nesting is rejected rather than risking the stack
+	const int MAX_DEPTH = 256;
+
+	class Parser {
+	public:
+		Parser(const char* text, size_t length) : gPos(text), gEnd(text + length) {}
+
+		bool ParseValue(JsonValue& value, int depth);
+		void SkipWhitespace() {
+			while (gPos < gEnd && (*gPos == ' ' || *gPos == '\t' || *gPos == '\n' || *gPos == '\r'))
+				gPos++;
+		}
+		bool AtEnd() const { return gPos == gEnd; }
+
+		const char* gError = nullptr;
+		const char* gPos;
+		const char* gEnd;
+
+	private:
+		bool ParseString(std::string& string);
+		bool ParseNumber(double& number);
+		bool ParseLiteral(const char* literal);
+		bool Fail(const char* error) {
+			if (!gError)
+				gError = error;
+			return false;
+		}
+	};
+
+	void AppendUtf8(std::string& string, unsigned int code) {
+		if (code < 0x80)
+			string.push_back((char)code);
+		else if (code < 0x800) {
+			string.push_back((char)(0xC0 | (code >> 6)));
+			string.push_back((char)(0x80 | (code & 0x3F)));
+		}
+		else if (code < 0x10000) {
+			string.push_back((char)(0xE0 | (code >> 12)));
+			string.push_back((char)(0x80 | ((code >> 6) & 0x3F)));
+			string.push_back((char)(0x80 | (code & 0x3F)));
+		}
+		else {
+			string.push_back((char)(0xF0 | (code >> 18)));
+			string.push_back((char)(0x80 | ((code >> 12) & 0x3F)));
+			string.push_back((char)(0x80 | ((code >> 6) & 0x3F)));
+			string.push_back((char)(0x80 | (code & 0x3F)));
+		}
+	}
+
+	bool ParseHex4(const char* p, unsigned int& code) {
+		code = 0;
+		for (int i = 0; i < 4; i++) {
+			const char c = p[i];
+			code <<= 4;
+			if (c >= '0' && c <= '9')
+				code |= c - '0';
+			else if (c >= 'a' && c <= 'f')
+				code |= c - 'a' + 10;
+			else if (c >= 'A' && c <= 'F')
+				code |= c - 'A' + 10;
+			else
+				return false;
+		}
+		return true;
+	}
+
+	bool Parser::ParseValue(JsonValue& value, int depth) {
+		if (depth > MAX_DEPTH)
+			return Fail("nested too deeply");
+
+		SkipWhitespace();
+		if (gPos == gEnd)
+			return Fail("unexpected end of text");
+
+		switch (*gPos) {
+		case '{':
+			value.gType = JsonValue::JSON_OBJECT;
+			gPos++;
+			SkipWhitespace();
+			if (gPos < gEnd && *gPos == '}') {
+				gPos++;
+				return true;
+			}
+			for (;;) {
+				SkipWhitespace();
+				value.gKeys.emplace_back();
+				if (gPos == gEnd || *gPos != '"' || !ParseString(value.gKeys.back()))
+					return Fail("expected a member name");
+				SkipWhitespace();
+				if (gPos == gEnd || *gPos++ != ':')
+					return Fail("expected ':'");
+				value.gItems.emplace_back();
+				if (!ParseValue(value.gItems.back(), depth + 1))
+					return false;
+				SkipWhitespace();
+				if (gPos < gEnd && *gPos == ',') {
+					gPos++;
+					continue;
+				}
+				if (gPos < gEnd && *gPos == '}') {
+					gPos++;
+					return true;
+				}
+				return Fail("expected ',' or '}'");
+			}
+
+		case '[':
+			value.gType = JsonValue::JSON_ARRAY;
+			gPos++;
+			SkipWhitespace();
+			if (gPos < gEnd && *gPos == ']') {
+				gPos++;
+				return true;
+			}
+			for (;;) {
+				value.gItems.emplace_back();
+				if (!ParseValue(value.gItems.back(), depth + 1))
+					return false;
+				SkipWhitespace();
+				if (gPos < gEnd && *gPos == ',') {
+					gPos++;
+					continue;
+				}
+				if (gPos < gEnd && *gPos == ']') {
+					gPos++;
+					return true;
+				}
+				return Fail("expected ',' or ']'");
+			}
+
+		case '"':
+			value.gType = JsonValue::JSON_STRING;
+			return ParseString(value.gString);
+
+		case 't':
+			value.gType = JsonValue::JSON_BOOL;
+			value.gNumber = 1.0;
+			return ParseLiteral("true");
+
+		case 'f':
+			value.gType = JsonValue::JSON_BOOL;
+			value.gNumber = 0.0;
+			return ParseLiteral("false");
+
+		case 'n':
+			value.gType = JsonValue::JSON_NULL;
+			return ParseLiteral("null");
+
+		default:
+			value.gType = JsonValue::JSON_NUMBER;
+			return ParseNumber(value.gNumber);
+		}
+	}
+
+	// gPos is on the opening quote
+	bool Parser::ParseString(std::string& string) {
+		gPos++;
+		for (;;) {
+			// Copy the run up to the next quote or escape in one go
+			const char* run = gPos;
+			while (gPos < gEnd && *gPos != '"' && *gPos != '\\')
+				gPos++;
+			string.append(run, gPos);
+			if (gPos == gEnd)
+				return Fail("unterminated string");
+			if (*gPos++ == '"')
+				return true;
+
+			if (gPos == gEnd)
+				return Fail("unterminated string");
+			const char escape = *gPos++;
+			switch (escape) {
+			case '"': string.push_back('"'); break;
+			case '\\': string.push_back('\\'); break;
+			case '/': string.push_back('/'); break;
+			case 'b': string.push_back('\b'); break;
+			case 'f': string.push_back('\f'); break;
+			case 'n': string.push_back('\n'); break;
+			case 'r': string.push_back('\r'); break;
+			case 't': string.push_back('\t'); break;
+			case 'u': {
+				unsigned int code;
+				if (gEnd - gPos < 4 || !ParseHex4(gPos, code))
+					return Fail("bad \\u escape");
+				gPos += 4;
+
+				// A high surrogate followed by a low one encodes a code point above 0xFFFF
+				unsigned int low;
+				if (code >= 0xD800 && code < 0xDC00 && gEnd - gPos >= 6 && gPos[0] == '\\' && gPos[1] == 'u' &&
+					ParseHex4(gPos + 2, low) && low >= 0xDC00 && low < 0xE000) {
+					code = 0x10000 + ((code - 0xD800) << 10) + (low - 0xDC00);
+					gPos += 6;
+				}
+				AppendUtf8(string, code);
+				break;
+			}
+			default:
+				return Fail("bad escape");
+			}
+		}
+	}
+
+	bool Parser::ParseNumber(double& number) {
+		// from_chars does not take a leading '+', and neither does JSON
+		std::from_chars_result result = std::from_chars(gPos, gEnd, number);
+		if (result.ec != std::errc() || result.ptr == gPos)
+			return Fail("unexpected character");
+		gPos = result.ptr;
+		return true;
+	}
+
+	bool Parser::ParseLiteral(const char* literal) {
+		const size_t length = strlen(literal);
+		if ((size_t)(gEnd - gPos) < length || memcmp(gPos, literal, length) != 0)
+			return Fail("unexpected character");
+		gPos += length;
+		return true;
+	}
+}
+
+///////////////////////////////////////////////////
+//	Parse(const char*, size_t, JsonValue&, std::string&)
+//
+//	text, length: the document, not necessarily
+//	null-terminated
+//	root: receives the top-level value
+//	error: receives a description of the problem and
+//	its line when false is returned
+///////////////////////////////////////////////////
+bool JsonValue::Parse(const char* text, size_t length, JsonValue& root, std::string& error) {
+	root = JsonValue();
+
+	Parser parser(text, length);
+	if (parser.ParseValue(root, 0)) {
+		parser.SkipWhitespace();
+		if (parser.AtEnd())
+			return true;
+		parser.gError = "trailing characters";
+	}
+
+	int line = 1;
+	for (const char* p = text; p < parser.gPos && p < text + length; p++)
+		if (*p == '\n')
+			line++;
+	error = std::string(parser.gError) + " on line " + std::to_string(line);
+	return false;
+}
+
+///////////////////////////////////////////////////
+//	Find(const char*)
+//
+//	Returns the member of an object with the given
+//	name, or nullptr if there is none (or this is not
+//	an object)
+///////////////////////////////////////////////////
+const JsonValue* JsonValue::Find(const char* key) const {
+	for (size_t i = 0; i < gKeys.size(); i++)
+		if (gKeys[i] == key)
+			return &gItems[i];
+	return nullptr;
+}
+
+double JsonValue::Number(const char* key, double fallback) const {
+	const JsonValue* value = Find(key);
+	return value && value->gType == JSON_NUMBER ? value->gNumber : fallback;
+}
+
+// Numbers outside the int range (or NaN) give the fallback, since casting them is undefined
+int JsonValue::Int(const char* key, int fallback) const {
+	const JsonValue* value = Find(key);
+	if (!value || value->gType != JSON_NUMBER || !(value->gNumber >= INT_MIN && value->gNumber <= INT_MAX))
+		return fallback;
+	return (int)value->gNumber;
+}
+
+bool JsonValue::Bool(const char* key, bool fallback) const {
+	const JsonValue* value = Find(key);
+	return value && value->gType == JSON_BOOL ? value->gNumber != 0.0 : fallback;
+}
+
+const char* JsonValue::String(const char* key, const char* fallback) const {
+	const JsonValue* value = Find(key);
+	return value && value->gType == JSON_STRING ? value->gString.c_str() : fallback;
+}
@@ -0,0 +1,48 @@
+///////////////////////////////////////////////////////////////////////////////
+// json.h
+// ========
+// minimal JSON reader: parses a document into a tree of values, enough for
+// asset descriptions such as glTF
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+class JsonValue {
+
+public:
+	enum Type {
+		JSON_NULL,
+		JSON_BOOL,
+		JSON_NUMBER,
+		JSON_STRING,
+		JSON_ARRAY,
+		JSON_OBJECT
+	};
+
+	Type gType = JSON_NULL;
+	double gNumber = 0.0;					// Numbers, and 0/1 for booleans
+	std::string gString;
+	std::vector<JsonValue> gItems;			// Array elements, or object member values
+	std::vector<std::string> gKeys;			// Object member names, parallel to gItems
+
+public:
+	static bool Parse(const char* text, size_t length, JsonValue& root, std::string& error);
+
+	bool IsArray() const { return gType == JSON_ARRAY; }
+	bool IsObject() const { return gType == JSON_OBJECT; }
+	size_t Size() const { return gItems.size(); }
+	const JsonValue& operator[](size_t index) const { return gItems[index]; }
+
+	const JsonValue* Find(const char* key) const;
+
+	// Member lookups that fall back to a default when the member is missing or of another type
+	double Number(const char* key, double fallback) const;
+	int Int(const char* key, int fallback) const;
+	bool Bool(const char* key, bool fallback) const;
+	const char* String(const char* key, const char* fallback) const;
+};
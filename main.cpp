@@ -1,5 +1,10 @@
 #include <iostream>         // cout, cerr
 #include <cstdlib>          // EXIT_FAILURE
+#include <cstring>          // strcmp
+#include <cfloat>           // FLT_MAX
+#include <algorithm>        // count
+#include <chrono>           // pick timing
+#include <map>              // imported models
 #include <GL/glew.h>        // GLEW library
 #include <GLFW/glfw3.h>     // GLFW library
 #include "glm/glm.hpp"
@@ -7,6 +12,28 @@
 
 
 #include "meshes.h"
+#include "arena.h"
+#include "bvh.h"
+#include "commands.h"
+#include "culling.h"
+#include "framepacing.h"
+#include "gltfloader.h"
+#include "gpuculling.h"
+#include "gpumemory.h"
+#include "gpuresources.h"
+#include "jobs.h"
+#include "objloader.h"
+#include "occlusion.h"
+#include "picking.h"
+#include "scene.h"
+#include "samplers.h"
+#include "shadercache.h"
+#include "shadervariants.h"
+#include "shaderwatch.h"
+#include "simulation.h"
+#include "spatialhash.h"
+#include "streambuffer.h"
+#include "texturestreaming.h"
 
 #include "camera.h" // Camera class
 
@@ -26,20 +53,43 @@ namespace
     const int WINDOW_WIDTH = 800;
     const int WINDOW_HEIGHT = 600;
 
-    // Stores the GL data relative to a given mesh
-    struct GLMesh
+    // How to draw a mesh that the scene file refers to by name
+    struct MeshDraw
     {
-        GLuint vao;     // Handle for the vertex array object
-        GLuint vbo;     // Handle for the vertex buffer object
-        GLuint nvertices;   // Number of vertices of the mesh
+        GLuint vao;         // Vertex array object of the mesh; its attributes are read back for the bounds
+        GLuint ebo;         // Index buffer
+        GLsizei nVertices;  // Vertices the attributes of the VAO cover
+        GLsizei nIndices;   // Index count, restart indices included
+        GLenum mode;        // GL_TRIANGLES or GL_TRIANGLE_STRIP, drawn with one glDrawElements call
+    };
+
+    // One object of an imported model: a primitive of one of its mesh nodes
+    struct ModelPart
+    {
+        std::string name;       // Node name, with the primitive number if the mesh has several
+        std::string mesh;       // Key into gModelMeshes
+        int material;           // Index into gScene.gMaterials
+        glm::mat4 transform;    // Relative to the model's origin
     };
 
     // Main GLFW window
     GLFWwindow* gWindow = nullptr;
     // Triangle mesh data
-    GLMesh gMesh;
-    // Shader program
-    GLuint gProgramId;
+    Meshes::GLMesh gMesh;
+    // Scene loaded from the scene file, and the GL resources its names resolve to
+    Scene gScene;
+    std::vector<MeshDraw> gSceneMeshes;
+    std::vector<AABB> gSceneMeshBounds;
+    std::vector<unsigned char> gSceneMeshOccluders;    // Solid boxes that can hide other objects
+    std::vector<float> gSceneMeshUvDensity;            // Texture coordinate units per unit of mesh surface
+    std::vector<TextureHandle> gSceneTextures;
+    std::vector<int> gSceneTextureStreams;             // Index in gTextureStreamer, -1 for textures resident from the start
+    // glTF files the scene's models use, imported once each, and the meshes they hold
+    std::map<std::string, std::vector<ModelPart>> gModelParts;     // By file name
+    std::map<std::string, MeshDraw> gModelMeshes;                  // By "<file>#<primitive>"
+    // Program each material is drawn with this frame, and its instanced version (0 while building)
+    std::vector<GLuint> gMaterialPrograms;
+    std::vector<GLuint> gMaterialInstancedPrograms;
 }
 
 double scrollY = 0.0f;
@@ -55,16 +105,15 @@ bool gFirstMouse = true;
 bool Increase = 0;
 bool Decrease = 0;
 
+// Input gathered this frame for the simulation
+SimulationInput gFrameInput;
+
 
 // timing
 float gDeltaTime = 0.0f; // time between current frame and last frame
-float gLastFrame = 0.0f;
-
+double gLastFrame = 0.0;
 
 
-unsigned int TextureId;
-unsigned int TextureId2;
-unsigned int TextureId3;
 
 /* User-defined Function prototypes to:
  * initialize the program, set the window size,
@@ -76,107 +125,106 @@ void UResizeWindow(GLFWwindow* window, int width, int height);
 void UProcessInput(GLFWwindow* window);
 void UMousePositionCallback(GLFWwindow* window, double xpos, double ypos);
 void UMouseScrollCallback(GLFWwindow* window, double xoffset, double yoffset);
-void UMouseButtonCallback(GLFWwindow* window, int button, int action, int mods); void UCreateMesh(GLMesh& mesh);
-void UDestroyMesh(GLMesh& mesh);
+void UMouseButtonCallback(GLFWwindow* window, int button, int action, int mods); void UCreateMesh(Meshes::GLMesh& mesh);
 void URender();
-bool UCreateShaderProgram(const char* vtxShaderSource, const char* fragShaderSource, GLuint& programId);
-void UDestroyShaderProgram(GLuint programId);
-bool UCreateTexture(const char* filename, GLuint& textureId);
-void UDestroyTexture(GLuint textureId);
+bool UReloadShaders(const std::vector<std::string>& changed);
+bool UFindMesh(const std::string& name, MeshDraw& draw);
+bool ULoadObjMesh(const std::string& filename, MeshDraw& draw);
+bool UImportModels();
+bool UImportGltf(const std::string& filename, std::vector<ModelPart>& parts);
+void UUseProgram(GLuint programId, int lightCount);
+void UBindProgram(GLuint programId);
+void UBindInstancedMaterial(int material);
+void URecordObject(unsigned int object, const glm::vec3& cameraPosition);
+void UDestroyTexture(TextureHandle texture);
+void URequestTextures();
+void UReadMeshVertices(const MeshDraw& draw, std::vector<GLfloat>& verts);
+AABB UMeshBounds(const MeshDraw& draw);
+void UReadMeshTriangles(const MeshDraw& draw, std::vector<GLfloat>& verts, std::vector<GLuint>& indices);
+void UBuildMeshRaycaster(const MeshDraw& draw, MeshRaycaster& raycaster);
+float UMeshUvDensity(const MeshDraw& draw);
+void UPickObject(GLFWwindow* window);
+
+
+
+
+// Shader sources, loaded from disk at startup and reloaded whenever they change
+const char* const VERTEX_SHADER_FILE = "shaders/phong.vert";
+const char* const FRAGMENT_SHADER_FILE = "shaders/phong.frag";
+const char* const CULLING_SHADER_FILE = "shaders/cull.comp";
+
+// Scene drawn when none is given on the command line
+const char* const DEFAULT_SCENE_FILE = "scenes/desk.scene";
+
+// Imports per file for --obj-benchmark
+const int OBJ_BENCHMARK_RUNS = 5;
 
+Meshes Objects;
 
+Samplers gSamplers;
 
+ShaderCache gShaderCache;
 
-// Vertex Shader Program Source Code
-const char* vertexShaderSource = R"(
-  #version 400 core
-  layout (location = 0) in vec3 aPos;
-  layout (location = 1) in vec3 normal;
-  layout (location = 2) in vec2 Tex;
-       
+ShaderVariants gShaderVariants;
 
-  out vec2 TexCoord;
-  uniform mat4 Proj;
-  uniform mat4 Model;
-  uniform mat4 View;
+ShaderWatcher gShaderWatcher;
 
-out vec3 vertexNormal; // For incoming normals
-out vec3 vertexFragmentPos; // For outgoing color / pixels to fragment shader
+JobSystem gJobs;
 
+Culling gCulling;
+BVH gSceneBVH;       // Over gCulling.gWorldBounds; refitted as objects move
 
-  void main()
-  {
-     TexCoord = vec2(Tex);
-     gl_Position = Proj * View * Model * vec4(aPos.x, aPos.y, aPos.z, 1.0);
-	 
-     vertexNormal = mat3(transpose(inverse(Model))) * normal; // get normal vectors in world space only and exclude normal translation properties
-	 
-     vertexFragmentPos = vec3(Model * vec4(aPos, 1.0f)); // Gets fragment / pixel position in world space only (exclude view and projection)
-}
-)";
+// Click to select: rays against the objects in gSceneBVH, then the triangles of their meshes
+Picking gPicking;
+int gSelectedObject = -1;
 
+// Objects filed by grid cell, kept up to date as they move, for neighborhood queries
+SpatialHash gSpatialHash;
+const float SPATIAL_HASH_CELL_SIZE = 2.0f;
+const float NEIGHBORHOOD_RADIUS = 1.5f;
 
-// Fragment Shader Program Source Code
-const char* fragmentShaderSource = R"(#version 400 core
-out vec4 FragColor;
-  in vec2 TexCoord;
+OcclusionCuller gOcclusion;
+bool gOcclusionCulling = true;
 
- uniform sampler2D m_texture;
+// Optional GPU-driven path for the scene's meshes
+GpuCulling gGpuCulling;
+bool gGpuCullingEnabled = false;
+bool gGpuCullingValidate = false;
 
-uniform vec3 color;
+CommandQueue gCommands;
 
-in vec3 vertexNormal; // For incoming normals
-in vec3 vertexFragmentPos; // For incoming fragment position
+Simulation gSimulation;
 
-// Uniform / Global variables for  light color, light position, and camera/view position
+FramePacer gFramePacer;
 
-uniform vec3 lightColor;
+// Per-frame instance data (model matrices of instanced draws)
+StreamBuffer gStreamBuffer;
+const GLsizeiptr STREAM_BUFFER_REGION_SIZE = 4 * 1024 * 1024;
 
-uniform vec3 lightPos;
+// Memory for data that lives one frame (the recorded draw commands), one arena per job thread
+FrameArenas gFrameArenas;
+const size_t FRAME_ARENA_SIZE = 256 * 1024;
 
-uniform vec3 viewPosition;
+// GL objects behind generation-checked handles; deleted once the GPU is done with them
+GpuResources gGpuResources;
+MeshHandle gMeshHandle;
+std::vector<MeshHandle> gBuiltInMeshes;       // Objects' primitives, in the order of Meshes' members
+std::vector<MeshHandle> gImportedMeshes;      // Meshes read from files the scene names
+std::vector<BufferHandle> gImportedBuffers;   // Vertex data shared by several imported meshes
 
-vec3 phongLight(vec3 mlightColor, vec3 mlightPosition)
-{
-	/*Phong lighting model calculations to generate ambient, diffuse, and specular components*/
-
-   //Calculate Ambient lighting*/
-	float ambientStrength = 0.1f; // Set ambient or global lighting strength
-	vec3 ambient = ambientStrength * mlightColor; // Generate ambient light color
-
-	//Calculate Diffuse lighting*/
-	vec3 norm = normalize(vertexNormal); // Normalize vectors to 1 unit
-	vec3 lightDirection = normalize(mlightPosition - vertexFragmentPos); // Calculate distance (light direction) between light source and fragments/pixels on cube
-	float impact = max(dot(norm, lightDirection), 0.0);// Calculate diffuse impact by generating dot product of normal and light
-	vec3 diffuse = impact * mlightColor; // Generate diffuse light color
-
-	//Calculate Specular lighting*/
-	float specularIntensity = 0.8f; // Set specular light strength
-	float highlightSize = 16.0f; // Set specular highlight size
-	vec3 viewDir = normalize(viewPosition - vertexFragmentPos); // Calculate view direction
-	vec3 reflectDir = reflect(-lightDirection, norm);// Calculate reflection vector
-	//Calculate specular component
-	float specularComponent = pow(max(dot(viewDir, reflectDir), 0.0), highlightSize);
-	vec3 specular = specularIntensity * specularComponent * mlightColor;
-
-	// Calculate phong result
-	vec3 phong = (ambient + diffuse + specular);
-	return phong;
-}
+// Sizes of the buffers and textures above; --gpu-budget=MB sheds texture mip levels to stay under it
+GpuMemory gGpuMemory;
 
-void main()
-{
-    vec3 phong = phongLight(lightColor, lightPos);
-    FragColor = vec4(phong, 1.0f) * texture(m_texture, TexCoord);
-}
-)";
+// Scene textures start with their small mip levels; finer ones are streamed in as objects come close
+TextureStreamer gTextureStreamer;
+const size_t TEXTURE_UPLOAD_BUDGET = 4 * 1024 * 1024;     // Bytes of mip levels uploaded per frame
 
-glm::vec3 KeyLightColor(1.0f, 1.0f, 0.6f);
+// --check-allocations: report frames that still allocate from the heap once warmed up
+bool gCheckAllocations = false;
+const unsigned int ALLOCATION_CHECK_WARMUP_FRAMES = 300;
+const unsigned int ALLOCATION_CHECK_MAX_WARNINGS = 10;
 
-// Light position and scale
-glm::vec3 KeyLightPos(1.6f, 5.45f, 3.2f);
-
-Meshes Objects;
+glm::mat4 gProjection;
 
 int Ploc;
 int MMloc;
@@ -188,41 +236,197 @@ int main(int argc, char* argv[])
     if (!UInitialize(argc, argv, &gWindow))
         return EXIT_FAILURE;
 
+    // Worker threads for the per-frame CPU work (transforms, culling)
+    gJobs.Initialize();
+    gFrameArenas.Initialize(gJobs.ThreadCount(), FRAME_ARENA_SIZE);
+
+    // Linked program binaries are reused across launches
+    gShaderCache.Initialize("shadercache");
+
     // Create the mesh
     UCreateMesh(gMesh); // Calls the function to create the Vertex Buffer Object
+    gMeshHandle = gGpuResources.AddMesh(gMesh.vao, gMesh.vbos[0], gMesh.vbos[1]);
 
     Objects.CreateMeshes();
 
-    // Create the shader program
-    UCreateShaderProgram(vertexShaderSource, fragmentShaderSource, gProgramId);
+    gGpuMemory.Initialize(&gGpuResources);
+    gTextureStreamer.Initialize(&gGpuResources, &gGpuMemory, TEXTURE_UPLOAD_BUDGET);
+    gGpuMemory.TrackBuffer(gMesh.vbos[0], MEMORY_MESHES);
+    gGpuMemory.TrackBuffer(gMesh.vbos[1], MEMORY_MESHES);
+    const Meshes::GLMesh* builtInMeshes[] = { &Objects.gBoxMesh, &Objects.gConeMesh, &Objects.gCylinderMesh,
+        &Objects.gTaperedCylinderMesh, &Objects.gPlaneMesh, &Objects.gPrismMesh, &Objects.gSphereMesh,
+        &Objects.gPyramid3Mesh, &Objects.gPyramid4Mesh, &Objects.gTorusMesh };
+    for (const Meshes::GLMesh* mesh : builtInMeshes)
+    {
+        gBuiltInMeshes.push_back(gGpuResources.AddMesh(mesh->vao, mesh->vbos[0], mesh->vbos[1]));
+        gGpuMemory.TrackBuffer(mesh->vbos[0], MEMORY_MESHES);
+        gGpuMemory.TrackBuffer(mesh->vbos[1], MEMORY_MESHES);
+    }
+
+    gSamplers.CreateSamplers();
+
+    gStreamBuffer.Initialize(STREAM_BUFFER_REGION_SIZE);
+    gGpuMemory.TrackBuffer(gStreamBuffer.Buffer(), MEMORY_STREAMING);
+
+    // Command line: [options] [scene file]
+    const char* sceneFilename = DEFAULT_SCENE_FILE;
+    bool simulationThread = false;
+    FramePacer::VsyncMode vsync = FramePacer::VSYNC_ON;
+    double fpsCap = 0.0;
+    int maxFramesAhead = 2;
+    const char* objBenchmark = nullptr;
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "--sim-thread") == 0)
+            simulationThread = true;
+        else if (strcmp(argv[i], "--no-occlusion") == 0)
+            gOcclusionCulling = false;
+        else if (strcmp(argv[i], "--gpu-cull") == 0)
+            gGpuCullingEnabled = true;
+        else if (strcmp(argv[i], "--gpu-cull-validate") == 0)
+            gGpuCullingEnabled = gGpuCullingValidate = true;
+        else if (strcmp(argv[i], "--check-allocations") == 0)
+        {
+            gCheckAllocations = HeapAllocationCountingEnabled();
+            if (!gCheckAllocations)
+                cout << "WARNING: --check-allocations is unavailable; heap allocations are only counted in builds that define OPENGL3D_COUNT_ALLOCATIONS" << endl;
+        }
+        else if (strncmp(argv[i], "--gpu-budget=", 13) == 0)
+            gGpuMemory.SetBudget((size_t)atoi(argv[i] + 13) * 1024 * 1024);
+        else if (strncmp(argv[i], "--obj-benchmark=", 16) == 0)
+            objBenchmark = argv[i] + 16;
+        else if (strncmp(argv[i], "--vsync=", 8) == 0)
+        {
+            if (!FramePacer::FindVsyncMode(argv[i] + 8, vsync))
+                cout << "WARNING: Unknown vsync mode " << argv[i] + 8 << " (off, on or adaptive)" << endl;
+        }
+        else if (strncmp(argv[i], "--fps-cap=", 10) == 0)
+            fpsCap = atof(argv[i] + 10);
+        else if (strncmp(argv[i], "--max-frames-ahead=", 19) == 0)
+            maxFramesAhead = atoi(argv[i] + 19);
+        else if (strncmp(argv[i], "--", 2) == 0)
+            cout << "WARNING: Unknown option " << argv[i] << endl;
+        else
+            sceneFilename = argv[i];
+    }
 
-    // Load texture
-    const char* texFilename = "images.jpg";
-    if (!UCreateTexture(texFilename, TextureId))
+    if (objBenchmark)
     {
-        cout << "Failed to load texture " << texFilename << endl;
+        ObjLoader::Benchmark(objBenchmark, &gJobs, OBJ_BENCHMARK_RUNS);
+        return EXIT_SUCCESS;
+    }
+
+    // Load the scene description and resolve the meshes and textures it names
+    if (!gScene.Load(sceneFilename))
+        return EXIT_FAILURE;
+
+    // Scenes without lights keep the original key light
+    if (gScene.gLights.empty())
+        gScene.gLights.push_back({ glm::vec3(1.6f, 5.45f, 3.2f), glm::vec3(1.0f, 1.0f, 0.6f) });
+
+    if (gScene.gLights.size() > MAX_SHADER_LIGHTS)
+    {
+        cout << "WARNING: Only the first " << MAX_SHADER_LIGHTS << " lights are used" << endl;
+        gScene.gLights.resize(MAX_SHADER_LIGHTS);
+    }
+
+    if (!UImportModels())
         return EXIT_FAILURE;
+
+    gSceneMeshes.resize(gScene.gMeshNames.size());
+    gSceneMeshBounds.resize(gScene.gMeshNames.size());
+    gSceneMeshOccluders.resize(gScene.gMeshNames.size());
+    gSceneMeshUvDensity.resize(gScene.gMeshNames.size());
+    for (size_t i = 0; i < gScene.gMeshNames.size(); i++)
+    {
+        if (!UFindMesh(gScene.gMeshNames[i], gSceneMeshes[i]))
+        {
+            cout << "Unknown mesh " << gScene.gMeshNames[i] << " in " << sceneFilename << endl;
+            return EXIT_FAILURE;
+        }
+        gSceneMeshBounds[i] = UMeshBounds(gSceneMeshes[i]);
+        gSceneMeshOccluders[i] = gScene.gMeshNames[i] == "box";
+        gSceneMeshUvDensity[i] = UMeshUvDensity(gSceneMeshes[i]);
     }
 
-    texFilename = "screen.jpg";
-    if (!UCreateTexture(texFilename, TextureId2))
+    // Triangle BVHs for picking; raycasters are built in place, as they must not move afterwards
+    gPicking.gMeshes.resize(gSceneMeshes.size());
+    for (size_t i = 0; i < gSceneMeshes.size(); i++)
+        UBuildMeshRaycaster(gSceneMeshes[i], gPicking.gMeshes[i]);
+
+    // Start streaming the textures; only their headers are read here. Those of the models are set up already.
+    gSceneTextures.resize(gScene.gTextureFiles.size());
+    gSceneTextureStreams.resize(gScene.gTextureFiles.size(), -1);
+    for (size_t i = 0; i < gScene.gTextureFiles.size(); i++)
     {
-        cout << "Failed to load texture " << texFilename << endl;
+        if (!gSceneTextures[i].IsNull())
+            continue;
+
+        const char* texFilename = gScene.gTextureFiles[i].c_str();
+        gSceneTextureStreams[i] = (int)gTextureStreamer.Count();
+        if (!gTextureStreamer.Add(texFilename, gSceneTextures[i]))
+        {
+            cout << "Failed to load texture " << texFilename << endl;
+            return EXIT_FAILURE;
+        }
+    }
+    gGpuMemory.Report();
+
+    // Create the shader programs: every variant the scene's materials use is submitted up
+    // front so the builds overlap, then we wait for them before the first frame
+    std::string vertexShaderSource, fragmentShaderSource;
+    if (!ShaderWatcher::ReadFile(VERTEX_SHADER_FILE, vertexShaderSource) ||
+        !ShaderWatcher::ReadFile(FRAGMENT_SHADER_FILE, fragmentShaderSource))
+    {
+        cout << "Failed to load shaders " << VERTEX_SHADER_FILE << ", " << FRAGMENT_SHADER_FILE << endl;
         return EXIT_FAILURE;
     }
 
-    texFilename = "handle.jpg";
-    if (!UCreateTexture(texFilename, TextureId3))
+    if (!gShaderVariants.Initialize(gWindow, vertexShaderSource.c_str(), fragmentShaderSource.c_str(), &gShaderCache,
+            &gGpuResources))
+        return EXIT_FAILURE;
+
+    const int lightCount = (int)gScene.gLights.size();
+    gShaderVariants.Prefetch(SHADER_TEXTURED | SHADER_LIT, lightCount);
+    for (const Scene::Material& material : gScene.gMaterials)
     {
-        cout << "Failed to load texture " << texFilename << endl;
+        gShaderVariants.Prefetch(material.features, lightCount);
+        gShaderVariants.Prefetch(material.features | SHADER_INSTANCED, lightCount);
+    }
+
+    // The textured + lit variant stands in for any variant that is still building
+    if (!gShaderVariants.GetBlocking(SHADER_TEXTURED | SHADER_LIT, lightCount))
         return EXIT_FAILURE;
+    for (const Scene::Material& material : gScene.gMaterials)
+        gShaderVariants.GetBlocking(material.features, lightCount);
+
+    // Meshes are culled and drawn from GPU-written indirect commands, with the instanced variants
+    if (gGpuCullingEnabled)
+    {
+        std::string cullingShaderSource;
+        gGpuCullingEnabled = ShaderWatcher::ReadFile(CULLING_SHADER_FILE, cullingShaderSource) &&
+            gGpuCulling.Initialize(cullingShaderSource.c_str(), &gGpuResources);
     }
+    if (gGpuCullingEnabled)
+    {
+        std::vector<GLuint> meshVaos;
+        std::vector<GLsizei> meshIndexCounts;
+        std::vector<GLenum> meshModes;
+        for (const MeshDraw& draw : gSceneMeshes)
+        {
+            meshVaos.push_back(draw.vao);
+            meshIndexCounts.push_back(draw.nIndices);
+            meshModes.push_back(draw.mode);
+        }
+        gGpuCulling.SetObjects(gScene.gObjectMesh, gScene.gObjectMaterial, gSceneMeshBounds, meshVaos, meshIndexCounts,
+            meshModes);
 
-    // tell opengl for each sampler to which texture unit it belongs to (only has to be done once)
-    glUseProgram(gProgramId);
-    glBindTexture(GL_TEXTURE_2D, TextureId);
-    // We set the texture as texture unit 0
-    glUniform1i(glGetUniformLocation(gProgramId, "m_texture"), 0);
+        for (const Scene::Material& material : gScene.gMaterials)
+            gShaderVariants.GetBlocking(material.features | SHADER_INSTANCED, lightCount);
+    }
+
+    // Edits to the shader files are picked up while running
+    gShaderWatcher.Initialize("shaders");
 
     // Sets the background color of the window to black (it will be implicitely used by glClear)
     glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
@@ -230,29 +434,31 @@ int main(int argc, char* argv[])
     // render loop
     // -----------
 
-    glm::mat4  Projection = glm::infinitePerspective(glm::radians(45.0f), 1280.0f / 720.0f, 0.1f);
-    glm::mat4 View = glm::lookAt(glm::vec3(0.0f, 4.0f, -20.0f), glm::vec3(0.0f, 1.0f, 0.0f), glm::vec3(0.0f, 1.0f, 0.0f));
-    glm::mat4 model = glm::rotate(glm::mat4(1.0f), glm::radians(45.0f), glm::vec3(0.0, 1.0f, 0.0f));
+    gProjection = glm::infinitePerspective(glm::radians(45.0f), 1280.0f / 720.0f, 0.1f);
 
-    // glm::mat4  Projection = glm::infinitePerspective(glm::radians(45.0f), 1280.0f / 720.0f, 0.1f);
-    // glm::mat4 View = glm::lookAt(glm::vec3(0.0f, -2.0f, -4.0f), glm::vec3(0.0f, -1.0f, 0.0f), glm::vec3(0.0f, 1.0f, 0.0f))
-    //     glm::mat4 model = glm::rotate(glm::mat4(1.0f), glm::radians(45.0f), glm::vec3(0.0, 1.0f, 0.0f));
+    gFramePacer.Initialize(vsync, fpsCap, maxFramesAhead);
 
-    Ploc = glGetUniformLocation(gProgramId, "Proj");
-    MMloc = glGetUniformLocation(gProgramId, "Model");
-    Vloc = glGetUniformLocation(gProgramId, "View");
+    // Camera and transforms advance in fixed steps from here on; the frames draw a blend of the last two
+    gSpatialHash.Initialize(SPATIAL_HASH_CELL_SIZE);
 
-    glUniformMatrix4fv(Ploc, 1, false, &Projection[0][0]);
-    glUniformMatrix4fv(MMloc, 1, false, &model[0][0]);
-    glUniformMatrix4fv(Vloc, 1, false, &View[0][0]);
+    gLastFrame = glfwGetTime();
+    gSimulation.Initialize(gCamera, gScene.gTransforms, gLastFrame, simulationThread);
 
+    unsigned int frameNumber = 0;
+    unsigned int allocatingFrames = 0;
+    unsigned long long frameAllocations = 0;
+    std::vector<std::string> changedShaders;
     while (!glfwWindowShouldClose(gWindow))
     {
+        const unsigned long long allocationsBefore = HeapAllocationCount();
+
+        // Wait for the frame cap and for the GPU to catch up before sampling input
+        gFramePacer.BeginFrame();
 
         // per-frame timing
         // --------------------
-        float currentFrame = glfwGetTime();
-        gDeltaTime = currentFrame - gLastFrame;
+        double currentFrame = glfwGetTime();
+        gDeltaTime = (float)(currentFrame - gLastFrame);
         gLastFrame = currentFrame;
 
 
@@ -260,27 +466,120 @@ int main(int argc, char* argv[])
         // -----
         UProcessInput(gWindow);
 
-        if (Increase)
+        // Run the simulation ticks that are due (the simulation thread runs its own),
+        // then place the camera and objects between the last two simulated states
+        float alpha = gSimulation.Advance(currentFrame);
+        gSimulation.Interpolate(alpha, gCamera, gScene.gTransforms);
+
+        // Rebuild shaders edited on disk; Poll() swaps the new programs in once they link
+        if (gShaderWatcher.Poll(currentFrame, changedShaders))
+            UReloadShaders(changedShaders);
+
+        // Recompute world matrices of anything that moved, then find what the camera sees:
+        // objects in the view frustum, minus those hidden behind large boxes
+        gScene.gTransforms.Update(&gJobs);
+        const glm::mat4 viewProjection = gProjection * gCamera.GetViewMatrix();
+        gCulling.Update(gScene.gTransforms.gWorld, gScene.gObjectMesh, gSceneMeshBounds, viewProjection, &gJobs,
+            &gSceneBVH, &gScene.gTransforms.LastUpdated());
+        if (gGpuCullingEnabled)
         {
-            gCamera.MovementSpeed += 0.75f;
+            gGpuCulling.Cull(gScene.gTransforms.gWorld, gScene.gTransforms.LastUpdated(), gCulling.gFrustum);
+            if (gGpuCullingValidate)
+                gGpuCulling.Validate(gCulling.gVisible);
         }
-
-        else if (Decrease)
+        // Only objects whose transform was recomputed can change cells; every object goes in on the first fill
+        if (gSpatialHash.Count() != gScene.ObjectCount())
         {
-            gCamera.MovementSpeed -= 0.75f;
+            for (unsigned int i = 0; i < (unsigned int)gScene.ObjectCount(); i++)
+                gSpatialHash.Update((int)i, gCulling.gWorldBounds[i]);
         }
+        else
+        {
+            for (const int transform : gScene.gTransforms.LastUpdated())
+                if (transform < (int)gScene.ObjectCount())
+                    gSpatialHash.Update(transform, gCulling.gWorldBounds[transform]);
+        }
+
+        // The GPU-drawn objects ignore occlusion, and the pass visits every object
+        if (gOcclusionCulling && !gGpuCullingEnabled)
+            gOcclusion.Cull(viewProjection, gScene.gTransforms.gWorld, gScene.gObjectMesh, gSceneMeshBounds,
+                gSceneMeshOccluders, gCulling, &gJobs);
+
+        // Pick up shader variants finished in the background
+        gShaderVariants.Poll();
+
+        // Stream in the mip levels the visible objects need, then keep within the memory budget
+        URequestTextures();
+        gTextureStreamer.Update();
+        gGpuMemory.Enforce();
 
         // Render this frame
         URender();
+        gGpuResources.EndFrame();
+        gFramePacer.EndFrame();
 
         glfwPollEvents();
+
+        // Everything recorded this frame has been consumed
+        gFrameArenas.Reset();
+
+        frameNumber++;
+        if (gCheckAllocations && frameNumber > ALLOCATION_CHECK_WARMUP_FRAMES)
+        {
+            const unsigned long long allocations = HeapAllocationCount() - allocationsBefore;
+            if (allocations)
+            {
+                if (allocatingFrames < ALLOCATION_CHECK_MAX_WARNINGS)
+                    cout << "WARNING: Frame " << frameNumber << " made " << allocations << " heap allocations" << endl;
+                allocatingFrames++;
+                frameAllocations += allocations;
+            }
+        }
     }
 
-    // Release mesh data
-    UDestroyMesh(gMesh);
+    if (gCheckAllocations && frameNumber > ALLOCATION_CHECK_WARMUP_FRAMES)
+        cout << "INFO: Allocation check: " << allocatingFrames << " of " << frameNumber - ALLOCATION_CHECK_WARMUP_FRAMES
+            << " frames after warm-up allocated (" << frameAllocations << " allocations)" << endl;
+    gFrameArenas.Report();
+    gGpuMemory.Report();
+    gTextureStreamer.Report();
+
+    gSimulation.Shutdown();
+    gFramePacer.Shutdown();
 
-    // Release shader program
-    UDestroyShaderProgram(gProgramId);
+    // Release mesh data
+    gGpuResources.Destroy(gMeshHandle);
+    for (MeshHandle mesh : gBuiltInMeshes)
+        gGpuResources.Destroy(mesh);
+    gBuiltInMeshes.clear();
+    for (MeshHandle mesh : gImportedMeshes)
+        gGpuResources.Destroy(mesh);
+    gImportedMeshes.clear();
+    for (BufferHandle buffer : gImportedBuffers)
+        gGpuResources.Destroy(buffer);
+    gImportedBuffers.clear();
+
+    // Release textures
+    gTextureStreamer.Shutdown();
+    for (TextureHandle texture : gSceneTextures)
+        UDestroyTexture(texture);
+    gSceneTextures.clear();
+
+    // Release shader programs
+    gShaderWatcher.Shutdown();
+    gShaderVariants.Shutdown();
+    gGpuCulling.Shutdown();
+
+    // Everything destroyed above that may still be in flight
+    gGpuResources.Shutdown();
+
+    // Release sampler objects
+    gSamplers.DestroySamplers();
+
+    gStreamBuffer.Shutdown();
+
+    gFrameArenas.Shutdown();
+    gJobs.Shutdown();
 
     exit(EXIT_SUCCESS); // Terminates the program successfully
 }
@@ -340,6 +639,15 @@ bool UInitialize(int argc, char* argv[], GLFWwindow** window)
     // Displays GPU OpenGL version
     cout << "INFO: OpenGL Version: " << glGetString(GL_VERSION) << endl;
 
+    // Strip meshes separate their strips with the all-ones index
+    if (GLEW_VERSION_4_3 || GLEW_ARB_ES3_compatibility)
+        glEnable(GL_PRIMITIVE_RESTART_FIXED_INDEX);
+    else
+    {
+        glEnable(GL_PRIMITIVE_RESTART);
+        glPrimitiveRestartIndex(MeshOptimizer::RESTART_INDEX);
+    }
+
     return true;
 }
 
@@ -353,19 +661,27 @@ void UProcessInput(GLFWwindow* window)
     if (glfwGetKey(window, GLFW_KEY_ESCAPE) == GLFW_PRESS)
         glfwSetWindowShouldClose(window, true);
 
+    // Movement is applied by the simulation ticks, scaled by the fixed timestep
+    gFrameInput.movement = 0;
     if (glfwGetKey(window, GLFW_KEY_W) == GLFW_PRESS)
-        gCamera.ProcessKeyboard(FORWARD, gDeltaTime);
+        gFrameInput.movement |= 1u << FORWARD;
     if (glfwGetKey(window, GLFW_KEY_S) == GLFW_PRESS)
-        gCamera.ProcessKeyboard(BACKWARD, gDeltaTime);
+        gFrameInput.movement |= 1u << BACKWARD;
     if (glfwGetKey(window, GLFW_KEY_A) == GLFW_PRESS)
-        gCamera.ProcessKeyboard(LEFT, gDeltaTime);
+        gFrameInput.movement |= 1u << LEFT;
     if (glfwGetKey(window, GLFW_KEY_D) == GLFW_PRESS)
-        gCamera.ProcessKeyboard(RIGHT, gDeltaTime);
+        gFrameInput.movement |= 1u << RIGHT;
     if (glfwGetKey(window, GLFW_KEY_Q) == GLFW_PRESS)
-        gCamera.ProcessKeyboard(UP, gDeltaTime);
+        gFrameInput.movement |= 1u << UP;
     if (glfwGetKey(window, GLFW_KEY_E) == GLFW_PRESS)
-        gCamera.ProcessKeyboard(DOWN, gDeltaTime);
+        gFrameInput.movement |= 1u << DOWN;
+
+    // The scroll wheel ramps the movement speed up or down, per second
+    gFrameInput.speedChange = Increase ? 1 : Decrease ? -1 : 0;
 
+    gSimulation.SetInput(gFrameInput);
+    gFrameInput.lookX = 0.0f;
+    gFrameInput.lookY = 0.0f;
 }
 
 
@@ -393,7 +709,9 @@ void UMousePositionCallback(GLFWwindow* window, double xpos, double ypos)
     gLastX = xpos;
     gLastY = ypos;
 
-    gCamera.ProcessMouseMovement(xoffset, yoffset);
+    // Applied to the camera by the next simulation tick
+    gFrameInput.lookX += xoffset;
+    gFrameInput.lookY += yoffset;
 }
 
 
@@ -428,6 +746,8 @@ void UMouseButtonCallback(GLFWwindow* window, int button, int action, int mods)
     {
     case GLFW_MOUSE_BUTTON_LEFT:
     {
+        if (action == GLFW_PRESS)
+            UPickObject(window);
     }
     break;
 
@@ -439,7 +759,8 @@ void UMouseButtonCallback(GLFWwindow* window, int button, int action, int mods)
 
     case GLFW_MOUSE_BUTTON_RIGHT:
     {
-        
+        if (action == GLFW_PRESS)
+            gSelectedObject = -1;
     }
     break;
 
@@ -460,265 +781,688 @@ void URender()
     glDepthFunc(GL_LEQUAL);
     glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
-    glUseProgram(gProgramId);
+    const int lightCount = (int)gScene.gLights.size();
+    const GLuint fallbackProgramId = gShaderVariants.Get(SHADER_TEXTURED | SHADER_LIT, lightCount);
 
+    // Programs are looked up here, since building a missing variant needs the GL thread.
+    // Variants still building fall back to the textured + lit program.
+    gMaterialPrograms.resize(gScene.gMaterials.size());
+    gMaterialInstancedPrograms.resize(gScene.gMaterials.size());
+    for (size_t m = 0; m < gScene.gMaterials.size(); m++)
+    {
+        const unsigned int features = gScene.gMaterials[m].features;
+        GLuint programId = gShaderVariants.Get(features, lightCount);
+        gMaterialPrograms[m] = programId ? programId : fallbackProgramId;
+        gMaterialInstancedPrograms[m] = programId ? gShaderVariants.Get(features | SHADER_INSTANCED, lightCount) : 0;
+    }
 
-    // Reference matrix uniforms from the Cube Shader program for the cub color, light color, light position, and camera position
-    GLint lightColorLoc = glGetUniformLocation(gProgramId, "lightColor");
+    // Record the draws of the visible objects on every job thread (with GPU culling, only
+    // of the objects it leaves to the CPU)...
+    const glm::vec3 cameraPosition = gCamera.Position;
+    gCommands.Begin(gJobs.ThreadCount(), &gFrameArenas);
+    if (gGpuCullingEnabled)
+    {
+        const std::vector<int>& objects = gGpuCulling.CpuDrawnObjects();
+        gJobs.ParallelFor((unsigned int)objects.size(), 64, [&cameraPosition, &objects](unsigned int begin, unsigned int end)
+        {
+            for (unsigned int i = begin; i < end; i++)
+                URecordObject((unsigned int)objects[i], cameraPosition);
+        });
+    }
+    else
+    {
+        gJobs.ParallelFor((unsigned int)gScene.ObjectCount(), 64, [&cameraPosition](unsigned int begin, unsigned int end)
+        {
+            for (unsigned int i = begin; i < end; i++)
+                URecordObject(i, cameraPosition);
+        });
+    }
 
-    GLint lightPositionLoc = glGetUniformLocation(gProgramId, "lightPos");
+    // ...then submit them from this one, sorted to minimize state changes and
+    // with repeated meshes instanced from matrices streamed into gStreamBuffer
+    gStreamBuffer.BeginFrame();
+    gCommands.Execute(gSamplers, UBindProgram, &gStreamBuffer);
+    gStreamBuffer.EndFrame();
 
-    GLint viewPositionLoc = glGetUniformLocation(gProgramId, "viewPosition");
+    // Objects culled on the GPU
+    if (gGpuCullingEnabled)
+        gGpuCulling.Draw(UBindInstancedMaterial);
 
+    // glfw: swap buffers and poll IO events (keys pressed/released, mouse moved etc.)
+    glfwSwapBuffers(gWindow);    // Flips the the back buffer with the front buffer every frame.
+}
 
 
-    glUniform3f(lightColorLoc, KeyLightColor.r, KeyLightColor.g, KeyLightColor.b);
+// Record the draw commands of one object (called from the job threads, so no GL calls)
+void URecordObject(unsigned int object, const glm::vec3& cameraPosition)
+{
+    if (!gCulling.gVisible[object] || (gGpuCullingEnabled && gGpuCulling.IsGpuDrawn(object)))
+        return;
+
+    const int materialIndex = gScene.gObjectMaterial[object];
+    const Scene::Material& material = gScene.gMaterials[materialIndex];
+    const MeshDraw& draw = gSceneMeshes[gScene.gObjectMesh[object]];
+
+    const AABB& bounds = gCulling.gWorldBounds[object];
+    const float depth = glm::length((bounds.min + bounds.max) * 0.5f - cameraPosition);
+
+    DrawCommand command;
+    command.program = gMaterialPrograms[materialIndex];
+    command.instancedProgram = gMaterialInstancedPrograms[materialIndex];
+    command.vao = draw.vao;
+    command.texture = material.texture >= 0 ? gGpuResources.Texture(gSceneTextures[material.texture]) : 0;
+    command.sampler = material.sampler;
+    command.color[0] = material.color.r;
+    command.color[1] = material.color.g;
+    command.color[2] = material.color.b;
+
+    // The selected object is tinted towards yellow
+    if ((int)object == gSelectedObject)
+    {
+        command.color[0] = 0.5f * command.color[0] + 0.5f;
+        command.color[1] = 0.5f * command.color[1] + 0.5f;
+        command.color[2] = 0.5f * command.color[2];
+    }
+    command.model = &gScene.gTransforms.gWorld[object][0][0];
+
+    command.mode = draw.mode;
+    command.first = 0;
+    command.count = draw.nIndices;
+    command.indexed = true;
+    command.key = CommandQueue::MakeKey(command.program, command.texture, command.vao, 0, depth);
+    gCommands.Record(command);
+}
 
-    glUniform3f(lightPositionLoc, KeyLightPos.x, KeyLightPos.y, KeyLightPos.z);
 
-    const glm::vec3 cameraPosition = gCamera.Position;
-    glUniform3f(viewPositionLoc, cameraPosition.x, cameraPosition.y, cameraPosition.z);
+// Re-read the edited shader files: the culling program is relinked at once, the variants
+// are rebuilt in the background when any other shader changed
+bool UReloadShaders(const std::vector<std::string>& changed)
+{
+    bool cullingChanged = false, variantsChanged = false;
+    for (const std::string& path : changed)
+    {
+        if (path == CULLING_SHADER_FILE)
+            cullingChanged = true;
+        else
+            variantsChanged = true;
+    }
 
-    int colorLoc = glGetUniformLocation(gProgramId, "color");
+    if (cullingChanged && gGpuCullingEnabled)
+    {
+        std::string cullingShaderSource;
+        if (!ShaderWatcher::ReadFile(CULLING_SHADER_FILE, cullingShaderSource))
+            cout << "Failed to reload " << CULLING_SHADER_FILE << ", keeping the current program" << endl;
+        else
+            gGpuCulling.Reload(cullingShaderSource.c_str());
+    }
+    if (!variantsChanged)
+        return true;
 
+    std::string vertexShaderSource, fragmentShaderSource;
+    if (!ShaderWatcher::ReadFile(VERTEX_SHADER_FILE, vertexShaderSource) ||
+        !ShaderWatcher::ReadFile(FRAGMENT_SHADER_FILE, fragmentShaderSource))
+    {
+        cout << "Failed to reload shaders, keeping the current programs" << endl;
+        return false;
+    }
 
-    // Set the shader to be used
+    cout << "INFO: Reloading shaders" << endl;
+    gShaderVariants.Reload(vertexShaderSource.c_str(), fragmentShaderSource.c_str());
+    return true;
+}
 
-    glBindTexture(GL_TEXTURE_2D, TextureId);
 
-    glUniformMatrix4fv(Vloc, 1, false, &gCamera.GetViewMatrix()[0][0]);
+// Make a program current and set the uniforms shared by every object drawn with it
+void UUseProgram(GLuint programId, int lightCount)
+{
+    glUseProgram(programId);
 
-    glBindVertexArray(Objects.gBoxMesh.vao);
+    // tell opengl for each sampler to which texture unit it belongs to
+    // We set the texture as texture unit 0
+    glUniform1i(glGetUniformLocation(programId, "m_texture"), 0);
 
-    //Desk
+    Ploc = glGetUniformLocation(programId, "Proj");
+    MMloc = glGetUniformLocation(programId, "Model");
+    Vloc = glGetUniformLocation(programId, "View");
 
-    glm::mat4 model =  glm::scale(glm::mat4(1.0f), glm::vec3(20.0f, 0.125f, 20.0f));
+    glUniformMatrix4fv(Ploc, 1, false, &gProjection[0][0]);
+    glUniformMatrix4fv(Vloc, 1, false, &gCamera.GetViewMatrix()[0][0]);
 
-    glUniformMatrix4fv(MMloc, 1, false, &model[0][0]);
-    glUniform3f(colorLoc, 0.65f, 0.65f, 0.65f);
+    // Reference matrix uniforms for the light colors, light positions, and camera position
+    GLint lightColorLoc = glGetUniformLocation(programId, "lightColor");
+    GLint lightPositionLoc = glGetUniformLocation(programId, "lightPos");
+    GLint viewPositionLoc = glGetUniformLocation(programId, "viewPosition");
 
-    glDrawElements(GL_TRIANGLES, Objects.gBoxMesh.nIndices, GL_UNSIGNED_INT, nullptr);
+    GLfloat lightColors[MAX_SHADER_LIGHTS * 3];
+    GLfloat lightPositions[MAX_SHADER_LIGHTS * 3];
+    for (int i = 0; i < lightCount; i++)
+    {
+        const Scene::Light& light = gScene.gLights[i];
+        lightColors[i * 3 + 0] = light.color.r;
+        lightColors[i * 3 + 1] = light.color.g;
+        lightColors[i * 3 + 2] = light.color.b;
+        lightPositions[i * 3 + 0] = light.position.x;
+        lightPositions[i * 3 + 1] = light.position.y;
+        lightPositions[i * 3 + 2] = light.position.z;
+    }
+    glUniform3fv(lightColorLoc, lightCount, lightColors);
+    glUniform3fv(lightPositionLoc, lightCount, lightPositions);
 
+    const glm::vec3 cameraPosition = gCamera.Position;
+    glUniform3f(viewPositionLoc, cameraPosition.x, cameraPosition.y, cameraPosition.z);
+}
 
-    //Monitor
-    glBindTexture(GL_TEXTURE_2D, TextureId2);
 
-     model = glm::translate(glm::mat4(1.0f), glm::vec3(0.0f, 1.0f, 1.0f)) *
-        glm::scale(glm::mat4(1.0f), glm::vec3(3.0f, 1.6875f, 0.1f));
+// Program switch callback of the command queue
+void UBindProgram(GLuint programId)
+{
+    UUseProgram(programId, (int)gScene.gLights.size());
+}
 
-    glUniformMatrix4fv(MMloc, 1, false, &model[0][0]);
-    glUniform3f(colorLoc, 0.1f, 0.1f, 0.1f);
 
-    glDrawElements(GL_TRIANGLES, Objects.gBoxMesh.nIndices, GL_UNSIGNED_INT, nullptr);
+// Material switch callback of the GPU culling path
+void UBindInstancedMaterial(int material)
+{
+    const Scene::Material& data = gScene.gMaterials[material];
+    const GLuint programId = gMaterialInstancedPrograms[material] ? gMaterialInstancedPrograms[material]
+        : gShaderVariants.Get(data.features | SHADER_INSTANCED, (int)gScene.gLights.size());
+
+    UUseProgram(programId, (int)gScene.gLights.size());
+    glBindTexture(GL_TEXTURE_2D, data.texture >= 0 ? gGpuResources.Texture(gSceneTextures[data.texture]) : 0);
+    gSamplers.Bind(0, data.sampler);
+    glUniform3f(glGetUniformLocation(programId, "color"), data.color.r, data.color.g, data.color.b);
+}
 
-    // Activate the VBOs contained within the mesh's VAO
-    glBindVertexArray(gMesh.vao);
 
-    glBindTexture(GL_TEXTURE_2D, TextureId3);
-    //Cylinders
-    glBindVertexArray(Objects.gCylinderMesh.vao);
+// Map a mesh name used in scene files to the mesh and the draw calls it needs
+bool UFindMesh(const std::string& name, MeshDraw& draw)
+{
+    struct NamedMesh
+    {
+        const char* name;
+        const Meshes::GLMesh* mesh;
+    };
+    // Every built-in mesh is indexed, as a triangle list or as strips
+    const NamedMesh meshes[] = {
+        { "box", &Objects.gBoxMesh },
+        { "cone", &Objects.gConeMesh },
+        { "cylinder", &Objects.gCylinderMesh },
+        { "plane", &Objects.gPlaneMesh },
+        { "prism", &Objects.gPrismMesh },
+        { "pyramid", &gMesh },
+        { "pyramid3", &Objects.gPyramid3Mesh },
+        { "pyramid4", &Objects.gPyramid4Mesh },
+        { "sphere", &Objects.gSphereMesh },
+        { "tapered_cylinder", &Objects.gTaperedCylinderMesh },
+        { "torus", &Objects.gTorusMesh },
+    };
 
+    std::map<std::string, MeshDraw>::const_iterator model = gModelMeshes.find(name);
+    if (model != gModelMeshes.end())
+    {
+        draw = model->second;
+        return true;
+    }
 
-    model = glm::translate(glm::mat4(1.0f), glm::vec3(0.0f, 0.0f, 0.9f)) * glm::scale(glm::mat4(1.0f), glm::vec3(0.1f, 1.0f, 0.1f));
+    if (name.size() > 4 && name.compare(name.size() - 4, 4, ".obj") == 0)
+        return ULoadObjMesh(name, draw);
 
-    glUniformMatrix4fv(MMloc, 1, false, &model[0][0]);
-    glUniform3f(colorLoc, .5f, 0.5f, 0.35f);
+    for (const NamedMesh& named : meshes)
+    {
+        if (name == named.name)
+        {
+            draw.vao = named.mesh->vao;
+            draw.ebo = named.mesh->vbos[1];
+            draw.nVertices = named.mesh->nVertices;
+            draw.nIndices = named.mesh->nIndices;
+            draw.mode = named.mesh->mode;
+            return true;
+        }
+    }
 
-    // Draws the triangles
-    glDrawArrays(GL_TRIANGLE_FAN, 0, 36);		//bottom
-    glDrawArrays(GL_TRIANGLE_FAN, 36, 36);		//top
-    glDrawArrays(GL_TRIANGLE_STRIP, 72, 146);	//sides
+    return false;
+}
 
 
-    // Activate the VBOs contained within the mesh's VAO
-    glBindVertexArray(gMesh.vao);
+// Import a Wavefront OBJ file as an indexed mesh, owned by gGpuResources
+bool ULoadObjMesh(const std::string& filename, MeshDraw& draw)
+{
+    ObjLoader loader;
+    if (!loader.Load(filename.c_str(), &gJobs))
+        return false;
+    if (loader.gIndices.empty())
+    {
+        cout << "ERROR::OBJ::NO_TRIANGLES " << filename << endl;
+        return false;
+    }
 
-    // Draws the triangle
-    glDrawArrays(GL_TRIANGLES, 0, gMesh.nvertices); // Draws the triangle
+    Meshes::GLMesh mesh;
+    Meshes::UCreateIndexedMesh(mesh, loader.gVertices.data(), (GLuint)loader.VertexCount(),
+        loader.gIndices.data(), (GLuint)loader.gIndices.size());
+    gImportedMeshes.push_back(gGpuResources.AddMesh(mesh.vao, mesh.vbos[0], mesh.vbos[1]));
+    gGpuMemory.TrackBuffer(mesh.vbos[0], MEMORY_MESHES);
+    gGpuMemory.TrackBuffer(mesh.vbos[1], MEMORY_MESHES);
+
+    draw.vao = mesh.vao;
+    draw.ebo = mesh.vbos[1];
+    draw.nVertices = (GLsizei)mesh.nVertices;
+    draw.nIndices = (GLsizei)mesh.nIndices;
+    draw.mode = mesh.mode;
+    return true;
+}
 
-    // Deactivate the VAO
-    glBindVertexArray(0);
 
-    // glfw: swap buffers and poll IO events (keys pressed/released, mouse moved etc.)
-    glfwSwapBuffers(gWindow);    // Flips the the back buffer with the front buffer every frame.
+// Expand the models the scene places: each glTF file is imported once, then every model
+// gets one object per primitive of each mesh node of its file
+bool UImportModels()
+{
+    for (const Scene::Model& model : gScene.gModels)
+    {
+        std::map<std::string, std::vector<ModelPart>>::iterator parts = gModelParts.find(model.filename);
+        if (parts == gModelParts.end())
+        {
+            parts = gModelParts.emplace(model.filename, std::vector<ModelPart>()).first;
+            if (!UImportGltf(model.filename, parts->second))
+                return false;
+        }
+
+        const glm::mat4 placement = glm::translate(glm::mat4(1.0f), model.position) * glm::mat4_cast(model.rotation) *
+            glm::scale(glm::mat4(1.0f), model.scale);
+        for (const ModelPart& part : parts->second)
+        {
+            // Objects have a position, rotation and scale, so the shear of a non-uniform
+            // scale above a rotation in the node hierarchy is lost
+            const glm::mat4 local = placement * part.transform;
+            glm::vec3 scale(glm::length(glm::vec3(local[0])), glm::length(glm::vec3(local[1])), glm::length(glm::vec3(local[2])));
+            if (glm::determinant(glm::mat3(local)) < 0.0f)
+                scale.x = -scale.x;
+            glm::quat rotation(1.0f, 0.0f, 0.0f, 0.0f);
+            if (scale.x != 0.0f && scale.y != 0.0f && scale.z != 0.0f)
+                rotation = glm::quat_cast(glm::mat3(glm::vec3(local[0]) / scale.x, glm::vec3(local[1]) / scale.y, glm::vec3(local[2]) / scale.z));
+
+            const std::string name = model.name + "/" + part.name;
+            gScene.AddObject(name.c_str(), part.mesh.c_str(), part.material, glm::vec3(local[3]), rotation, scale, model.parent);
+        }
+    }
+
+    gScene.gTransforms.Update();
+    return true;
 }
 
 
-// Implements the UCreateMesh function
-void UCreateMesh(GLMesh& mesh)
+// Import a glTF file: its GL objects are handed to gGpuResources, its images and materials
+// become scene textures and materials, and its primitives meshes in gModelMeshes
+bool UImportGltf(const std::string& filename, std::vector<ModelPart>& parts)
 {
-    // Position and Color data
-    GLfloat verts[] = {
-        //Positions              //Normals                Tex Coords
-        // -----------------    -------------------------------------
-       -0.5f,-0.5f,  0.5f,      1.0f, 0.0f, -1.0f,     0.0f, 0.0f,
-       -0.5f,-0.5f, -0.5f,      0.0f, 0.0f, -1.0f,     1.0f, 0.0f,
-        0.0f, 0.5f,  0.0f,      1.0f, 1.0f, -1.0f,     0.0f, 1.0f,
+    GltfLoader loader;
+    if (!loader.Load(filename.c_str()))
+        return false;
 
-        0.5f,-0.5f, -0.5f,      0.0f, 0.0f,  1.0f,     0.0f, 0.0f,
-        0.5f,-0.5f,  0.5f,      1.0f, 0.0f,  1.0f,     1.0f, 0.0f,
-        0.0f, 0.5f,  0.0f,      0.5f, 0.5f,  1.0f,     0.0f, 1.0f,
+    for (GLuint buffer : loader.gBuffers)
+    {
+        gImportedBuffers.push_back(gGpuResources.AddBuffer(buffer));
+        gGpuMemory.TrackBuffer(buffer, MEMORY_MESHES);
+    }
 
+    std::vector<std::string> meshNames;
+    for (size_t p = 0; p < loader.gPrimitives.size(); p++)
+    {
+        const Meshes::GLMesh& mesh = loader.gPrimitives[p].mesh;
+        gImportedMeshes.push_back(gGpuResources.AddMesh(mesh.vao, mesh.vbos[0], mesh.vbos[1]));
+        if (mesh.vbos[0])
+            gGpuMemory.TrackBuffer(mesh.vbos[0], MEMORY_MESHES);
+        gGpuMemory.TrackBuffer(mesh.vbos[1], MEMORY_MESHES);
+
+        MeshDraw draw;
+        draw.vao = mesh.vao;
+        draw.ebo = mesh.vbos[1];
+        draw.nVertices = (GLsizei)mesh.nVertices;
+        draw.nIndices = (GLsizei)mesh.nIndices;
+        draw.mode = mesh.mode;
+        meshNames.push_back(filename + "#" + to_string(p));
+        gModelMeshes[meshNames.back()] = draw;
+    }
 
-        -0.5f,-0.5f, -0.5f,     0.0f, 0.0f, 0.0f,       0.0f, 0.0f,
-        0.5f,-0.5f, -0.5f,      1.0f, 0.0f, 0.0f,       1.0f, 0.0f,
-        0.0f, 0.5f,  0.0f,      0.5f, 0.5f, 0.0f,       0.0f, 1.0f,
+    // Embedded images are resident already, and may lose mip levels to the memory budget;
+    // image files are streamed like the scene's own textures, but not flipped
+    std::vector<int> textures(loader.gImages.size(), -1);
+    for (size_t i = 0; i < loader.gImages.size(); i++)
+    {
+        const GltfLoader::Image& image = loader.gImages[i];
+        const std::string name = filename + "#image" + to_string(i);
+        if (!image.texture && image.filename.empty())
+            continue;
 
-       -0.5f,-0.5f,  0.5f,      0.0f, 0.0f, 0.0f,      0.0f, 0.0f,
-        0.5f,-0.5f,  0.5f,      1.0f, 0.0f, 0.0f,      1.0f, 0.0f,
-        0.0f, 0.5f,  0.0f,      0.5f, 0.5f, 0.0f,      0.0f, 1.0f,
+        textures[i] = gScene.AddTexture(name.c_str(), image.texture ? name.c_str() : image.filename.c_str());
+        if (textures[i] < 0)
+        {
+            cout << "Texture " << name << " declared twice" << endl;
+            return false;
+        }
+        gSceneTextures.resize(gScene.gTextureFiles.size());
+        gSceneTextureStreams.resize(gScene.gTextureFiles.size(), -1);
 
-       -0.5f,-0.5f, -0.5f,      0.0f, 0.0f, 0.0f,      0.0f, 0.0f,
-        0.5f,-0.5f, -0.5f,      1.0f, 0.0f, 0.0f,      0.0f, 1.0f,
-        0.5f,-0.5f,  0.5f,      1.0f, 1.0f, 0.0f,      1.0f, 0.0f,
+        if (image.texture)
+        {
+            gSceneTextures[textures[i]] = gGpuResources.AddTexture(image.texture);
+            gGpuMemory.TrackTexture(gSceneTextures[textures[i]], MEMORY_TEXTURES, true);
+        }
+        else
+        {
+            gSceneTextureStreams[textures[i]] = (int)gTextureStreamer.Count();
+            if (!gTextureStreamer.Add(image.filename.c_str(), gSceneTextures[textures[i]], false))
+            {
+                cout << "Failed to load texture " << image.filename << endl;
+                return false;
+            }
+        }
+    }
 
-       -0.5f,-0.5f, -0.5f,      0.0f, 0.0f, 0.0f,      1.0f, 0.0f,
-       -0.5f,-0.5f,  0.5f,      0.0f, 1.0f, 0.0f,      0.0f, 1.0f,
-        0.5f,-0.5f,  0.5f,      1.0f, 1.0f, 0.0f,      1.0f, 1.0f,
-    };
+    // Primitives without a material get the glTF default: white and lit
+    const GltfLoader::Material defaultMaterial = { glm::vec3(1.0f), -1, false, false };
+    std::vector<int> materials(loader.gMaterials.size() + 1);
+    for (size_t m = 0; m < materials.size(); m++)
+    {
+        const GltfLoader::Material& source = m < loader.gMaterials.size() ? loader.gMaterials[m] : defaultMaterial;
+        Scene::Material material;
+        material.texture = source.image >= 0 ? textures[source.image] : -1;
+        material.sampler = source.nearest ? Samplers::POINT : Samplers::TRILINEAR;
+        material.color = source.color;
+        material.features = (source.unlit ? 0 : SHADER_LIT) | (material.texture >= 0 ? SHADER_TEXTURED : 0);
+
+        const std::string name = filename + (m < loader.gMaterials.size() ? "#material" + to_string(m) : "#default");
+        materials[m] = gScene.AddMaterial(name.c_str(), material);
+        if (materials[m] < 0)
+        {
+            cout << "Material " << name << " declared twice" << endl;
+            return false;
+        }
+    }
 
-    const GLuint floatsPerVertex = 3;
-    const GLuint floatsPerNormal = 3;
-    const GLuint floatsPerUV = 2;
+    for (const GltfLoader::Node& node : loader.gNodes)
+    {
+        const GltfLoader::Mesh& mesh = loader.gMeshes[node.mesh];
+        for (int p = mesh.firstPrimitive; p < mesh.firstPrimitive + mesh.primitiveCount; p++)
+        {
+            const int material = loader.gPrimitives[p].material;
+            ModelPart part;
+            part.name = mesh.primitiveCount > 1 ? node.name + "/" + to_string(p - mesh.firstPrimitive) : node.name;
+            part.mesh = meshNames[p];
+            part.material = materials[material >= 0 ? material : loader.gMaterials.size()];
+            part.transform = node.world;
+            parts.push_back(part);
+        }
+    }
+    return true;
+}
 
-    mesh.nvertices = sizeof(verts) / (sizeof(verts[0]) * (floatsPerVertex + floatsPerNormal + floatsPerUV));
 
-    glGenVertexArrays(1, &mesh.vao); // we can also generate multiple VAOs or buffers at the same time
-    glBindVertexArray(mesh.vao);
+// Read back the vertices of a mesh as position, normal and uv (8 floats each), following the
+// attribute formats of its VAO: imported meshes keep the layout of their file
+void UReadMeshVertices(const MeshDraw& draw, std::vector<GLfloat>& verts)
+{
+    const int floatsPerVertex = 8;
+    const GLint attributeFloats[3] = { 3, 3, 2 };
 
-    // Create 2 buffers: first one for the vertex data; second one for the indices
-    glGenBuffers(1, &mesh.vbo);
-    glBindBuffer(GL_ARRAY_BUFFER, mesh.vbo); // Activates the buffer
-    glBufferData(GL_ARRAY_BUFFER, sizeof(verts), verts, GL_STATIC_DRAW); // Sends vertex or coordinate data to the GPU
+    verts.assign((size_t)draw.nVertices * floatsPerVertex, 0.0f);
+    if (draw.nVertices <= 0)
+        return;
 
-    // Strides between vertex coordinates is 6 (x, y, z, r, g, b, a). A tightly packed stride is 0.
-    GLint stride = sizeof(float) * (floatsPerVertex + floatsPerNormal + floatsPerUV);// The number of floats before each
+    std::vector<unsigned char> bytes;
+    glBindVertexArray(draw.vao);
+    for (GLuint attribute = 0, first = 0; attribute < 3; first += attributeFloats[attribute], attribute++)
+    {
+        GLint enabled = 0, buffer = 0, size = 0, type = 0, normalized = 0, stride = 0;
+        void* offset = nullptr;
+        glGetVertexAttribiv(attribute, GL_VERTEX_ATTRIB_ARRAY_ENABLED, &enabled);
+        glGetVertexAttribiv(attribute, GL_VERTEX_ATTRIB_ARRAY_BUFFER_BINDING, &buffer);
+        glGetVertexAttribiv(attribute, GL_VERTEX_ATTRIB_ARRAY_SIZE, &size);
+        glGetVertexAttribiv(attribute, GL_VERTEX_ATTRIB_ARRAY_TYPE, &type);
+        glGetVertexAttribiv(attribute, GL_VERTEX_ATTRIB_ARRAY_NORMALIZED, &normalized);
+        glGetVertexAttribiv(attribute, GL_VERTEX_ATTRIB_ARRAY_STRIDE, &stride);
+        glGetVertexAttribPointerv(attribute, GL_VERTEX_ATTRIB_ARRAY_POINTER, &offset);
+
+        const GLint componentSize = type == GL_FLOAT ? 4 : type == GL_UNSIGNED_SHORT ? 2 : type == GL_UNSIGNED_BYTE ? 1 : 0;
+        if (!enabled || !buffer || !componentSize)
+            continue;
+        if (stride == 0)
+            stride = size * componentSize;
+
+        bytes.resize((size_t)(draw.nVertices - 1) * stride + size * componentSize);
+        glBindBuffer(GL_COPY_READ_BUFFER, buffer);
+        glGetBufferSubData(GL_COPY_READ_BUFFER, (GLintptr)offset, (GLsizeiptr)bytes.size(), bytes.data());
+
+        const int components = std::min(size, attributeFloats[attribute]);
+        for (GLsizei v = 0; v < draw.nVertices; v++)
+        {
+            const unsigned char* source = &bytes[(size_t)v * stride];
+            GLfloat* target = &verts[(size_t)v * floatsPerVertex + first];
+            for (int c = 0; c < components; c++)
+            {
+                if (type == GL_FLOAT)
+                    memcpy(&target[c], source + c * 4, 4);
+                else if (type == GL_UNSIGNED_SHORT)
+                {
+                    unsigned short value;
+                    memcpy(&value, source + c * 2, 2);
+                    target[c] = normalized ? value / 65535.0f : value;
+                }
+                else
+                    target[c] = normalized ? source[c] / 255.0f : source[c];
+            }
+        }
+    }
+    glBindBuffer(GL_COPY_READ_BUFFER, 0);
+    glBindVertexArray(0);
+}
 
-    // Create Vertex Attribute Pointers
-    glVertexAttribPointer(0, floatsPerVertex, GL_FLOAT, GL_FALSE, stride, 0);
-    glEnableVertexAttribArray(0);
 
-    glVertexAttribPointer(1, floatsPerNormal, GL_FLOAT, GL_FALSE, stride, (void*)(sizeof(float) * floatsPerVertex));
-    glEnableVertexAttribArray(1);
+// Bounding box of a mesh, read back once from its vertex buffers
+AABB UMeshBounds(const MeshDraw& draw)
+{
+    const int floatsPerVertex = 8;
 
-    glVertexAttribPointer(2, floatsPerUV, GL_FLOAT, GL_FALSE, stride, (void*)(sizeof(float) * (floatsPerVertex + floatsPerNormal)));
-    glEnableVertexAttribArray(2);
+    std::vector<GLfloat> verts;
+    UReadMeshVertices(draw, verts);
 
+    AABB bounds = { glm::vec3(0.0f), glm::vec3(0.0f) };
+    for (size_t v = 0; v + floatsPerVertex <= verts.size(); v += floatsPerVertex)
+    {
+        glm::vec3 position(verts[v], verts[v + 1], verts[v + 2]);
+        if (v == 0)
+            bounds.min = bounds.max = position;
+        bounds.min = glm::min(bounds.min, position);
+        bounds.max = glm::max(bounds.max, position);
+    }
+    return bounds;
 }
 
 
-void UDestroyMesh(GLMesh& mesh)
+// Read back the vertices of a mesh (position, normal, uv) and its triangles as vertex index triples
+void UReadMeshTriangles(const MeshDraw& draw, std::vector<GLfloat>& verts, std::vector<GLuint>& indices)
 {
-    glDeleteVertexArrays(1, &mesh.vao);
-    glDeleteBuffers(1, &mesh.vbo);
+    UReadMeshVertices(draw, verts);
+
+    // Strips are expanded back to a triangle list
+    std::vector<GLuint> drawIndices(draw.nIndices);
+    glBindBuffer(GL_COPY_READ_BUFFER, draw.ebo);
+    glGetBufferSubData(GL_COPY_READ_BUFFER, 0, draw.nIndices * sizeof(GLuint), drawIndices.data());
+    glBindBuffer(GL_COPY_READ_BUFFER, 0);
+
+    indices.clear();
+    MeshOptimizer::AppendTriangles(draw.mode, drawIndices.data(), drawIndices.size(), indices);
 }
 
 
-// Implements the UCreateShaders function
-bool UCreateShaderProgram(const char* vtxShaderSource, const char* fragShaderSource, GLuint& programId)
+// Read back the triangles of a mesh and build the BVH that rays are tested against
+void UBuildMeshRaycaster(const MeshDraw& draw, MeshRaycaster& raycaster)
 {
-    // Compilation and linkage error reporting
-    int success = 0;
-    char infoLog[512];
+    const int floatsPerVertex = 8;
 
-    // Create a Shader program object.
-    programId = glCreateProgram();
+    std::vector<GLfloat> verts;
+    std::vector<GLuint> indices;
+    UReadMeshTriangles(draw, verts, indices);
 
-    // Create the vertex and fragment shader objects
-    GLuint vertexShaderId = glCreateShader(GL_VERTEX_SHADER);
-    GLuint fragmentShaderId = glCreateShader(GL_FRAGMENT_SHADER);
+    std::vector<glm::vec3> positions;
+    for (size_t v = 0; v + floatsPerVertex <= verts.size(); v += floatsPerVertex)
+        positions.push_back(glm::vec3(verts[v], verts[v + 1], verts[v + 2]));
 
-    // Retrive the shader source
-    glShaderSource(vertexShaderId, 1, &vtxShaderSource, NULL);
-    glShaderSource(fragmentShaderId, 1, &fragShaderSource, NULL);
+    raycaster.Build(positions, indices);
+}
 
-    // Compile the vertex shader, and print compilation errors (if any)
-    glCompileShader(vertexShaderId); // compile the vertex shader
-    // check for shader compile errors
-    glGetShaderiv(vertexShaderId, GL_COMPILE_STATUS, &success);
-    if (!success)
-    {
-        glGetShaderInfoLog(vertexShaderId, 512, NULL, infoLog);
-        std::cout << "ERROR::SHADER::VERTEX::COMPILATION_FAILED\n" << infoLog << std::endl;
 
-        return false;
-    }
+// Texture coordinate units per unit of surface, averaged over the mesh: the square root of
+// the ratio of its total UV area to its total surface area
+float UMeshUvDensity(const MeshDraw& draw)
+{
+    const int floatsPerVertex = 8;
 
-    glCompileShader(fragmentShaderId); // compile the fragment shader
-    // check for shader compile errors
-    glGetShaderiv(fragmentShaderId, GL_COMPILE_STATUS, &success);
-    if (!success)
-    {
-        glGetShaderInfoLog(fragmentShaderId, sizeof(infoLog), NULL, infoLog);
-        std::cout << "ERROR::SHADER::FRAGMENT::COMPILATION_FAILED\n" << infoLog << std::endl;
+    std::vector<GLfloat> verts;
+    std::vector<GLuint> indices;
+    UReadMeshTriangles(draw, verts, indices);
 
-        return false;
+    const size_t vertexCount = verts.size() / floatsPerVertex;
+    double surfaceArea = 0.0, uvArea = 0.0;
+    for (size_t t = 0; t + 3 <= indices.size(); t += 3)
+    {
+        if (indices[t] >= vertexCount || indices[t + 1] >= vertexCount || indices[t + 2] >= vertexCount)
+            continue;
+        const GLfloat* a = &verts[indices[t] * floatsPerVertex];
+        const GLfloat* b = &verts[indices[t + 1] * floatsPerVertex];
+        const GLfloat* c = &verts[indices[t + 2] * floatsPerVertex];
+
+        const glm::vec3 edge1(b[0] - a[0], b[1] - a[1], b[2] - a[2]);
+        const glm::vec3 edge2(c[0] - a[0], c[1] - a[1], c[2] - a[2]);
+        surfaceArea += 0.5 * glm::length(glm::cross(edge1, edge2));
+        uvArea += 0.5 * std::abs((b[6] - a[6]) * (c[7] - a[7]) - (c[6] - a[6]) * (b[7] - a[7]));
     }
 
-    // Attached compiled shaders to the shader program
-    glAttachShader(programId, vertexShaderId);
-    glAttachShader(programId, fragmentShaderId);
+    // Meshes without texture coordinates still ask for something sensible
+    return surfaceArea > 0.0 && uvArea > 0.0 ? (float)std::sqrt(uvArea / surfaceArea) : 1.0f;
+}
+
+
+// Tell the texture streamer how finely each visible object's texture is seen: the UV range one
+// pixel covers at the object's nearest point, from its mesh's UV density and its scale
+void URequestTextures()
+{
+    int width, height;
+    glfwGetFramebufferSize(gWindow, &width, &height);
+    if (height <= 0)
+        return;
+
+    // Pixels per world unit at distance 1
+    const float pixelsPerUnit = height * gProjection[1][1] * 0.5f;
+    const glm::vec3 cameraPosition = gCamera.Position;
 
-    glLinkProgram(programId);   // links the shader program
-    // check for linking errors
-    glGetProgramiv(programId, GL_LINK_STATUS, &success);
-    if (!success)
+    for (size_t i = 0; i < gCulling.gVisible.size(); i++)
     {
-        glGetProgramInfoLog(programId, sizeof(infoLog), NULL, infoLog);
-        std::cout << "ERROR::SHADER::PROGRAM::LINKING_FAILED\n" << infoLog << std::endl;
+        const int texture = gScene.gMaterials[gScene.gObjectMaterial[i]].texture;
+        if (!gCulling.gVisible[i] || texture < 0)
+            continue;
+        const int stream = gSceneTextureStreams[texture];
 
-        return false;
-    }
+        const AABB& bounds = gCulling.gWorldBounds[i];
+        const float radius = glm::length(bounds.max - bounds.min) * 0.5f;
+        const float distance = std::max(glm::length((bounds.min + bounds.max) * 0.5f - cameraPosition) - radius, 0.1f);
 
-    glUseProgram(programId);    // Uses the shader program
+        const glm::mat4& world = gScene.gTransforms.gWorld[i];
+        const float scale = (glm::length(glm::vec3(world[0])) + glm::length(glm::vec3(world[1])) + glm::length(glm::vec3(world[2]))) / 3.0f;
+        if (scale <= 0.0f)
+            continue;
 
-    return true;
+        if (stream >= 0)
+            gTextureStreamer.Request(stream, gSceneMeshUvDensity[gScene.gObjectMesh[i]] / scale * distance / pixelsPerUnit);
+
+        // Textures drawn this frame are the last to lose mip levels when over the memory budget
+        gGpuMemory.Touch(gSceneTextures[texture]);
+    }
 }
 
 
-/*Generate and load the texture*/
-bool UCreateTexture(const char* filename, GLuint& textureId)
+// Select the object under the cursor (the window center while the cursor drives the camera)
+void UPickObject(GLFWwindow* window)
 {
-    int width, height, channels;
-    stbi_set_flip_vertically_on_load(true);
-    unsigned char* image = stbi_load(filename, &width, &height, &channels, 4);
-    if (image)
+    int width, height;
+    glfwGetWindowSize(window, &width, &height);
+    if (width <= 0 || height <= 0)
+        return;
+
+    double x = width * 0.5, y = height * 0.5;
+    if (glfwGetInputMode(window, GLFW_CURSOR) != GLFW_CURSOR_DISABLED)
+        glfwGetCursorPos(window, &x, &y);
+
+    const auto start = std::chrono::steady_clock::now();
+
+    glm::vec3 origin, direction;
+    Picking::ScreenRay((float)x, (float)y, (float)width, (float)height, gProjection * gCamera.GetViewMatrix(), origin, direction);
+    float distance = FLT_MAX;
+    gSelectedObject = gPicking.Pick(gSceneBVH, gScene.gTransforms.gWorld, gScene.gObjectMesh, origin, direction, distance);
+
+    const double milliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    if (gSelectedObject >= 0)
     {
-        glGenTextures(1, &textureId);
-        glBindTexture(GL_TEXTURE_2D, textureId);
+        // Other objects close to the selection (kept, so clicking does not allocate once it has grown)
+        static std::vector<int> neighbors;
+        neighbors.clear();
+        gSpatialHash.QuerySphere(origin + direction * distance, NEIGHBORHOOD_RADIUS, neighbors);
+        const size_t neighborCount = neighbors.size() - std::count(neighbors.begin(), neighbors.end(), gSelectedObject);
+
+        cout << "INFO: Picked " << gScene.ObjectName(gSelectedObject) << " at distance " << distance
+            << " (" << milliseconds << " ms), " << neighborCount << " other objects within " << NEIGHBORHOOD_RADIUS << endl;
+    }
+    else
+        cout << "INFO: Picked nothing (" << milliseconds << " ms)" << endl;
+}
 
-        // set the texture wrapping parameters
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-        // set texture filtering parameters
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+// Implements the UCreateMesh function
+void UCreateMesh(Meshes::GLMesh& mesh)
+{
+    // Position and Color data
+    GLfloat verts[] = {
+        //Positions              //Normals                Tex Coords
+        // -----------------    -------------------------------------
+       -0.5f,-0.5f,  0.5f,      1.0f, 0.0f, -1.0f,     0.0f, 0.0f,
+       -0.5f,-0.5f, -0.5f,      0.0f, 0.0f, -1.0f,     1.0f, 0.0f,
+        0.0f, 0.5f,  0.0f,      1.0f, 1.0f, -1.0f,     0.0f, 1.0f,
 
+        0.5f,-0.5f, -0.5f,      0.0f, 0.0f,  1.0f,     0.0f, 0.0f,
+        0.5f,-0.5f,  0.5f,      1.0f, 0.0f,  1.0f,     1.0f, 0.0f,
+        0.0f, 0.5f,  0.0f,      0.5f, 0.5f,  1.0f,     0.0f, 1.0f,
 
-            glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, image);
 
+        -0.5f,-0.5f, -0.5f,     0.0f, 0.0f, 0.0f,       0.0f, 0.0f,
+        0.5f,-0.5f, -0.5f,      1.0f, 0.0f, 0.0f,       1.0f, 0.0f,
+        0.0f, 0.5f,  0.0f,      0.5f, 0.5f, 0.0f,       0.0f, 1.0f,
 
-        glGenerateMipmap(GL_TEXTURE_2D);
+       -0.5f,-0.5f,  0.5f,      0.0f, 0.0f, 0.0f,      0.0f, 0.0f,
+        0.5f,-0.5f,  0.5f,      1.0f, 0.0f, 0.0f,      1.0f, 0.0f,
+        0.0f, 0.5f,  0.0f,      0.5f, 0.5f, 0.0f,      0.0f, 1.0f,
 
-        stbi_image_free(image);
-        glBindTexture(GL_TEXTURE_2D, 0); // Unbind the texture
+       -0.5f,-0.5f, -0.5f,      0.0f, 0.0f, 0.0f,      0.0f, 0.0f,
+        0.5f,-0.5f, -0.5f,      1.0f, 0.0f, 0.0f,      0.0f, 1.0f,
+        0.5f,-0.5f,  0.5f,      1.0f, 1.0f, 0.0f,      1.0f, 0.0f,
 
-        return true;
-    }
+       -0.5f,-0.5f, -0.5f,      0.0f, 0.0f, 0.0f,      1.0f, 0.0f,
+       -0.5f,-0.5f,  0.5f,      0.0f, 1.0f, 0.0f,      0.0f, 1.0f,
+        0.5f,-0.5f,  0.5f,      1.0f, 1.0f, 0.0f,      1.0f, 1.0f,
+    };
 
-    // Error loading the image
-    return false;
-}
+    const GLuint floatsPerVertex = 3;
+    const GLuint floatsPerNormal = 3;
+    const GLuint floatsPerUV = 2;
 
+    const GLuint nVertices = sizeof(verts) / (sizeof(verts[0]) * (floatsPerVertex + floatsPerNormal + floatsPerUV));
 
-void UDestroyTexture(GLuint textureId)
-{
-    glGenTextures(1, &textureId);
+    // Authored as separate triangles; welded into an indexed list like the other built-in meshes
+    const MeshOptimizer::Range ranges[] = { { GL_TRIANGLES, 0, (GLsizei)nVertices } };
+    Meshes::UCreateWeldedMesh(mesh, "pyramid", verts, nVertices, ranges, 1);
 }
 
 
-void UDestroyShaderProgram(GLuint programId)
+// The texture is deleted once the frames using it are finished; the handle is invalid right away
+void UDestroyTexture(TextureHandle texture)
 {
-    glDeleteProgram(programId);
+    gGpuMemory.UntrackTexture(texture);
+    gGpuResources.Destroy(texture);
 }
-
@@ -0,0 +1,107 @@
+///////////////////////////////////////////////////////////////////////////////
+// mappedfile.cpp
+// ========
+// read-only memory-mapped file: the whole file addressable as one range of
+// bytes, paged in by the OS as it is read, without copying it into a buffer
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#include "mappedfile.h"
+
+#include <iostream>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+///////////////////////////////////////////////////
+//	Open(const char*)
+//
+//	Map the whole file for reading. Returns false (after
+//	reporting why) if it cannot be opened or mapped.
+///////////////////////////////////////////////////
+bool MappedFile::Open(const char* filename) {
+	Close();
+
+#ifdef _WIN32
+	HANDLE file = CreateFileA(filename, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING,
+		FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+	if (file == INVALID_HANDLE_VALUE) {
+		std::cout << "ERROR::MAPPEDFILE::FILE_NOT_FOUND " << filename << std::endl;
+		return false;
+	}
+	gFile = file;
+
+	LARGE_INTEGER size;
+	if (!GetFileSizeEx(file, &size)) {
+		std::cout << "ERROR::MAPPEDFILE::MAP_FAILED " << filename << std::endl;
+		Close();
+		return false;
+	}
+	gSize = (size_t)size.QuadPart;
+	if (gSize == 0)
+		return true;
+
+	gMapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+	if (gMapping)
+		gData = (const char*)MapViewOfFile(gMapping, FILE_MAP_READ, 0, 0, 0);
+#else
+	gFile = open(filename, O_RDONLY);
+	if (gFile < 0) {
+		std::cout << "ERROR::MAPPEDFILE::FILE_NOT_FOUND " << filename << std::endl;
+		return false;
+	}
+
+	struct stat status;
+	if (fstat(gFile, &status) != 0) {
+		std::cout << "ERROR::MAPPEDFILE::MAP_FAILED " << filename << std::endl;
+		Close();
+		return false;
+	}
+	gSize = (size_t)status.st_size;
+	if (gSize == 0)
+		return true;
+
+	void* data = mmap(nullptr, gSize, PROT_READ, MAP_PRIVATE, gFile, 0);
+	if (data != MAP_FAILED) {
+		gData = (const char*)data;
+		// Parsers read front to back
+		madvise(data, gSize, MADV_SEQUENTIAL);
+	}
+#endif
+
+	if (!gData) {
+		std::cout << "ERROR::MAPPEDFILE::MAP_FAILED " << filename << std::endl;
+		Close();
+		return false;
+	}
+	return true;
+}
+
+void MappedFile::Close() {
+#ifdef _WIN32
+	if (gData)
+		UnmapViewOfFile(gData);
+	if (gMapping)
+		CloseHandle(gMapping);
+	if (gFile)
+		CloseHandle(gFile);
+	gMapping = nullptr;
+	gFile = nullptr;
+#else
+	if (gData)
+		munmap((void*)gData, gSize);
+	if (gFile >= 0)
+		close(gFile);
+	gFile = -1;
+#endif
+	gData = nullptr;
+	gSize = 0;
+}
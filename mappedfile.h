@@ -0,0 +1,38 @@
+///////////////////////////////////////////////////////////////////////////////
+// mappedfile.h
+// ========
+// read-only memory-mapped file: the whole file addressable as one range of
+// bytes, paged in by the OS as it is read, without copying it into a buffer
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <cstddef>
+
+class MappedFile {
+
+public:
+	MappedFile() = default;
+	~MappedFile() { Close(); }
+
+	MappedFile(const MappedFile&) = delete;
+	MappedFile& operator=(const MappedFile&) = delete;
+
+	bool Open(const char* filename);
+	void Close();
+
+	const char* Data() const { return gData; }
+	size_t Size() const { return gSize; }
+
+private:
+	const char* gData = nullptr;	// nullptr for empty files
+	size_t gSize = 0;
+
+#ifdef _WIN32
+	void* gFile = nullptr;			// File and mapping HANDLEs
+	void* gMapping = nullptr;
+#else
+	int gFile = -1;
+#endif
+};
@@ -7,11 +7,33 @@
 
 #include "meshes.h"
 
+#include <iostream>
+#include <utility>
 #include <vector>
 
 namespace {
 	const double M_PI = 3.14159265358979323846f;
 	const double M_PI_2 = 1.571428571428571;
+
+	// The hand-written tables repeat shared vertices exactly; generated ones agree to well within this
+	const float WELD_EPSILON = 1e-5f;
+
+	double Kilobytes(size_t bytes) {
+		return bytes / 1024.0;
+	}
+
+	// The indices to draw a triangle list with: the list itself (GL_TRIANGLES), or strips
+	// joined by restart indices (GL_TRIANGLE_STRIP) when those are shorter
+	GLuint StripIfShorter(const GLuint* indices, size_t nIndices, GLenum& mode, std::vector<GLuint>& drawIndices) {
+		MeshOptimizer::Stripify(indices, nIndices, drawIndices);
+		if (drawIndices.size() < nIndices)
+			mode = GL_TRIANGLE_STRIP;
+		else {
+			mode = GL_TRIANGLES;
+			drawIndices.assign(indices, indices + nIndices);
+		}
+		return (GLuint)drawIndices.size();
+	}
 }
 
 ///////////////////////////////////////////////////
@@ -19,6 +41,7 @@ namespace {
 //
 //	Create all the following 3D meshes:
 //		plane, pyramid, cube, cylinder, torus, sphere
+//	Their GL objects are the caller's to delete.
 ///////////////////////////////////////////////////
 void Meshes::CreateMeshes() {
 	UCreatePlaneMesh(gPlaneMesh);
@@ -33,23 +56,6 @@ void Meshes::CreateMeshes() {
 	UCreateTorusMesh(gTorusMesh);
 }
 
-///////////////////////////////////////////////////
-//	DestroyMeshes()
-//
-//	Destroy the created meshes
-///////////////////////////////////////////////////
-void Meshes::DestroyMeshes() {
-	UDestroyMesh(gBoxMesh);
-	UDestroyMesh(gConeMesh);
-	UDestroyMesh(gCylinderMesh);
-	UDestroyMesh(gPlaneMesh);
-	UDestroyMesh(gPyramid3Mesh);
-	UDestroyMesh(gPyramid4Mesh);
-	UDestroyMesh(gPrismMesh);
-	UDestroyMesh(gSphereMesh);
-	UDestroyMesh(gTorusMesh);
-}
-
 ///////////////////////////////////////////////////
 //	UCreatePlaneMesh(GLMesh&)
 //
@@ -59,7 +65,7 @@ void Meshes::DestroyMeshes() {
 // 
 //  Correct triangle drawing command:
 //
-//	glDrawElements(GL_TRIANGLES, meshes.gPlaneMesh.nIndices, GL_UNSIGNED_INT, (void*)0);
+//	glDrawElements(meshes.gPlaneMesh.mode, meshes.gPlaneMesh.nIndices, GL_UNSIGNED_INT, (void*)0);
 ///////////////////////////////////////////////////
 void Meshes::UCreatePlaneMesh(GLMesh& mesh) {
 	// Vertex data
@@ -84,7 +90,8 @@ void Meshes::UCreatePlaneMesh(GLMesh& mesh) {
 
 	// store vertex and index count
 	mesh.nVertices = sizeof(verts) / (sizeof(verts[0]) * (floatsPerVertex + floatsPerNormal + floatsPerUV));
-	mesh.nIndices = sizeof(indices) / sizeof(indices[0]);
+	std::vector<GLuint> drawIndices;		// Strips when they take fewer indices than the list
+	mesh.nIndices = StripIfShorter(indices, sizeof(indices) / sizeof(indices[0]), mesh.mode, drawIndices);
 
 	// Generate the VAO for the mesh
 	glGenVertexArrays(1, &mesh.vao);
@@ -96,7 +103,7 @@ void Meshes::UCreatePlaneMesh(GLMesh& mesh) {
 	glBufferData(GL_ARRAY_BUFFER, sizeof(verts), verts, GL_STATIC_DRAW); // Sends data to the GPU
 
 	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, mesh.vbos[1]); // Activates the buffer
-	glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(indices), indices, GL_STATIC_DRAW);
+	glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(GLuint) * drawIndices.size(), drawIndices.data(), GL_STATIC_DRAW);
 
 	// Strides between vertex coordinates
 	GLint stride = sizeof(float) * (floatsPerVertex + floatsPerNormal + floatsPerUV);
@@ -119,9 +126,10 @@ void Meshes::UCreatePlaneMesh(GLMesh& mesh) {
 //
 //	Create a pyramid mesh and store it in a VAO/VBO
 //
-//  Correct triangle drawing command:
+//	Authored as a triangle strip and welded into an
+//	indexed mesh. Drawing command:
 //
-//	glDrawArrays(GL_TRIANGLE_STRIP, 0, meshes.gPyramid3Mesh.nVertices);
+//	glDrawElements(meshes.gPyramid3Mesh.mode, meshes.gPyramid3Mesh.nIndices, GL_UNSIGNED_INT, (void*)0);
 ///////////////////////////////////////////////////
 void Meshes::UCreatePyramid3Mesh(GLMesh& mesh) {
 	// Vertex data
@@ -154,25 +162,11 @@ void Meshes::UCreatePyramid3Mesh(GLMesh& mesh) {
 	const GLuint floatsPerUV = 2;		// Number of texture coordinate values
 
 	// Calculate total defined vertices
-	mesh.nVertices = sizeof(verts) / (sizeof(verts[0]) * (floatsPerVertex + floatsPerColor + floatsPerUV));
+	const GLuint nVertices = sizeof(verts) / (sizeof(verts[0]) * (floatsPerVertex + floatsPerColor + floatsPerUV));
 
-	glGenVertexArrays(1, &mesh.vao);			// Creates 1 VAO
-	glGenBuffers(1, mesh.vbos);					// Creates 1 VBO
-	glBindVertexArray(mesh.vao);				// Activates the VAO
-	glBindBuffer(GL_ARRAY_BUFFER, mesh.vbos[0]);	// Activates the VBO
-	// Sends vertex or coordinate data to the GPU
-	glBufferData(GL_ARRAY_BUFFER, sizeof(verts), verts, GL_STATIC_DRAW);
-
-	// Strides between sets of attribute data
-	GLint stride = sizeof(float) * (floatsPerVertex + floatsPerColor + floatsPerUV);
-
-	// Creates the Vertex Attribute Pointers
-	glVertexAttribPointer(0, floatsPerVertex, GL_FLOAT, GL_FALSE, stride, (void*)0);
-	glEnableVertexAttribArray(0);
-	glVertexAttribPointer(1, floatsPerColor, GL_FLOAT, GL_FALSE, stride, (void*)(sizeof(float) * floatsPerVertex));
-	glEnableVertexAttribArray(1);
-	glVertexAttribPointer(2, floatsPerUV, GL_FLOAT, GL_FALSE, stride, (void*)(sizeof(float) * (floatsPerVertex + floatsPerColor)));
-	glEnableVertexAttribArray(2);
+	// Authored as a single strip over every vertex
+	const MeshOptimizer::Range ranges[] = { { GL_TRIANGLE_STRIP, 0, (GLsizei)nVertices } };
+	UCreateWeldedMesh(mesh, "pyramid3", verts, nVertices, ranges, 1);
 }
 
 ///////////////////////////////////////////////////
@@ -182,9 +176,10 @@ void Meshes::UCreatePyramid3Mesh(GLMesh& mesh) {
 //
 //	Create a pyramid mesh and store it in a VAO/VBO
 //
-//  Correct triangle drawing command:
+//	Authored as a triangle strip and welded into an
+//	indexed mesh. Drawing command:
 //
-//	glDrawArrays(GL_TRIANGLE_STRIP, 0, meshes.gPyramid4Mesh.nVertices);
+//	glDrawElements(meshes.gPyramid4Mesh.mode, meshes.gPyramid4Mesh.nIndices, GL_UNSIGNED_INT, (void*)0);
 ///////////////////////////////////////////////////
 void Meshes::UCreatePyramid4Mesh(GLMesh& mesh) {
 	// Vertex data
@@ -226,25 +221,11 @@ void Meshes::UCreatePyramid4Mesh(GLMesh& mesh) {
 	const GLuint floatsPerUV = 2;		// Number of texture coordinate values
 
 	// Calculate total defined vertices
-	mesh.nVertices = sizeof(verts) / (sizeof(verts[0]) * (floatsPerVertex + floatsPerColor + floatsPerUV));
+	const GLuint nVertices = sizeof(verts) / (sizeof(verts[0]) * (floatsPerVertex + floatsPerColor + floatsPerUV));
 
-	glGenVertexArrays(1, &mesh.vao);			// Creates 1 VAO
-	glGenBuffers(1, mesh.vbos);					// Creates 1 VBO
-	glBindVertexArray(mesh.vao);				// Activates the VAO
-	glBindBuffer(GL_ARRAY_BUFFER, mesh.vbos[0]);	// Activates the VBO
-	// Sends vertex or coordinate data to the GPU
-	glBufferData(GL_ARRAY_BUFFER, sizeof(verts), verts, GL_STATIC_DRAW);
-
-	// Strides between sets of attribute data
-	GLint stride = sizeof(float) * (floatsPerVertex + floatsPerColor + floatsPerUV);
-
-	// Creates the Vertex Attribute Pointers
-	glVertexAttribPointer(0, floatsPerVertex, GL_FLOAT, GL_FALSE, stride, (void*)0);
-	glEnableVertexAttribArray(0);
-	glVertexAttribPointer(1, floatsPerColor, GL_FLOAT, GL_FALSE, stride, (void*)(sizeof(float) * floatsPerVertex));
-	glEnableVertexAttribArray(1);
-	glVertexAttribPointer(2, floatsPerUV, GL_FLOAT, GL_FALSE, stride, (void*)(sizeof(float) * (floatsPerVertex + floatsPerColor)));
-	glEnableVertexAttribArray(2);
+	// Authored as a single strip over every vertex
+	const MeshOptimizer::Range ranges[] = { { GL_TRIANGLE_STRIP, 0, (GLsizei)nVertices } };
+	UCreateWeldedMesh(mesh, "pyramid4", verts, nVertices, ranges, 1);
 }
 
 ///////////////////////////////////////////////////
@@ -252,11 +233,12 @@ void Meshes::UCreatePyramid4Mesh(GLMesh& mesh) {
 //
 //	mesh: reference to mesh structure for storing data
 //
-//	Create a pyramid mesh and store it in a VAO/VBO
+//	Create a prism mesh and store it in a VAO/VBO
 //
-//	Correct triangle drawing command:
+//	Authored as a triangle strip and welded into an
+//	indexed mesh. Drawing command:
 //
-//	glDrawArrays(GL_TRIANGLE_STRIP, 0, meshes.gPrismMesh.nVertices);
+//	glDrawElements(meshes.gPrismMesh.mode, meshes.gPrismMesh.nIndices, GL_UNSIGNED_INT, (void*)0);
 ///////////////////////////////////////////////////
 void Meshes::UCreatePrismMesh(GLMesh& mesh) {
 	// Vertex data
@@ -312,28 +294,12 @@ void Meshes::UCreatePrismMesh(GLMesh& mesh) {
 	const GLuint floatsPerNormal = 3;
 	const GLuint floatsPerUV = 2;
 
-	mesh.nVertices = sizeof(verts) / (sizeof(verts[0]) * (floatsPerVertex + floatsPerNormal + floatsPerUV));
-
-	glGenVertexArrays(1, &mesh.vao); // we can also generate multiple VAOs or buffers at the same time
-	glBindVertexArray(mesh.vao);
-
-	// Create 2 buffers: first one for the vertex data; second one for the indices
-	glGenBuffers(1, mesh.vbos);
-	glBindBuffer(GL_ARRAY_BUFFER, mesh.vbos[0]); // Activates the buffer
-	glBufferData(GL_ARRAY_BUFFER, sizeof(verts), verts, GL_STATIC_DRAW); // Sends vertex or coordinate data to the GPU
-
-	// Strides between vertex coordinates is 6 (x, y, z, r, g, b, a). A tightly packed stride is 0.
-	GLint stride = sizeof(float) * (floatsPerVertex + floatsPerNormal + floatsPerUV);// The number of floats before each
-
-	// Create Vertex Attribute Pointers
-	glVertexAttribPointer(0, floatsPerVertex, GL_FLOAT, GL_FALSE, stride, 0);
-	glEnableVertexAttribArray(0);
-
-	glVertexAttribPointer(1, floatsPerNormal, GL_FLOAT, GL_FALSE, stride, (void*)(sizeof(float) * floatsPerVertex));
-	glEnableVertexAttribArray(1);
+	// Calculate total defined vertices
+	const GLuint nVertices = sizeof(verts) / (sizeof(verts[0]) * (floatsPerVertex + floatsPerNormal + floatsPerUV));
 
-	glVertexAttribPointer(2, floatsPerUV, GL_FLOAT, GL_FALSE, stride, (void*)(sizeof(float) * (floatsPerVertex + floatsPerNormal)));
-	glEnableVertexAttribArray(2);
+	// Authored as a single strip over every vertex
+	const MeshOptimizer::Range ranges[] = { { GL_TRIANGLE_STRIP, 0, (GLsizei)nVertices } };
+	UCreateWeldedMesh(mesh, "prism", verts, nVertices, ranges, 1);
 }
 
 ///////////////////////////////////////////////////
@@ -345,7 +311,7 @@ void Meshes::UCreatePrismMesh(GLMesh& mesh) {
 //
 //	Correct triangle drawing command:
 //
-//	glDrawElements(GL_TRIANGLES, meshes.gBoxMesh.nIndices, GL_UNSIGNED_INT, (void*)0);
+//	glDrawElements(meshes.gBoxMesh.mode, meshes.gBoxMesh.nIndices, GL_UNSIGNED_INT, (void*)0);
 ///////////////////////////////////////////////////
 void Meshes::UCreateBoxMesh(GLMesh& mesh) {
 	// Position and Color data
@@ -411,7 +377,8 @@ void Meshes::UCreateBoxMesh(GLMesh& mesh) {
 	const GLuint floatsPerUV = 2;
 
 	mesh.nVertices = sizeof(verts) / (sizeof(verts[0]) * (floatsPerVertex + floatsPerNormal + floatsPerUV));
-	mesh.nIndices = sizeof(indices) / sizeof(indices[0]);
+	std::vector<GLuint> drawIndices;		// Strips when they take fewer indices than the list
+	mesh.nIndices = StripIfShorter(indices, sizeof(indices) / sizeof(indices[0]), mesh.mode, drawIndices);
 
 	glGenVertexArrays(1, &mesh.vao); // we can also generate multiple VAOs or buffers at the same time
 	glBindVertexArray(mesh.vao);
@@ -422,7 +389,7 @@ void Meshes::UCreateBoxMesh(GLMesh& mesh) {
 	glBufferData(GL_ARRAY_BUFFER, sizeof(verts), verts, GL_STATIC_DRAW); // Sends vertex or coordinate data to the GPU
 
 	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, mesh.vbos[1]); // Activates the buffer
-	glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(indices), indices, GL_STATIC_DRAW);
+	glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(GLuint) * drawIndices.size(), drawIndices.data(), GL_STATIC_DRAW);
 
 	// Strides between vertex coordinates is 6 (x, y, z, r, g, b, a). A tightly packed stride is 0.
 	GLint stride = sizeof(float) * (floatsPerVertex + floatsPerNormal + floatsPerUV);// The number of floats before each
@@ -445,10 +412,10 @@ void Meshes::UCreateBoxMesh(GLMesh& mesh) {
 //
 //	Create a cone mesh and store it in a VAO/VBO
 //
-//  Correct triangle drawing commands:
+//	Authored as a fan (bottom) and a strip (sides) and
+//	welded into an indexed mesh. Drawing command:
 //
-//	glDrawArrays(GL_TRIANGLE_FAN, 0, 36);		//bottom
-//	glDrawArrays(GL_TRIANGLE_STRIP, 36, 108);	//sides
+//	glDrawElements(meshes.gConeMesh.mode, meshes.gConeMesh.nIndices, GL_UNSIGNED_INT, (void*)0);
 ///////////////////////////////////////////////////
 void Meshes::UCreateConeMesh(GLMesh& mesh) {
 	GLfloat verts[] = {
@@ -608,31 +575,14 @@ void Meshes::UCreateConeMesh(GLMesh& mesh) {
 	const GLuint floatsPerNormal = 3;
 	const GLuint floatsPerUV = 2;
 
-	// store vertex and index count
-	mesh.nVertices = sizeof(verts) / (sizeof(verts[0]) * (floatsPerVertex + floatsPerNormal + floatsPerUV));
-	mesh.nIndices = 0;
-
-	// Create VAO
-	glGenVertexArrays(1, &mesh.vao); // we can also generate multiple VAOs or buffers at the same time
-	glBindVertexArray(mesh.vao);
-
-	// Create VBO
-	glGenBuffers(1, mesh.vbos);
-	glBindBuffer(GL_ARRAY_BUFFER, mesh.vbos[0]); // Activates the buffer
-	glBufferData(GL_ARRAY_BUFFER, sizeof(verts), verts, GL_STATIC_DRAW); // Sends vertex or coordinate data to the GPU
-
-	// Strides between vertex coordinates
-	GLint stride = sizeof(float) * (floatsPerVertex + floatsPerNormal + floatsPerUV);
-
-	// Create Vertex Attribute Pointers
-	glVertexAttribPointer(0, floatsPerVertex, GL_FLOAT, GL_FALSE, stride, (void*)0);
-	glEnableVertexAttribArray(0);
-
-	glVertexAttribPointer(1, floatsPerNormal, GL_FLOAT, GL_FALSE, stride, (void*)(sizeof(float) * (floatsPerVertex)));
-	glEnableVertexAttribArray(1);
+	// Calculate total defined vertices
+	const GLuint nVertices = sizeof(verts) / (sizeof(verts[0]) * (floatsPerVertex + floatsPerNormal + floatsPerUV));
 
-	glVertexAttribPointer(2, floatsPerUV, GL_FLOAT, GL_FALSE, stride, (void*)(sizeof(float) * (floatsPerVertex + floatsPerNormal)));
-	glEnableVertexAttribArray(2);
+	const MeshOptimizer::Range ranges[] = {
+		{ GL_TRIANGLE_FAN, 0, 36 },			//bottom
+		{ GL_TRIANGLE_STRIP, 36, 108 },		//sides
+	};
+	UCreateWeldedMesh(mesh, "cone", verts, nVertices, ranges, 2);
 }
 
 void Meshes::CalculateTriangleNormal(glm::vec3 p0, glm::vec3 p1, glm::vec3 p2) {
@@ -664,11 +614,11 @@ void Meshes::CalculateTriangleNormal(glm::vec3 p0, glm::vec3 p1, glm::vec3 p2) {
 //
 //	Create a cylinder mesh and store it in a VAO/VBO
 //
-//  Correct triangle drawing commands:
+//	Authored as two fans (bottom, top) and a strip (sides)
+//	and welded into an indexed mesh. Drawing
+//	command:
 //
-//	glDrawArrays(GL_TRIANGLE_FAN, 0, 36);		//bottom
-//	glDrawArrays(GL_TRIANGLE_FAN, 36, 36);		//top
-//	glDrawArrays(GL_TRIANGLE_STRIP, 72, 146);	//sides
+//	glDrawElements(meshes.gCylinderMesh.mode, meshes.gCylinderMesh.nIndices, GL_UNSIGNED_INT, (void*)0);
 ///////////////////////////////////////////////////
 void Meshes::UCreateCylinderMesh(GLMesh& mesh) {
 	GLfloat verts[] = {
@@ -902,31 +852,15 @@ void Meshes::UCreateCylinderMesh(GLMesh& mesh) {
 	const GLuint floatsPerNormal = 3;
 	const GLuint floatsPerUV = 2;
 
-	// store vertex and index count
-	mesh.nVertices = sizeof(verts) / (sizeof(verts[0]) * (floatsPerVertex + floatsPerNormal + floatsPerUV));
-	mesh.nIndices = 0;
-
-	// Create VAO
-	glGenVertexArrays(1, &mesh.vao); // we can also generate multiple VAOs or buffers at the same time
-	glBindVertexArray(mesh.vao);
-
-	// Create VBO
-	glGenBuffers(1, mesh.vbos);
-	glBindBuffer(GL_ARRAY_BUFFER, mesh.vbos[0]); // Activates the buffer
-	glBufferData(GL_ARRAY_BUFFER, sizeof(verts), verts, GL_STATIC_DRAW); // Sends vertex or coordinate data to the GPU
-
-	// Strides between vertex coordinates
-	GLint stride = sizeof(float) * (floatsPerVertex + floatsPerNormal + floatsPerUV);
-
-	// Create Vertex Attribute Pointers
-	glVertexAttribPointer(0, floatsPerVertex, GL_FLOAT, GL_FALSE, stride, (void*)0);
-	glEnableVertexAttribArray(0);
-
-	glVertexAttribPointer(1, floatsPerNormal, GL_FLOAT, GL_FALSE, stride, (void*)(sizeof(float) * (floatsPerVertex)));
-	glEnableVertexAttribArray(1);
+	// Calculate total defined vertices
+	const GLuint nVertices = sizeof(verts) / (sizeof(verts[0]) * (floatsPerVertex + floatsPerNormal + floatsPerUV));
 
-	glVertexAttribPointer(2, floatsPerUV, GL_FLOAT, GL_FALSE, stride, (void*)(sizeof(float) * (floatsPerVertex + floatsPerNormal)));
-	glEnableVertexAttribArray(2);
+	const MeshOptimizer::Range ranges[] = {
+		{ GL_TRIANGLE_FAN, 0, 36 },			//bottom
+		{ GL_TRIANGLE_FAN, 36, 36 },		//top
+		{ GL_TRIANGLE_STRIP, 72, 146 },		//sides
+	};
+	UCreateWeldedMesh(mesh, "cylinder", verts, nVertices, ranges, 3);
 }
 
 ///////////////////////////////////////////////////
@@ -936,11 +870,11 @@ void Meshes::UCreateCylinderMesh(GLMesh& mesh) {
 //
 //	Create a tapered cylinder mesh and store it in a VAO/VBO
 //
-//  Correct triangle drawing commands:
+//	Authored as two fans (bottom, top) and a strip (sides)
+//	and welded into an indexed mesh. Drawing
+//	command:
 //
-//	glDrawArrays(GL_TRIANGLE_FAN, 0, 36);		//bottom
-//	glDrawArrays(GL_TRIANGLE_FAN, 36, 72);		//top
-//	glDrawArrays(GL_TRIANGLE_STRIP, 72, 146);	//sides
+//	glDrawElements(meshes.gTaperedCylinderMesh.mode, meshes.gTaperedCylinderMesh.nIndices, GL_UNSIGNED_INT, (void*)0);
 ///////////////////////////////////////////////////
 void Meshes::UCreateTaperedCylinderMesh(GLMesh& mesh) {
 	GLfloat verts[] = {
@@ -1174,31 +1108,15 @@ void Meshes::UCreateTaperedCylinderMesh(GLMesh& mesh) {
 	const GLuint floatsPerNormal = 3;
 	const GLuint floatsPerUV = 2;
 
-	// store vertex and index count
-	mesh.nVertices = sizeof(verts) / (sizeof(verts[0]) * (floatsPerVertex + floatsPerNormal + floatsPerUV));
-	mesh.nIndices = 0;
-
-	// Create VAO
-	glGenVertexArrays(1, &mesh.vao); // we can also generate multiple VAOs or buffers at the same time
-	glBindVertexArray(mesh.vao);
-
-	// Create VBO
-	glGenBuffers(1, mesh.vbos);
-	glBindBuffer(GL_ARRAY_BUFFER, mesh.vbos[0]); // Activates the buffer
-	glBufferData(GL_ARRAY_BUFFER, sizeof(verts), verts, GL_STATIC_DRAW); // Sends vertex or coordinate data to the GPU
-
-	// Strides between vertex coordinates
-	GLint stride = sizeof(float) * (floatsPerVertex + floatsPerNormal + floatsPerUV);
-
-	// Create Vertex Attribute Pointers
-	glVertexAttribPointer(0, floatsPerVertex, GL_FLOAT, GL_FALSE, stride, (void*)0);
-	glEnableVertexAttribArray(0);
-
-	glVertexAttribPointer(1, floatsPerNormal, GL_FLOAT, GL_FALSE, stride, (void*)(sizeof(float) * (floatsPerVertex)));
-	glEnableVertexAttribArray(1);
+	// Calculate total defined vertices
+	const GLuint nVertices = sizeof(verts) / (sizeof(verts[0]) * (floatsPerVertex + floatsPerNormal + floatsPerUV));
 
-	glVertexAttribPointer(2, floatsPerUV, GL_FLOAT, GL_FALSE, stride, (void*)(sizeof(float) * (floatsPerVertex + floatsPerNormal)));
-	glEnableVertexAttribArray(2);
+	const MeshOptimizer::Range ranges[] = {
+		{ GL_TRIANGLE_FAN, 0, 36 },			//bottom
+		{ GL_TRIANGLE_FAN, 36, 36 },		//top
+		{ GL_TRIANGLE_STRIP, 72, 146 },		//sides
+	};
+	UCreateWeldedMesh(mesh, "tapered_cylinder", verts, nVertices, ranges, 3);
 }
 
 ///////////////////////////////////////////////////
@@ -1208,9 +1126,10 @@ void Meshes::UCreateTaperedCylinderMesh(GLMesh& mesh) {
 //
 //	Create a torus mesh and store it in a VAO/VBO
 //
-//	Correct triangle drawing command:
+//	Generated as separate triangles and welded into an
+//	indexed mesh. Drawing command:
 //
-//	glDrawArrays(GL_TRIANGLES, 0, meshes.gTorusMesh.nVertices);
+//	glDrawElements(meshes.gTorusMesh.mode, meshes.gTorusMesh.nIndices, GL_UNSIGNED_INT, (void*)0);
 ///////////////////////////////////////////////////
 void Meshes::UCreateTorusMesh(GLMesh& mesh) {
 	int _mainSegments = 30;
@@ -1221,9 +1140,16 @@ void Meshes::UCreateTorusMesh(GLMesh& mesh) {
 	auto mainSegmentAngleStep = glm::radians(360.0f / float(_mainSegments));
 	auto tubeSegmentAngleStep = glm::radians(360.0f / float(_tubeSegments));
 
+	// Every (main, tube) segment pair emits 7 vertices; reserving up front
+	// avoids regrowing the lists while they fill
+	const size_t vertexCount = (size_t)_mainSegments * _tubeSegments * 7;
+
 	std::vector<glm::vec3> vertex_list;
 	std::vector<std::vector<glm::vec3>> segments_list;
 	std::vector<glm::vec2> texture_coords;
+	vertex_list.reserve(vertexCount);
+	segments_list.reserve(_mainSegments);
+	texture_coords.reserve(vertexCount);
 	glm::vec3 center(0.0f, 0.0f, 0.0f);
 	glm::vec3 normal;
 	glm::vec3 vertex;
@@ -1237,6 +1163,7 @@ void Meshes::UCreateTorusMesh(GLMesh& mesh) {
 		auto cosMainSegment = cos(currentMainSegmentAngle);
 		auto currentTubeSegmentAngle = 0.0f;
 		std::vector<glm::vec3> segment_points;
+		segment_points.reserve(_tubeSegments);
 		for (auto j = 0; j < _tubeSegments; j++) {
 			// Calculate sine and cosine of tube segment angle
 			auto sinTubeSegment = sin(currentTubeSegmentAngle);
@@ -1254,7 +1181,7 @@ void Meshes::UCreateTorusMesh(GLMesh& mesh) {
 			// Update current tube angle
 			currentTubeSegmentAngle += tubeSegmentAngleStep;
 		}
-		segments_list.push_back(segment_points);
+		segments_list.push_back(std::move(segment_points));
 		segment_points.clear();
 
 		// Update main segment angle
@@ -1340,6 +1267,7 @@ void Meshes::UCreateTorusMesh(GLMesh& mesh) {
 	}
 
 	std::vector<GLfloat> combined_values;
+	combined_values.reserve(vertex_list.size() * 8);
 
 	// combine interleaved vertices, normals, and texture coords
 	for (int i = 0; i < vertex_list.size(); i++) {
@@ -1356,36 +1284,11 @@ void Meshes::UCreateTorusMesh(GLMesh& mesh) {
 		combined_values.push_back(text_coord.y);
 	}
 
-	// total float values per each type
-	const GLuint floatsPerVertex = 3;
-	const GLuint floatsPerNormal = 3;
-	const GLuint floatsPerUV = 2;
-
-	// store vertex and index count
-	mesh.nVertices = vertex_list.size();
-	mesh.nIndices = 0;
-
-	// Create VAO
-	glGenVertexArrays(1, &mesh.vao); // we can also generate multiple VAOs or buffers at the same time
-	glBindVertexArray(mesh.vao);
-
-	// Create VBOs
-	glGenBuffers(1, mesh.vbos);
-	glBindBuffer(GL_ARRAY_BUFFER, mesh.vbos[0]); // Activates the buffer
-	glBufferData(GL_ARRAY_BUFFER, sizeof(GLfloat) * combined_values.size(), combined_values.data(), GL_STATIC_DRAW); // Sends vertex or coordinate data to the GPU
-
-	// Strides between vertex coordinates
-	GLint stride = sizeof(float) * (floatsPerVertex + floatsPerNormal + floatsPerUV);
-
-	// Create Vertex Attribute Pointers
-	glVertexAttribPointer(0, floatsPerVertex, GL_FLOAT, GL_FALSE, stride, 0);
-	glEnableVertexAttribArray(0);
-
-	glVertexAttribPointer(1, floatsPerNormal, GL_FLOAT, GL_FALSE, stride, (void*)(sizeof(float) * floatsPerVertex));
-	glEnableVertexAttribArray(1);
+	// Calculate total defined vertices
+	const GLuint nVertices = (GLuint)vertex_list.size();
 
-	glVertexAttribPointer(2, floatsPerUV, GL_FLOAT, GL_FALSE, stride, (void*)(sizeof(float) * (floatsPerVertex + floatsPerNormal)));
-	glEnableVertexAttribArray(2);
+	const MeshOptimizer::Range ranges[] = { { GL_TRIANGLES, 0, (GLsizei)nVertices } };
+	UCreateWeldedMesh(mesh, "torus", combined_values.data(), nVertices, ranges, 1);
 }
 
 ///////////////////////////////////////////////////
@@ -1397,7 +1300,7 @@ void Meshes::UCreateTorusMesh(GLMesh& mesh) {
 //
 //  Correct triangle drawing command:
 //
-//	glDrawElements(GL_TRIANGLES, meshes.gSphereMesh.nIndices, GL_UNSIGNED_INT, (void*)0);
+//	glDrawElements(meshes.gSphereMesh.mode, meshes.gSphereMesh.nIndices, GL_UNSIGNED_INT, (void*)0);
 ///////////////////////////////////////////////////
 void Meshes::UCreateSphereMesh(GLMesh& mesh) {
 	GLfloat verts[] = {
@@ -2185,13 +2088,15 @@ void Meshes::UCreateSphereMesh(GLMesh& mesh) {
 
 	// store vertex and index count
 	mesh.nVertices = sizeof(verts) / (sizeof(verts[0]) * (floatsPerVertex));
-	mesh.nIndices = sizeof(indices) / (sizeof(indices[0]));
+	std::vector<GLuint> drawIndices;		// Strips when they take fewer indices than the list
+	mesh.nIndices = StripIfShorter(indices, sizeof(indices) / sizeof(indices[0]), mesh.mode, drawIndices);
 
 	glm::vec3 normal;
 	glm::vec3 vert;
 	glm::vec3 center(0.0f, 0.0f, 0.0f);
 	float u, v;
 	std::vector<GLfloat> combined_values;
+	combined_values.reserve(sizeof(verts) / sizeof(verts[0]) / 3 * 8);
 
 	// combine interleaved vertices, normals, and texture coords
 	for (int i = 0; i < sizeof(verts) / (sizeof(verts[0])); i += 3) {
@@ -2219,11 +2124,60 @@ void Meshes::UCreateSphereMesh(GLMesh& mesh) {
 	glBufferData(GL_ARRAY_BUFFER, sizeof(GLfloat) * combined_values.size(), combined_values.data(), GL_STATIC_DRAW); // Sends vertex or coordinate data to the GPU
 
 	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, mesh.vbos[1]); // Activates the index buffer
-	glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(indices), indices, GL_STATIC_DRAW);
+	glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(GLuint) * drawIndices.size(), drawIndices.data(), GL_STATIC_DRAW);
+
+	// Strides between vertex coordinates
+	GLint stride = sizeof(float) * (floatsPerVertex + floatsPerNormal + floatsPerUV);
+
+	// Create Vertex Attribute Pointers
+	glVertexAttribPointer(0, floatsPerVertex, GL_FLOAT, GL_FALSE, stride, 0);
+	glEnableVertexAttribArray(0);
+
+	glVertexAttribPointer(1, floatsPerNormal, GL_FLOAT, GL_FALSE, stride, (void*)(sizeof(float) * floatsPerVertex));
+	glEnableVertexAttribArray(1);
+
+	glVertexAttribPointer(2, floatsPerUV, GL_FLOAT, GL_FALSE, stride, (void*)(sizeof(float) * (floatsPerVertex + floatsPerNormal)));
+	glEnableVertexAttribArray(2);
+}
+
+///////////////////////////////////////////////////
+//	UCreateIndexedMesh(GLMesh&, const GLfloat*, GLuint, const GLuint*, GLuint, GLenum)
+//
+//	mesh: reference to mesh structure for storing data
+//	verts: position, normal and uv of each vertex
+//	indices: triangle list, or strips separated by
+//	MeshOptimizer::RESTART_INDEX
+//	mode: GL_TRIANGLES or GL_TRIANGLE_STRIP
+//
+//	Upload a mesh built elsewhere (e.g. imported from a
+//	file) in the same layout as the meshes above
+//
+//	glDrawElements(mesh.mode, mesh.nIndices, GL_UNSIGNED_INT, (void*)0);
+///////////////////////////////////////////////////
+void Meshes::UCreateIndexedMesh(GLMesh& mesh, const GLfloat* verts, GLuint nVertices, const GLuint* indices, GLuint nIndices,
+	GLenum mode) {
+	// total float values per each type
+	const GLuint floatsPerVertex = 3;
+	const GLuint floatsPerNormal = 3;
+	const GLuint floatsPerUV = 2;
+
+	mesh.mode = mode;
+	mesh.nVertices = nVertices;
+	mesh.nIndices = nIndices;
+
+	glGenVertexArrays(1, &mesh.vao);
+	glBindVertexArray(mesh.vao);
 
 	// Strides between vertex coordinates
 	GLint stride = sizeof(float) * (floatsPerVertex + floatsPerNormal + floatsPerUV);
 
+	glGenBuffers(2, mesh.vbos);
+	glBindBuffer(GL_ARRAY_BUFFER, mesh.vbos[0]);
+	glBufferData(GL_ARRAY_BUFFER, (GLsizeiptr)nVertices * stride, verts, GL_STATIC_DRAW);
+
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, mesh.vbos[1]);
+	glBufferData(GL_ELEMENT_ARRAY_BUFFER, (GLsizeiptr)nIndices * sizeof(GLuint), indices, GL_STATIC_DRAW);
+
 	// Create Vertex Attribute Pointers
 	glVertexAttribPointer(0, floatsPerVertex, GL_FLOAT, GL_FALSE, stride, 0);
 	glEnableVertexAttribArray(0);
@@ -2233,9 +2187,53 @@ void Meshes::UCreateSphereMesh(GLMesh& mesh) {
 
 	glVertexAttribPointer(2, floatsPerUV, GL_FLOAT, GL_FALSE, stride, (void*)(sizeof(float) * (floatsPerVertex + floatsPerNormal)));
 	glEnableVertexAttribArray(2);
+
+	glBindVertexArray(0);
 }
 
-void Meshes::UDestroyMesh(GLMesh& mesh) {
-	glDeleteVertexArrays(1, &mesh.vao);
-	glDeleteBuffers(2, mesh.vbos);
+///////////////////////////////////////////////////
+//	UCreateWeldedMesh(GLMesh&, const char*, const GLfloat*, GLuint, ...)
+//
+//	mesh: reference to mesh structure for storing data
+//	name: mesh name for the report
+//	verts: position, normal and uv of each vertex
+//	ranges: how the vertices would be drawn with
+//	glDrawArrays
+//
+//	Expand the ranges to triangles, weld duplicate
+//	vertices, join the triangles into strips if that takes
+//	fewer indices and upload the result with
+//	UCreateIndexedMesh, reporting what it all saved
+//
+//	glDrawElements(mesh.mode, mesh.nIndices, GL_UNSIGNED_INT, (void*)0);
+///////////////////////////////////////////////////
+void Meshes::UCreateWeldedMesh(GLMesh& mesh, const char* name, const GLfloat* verts, GLuint nVertices,
+	const MeshOptimizer::Range* ranges, int nRanges) {
+	const int floatsPerVertex = 8;
+
+	// Every vertex a glDrawArrays call submits runs the vertex shader; nothing is reused
+	std::vector<GLuint> indices;
+	size_t runsBefore = 0;
+	for (int r = 0; r < nRanges; r++) {
+		MeshOptimizer::AppendTriangles(ranges[r].mode, ranges[r].first, ranges[r].count, indices);
+		runsBefore += ranges[r].count;
+	}
+
+	std::vector<GLfloat> welded;
+	const size_t nWelded = MeshOptimizer::Weld(verts, nVertices, floatsPerVertex, WELD_EPSILON, indices, welded);
+
+	std::vector<GLuint> drawIndices;
+	GLenum mode;
+	StripIfShorter(indices.data(), indices.size(), mode, drawIndices);
+	UCreateIndexedMesh(mesh, welded.data(), (GLuint)nWelded, drawIndices.data(), (GLuint)drawIndices.size(), mode);
+
+	const size_t bytesBefore = (size_t)nVertices * floatsPerVertex * sizeof(GLfloat);
+	const size_t bytesAfter = welded.size() * sizeof(GLfloat) + drawIndices.size() * sizeof(GLuint);
+	const std::streamsize precision = std::cout.precision(1);
+	std::cout << std::fixed << "INFO: Welded " << name << ": " << nVertices << " -> " << nWelded << " vertices, "
+		<< drawIndices.size() << (mode == GL_TRIANGLE_STRIP ? " strip" : " list") << " indices (" << indices.size()
+		<< " as a list), " << Kilobytes(bytesBefore) << " -> " << Kilobytes(bytesAfter) << " KB, vertex shader runs "
+		<< runsBefore << " -> " << MeshOptimizer::VertexShaderRuns(drawIndices.data(), drawIndices.size()) << " per draw"
+		<< std::defaultfloat << std::endl;
+	std::cout.precision(precision);
 }
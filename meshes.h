@@ -9,6 +9,7 @@
 
 #include "GL/glew.h"
 #include "glm/glm.hpp"
+#include "meshopt.h"
 
 class Meshes {
 
@@ -19,7 +20,8 @@ public:
 		GLuint vao;         // Handle for the vertex array object
 		GLuint vbos[2];     // Handles for the vertex buffer objects
 		GLuint nVertices;	// Number of vertices for the mesh
-		GLuint nIndices;    // Number of indices for the mesh
+		GLuint nIndices;    // Number of indices for the mesh, restart indices included
+		GLenum mode;		// GL_TRIANGLES, or GL_TRIANGLE_STRIP with MeshOptimizer::RESTART_INDEX between strips
 	};
 
 	GLMesh gBoxMesh;
@@ -35,7 +37,11 @@ public:
 
 public:
 	void CreateMeshes();
-	void DestroyMeshes();
+
+	static void UCreateIndexedMesh(GLMesh& mesh, const GLfloat* verts, GLuint nVertices, const GLuint* indices, GLuint nIndices,
+		GLenum mode = GL_TRIANGLES);
+	static void UCreateWeldedMesh(GLMesh& mesh, const char* name, const GLfloat* verts, GLuint nVertices,
+		const MeshOptimizer::Range* ranges, int nRanges);
 
 private:
 	void UCreatePlaneMesh(GLMesh& mesh);
@@ -49,7 +55,5 @@ private:
 	void UCreatePyramid4Mesh(GLMesh& mesh);
 	void UCreateSphereMesh(GLMesh& mesh);
 
-	void UDestroyMesh(GLMesh& mesh);
-
 	void CalculateTriangleNormal(glm::vec3 px, glm::vec3 py, glm::vec3 pz);
 };
\ No newline at end of file
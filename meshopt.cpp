@@ -0,0 +1,349 @@
+///////////////////////////////////////////////////////////////////////////////
+// meshopt.cpp
+// ========
+// mesh optimization passes: turn glDrawArrays vertex ranges into triangle
+// lists, weld duplicate vertices into an indexed mesh, join triangles into
+// strips, and estimate how often the vertex shader runs for an index list
+//
+// Welding quantizes every attribute of a vertex (position, normal, uv) to a
+// multiple of epsilon and hashes the whole tuple, so two vertices merge only
+// when all of their attributes agree: a cube corner shared by three faces
+// with different normals stays three vertices. Exact duplicates always merge;
+// values that differ by less than epsilon merge unless they straddle a
+// rounding boundary.
+//
+// Strips are grown greedily across shared edges. A strip starts from the
+// unused triangle with the fewest unused neighbours (so that triangles at
+// the edges of the mesh are not left over as strips of their own) and
+// extends while the triangle across its last edge is unused and wound the
+// same way, which keeps every triangle facing as it did in the list. The
+// strips are joined with RESTART_INDEX rather than degenerate triangles.
+//
+// Vertex shader runs are counted against a FIFO post-transform cache, the
+// model most hardware documentation describes. It is an estimate: real
+// caches differ in size and replacement, but the order of magnitude (and the
+// comparison with a non-indexed draw, which reuses nothing) holds.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#include "meshopt.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+
+namespace {
+	const GLuint EMPTY_SLOT = 0xFFFFFFFFu;
+	const GLuint NO_TRIANGLE = 0xFFFFFFFFu;
+
+	// Directed edge of a triangle, in the order of its winding
+	struct Edge {
+		uint64_t key;		// From vertex in the high half, to vertex in the low half
+		GLuint triangle;
+	};
+
+	uint64_t EdgeKey(GLuint from, GLuint to) {
+		return ((uint64_t)from << 32) | to;
+	}
+
+	bool EdgeLess(const Edge& a, const Edge& b) {
+		return a.key < b.key;
+	}
+
+	// FNV-1a over the quantized attributes
+	uint64_t HashKey(const long long* key, int count) {
+		uint64_t hash = 14695981039346656037ull;
+		for (int i = 0; i < count; i++) {
+			hash ^= (uint64_t)key[i];
+			hash *= 1099511628211ull;
+		}
+		return hash ^ (hash >> 32);
+	}
+}
+
+///////////////////////////////////////////////////
+//	AppendTriangles(GLenum, GLint, GLsizei, std::vector<GLuint>&)
+//
+//	mode: GL_TRIANGLES, GL_TRIANGLE_STRIP or GL_TRIANGLE_FAN
+//	first, count: vertex range, as passed to glDrawArrays
+//
+//	Appends the vertex indices of the triangles the range
+//	draws, three per triangle, with the winding GL gives
+//	them
+///////////////////////////////////////////////////
+void MeshOptimizer::AppendTriangles(GLenum mode, GLint first, GLsizei count, std::vector<GLuint>& indices) {
+	for (GLsizei i = 2; i < count; i++) {
+		GLuint a, b, c;
+		if (mode == GL_TRIANGLES) {
+			if (i % 3 != 2)
+				continue;
+			a = first + i - 2;
+			b = first + i - 1;
+			c = first + i;
+		}
+		else if (mode == GL_TRIANGLE_FAN) {
+			a = first;
+			b = first + i - 1;
+			c = first + i;
+		}
+		else {
+			// Every other triangle of a strip is wound the other way; swapping two corners undoes that
+			a = first + i - 2;
+			b = first + ((i & 1) ? i : i - 1);
+			c = first + ((i & 1) ? i - 1 : i);
+		}
+		indices.push_back(a);
+		indices.push_back(b);
+		indices.push_back(c);
+	}
+}
+
+///////////////////////////////////////////////////
+//	AppendTriangles(GLenum, const GLuint*, size_t, std::vector<GLuint>&)
+//
+//	mode: GL_TRIANGLES, GL_TRIANGLE_STRIP or GL_TRIANGLE_FAN
+//	indices: index list, as passed to glDrawElements;
+//	RESTART_INDEX ends a strip or fan
+//
+//	Appends the vertex indices of the triangles the list
+//	draws, three per triangle
+///////////////////////////////////////////////////
+void MeshOptimizer::AppendTriangles(GLenum mode, const GLuint* indices, size_t nIndices, std::vector<GLuint>& triangles) {
+	if (mode == GL_TRIANGLES) {
+		triangles.insert(triangles.end(), indices, indices + nIndices - nIndices % 3);
+		return;
+	}
+
+	// Each run between restarts is drawn like a vertex range of the same length
+	std::vector<GLuint> range;
+	size_t start = 0;
+	for (size_t i = 0; i <= nIndices; i++) {
+		if (i < nIndices && indices[i] != RESTART_INDEX)
+			continue;
+		range.clear();
+		AppendTriangles(mode, 0, (GLsizei)(i - start), range);
+		for (GLuint corner : range)
+			triangles.push_back(indices[start + corner]);
+		start = i + 1;
+	}
+}
+
+///////////////////////////////////////////////////
+//	Weld(const GLfloat*, size_t, int, float, ...)
+//
+//	verts: nVertices vertices of floatsPerVertex floats
+//	epsilon: quantization step of every attribute
+//	indices: triangle list into verts; replaced by the
+//	same triangles indexing welded
+//	welded: receives the distinct vertices, in order of
+//	first use
+//
+//	Triangles with a corner outside verts, or with two
+//	corners at the same position (which includes those
+//	welding collapses), are dropped. Returns the number of
+//	welded vertices.
+///////////////////////////////////////////////////
+size_t MeshOptimizer::Weld(const GLfloat* verts, size_t nVertices, int floatsPerVertex, float epsilon,
+	std::vector<GLuint>& indices, std::vector<GLfloat>& welded) {
+	welded.clear();
+
+	std::vector<long long> keys(nVertices * floatsPerVertex);
+	for (size_t i = 0; i < keys.size(); i++)
+		keys[i] = std::llround(verts[i] / epsilon);
+
+	// Open addressing, at most half full; slots hold the first vertex with a given key
+	size_t tableSize = 1;
+	while (tableSize < nVertices * 2)
+		tableSize <<= 1;
+	std::vector<GLuint> table(tableSize, EMPTY_SLOT);
+
+	std::vector<GLuint> remap(nVertices);
+	size_t count = 0;
+	for (size_t v = 0; v < nVertices; v++) {
+		const long long* key = &keys[v * floatsPerVertex];
+		size_t slot = HashKey(key, floatsPerVertex) & (tableSize - 1);
+		for (;;) {
+			const GLuint other = table[slot];
+			if (other == EMPTY_SLOT) {
+				table[slot] = (GLuint)v;
+				remap[v] = (GLuint)count++;
+				welded.insert(welded.end(), verts + v * floatsPerVertex, verts + (v + 1) * floatsPerVertex);
+				break;
+			}
+			if (std::equal(key, key + floatsPerVertex, &keys[other * floatsPerVertex])) {
+				remap[v] = remap[other];
+				break;
+			}
+			slot = (slot + 1) & (tableSize - 1);
+		}
+	}
+
+	// Positions are the first three attributes
+	const int positionFloats = std::min(floatsPerVertex, 3);
+	auto samePosition = [&](GLuint a, GLuint b) {
+		return std::equal(&keys[a * floatsPerVertex], &keys[a * floatsPerVertex] + positionFloats, &keys[b * floatsPerVertex]);
+	};
+
+	size_t kept = 0;
+	for (size_t t = 0; t + 3 <= indices.size(); t += 3) {
+		const GLuint a = indices[t], b = indices[t + 1], c = indices[t + 2];
+		if (a >= nVertices || b >= nVertices || c >= nVertices)
+			continue;
+		if (samePosition(a, b) || samePosition(b, c) || samePosition(a, c))
+			continue;
+		indices[kept++] = remap[a];
+		indices[kept++] = remap[b];
+		indices[kept++] = remap[c];
+	}
+	indices.resize(kept);
+	return count;
+}
+
+///////////////////////////////////////////////////
+//	Stripify(const GLuint*, size_t, std::vector<GLuint>&)
+//
+//	indices: triangle list
+//	strips: receives a GL_TRIANGLE_STRIP index list that
+//	draws the same triangles, facing the same way, with
+//	RESTART_INDEX between strips
+//
+//	Triangles with a repeated corner are dropped. Returns
+//	the number of strips.
+///////////////////////////////////////////////////
+size_t MeshOptimizer::Stripify(const GLuint* indices, size_t nIndices, std::vector<GLuint>& strips) {
+	strips.clear();
+	const size_t nTriangles = nIndices / 3;
+
+	std::vector<Edge> edges;
+	edges.reserve(nTriangles * 3);
+	for (size_t t = 0; t < nTriangles; t++)
+		for (int e = 0; e < 3; e++)
+			edges.push_back({ EdgeKey(indices[t * 3 + e], indices[t * 3 + (e + 1) % 3]), (GLuint)t });
+	std::sort(edges.begin(), edges.end(), EdgeLess);
+
+	std::vector<unsigned char> used(nTriangles, 0);
+	for (size_t t = 0; t < nTriangles; t++) {
+		const GLuint* corner = &indices[t * 3];
+		if (corner[0] == corner[1] || corner[1] == corner[2] || corner[0] == corner[2])
+			used[t] = 1;
+	}
+
+	// Triangles across the edge from -> to that are wound the same way hold the edge to -> from
+	auto adjacent = [&](GLuint from, GLuint to) {
+		const Edge key = { EdgeKey(to, from), 0 };
+		return std::equal_range(edges.begin(), edges.end(), key, EdgeLess);
+	};
+	auto neighbor = [&](GLuint from, GLuint to) {
+		auto range = adjacent(from, to);
+		for (auto edge = range.first; edge != range.second; ++edge)
+			if (!used[edge->triangle])
+				return edge->triangle;
+		return NO_TRIANGLE;
+	};
+
+	// Unused neighbours of every unused triangle, and the triangles by that count. Entries
+	// are not removed when the count drops; stale ones are skipped when taken.
+	std::vector<unsigned char> degree(nTriangles, 0);
+	std::vector<GLuint> byDegree[4];
+	for (size_t t = nTriangles; t-- > 0;) {
+		if (used[t])
+			continue;
+		for (int e = 0; e < 3; e++)
+			if (neighbor(indices[t * 3 + e], indices[t * 3 + (e + 1) % 3]) != NO_TRIANGLE)
+				degree[t]++;
+		byDegree[degree[t]].push_back((GLuint)t);
+	}
+
+	auto use = [&](GLuint t) {
+		used[t] = 1;
+		for (int e = 0; e < 3; e++) {
+			auto range = adjacent(indices[t * 3 + e], indices[t * 3 + (e + 1) % 3]);
+			for (auto edge = range.first; edge != range.second; ++edge) {
+				const GLuint other = edge->triangle;
+				if (!used[other] && degree[other] > 0)
+					byDegree[--degree[other]].push_back(other);
+			}
+		}
+	};
+
+	size_t count = 0;
+	for (;;) {
+		GLuint start = NO_TRIANGLE;
+		for (int d = 0; d < 4 && start == NO_TRIANGLE; d++) {
+			while (!byDegree[d].empty()) {
+				const GLuint t = byDegree[d].back();
+				byDegree[d].pop_back();
+				if (!used[t] && degree[t] == d) {
+					start = t;
+					break;
+				}
+			}
+		}
+		if (start == NO_TRIANGLE)
+			break;
+
+		// Begin at the corner that puts an edge with a neighbour last
+		const GLuint* corner = &indices[start * 3];
+		int first = 0;
+		for (int r = 0; r < 3; r++) {
+			if (neighbor(corner[(r + 1) % 3], corner[(r + 2) % 3]) != NO_TRIANGLE) {
+				first = r;
+				break;
+			}
+		}
+
+		if (count++)
+			strips.push_back(RESTART_INDEX);
+		strips.push_back(corner[first]);
+		strips.push_back(corner[(first + 1) % 3]);
+		strips.push_back(corner[(first + 2) % 3]);
+		use(start);
+
+		// Triangle n of a strip holds the edge p -> q of its last two vertices when n is
+		// even, and q -> p when n is odd
+		for (size_t n = 0;; n++) {
+			const GLuint p = strips[strips.size() - 2];
+			const GLuint q = strips.back();
+			const GLuint next = (n & 1) ? neighbor(q, p) : neighbor(p, q);
+			if (next == NO_TRIANGLE)
+				break;
+
+			const GLuint* nextCorner = &indices[next * 3];
+			for (int k = 0; k < 3; k++) {
+				if (nextCorner[k] != p && nextCorner[k] != q) {
+					strips.push_back(nextCorner[k]);
+					break;
+				}
+			}
+			use(next);
+		}
+	}
+	return count;
+}
+
+///////////////////////////////////////////////////
+//	VertexShaderRuns(const GLuint*, size_t, size_t)
+//
+//	indices: index list as drawn; restart indices are
+//	skipped
+//	cacheSize: post-transform cache entries
+//
+//	Returns how many times the vertex shader runs for the
+//	list, assuming a FIFO cache that starts empty
+///////////////////////////////////////////////////
+size_t MeshOptimizer::VertexShaderRuns(const GLuint* indices, size_t nIndices, size_t cacheSize) {
+	if (cacheSize == 0)
+		return nIndices - std::count(indices, indices + nIndices, RESTART_INDEX);
+
+	std::vector<GLuint> cache(cacheSize, EMPTY_SLOT);
+	size_t next = 0;
+	size_t runs = 0;
+	for (size_t i = 0; i < nIndices; i++) {
+		if (indices[i] == RESTART_INDEX || std::find(cache.begin(), cache.end(), indices[i]) != cache.end())
+			continue;
+		cache[next] = indices[i];
+		next = (next + 1) % cacheSize;
+		runs++;
+	}
+	return runs;
+}
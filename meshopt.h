@@ -0,0 +1,40 @@
+///////////////////////////////////////////////////////////////////////////////
+// meshopt.h
+// ========
+// mesh optimization passes: turn glDrawArrays vertex ranges into triangle
+// lists, weld duplicate vertices into an indexed mesh, join triangles into
+// strips, and estimate how often the vertex shader runs for an index list
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include "GL/glew.h"
+
+#include <cstddef>
+#include <vector>
+
+class MeshOptimizer {
+
+public:
+	// Vertex range of a non-indexed mesh, as passed to glDrawArrays
+	struct Range {
+		GLenum mode;		// GL_TRIANGLES, GL_TRIANGLE_STRIP or GL_TRIANGLE_FAN
+		GLint first;
+		GLsizei count;
+	};
+
+	// Post-transform cache entries assumed by VertexShaderRuns()
+	static const size_t VERTEX_CACHE_SIZE = 16;
+
+	// Separates the strips of a GL_TRIANGLE_STRIP index list; the value GL_PRIMITIVE_RESTART_FIXED_INDEX uses
+	static constexpr GLuint RESTART_INDEX = 0xFFFFFFFFu;
+
+public:
+	static void AppendTriangles(GLenum mode, GLint first, GLsizei count, std::vector<GLuint>& indices);
+	static void AppendTriangles(GLenum mode, const GLuint* indices, size_t nIndices, std::vector<GLuint>& triangles);
+	static size_t Weld(const GLfloat* verts, size_t nVertices, int floatsPerVertex, float epsilon,
+		std::vector<GLuint>& indices, std::vector<GLfloat>& welded);
+	static size_t Stripify(const GLuint* indices, size_t nIndices, std::vector<GLuint>& strips);
+	static size_t VertexShaderRuns(const GLuint* indices, size_t nIndices, size_t cacheSize = VERTEX_CACHE_SIZE);
+};
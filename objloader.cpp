@@ -0,0 +1,468 @@
+///////////////////////////////////////////////////////////////////////////////
+// objloader.cpp
+// ========
+// Wavefront OBJ importer: the memory-mapped file is split into line-aligned
+// chunks parsed in parallel, then position/uv/normal triplets are merged
+// into an indexed triangle mesh in the Meshes::GLMesh vertex layout
+//
+// Supported records are v, vt, vn and f (polygons are fanned into triangles,
+// negative indices count back from the last element). Everything else
+// (groups, materials, smoothing groups, lines) is skipped. Line ends are
+// found with memchr, which the C runtime vectorizes, and numbers are read
+// with std::from_chars, so no locale or allocation is involved per value.
+//
+// A negative index refers to elements read before it, which may lie in an
+// earlier chunk. Chunks store such indices relative to their own start and
+// flag them; once every chunk is parsed, the counts of the chunks before
+// are added. Corners are then merged through a hash map keyed by the index
+// triplet and bucketed by position index. Vertices of files without normals
+// get smooth, area-weighted ones.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#include "objloader.h"
+#include "jobs.h"
+#include "mappedfile.h"
+
+#include "glm/glm.hpp"
+
+#include <charconv>
+#include <chrono>
+#include <climits>
+#include <cstring>
+#include <iostream>
+
+namespace {
+	const int MISSING = INT_MIN;
+
+	// Corner indices that count back from the chunk's own elements
+	const unsigned char RELATIVE_POSITION = 1;
+	const unsigned char RELATIVE_UV = 2;
+	const unsigned char RELATIVE_NORMAL = 4;
+
+	// Chunks smaller than this are not worth a job
+	const size_t MIN_CHUNK_SIZE = 1024 * 1024;
+	const unsigned int CHUNKS_PER_THREAD = 4;
+
+	inline const char* SkipSpaces(const char* p, const char* end) {
+		while (p < end && (*p == ' ' || *p == '\t'))
+			p++;
+		return p;
+	}
+
+	inline bool ParseFloat(const char*& p, const char* end, float& value) {
+		p = SkipSpaces(p, end);
+		if (p < end && *p == '+')
+			p++;
+		std::from_chars_result result = std::from_chars(p, end, value);
+		if (result.ec != std::errc())
+			return false;
+		p = result.ptr;
+		return true;
+	}
+
+	// One index of a face corner: 1-based, or negative to count back from the
+	// elements read so far. Stored 0-based; negative ones are left relative to
+	// the chunk's count and flagged.
+	inline bool ParseIndex(const char*& p, const char* end, size_t chunkCount, unsigned char relativeBit,
+		int& index, unsigned char& relative) {
+		int value;
+		std::from_chars_result result = std::from_chars(p, end, value);
+		if (result.ec != std::errc() || value == 0)
+			return false;
+		p = result.ptr;
+
+		if (value > 0) {
+			index = value - 1;
+		}
+		else {
+			index = (int)chunkCount + value;
+			relative |= relativeBit;
+		}
+		return true;
+	}
+
+	double Megabytes(size_t bytes) {
+		return bytes / (1024.0 * 1024.0);
+	}
+}
+
+///////////////////////////////////////////////////
+//	ParseChunk(Chunk&)
+//
+//	Parse the lines in [begin, end). Runs on any job
+//	thread; touches nothing but the chunk.
+///////////////////////////////////////////////////
+void ObjLoader::ParseChunk(Chunk& chunk) {
+	chunk.error = nullptr;
+	const char* p = chunk.begin;
+	const char* const end = chunk.end;
+
+	Corner polygon[3];
+	unsigned char polygonRelative[3];
+
+	while (p < end) {
+		const char* lineEnd = (const char*)memchr(p, '\n', end - p);
+		if (!lineEnd)
+			lineEnd = end;
+		const char* line = p;
+		p = SkipSpaces(p, lineEnd);
+
+		bool valid = true;
+		if (lineEnd - p >= 2 && p[0] == 'v' && (p[1] == ' ' || p[1] == '\t')) {
+			float x, y, z;
+			p += 2;
+			valid = ParseFloat(p, lineEnd, x) && ParseFloat(p, lineEnd, y) && ParseFloat(p, lineEnd, z);
+			if (valid) {
+				chunk.positions.push_back(x);
+				chunk.positions.push_back(y);
+				chunk.positions.push_back(z);
+			}
+		}
+		else if (lineEnd - p >= 3 && p[0] == 'v' && p[1] == 't' && (p[2] == ' ' || p[2] == '\t')) {
+			float u, v = 0.0f;
+			p += 3;
+			valid = ParseFloat(p, lineEnd, u);
+			const char* second = p;
+			if (!ParseFloat(second, lineEnd, v))
+				v = 0.0f;
+			if (valid) {
+				chunk.uvs.push_back(u);
+				chunk.uvs.push_back(v);
+			}
+		}
+		else if (lineEnd - p >= 3 && p[0] == 'v' && p[1] == 'n' && (p[2] == ' ' || p[2] == '\t')) {
+			float x, y, z;
+			p += 3;
+			valid = ParseFloat(p, lineEnd, x) && ParseFloat(p, lineEnd, y) && ParseFloat(p, lineEnd, z);
+			if (valid) {
+				chunk.normals.push_back(x);
+				chunk.normals.push_back(y);
+				chunk.normals.push_back(z);
+			}
+		}
+		else if (lineEnd - p >= 2 && p[0] == 'f' && (p[1] == ' ' || p[1] == '\t')) {
+			// v, v/vt, v//vn or v/vt/vn per corner; triangles fan out from the first corner
+			p += 2;
+			int corners = 0;
+			for (;;) {
+				p = SkipSpaces(p, lineEnd);
+				if (p >= lineEnd || *p == '\r' || *p == '#')
+					break;
+
+				Corner corner = { MISSING, MISSING, MISSING };
+				unsigned char relative = 0;
+				if (!ParseIndex(p, lineEnd, chunk.positions.size() / 3, RELATIVE_POSITION, corner.v, relative)) {
+					valid = false;
+					break;
+				}
+				if (p < lineEnd && *p == '/') {
+					p++;
+					if (p < lineEnd && *p != '/' && !ParseIndex(p, lineEnd, chunk.uvs.size() / 2, RELATIVE_UV, corner.vt, relative)) {
+						valid = false;
+						break;
+					}
+					if (p < lineEnd && *p == '/') {
+						p++;
+						if (!ParseIndex(p, lineEnd, chunk.normals.size() / 3, RELATIVE_NORMAL, corner.vn, relative)) {
+							valid = false;
+							break;
+						}
+					}
+				}
+
+				// A corner ends at whitespace, a comment or the end of the line
+				if (p < lineEnd && *p != ' ' && *p != '\t' && *p != '\r' && *p != '#') {
+					valid = false;
+					break;
+				}
+
+				if (corners < 2) {
+					polygon[corners] = corner;
+					polygonRelative[corners] = relative;
+				}
+				else {
+					if (corners > 2) {
+						polygon[1] = polygon[2];
+						polygonRelative[1] = polygonRelative[2];
+					}
+					polygon[2] = corner;
+					polygonRelative[2] = relative;
+					chunk.corners.insert(chunk.corners.end(), polygon, polygon + 3);
+					chunk.relative.insert(chunk.relative.end(), polygonRelative, polygonRelative + 3);
+				}
+				corners++;
+			}
+		}
+
+		if (!valid) {
+			chunk.error = line;
+			return;
+		}
+		p = lineEnd + 1;
+	}
+}
+
+///////////////////////////////////////////////////
+//	Load(const char*, JobSystem*)
+//
+//	filename: OBJ file to import
+//	jobs: parses the chunks on its threads, or nullptr
+//
+//	Replaces gVertices and gIndices with the file's
+//	triangles. Returns false (after reporting the first
+//	malformed line) if the file cannot be read or parsed.
+///////////////////////////////////////////////////
+bool ObjLoader::Load(const char* filename, JobSystem* jobs) {
+	const auto start = std::chrono::steady_clock::now();
+	gVertices.clear();
+	gIndices.clear();
+
+	MappedFile file;
+	if (!file.Open(filename))
+		return false;
+	const char* data = file.Data();
+	const size_t size = file.Size();
+
+	// Line-aligned chunks, a few per thread so uneven ones even out
+	const unsigned int threads = jobs ? jobs->ThreadCount() : 1;
+	size_t chunkCount = size / MIN_CHUNK_SIZE;
+	if (chunkCount > (size_t)threads * CHUNKS_PER_THREAD)
+		chunkCount = (size_t)threads * CHUNKS_PER_THREAD;
+	if (chunkCount == 0)
+		chunkCount = 1;
+
+	gChunks.resize(chunkCount);
+	const char* chunkBegin = data;
+	for (size_t c = 0; c < chunkCount; c++) {
+		const char* chunkEnd = data + size;
+		if (c + 1 < chunkCount) {
+			const char* target = data + size * (c + 1) / chunkCount;
+			if (target < chunkBegin)
+				target = chunkBegin;
+			const char* newline = (const char*)memchr(target, '\n', data + size - target);
+			chunkEnd = newline ? newline + 1 : data + size;
+		}
+
+		Chunk& chunk = gChunks[c];
+		chunk.begin = chunkBegin;
+		chunk.end = chunkEnd;
+		chunk.positions.clear();
+		chunk.uvs.clear();
+		chunk.normals.clear();
+		chunk.corners.clear();
+		chunk.relative.clear();
+		chunkBegin = chunkEnd;
+	}
+
+	auto parse = [this](unsigned int begin, unsigned int end) {
+		for (unsigned int c = begin; c < end; c++)
+			ParseChunk(gChunks[c]);
+	};
+	if (jobs)
+		jobs->ParallelFor((unsigned int)chunkCount, 1, parse);
+	else
+		parse(0, (unsigned int)chunkCount);
+	const auto parsed = std::chrono::steady_clock::now();
+
+	const bool built = Build(filename);
+
+	// The chunks only point into the mapping, which closes here
+	for (Chunk& chunk : gChunks) {
+		std::vector<float>().swap(chunk.positions);
+		std::vector<float>().swap(chunk.uvs);
+		std::vector<float>().swap(chunk.normals);
+		std::vector<Corner>().swap(chunk.corners);
+		std::vector<unsigned char>().swap(chunk.relative);
+	}
+	if (!built) {
+		gVertices.clear();
+		gIndices.clear();
+		return false;
+	}
+
+	const auto finished = std::chrono::steady_clock::now();
+	const double seconds = std::chrono::duration<double>(finished - start).count();
+	gLastThroughput = seconds > 0.0 ? Megabytes(size) / seconds : 0.0;
+
+	const std::streamsize precision = std::cout.precision(1);
+	std::cout << std::fixed << "INFO: Loaded " << filename << " (" << gIndices.size() / 3 << " triangles, " << VertexCount()
+		<< " vertices): " << Megabytes(size) << " MB in " << seconds * 1000.0 << " ms, " << gLastThroughput << " MB/s (parse "
+		<< std::chrono::duration<double, std::milli>(parsed - start).count() << " ms on " << threads << " threads, index "
+		<< std::chrono::duration<double, std::milli>(finished - parsed).count() << " ms)" << std::defaultfloat << std::endl;
+	std::cout.precision(precision);
+	return true;
+}
+
+///////////////////////////////////////////////////
+//	Build(const char*)
+//
+//	Join the parsed chunks: resolve relative indices,
+//	merge identical corners into vertices and fill in
+//	missing normals
+///////////////////////////////////////////////////
+bool ObjLoader::Build(const char* filename) {
+	const char* const data = gChunks.front().begin;
+	size_t positionCount = 0, uvCount = 0, normalCount = 0, cornerCount = 0;
+	for (const Chunk& chunk : gChunks) {
+		if (chunk.error) {
+			size_t line = 1;
+			for (const char* p = data; (p = (const char*)memchr(p, '\n', chunk.error - p)) != nullptr; p++)
+				line++;
+			std::cout << "ERROR::OBJ::PARSE_FAILED " << filename << ":" << line << ": malformed record" << std::endl;
+			return false;
+		}
+		positionCount += chunk.positions.size() / 3;
+		uvCount += chunk.uvs.size() / 2;
+		normalCount += chunk.normals.size() / 3;
+		cornerCount += chunk.corners.size();
+	}
+	if (positionCount > INT_MAX || uvCount > INT_MAX || normalCount > INT_MAX || cornerCount > UINT_MAX) {
+		std::cout << "ERROR::OBJ::TOO_LARGE " << filename << std::endl;
+		return false;
+	}
+
+	// Hash map from (position, uv, normal) to vertex number, bucketed by position index: a
+	// position is rarely shared by more than a few vertices, and faces that are close in the
+	// file use positions that are close in the file, so lookups mostly hit the cache
+	std::vector<GLuint> firstVertex(positionCount, ~0u);
+	std::vector<GLuint> nextVertex;			// Next vertex in the same bucket
+	std::vector<Corner> keys;
+	nextVertex.reserve(positionCount + positionCount / 4);
+	keys.reserve(positionCount + positionCount / 4);
+	gVertices.reserve((positionCount + positionCount / 4) * FLOATS_PER_VERTEX);
+	gIndices.reserve(cornerCount);
+
+	// All elements in file order; each chunk's first one is where its relative indices start
+	std::vector<float> positions, uvs, normals;
+	positions.reserve(positionCount * 3);
+	uvs.reserve(uvCount * 2);
+	normals.reserve(normalCount * 3);
+
+	std::vector<Corner> starts(gChunks.size());		// Index of each chunk's first position, uv and normal
+	for (size_t c = 0; c < gChunks.size(); c++) {
+		Chunk& chunk = gChunks[c];
+		starts[c] = { (int)(positions.size() / 3), (int)(uvs.size() / 2), (int)(normals.size() / 3) };
+		positions.insert(positions.end(), chunk.positions.begin(), chunk.positions.end());
+		uvs.insert(uvs.end(), chunk.uvs.begin(), chunk.uvs.end());
+		normals.insert(normals.end(), chunk.normals.begin(), chunk.normals.end());
+		std::vector<float>().swap(chunk.positions);
+		std::vector<float>().swap(chunk.uvs);
+		std::vector<float>().swap(chunk.normals);
+	}
+
+	bool missingNormals = false;
+	for (size_t c = 0; c < gChunks.size(); c++) {
+		const Chunk& chunk = gChunks[c];
+		for (size_t k = 0; k < chunk.corners.size(); k++) {
+			Corner corner = chunk.corners[k];
+			const unsigned char relative = chunk.relative[k];
+			if (relative & RELATIVE_POSITION)
+				corner.v += starts[c].v;
+			if (relative & RELATIVE_UV)
+				corner.vt += starts[c].vt;
+			if (relative & RELATIVE_NORMAL)
+				corner.vn += starts[c].vn;
+
+			if (corner.v < 0 || (size_t)corner.v >= positionCount ||
+				(corner.vt != MISSING && (corner.vt < 0 || (size_t)corner.vt >= uvCount)) ||
+				(corner.vn != MISSING && (corner.vn < 0 || (size_t)corner.vn >= normalCount))) {
+				std::cout << "ERROR::OBJ::INDEX_OUT_OF_RANGE " << filename << ": face " << (gIndices.size() / 3 + 1) << std::endl;
+				return false;
+			}
+
+			GLuint vertex = firstVertex[corner.v];
+			while (vertex != ~0u && (keys[vertex].vt != corner.vt || keys[vertex].vn != corner.vn))
+				vertex = nextVertex[vertex];
+
+			if (vertex == ~0u) {
+				vertex = (GLuint)keys.size();
+				nextVertex.push_back(firstVertex[corner.v]);
+				firstVertex[corner.v] = vertex;
+				keys.push_back(corner);
+
+				const float* position = &positions[(size_t)corner.v * 3];
+				gVertices.insert(gVertices.end(), position, position + 3);
+				if (corner.vn != MISSING) {
+					const float* normal = &normals[(size_t)corner.vn * 3];
+					gVertices.insert(gVertices.end(), normal, normal + 3);
+				}
+				else {
+					gVertices.insert(gVertices.end(), 3, 0.0f);
+					missingNormals = true;
+				}
+				if (corner.vt != MISSING) {
+					const float* uv = &uvs[(size_t)corner.vt * 2];
+					gVertices.insert(gVertices.end(), uv, uv + 2);
+				}
+				else {
+					gVertices.insert(gVertices.end(), 2, 0.0f);
+				}
+			}
+			gIndices.push_back(vertex);
+		}
+	}
+
+	// Smooth normals, weighted by triangle area, for the vertices that had none
+	if (missingNormals) {
+		std::vector<unsigned char> generated(keys.size());
+		for (size_t v = 0; v < keys.size(); v++)
+			generated[v] = keys[v].vn == MISSING;
+
+		for (size_t t = 0; t + 3 <= gIndices.size(); t += 3) {
+			GLfloat* a = &gVertices[gIndices[t] * FLOATS_PER_VERTEX];
+			GLfloat* b = &gVertices[gIndices[t + 1] * FLOATS_PER_VERTEX];
+			GLfloat* c = &gVertices[gIndices[t + 2] * FLOATS_PER_VERTEX];
+			const glm::vec3 normal = glm::cross(glm::vec3(b[0] - a[0], b[1] - a[1], b[2] - a[2]),
+				glm::vec3(c[0] - a[0], c[1] - a[1], c[2] - a[2]));
+			for (int corner = 0; corner < 3; corner++) {
+				if (!generated[gIndices[t + corner]])
+					continue;
+				GLfloat* vertex = &gVertices[gIndices[t + corner] * FLOATS_PER_VERTEX];
+				vertex[3] += normal.x;
+				vertex[4] += normal.y;
+				vertex[5] += normal.z;
+			}
+		}
+
+		for (size_t v = 0; v < keys.size(); v++) {
+			if (!generated[v])
+				continue;
+			GLfloat* vertex = &gVertices[v * FLOATS_PER_VERTEX];
+			const float length = glm::length(glm::vec3(vertex[3], vertex[4], vertex[5]));
+			if (length > 0.0f) {
+				vertex[3] /= length;
+				vertex[4] /= length;
+				vertex[5] /= length;
+			}
+		}
+	}
+	return true;
+}
+
+///////////////////////////////////////////////////
+//	Benchmark(const char*, JobSystem*, int)
+//
+//	Import a file several times and report the best and
+//	average throughput. The first run includes reading the
+//	file from disk; the others mostly hit the page cache.
+///////////////////////////////////////////////////
+void ObjLoader::Benchmark(const char* filename, JobSystem* jobs, int runs) {
+	ObjLoader loader;
+	double best = 0.0, total = 0.0;
+	int completed = 0;
+	for (int run = 0; run < runs; run++) {
+		if (!loader.Load(filename, jobs))
+			break;
+		best = loader.LastThroughput() > best ? loader.LastThroughput() : best;
+		total += loader.LastThroughput();
+		completed++;
+	}
+	if (completed == 0)
+		return;
+
+	const std::streamsize precision = std::cout.precision(1);
+	std::cout << std::fixed << "INFO: OBJ benchmark: " << completed << " runs, best " << best << " MB/s, average "
+		<< total / completed << " MB/s" << std::defaultfloat << std::endl;
+	std::cout.precision(precision);
+}
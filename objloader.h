@@ -0,0 +1,60 @@
+///////////////////////////////////////////////////////////////////////////////
+// objloader.h
+// ========
+// Wavefront OBJ importer: the memory-mapped file is split into line-aligned
+// chunks parsed in parallel, then position/uv/normal triplets are merged
+// into an indexed triangle mesh in the Meshes::GLMesh vertex layout
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include "GL/glew.h"
+
+#include <cstddef>
+#include <vector>
+
+class JobSystem;
+
+class ObjLoader {
+
+public:
+	// Interleaved position (3), normal (3), uv (2) per vertex, as Meshes::GLMesh buffers hold them
+	std::vector<GLfloat> gVertices;
+	std::vector<GLuint> gIndices;			// Triangle list
+
+	static const int FLOATS_PER_VERTEX = 8;
+
+public:
+	bool Load(const char* filename, JobSystem* jobs);
+	static void Benchmark(const char* filename, JobSystem* jobs, int runs);
+
+	size_t VertexCount() const { return gVertices.size() / FLOATS_PER_VERTEX; }
+	double LastThroughput() const { return gLastThroughput; }
+
+private:
+	// Face corner: 0-based position, uv and normal indices, MISSING when absent
+	struct Corner {
+		int v;
+		int vt;
+		int vn;
+	};
+
+	// Parse results of one line-aligned range of the file
+	struct Chunk {
+		const char* begin;
+		const char* end;
+		std::vector<float> positions;
+		std::vector<float> uvs;
+		std::vector<float> normals;
+		std::vector<Corner> corners;			// Three per triangle, polygons fanned
+		std::vector<unsigned char> relative;	// Per corner, RELATIVE_* bits for negative references
+		const char* error;						// First malformed line, or nullptr
+	};
+
+	static void ParseChunk(Chunk& chunk);
+	bool Build(const char* filename);
+
+	std::vector<Chunk> gChunks;
+	double gLastThroughput = 0.0;			// MB/s of the last Load()
+};
@@ -0,0 +1,414 @@
+///////////////////////////////////////////////////////////////////////////////
+// occlusion.cpp
+// ========
+// CPU occlusion culling: large boxes are rasterized into a small software
+// depth buffer, and objects hidden behind them are dropped before drawing
+//
+// Each frame the largest on-screen box objects are chosen as occluders and
+// rasterized (SSE2, four pixels at a time) into a WIDTH x HEIGHT buffer of
+// 1 / w, in horizontal bands on the job threads. Rasterization is
+// conservative: a pixel is written only when the triangle covers all of it,
+// and it gets the farthest depth the triangle has over its area, so a pixel
+// at an occluder's silhouette or on a sloped face never hides more than the
+// occluder does. A min/max hierarchy is built on top of it. An object is occluded when the nearest point of its bounding
+// box is behind the farthest occluder depth of every texel its screen
+// rectangle touches; the test starts at a coarse level and only descends
+// where that level is inconclusive. No GPU readback is involved, so the
+// result is ready in the same frame.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#include "occlusion.h"
+#include "jobs.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define OCCLUSION_SSE2
+#include <emmintrin.h>
+#endif
+
+namespace {
+	// Boxes covering fewer pixels than this hide too little to be worth rasterizing
+	const int MIN_OCCLUDER_AREA = 64;
+
+	// Rows per rasterization job
+	const int BAND_HEIGHT = 16;
+
+	// Vertices closer than this (clip w) are treated as crossing the near plane
+	const float MIN_W = 1e-3f;
+
+	// Corner c of a box: bit 0 selects max x, bit 1 max y, bit 2 max z
+	const int BOX_TRIANGLES[12][3] = {
+		{ 0, 2, 6 }, { 0, 6, 4 },	// -x
+		{ 1, 3, 7 }, { 1, 7, 5 },	// +x
+		{ 0, 1, 5 }, { 0, 5, 4 },	// -y
+		{ 2, 3, 7 }, { 2, 7, 6 },	// +y
+		{ 0, 1, 3 }, { 0, 3, 2 },	// -z
+		{ 4, 5, 7 }, { 4, 7, 6 },	// +z
+	};
+
+	inline glm::vec3 Corner(const AABB& box, int c) {
+		return glm::vec3((c & 1) ? box.max.x : box.min.x, (c & 2) ? box.max.y : box.min.y, (c & 4) ? box.max.z : box.min.z);
+	}
+
+	// Edge function coefficients: value(x, y) = a * x + b * y + c, positive inside
+	struct Edge {
+		float a, b, c;
+	};
+
+	inline Edge MakeEdge(float x0, float y0, float x1, float y1) {
+		Edge edge;
+		edge.a = y0 - y1;
+		edge.b = x1 - x0;
+		edge.c = -(edge.a * x0 + edge.b * y0);
+		return edge;
+	}
+}
+
+float OcclusionCuller::MinAt(int level, int x, int y) const {
+	return level == 0 ? gDepth[y * WIDTH + x] : gLevels[level].min[y * gLevels[level].width + x];
+}
+
+float OcclusionCuller::MaxAt(int level, int x, int y) const {
+	return level == 0 ? gDepth[y * WIDTH + x] : gLevels[level].max[y * gLevels[level].width + x];
+}
+
+///////////////////////////////////////////////////
+//	Project(const AABB&, ScreenRect&)
+//
+//	Screen rectangle and nearest depth of a world space
+//	box. Returns false when the box reaches behind the
+//	camera or is entirely off screen; such boxes are
+//	never treated as occluded.
+///////////////////////////////////////////////////
+bool OcclusionCuller::Project(const AABB& box, ScreenRect& rect) const {
+	float minX = 1e30f, minY = 1e30f, maxX = -1e30f, maxY = -1e30f;
+	rect.nearest = 0.0f;
+
+	for (int c = 0; c < 8; c++) {
+		glm::vec4 clip = gViewProjection * glm::vec4(Corner(box, c), 1.0f);
+		if (clip.w < MIN_W)
+			return false;
+
+		const float invW = 1.0f / clip.w;
+		const float x = (clip.x * invW * 0.5f + 0.5f) * WIDTH;
+		const float y = (clip.y * invW * 0.5f + 0.5f) * HEIGHT;
+		minX = std::min(minX, x);
+		maxX = std::max(maxX, x);
+		minY = std::min(minY, y);
+		maxY = std::max(maxY, y);
+		rect.nearest = std::max(rect.nearest, invW);
+	}
+
+	rect.x0 = std::max((int)std::floor(minX), 0);
+	rect.y0 = std::max((int)std::floor(minY), 0);
+	rect.x1 = std::min((int)std::floor(maxX), WIDTH - 1);
+	rect.y1 = std::min((int)std::floor(maxY), HEIGHT - 1);
+	return rect.x0 <= rect.x1 && rect.y0 <= rect.y1;
+}
+
+// Transform the 12 triangles of an occluder box to screen space
+void OcclusionCuller::SetupOccluder(int occluder, const glm::mat4& world, const AABB& bounds) {
+	const glm::mat4 matrix = gViewProjection * world;
+
+	ScreenVertex corners[8];
+	bool inFront[8];
+	for (int c = 0; c < 8; c++) {
+		glm::vec4 clip = matrix * glm::vec4(Corner(bounds, c), 1.0f);
+		inFront[c] = clip.w >= MIN_W;
+		const float invW = inFront[c] ? 1.0f / clip.w : 0.0f;
+		corners[c].x = (clip.x * invW * 0.5f + 0.5f) * WIDTH;
+		corners[c].y = (clip.y * invW * 0.5f + 0.5f) * HEIGHT;
+		corners[c].invW = invW;
+	}
+
+	for (int t = 0; t < 12; t++) {
+		Triangle& triangle = gTriangles[occluder * 12 + t];
+		const int* index = BOX_TRIANGLES[t];
+
+		// Triangles crossing the near plane are dropped rather than clipped:
+		// missing occluder area only makes the culling less effective
+		triangle.valid = inFront[index[0]] && inFront[index[1]] && inFront[index[2]];
+		if (!triangle.valid)
+			continue;
+
+		triangle.v[0] = corners[index[0]];
+		triangle.v[1] = corners[index[1]];
+		triangle.v[2] = corners[index[2]];
+
+		// Counter-clockwise, so the edge functions are positive inside
+		const ScreenVertex* v = triangle.v;
+		float area = (v[1].x - v[0].x) * (v[2].y - v[0].y) - (v[2].x - v[0].x) * (v[1].y - v[0].y);
+		if (area < 0.0f)
+			std::swap(triangle.v[1], triangle.v[2]);
+		triangle.valid = std::fabs(area) > 1e-6f;
+	}
+}
+
+///////////////////////////////////////////////////
+//	RasterizeBand(int, int)
+//
+//	Rasterize every occluder triangle into rows [y0, y1),
+//	keeping the nearest depth per pixel. Bands do not
+//	overlap, so they can be rasterized concurrently.
+///////////////////////////////////////////////////
+void OcclusionCuller::RasterizeBand(int y0, int y1) {
+	std::fill(gDepth.begin() + y0 * WIDTH, gDepth.begin() + y1 * WIDTH, 0.0f);
+
+	for (const Triangle& triangle : gTriangles) {
+		if (!triangle.valid)
+			continue;
+
+		const ScreenVertex* v = triangle.v;
+		const float minY = std::min(v[0].y, std::min(v[1].y, v[2].y));
+		const float maxY = std::max(v[0].y, std::max(v[1].y, v[2].y));
+		const int rowBegin = std::max((int)std::floor(minY), y0);
+		const int rowEnd = std::min((int)std::ceil(maxY), y1);
+		if (rowBegin >= rowEnd)
+			continue;
+
+		const float minX = std::min(v[0].x, std::min(v[1].x, v[2].x));
+		const float maxX = std::max(v[0].x, std::max(v[1].x, v[2].x));
+		const int columnBegin = std::max((int)std::floor(minX), 0) & ~3;
+		const int columnEnd = std::min((int)std::ceil(maxX), WIDTH);
+		if (columnBegin >= columnEnd)
+			continue;
+
+		// Edge i is opposite vertex i, so its value is that vertex's barycentric weight (times the area)
+		Edge edges[3] = {
+			MakeEdge(v[1].x, v[1].y, v[2].x, v[2].y),
+			MakeEdge(v[2].x, v[2].y, v[0].x, v[0].y),
+			MakeEdge(v[0].x, v[0].y, v[1].x, v[1].y),
+		};
+		const float area = edges[0].a * v[0].x + edges[0].b * v[0].y + edges[0].c;
+		const float invArea = 1.0f / area;
+
+		// 1 / w is linear in screen space
+		Edge depth;
+		depth.a = (edges[0].a * v[0].invW + edges[1].a * v[1].invW + edges[2].a * v[2].invW) * invArea;
+		depth.b = (edges[0].b * v[0].invW + edges[1].b * v[1].invW + edges[2].b * v[2].invW) * invArea;
+		depth.c = (edges[0].c * v[0].invW + edges[1].c * v[1].invW + edges[2].c * v[2].invW) * invArea;
+
+		// A linear function is smallest over a pixel at one of its corners, half a pixel from the
+		// centre in x and y. Lowering the edges by that much at the centre keeps only fully covered
+		// pixels; lowering 1 / w gives the farthest depth over the pixel.
+		for (int i = 0; i < 3; i++)
+			edges[i].c -= 0.5f * (std::fabs(edges[i].a) + std::fabs(edges[i].b));
+		depth.c -= 0.5f * (std::fabs(depth.a) + std::fabs(depth.b));
+
+		for (int y = rowBegin; y < rowEnd; y++) {
+			const float py = y + 0.5f;
+			const float px = columnBegin + 0.5f;
+			float* row = &gDepth[y * WIDTH];
+
+#ifdef OCCLUSION_SSE2
+			const __m128 offsets = _mm_setr_ps(0.0f, 1.0f, 2.0f, 3.0f);
+			const __m128 zero = _mm_setzero_ps();
+			__m128 e[3], eStep[3];
+			for (int i = 0; i < 3; i++) {
+				e[i] = _mm_add_ps(_mm_set1_ps(edges[i].a * px + edges[i].b * py + edges[i].c),
+					_mm_mul_ps(_mm_set1_ps(edges[i].a), offsets));
+				eStep[i] = _mm_set1_ps(edges[i].a * 4.0f);
+			}
+			__m128 z = _mm_add_ps(_mm_set1_ps(depth.a * px + depth.b * py + depth.c), _mm_mul_ps(_mm_set1_ps(depth.a), offsets));
+			const __m128 zStep = _mm_set1_ps(depth.a * 4.0f);
+
+			for (int x = columnBegin; x < columnEnd; x += 4) {
+				__m128 inside = _mm_and_ps(_mm_and_ps(_mm_cmpge_ps(e[0], zero), _mm_cmpge_ps(e[1], zero)), _mm_cmpge_ps(e[2], zero));
+				if (_mm_movemask_ps(inside)) {
+					__m128 current = _mm_loadu_ps(row + x);
+					__m128 nearer = _mm_max_ps(current, z);
+					_mm_storeu_ps(row + x, _mm_or_ps(_mm_and_ps(inside, nearer), _mm_andnot_ps(inside, current)));
+				}
+				for (int i = 0; i < 3; i++)
+					e[i] = _mm_add_ps(e[i], eStep[i]);
+				z = _mm_add_ps(z, zStep);
+			}
+#else
+			for (int x = columnBegin; x < columnEnd; x++) {
+				const float cx = x + 0.5f;
+				if (edges[0].a * cx + edges[0].b * py + edges[0].c >= 0.0f &&
+					edges[1].a * cx + edges[1].b * py + edges[1].c >= 0.0f &&
+					edges[2].a * cx + edges[2].b * py + edges[2].c >= 0.0f) {
+					const float z = depth.a * cx + depth.b * py + depth.c;
+					if (z > row[x])
+						row[x] = z;
+				}
+			}
+#endif
+		}
+	}
+}
+
+///////////////////////////////////////////////////
+//	BuildHierarchy()
+//
+//	Min and max of each 2x2 block, level by level, down
+//	to a single texel
+///////////////////////////////////////////////////
+void OcclusionCuller::BuildHierarchy() {
+	for (size_t level = 1; level < gLevels.size(); level++) {
+		Level& current = gLevels[level];
+		const int belowWidth = level == 1 ? WIDTH : gLevels[level - 1].width;
+		const int belowHeight = level == 1 ? HEIGHT : gLevels[level - 1].height;
+
+		for (int y = 0; y < current.height; y++) {
+			for (int x = 0; x < current.width; x++) {
+				const int x0 = x * 2, x1 = std::min(x * 2 + 1, belowWidth - 1);
+				const int y0 = y * 2, y1 = std::min(y * 2 + 1, belowHeight - 1);
+				const int below = (int)level - 1;
+
+				current.min[y * current.width + x] = std::min(
+					std::min(MinAt(below, x0, y0), MinAt(below, x1, y0)),
+					std::min(MinAt(below, x0, y1), MinAt(below, x1, y1)));
+				current.max[y * current.width + x] = std::max(
+					std::max(MaxAt(below, x0, y0), MaxAt(below, x1, y0)),
+					std::max(MaxAt(below, x0, y1), MaxAt(below, x1, y1)));
+			}
+		}
+	}
+}
+
+// Whether the part of rect inside texel (x, y) of a level is hidden
+bool OcclusionCuller::IsTexelOccluded(int level, int x, int y, const ScreenRect& rect) const {
+	if (rect.nearest >= MaxAt(level, x, y))
+		return false;		// In front of every occluder pixel in the texel
+	if (rect.nearest < MinAt(level, x, y))
+		return true;		// Behind every occluder pixel in the texel
+
+	// Inconclusive (level 0 never is): look at the covered children
+	const int below = level - 1;
+	const int childX0 = std::max(x * 2, rect.x0 >> below), childX1 = std::min(x * 2 + 1, rect.x1 >> below);
+	const int childY0 = std::max(y * 2, rect.y0 >> below), childY1 = std::min(y * 2 + 1, rect.y1 >> below);
+	for (int cy = childY0; cy <= childY1; cy++)
+		for (int cx = childX0; cx <= childX1; cx++)
+			if (!IsTexelOccluded(below, cx, cy, rect))
+				return false;
+	return true;
+}
+
+bool OcclusionCuller::IsOccluded(const ScreenRect& rect) const {
+	// Coarsest level at which the rectangle still spans at most 2x2 texels
+	int level = 0;
+	while (level + 1 < (int)gLevels.size() &&
+		((rect.x1 >> level) - (rect.x0 >> level) > 1 || (rect.y1 >> level) - (rect.y0 >> level) > 1))
+		level++;
+
+	for (int y = rect.y0 >> level; y <= rect.y1 >> level; y++)
+		for (int x = rect.x0 >> level; x <= rect.x1 >> level; x++)
+			if (!IsTexelOccluded(level, x, y, rect))
+				return false;
+	return true;
+}
+
+///////////////////////////////////////////////////
+//	Cull(viewProjection, world, objectMesh, meshBounds, occluderMeshes, culling, jobs)
+//
+//	world, objectMesh: world matrix and mesh of every object
+//	meshBounds: local bounds of every mesh
+//	occluderMeshes: per mesh, non-zero if its bounds are
+//	solid (a box), so it can hide what is behind it
+//	culling: frustum culling results of this frame; the
+//	gVisible flags of occluded objects are cleared
+//	jobs: spreads the work over its threads, or nullptr
+///////////////////////////////////////////////////
+void OcclusionCuller::Cull(const glm::mat4& viewProjection, const std::vector<glm::mat4>& world,
+	const std::vector<int>& objectMesh, const std::vector<AABB>& meshBounds,
+	const std::vector<unsigned char>& occluderMeshes, Culling& culling, JobSystem* jobs) {
+	gViewProjection = viewProjection;
+	gOccludedCount = 0;
+
+	if (gDepth.empty()) {
+		gDepth.resize(WIDTH * HEIGHT);
+		gLevels.resize(1);
+		for (int width = WIDTH, height = HEIGHT; width > 1 || height > 1;) {
+			width = std::max(width / 2, 1);
+			height = std::max(height / 2, 1);
+			Level level;
+			level.width = width;
+			level.height = height;
+			level.min.resize(width * height);
+			level.max.resize(width * height);
+			gLevels.push_back(level);
+		}
+	}
+
+	// Occluders: the visible boxes with the largest screen area
+	const size_t objectCount = objectMesh.size();
+	std::vector<std::pair<int, int>>& candidates = gCandidates;
+	candidates.clear();
+	for (size_t i = 0; i < objectCount; i++) {
+		ScreenRect rect;
+		if (!culling.gVisible[i] || !occluderMeshes[objectMesh[i]] || !Project(culling.gWorldBounds[i], rect))
+			continue;
+		const int area = (rect.x1 - rect.x0 + 1) * (rect.y1 - rect.y0 + 1);
+		if (area >= MIN_OCCLUDER_AREA)
+			candidates.push_back(std::make_pair(area, (int)i));
+	}
+	if (candidates.size() > (size_t)MAX_OCCLUDERS) {
+		std::nth_element(candidates.begin(), candidates.begin() + MAX_OCCLUDERS, candidates.end(),
+			[](const std::pair<int, int>& a, const std::pair<int, int>& b) { return a.first > b.first; });
+		candidates.resize(MAX_OCCLUDERS);
+	}
+
+	gOccluders.clear();
+	gIsOccluder.assign(objectCount, 0);
+	for (const std::pair<int, int>& candidate : candidates) {
+		gOccluders.push_back(candidate.second);
+		gIsOccluder[candidate.second] = 1;
+	}
+	if (gOccluders.empty())
+		return;
+
+	// Rasterize
+	gTriangles.resize(gOccluders.size() * 12);
+	auto setup = [&](unsigned int begin, unsigned int end) {
+		for (unsigned int o = begin; o < end; o++) {
+			const int object = gOccluders[o];
+			SetupOccluder((int)o, world[object], meshBounds[objectMesh[object]]);
+		}
+	};
+	auto rasterize = [this](unsigned int begin, unsigned int end) {
+		for (unsigned int band = begin; band < end; band++)
+			RasterizeBand(band * BAND_HEIGHT, std::min((int)(band + 1) * BAND_HEIGHT, HEIGHT));
+	};
+	const unsigned int bandCount = (HEIGHT + BAND_HEIGHT - 1) / BAND_HEIGHT;
+
+	if (jobs) {
+		jobs->ParallelFor((unsigned int)gOccluders.size(), 8, setup);
+		jobs->ParallelFor(bandCount, 1, rasterize);
+	}
+	else {
+		setup(0, (unsigned int)gOccluders.size());
+		rasterize(0, bandCount);
+	}
+
+	BuildHierarchy();
+
+	// Test everything else that survived frustum culling. Occluders are not
+	// tested: they are drawn whenever they are in the frustum.
+	std::atomic<size_t> occluded{ 0 };
+	auto test = [&](unsigned int begin, unsigned int end) {
+		size_t hidden = 0;
+		for (unsigned int i = begin; i < end; i++) {
+			ScreenRect rect;
+			if (!culling.gVisible[i] || gIsOccluder[i] || !Project(culling.gWorldBounds[i], rect))
+				continue;
+			if (IsOccluded(rect)) {
+				culling.gVisible[i] = 0;
+				hidden++;
+			}
+		}
+		occluded.fetch_add(hidden, std::memory_order_relaxed);
+	};
+
+	if (jobs)
+		jobs->ParallelFor((unsigned int)objectCount, 128, test);
+	else
+		test(0, (unsigned int)objectCount);
+
+	gOccludedCount = occluded.load(std::memory_order_relaxed);
+}
@@ -0,0 +1,78 @@
+///////////////////////////////////////////////////////////////////////////////
+// occlusion.h
+// ========
+// CPU occlusion culling: large boxes are rasterized into a small software
+// depth buffer, and objects hidden behind them are dropped before drawing
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include "glm/glm.hpp"
+#include "culling.h"
+
+#include <utility>
+#include <vector>
+
+class JobSystem;
+
+class OcclusionCuller {
+
+public:
+	// Depth buffer resolution; WIDTH must be a multiple of 4 (one SSE register)
+	static const int WIDTH = 256;
+	static const int HEIGHT = 128;
+
+	static const int MAX_OCCLUDERS = 64;
+
+public:
+	void Cull(const glm::mat4& viewProjection, const std::vector<glm::mat4>& world,
+		const std::vector<int>& objectMesh, const std::vector<AABB>& meshBounds,
+		const std::vector<unsigned char>& occluderMeshes, Culling& culling, JobSystem* jobs);
+
+	size_t OccluderCount() const { return gOccluders.size(); }
+	size_t OccludedCount() const { return gOccludedCount; }
+
+private:
+	struct ScreenVertex {
+		float x, y;		// Pixels
+		float invW;		// 1 / clip w, larger is nearer
+	};
+
+	struct Triangle {
+		ScreenVertex v[3];
+		bool valid;		// False when behind the camera or degenerate
+	};
+
+	// Pixels an object may cover and the depth of its nearest point
+	struct ScreenRect {
+		int x0, y0, x1, y1;	// Inclusive
+		float nearest;		// Largest 1 / w of the box corners
+	};
+
+	// Min and max of 2x2 texels of the level below; level 0 is gDepth itself
+	struct Level {
+		int width, height;
+		std::vector<float> min;
+		std::vector<float> max;
+	};
+
+	bool Project(const AABB& box, ScreenRect& rect) const;
+	void SetupOccluder(int occluder, const glm::mat4& world, const AABB& bounds);
+	void RasterizeBand(int y0, int y1);
+	void BuildHierarchy();
+	bool IsOccluded(const ScreenRect& rect) const;
+	bool IsTexelOccluded(int level, int x, int y, const ScreenRect& rect) const;
+
+	float MinAt(int level, int x, int y) const;
+	float MaxAt(int level, int x, int y) const;
+
+	glm::mat4 gViewProjection;
+	std::vector<float> gDepth;				// WIDTH x HEIGHT, 1 / w of the nearest occluder, 0 where there is none
+	std::vector<Level> gLevels;				// Index 0 unused (gDepth)
+	std::vector<Triangle> gTriangles;		// 12 per occluder
+	std::vector<int> gOccluders;			// Objects rasterized this frame
+	std::vector<std::pair<int, int>> gCandidates;	// (screen area, object) of possible occluders
+	std::vector<unsigned char> gIsOccluder;	// Per object
+	size_t gOccludedCount = 0;
+};
@@ -0,0 +1,241 @@
+///////////////////////////////////////////////////////////////////////////////
+// picking.cpp
+// ========
+// object picking by ray casting on the CPU: the scene's object BVH finds the
+// candidate objects, a triangle BVH per mesh finds the exact hit
+//
+// A mesh's triangles are first ordered along a BVH built over them, so that
+// runs of four neighbouring triangles can be packed together. A second BVH
+// over those packets is what rays walk; at its leaves the four triangles of
+// a packet are tested with one 4-wide Moller-Trumbore intersection. Nothing
+// is read back from the GPU, so a pick never stalls the pipeline.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#include "picking.h"
+
+#include <cfloat>
+#include <cmath>
+
+#if defined(_M_X64) || defined(__SSE2__)
+#include <emmintrin.h>
+#define PICKING_SSE 1
+#endif
+
+namespace {
+	// Triangles whose edges are (nearly) parallel to the ray are missed
+	const float PARALLEL_EPSILON = 1e-12f;
+}
+
+///////////////////////////////////////////////////
+//	Build(const std::vector<glm::vec3>&, const std::vector<unsigned int>&)
+//
+//	positions: local space vertex positions
+//	indices: three per triangle
+//
+//	Returns false if there are no triangles
+///////////////////////////////////////////////////
+bool MeshRaycaster::Build(const std::vector<glm::vec3>& positions, const std::vector<unsigned int>& indices) {
+	gPackets.clear();
+	gPacketBounds.clear();
+
+	// Drop triangles that refer to missing vertices
+	std::vector<AABB> triangleBounds;
+	std::vector<unsigned int> triangles;
+	for (size_t i = 0; i + 2 < indices.size(); i += 3) {
+		if (indices[i] >= positions.size() || indices[i + 1] >= positions.size() || indices[i + 2] >= positions.size())
+			continue;
+
+		const glm::vec3& a = positions[indices[i]];
+		const glm::vec3& b = positions[indices[i + 1]];
+		const glm::vec3& c = positions[indices[i + 2]];
+		AABB box;
+		box.min = glm::min(a, glm::min(b, c));
+		box.max = glm::max(a, glm::max(b, c));
+		triangleBounds.push_back(box);
+		triangles.push_back((unsigned int)i);
+	}
+
+	gTriangleCount = triangles.size();
+	if (triangles.empty()) {
+		gBVH.Build(gPacketBounds);
+		return false;
+	}
+
+	// The triangle BVH is only needed for its leaf order
+	BVH triangleBVH;
+	triangleBVH.Build(triangleBounds);
+
+	const size_t packetCount = (triangles.size() + 3) / 4;
+	gPackets.resize(packetCount);
+	gPacketBounds.resize(packetCount);
+	for (size_t p = 0; p < packetCount; p++) {
+		Packet& packet = gPackets[p];
+		AABB& box = gPacketBounds[p];
+		box.min = glm::vec3(FLT_MAX);
+		box.max = glm::vec3(-FLT_MAX);
+
+		for (int lane = 0; lane < 4; lane++) {
+			glm::vec3 v0(0.0f), e1(0.0f), e2(0.0f);
+			const size_t t = p * 4 + lane;
+			if (t < triangles.size()) {
+				const int triangle = triangleBVH.gIndices[t];
+				const unsigned int i = triangles[triangle];
+				v0 = positions[indices[i]];
+				e1 = positions[indices[i + 1]] - v0;
+				e2 = positions[indices[i + 2]] - v0;
+				box.min = glm::min(box.min, triangleBounds[triangle].min);
+				box.max = glm::max(box.max, triangleBounds[triangle].max);
+			}
+			packet.v0x[lane] = v0.x; packet.v0y[lane] = v0.y; packet.v0z[lane] = v0.z;
+			packet.e1x[lane] = e1.x; packet.e1y[lane] = e1.y; packet.e1z[lane] = e1.z;
+			packet.e2x[lane] = e2.x; packet.e2y[lane] = e2.y; packet.e2z[lane] = e2.z;
+		}
+	}
+
+	gBVH.Build(gPacketBounds);
+	return true;
+}
+
+///////////////////////////////////////////////////
+//	IntersectPacket(const Packet&, const glm::vec3&, const glm::vec3&, float&)
+//
+//	Moller-Trumbore against the four triangles of a
+//	packet. Both sides of a triangle count. Shortens
+//	distance and returns true on a hit nearer than it.
+///////////////////////////////////////////////////
+bool MeshRaycaster::IntersectPacket(const Packet& packet, const glm::vec3& origin, const glm::vec3& direction, float& distance) {
+#ifdef PICKING_SSE
+	const __m128 dx = _mm_set1_ps(direction.x), dy = _mm_set1_ps(direction.y), dz = _mm_set1_ps(direction.z);
+	const __m128 e1x = _mm_loadu_ps(packet.e1x), e1y = _mm_loadu_ps(packet.e1y), e1z = _mm_loadu_ps(packet.e1z);
+	const __m128 e2x = _mm_loadu_ps(packet.e2x), e2y = _mm_loadu_ps(packet.e2y), e2z = _mm_loadu_ps(packet.e2z);
+
+	// p = direction x e2, det = e1 . p
+	const __m128 px = _mm_sub_ps(_mm_mul_ps(dy, e2z), _mm_mul_ps(dz, e2y));
+	const __m128 py = _mm_sub_ps(_mm_mul_ps(dz, e2x), _mm_mul_ps(dx, e2z));
+	const __m128 pz = _mm_sub_ps(_mm_mul_ps(dx, e2y), _mm_mul_ps(dy, e2x));
+	const __m128 det = _mm_add_ps(_mm_add_ps(_mm_mul_ps(e1x, px), _mm_mul_ps(e1y, py)), _mm_mul_ps(e1z, pz));
+
+	const __m128 absDet = _mm_andnot_ps(_mm_set1_ps(-0.0f), det);
+	__m128 valid = _mm_cmpgt_ps(absDet, _mm_set1_ps(PARALLEL_EPSILON));
+	if (!_mm_movemask_ps(valid))
+		return false;
+	const __m128 inverseDet = _mm_div_ps(_mm_set1_ps(1.0f), det);
+
+	// s = origin - v0, u = (s . p) / det
+	const __m128 sx = _mm_sub_ps(_mm_set1_ps(origin.x), _mm_loadu_ps(packet.v0x));
+	const __m128 sy = _mm_sub_ps(_mm_set1_ps(origin.y), _mm_loadu_ps(packet.v0y));
+	const __m128 sz = _mm_sub_ps(_mm_set1_ps(origin.z), _mm_loadu_ps(packet.v0z));
+	const __m128 u = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(sx, px), _mm_mul_ps(sy, py)), _mm_mul_ps(sz, pz)), inverseDet);
+
+	// q = s x e1, v = (direction . q) / det, t = (e2 . q) / det
+	const __m128 qx = _mm_sub_ps(_mm_mul_ps(sy, e1z), _mm_mul_ps(sz, e1y));
+	const __m128 qy = _mm_sub_ps(_mm_mul_ps(sz, e1x), _mm_mul_ps(sx, e1z));
+	const __m128 qz = _mm_sub_ps(_mm_mul_ps(sx, e1y), _mm_mul_ps(sy, e1x));
+	const __m128 v = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, qx), _mm_mul_ps(dy, qy)), _mm_mul_ps(dz, qz)), inverseDet);
+	const __m128 t = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(e2x, qx), _mm_mul_ps(e2y, qy)), _mm_mul_ps(e2z, qz)), inverseDet);
+
+	const __m128 zero = _mm_setzero_ps();
+	valid = _mm_and_ps(valid, _mm_cmpge_ps(u, zero));
+	valid = _mm_and_ps(valid, _mm_cmpge_ps(v, zero));
+	valid = _mm_and_ps(valid, _mm_cmple_ps(_mm_add_ps(u, v), _mm_set1_ps(1.0f)));
+	valid = _mm_and_ps(valid, _mm_cmpgt_ps(t, zero));
+	valid = _mm_and_ps(valid, _mm_cmplt_ps(t, _mm_set1_ps(distance)));
+
+	const int mask = _mm_movemask_ps(valid);
+	if (!mask)
+		return false;
+
+	float hits[4];
+	_mm_storeu_ps(hits, t);
+	for (int lane = 0; lane < 4; lane++)
+		if ((mask & (1 << lane)) && hits[lane] < distance)
+			distance = hits[lane];
+	return true;
+#else
+	bool hit = false;
+	for (int lane = 0; lane < 4; lane++) {
+		const glm::vec3 e1(packet.e1x[lane], packet.e1y[lane], packet.e1z[lane]);
+		const glm::vec3 e2(packet.e2x[lane], packet.e2y[lane], packet.e2z[lane]);
+		const glm::vec3 p = glm::cross(direction, e2);
+		const float det = glm::dot(e1, p);
+		if (std::fabs(det) <= PARALLEL_EPSILON)
+			continue;
+
+		const float inverseDet = 1.0f / det;
+		const glm::vec3 s = origin - glm::vec3(packet.v0x[lane], packet.v0y[lane], packet.v0z[lane]);
+		const float u = glm::dot(s, p) * inverseDet;
+		const glm::vec3 q = glm::cross(s, e1);
+		const float v = glm::dot(direction, q) * inverseDet;
+		const float t = glm::dot(e2, q) * inverseDet;
+		if (u >= 0.0f && v >= 0.0f && u + v <= 1.0f && t > 0.0f && t < distance) {
+			distance = t;
+			hit = true;
+		}
+	}
+	return hit;
+#endif
+}
+
+///////////////////////////////////////////////////
+//	Raycast(const glm::vec3&, const glm::vec3&, float&)
+//
+//	Ray in the mesh's local space. distance: in, the
+//	farthest hit to accept; out, the nearest hit, in
+//	multiples of direction. Returns true on a hit.
+///////////////////////////////////////////////////
+bool MeshRaycaster::Raycast(const glm::vec3& origin, const glm::vec3& direction, float& distance) const {
+	return gBVH.Raycast(origin, direction, distance, [&](int packet, float& nearest) {
+		return IntersectPacket(gPackets[packet], origin, direction, nearest);
+	}) >= 0;
+}
+
+///////////////////////////////////////////////////
+//	Pick(objects, world, objectMesh, origin, direction, distance)
+//
+//	objects: BVH over the world bounds of the objects
+//	world: world matrix of every object
+//	objectMesh: mesh of every object, index into gMeshes
+//	distance: in, the farthest hit to accept; out, the
+//	nearest hit
+//
+//	Returns the object nearest along the ray, or -1.
+//	The ray is moved into each candidate's local space
+//	without renormalizing, so distances stay comparable.
+///////////////////////////////////////////////////
+int Picking::Pick(const BVH& objects, const std::vector<glm::mat4>& world, const std::vector<int>& objectMesh,
+	const glm::vec3& origin, const glm::vec3& direction, float& distance) const {
+	return objects.Raycast(origin, direction, distance, [&](int object, float& nearest) {
+		const int mesh = objectMesh[object];
+		if (mesh < 0 || mesh >= (int)gMeshes.size())
+			return false;
+
+		const glm::mat4 toLocal = glm::inverse(world[object]);
+		const glm::vec3 localOrigin = glm::vec3(toLocal * glm::vec4(origin, 1.0f));
+		const glm::vec3 localDirection = glm::vec3(toLocal * glm::vec4(direction, 0.0f));
+		return gMeshes[mesh].Raycast(localOrigin, localDirection, nearest);
+	});
+}
+
+///////////////////////////////////////////////////
+//	ScreenRay(float, float, float, float, const glm::mat4&, glm::vec3&, glm::vec3&)
+//
+//	x, y: window position, in pixels from the top left
+//	width, height: window size
+//
+//	World space ray through a window position: origin on
+//	the near plane, unit direction away from the camera
+///////////////////////////////////////////////////
+void Picking::ScreenRay(float x, float y, float width, float height, const glm::mat4& viewProjection,
+	glm::vec3& origin, glm::vec3& direction) {
+	const float ndcX = 2.0f * x / width - 1.0f;
+	const float ndcY = 1.0f - 2.0f * y / height;
+
+	// The projection may have no far plane, so the second point is taken halfway in depth
+	const glm::mat4 toWorld = glm::inverse(viewProjection);
+	const glm::vec4 nearPoint = toWorld * glm::vec4(ndcX, ndcY, -1.0f, 1.0f);
+	const glm::vec4 farPoint = toWorld * glm::vec4(ndcX, ndcY, 0.0f, 1.0f);
+
+	origin = glm::vec3(nearPoint) / nearPoint.w;
+	direction = glm::normalize(glm::vec3(farPoint) / farPoint.w - origin);
+}
@@ -0,0 +1,54 @@
+///////////////////////////////////////////////////////////////////////////////
+// picking.h
+// ========
+// object picking by ray casting on the CPU: the scene's object BVH finds the
+// candidate objects, a triangle BVH per mesh finds the exact hit
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include "glm/glm.hpp"
+#include "bvh.h"
+
+#include <vector>
+
+// Ray queries against the triangles of one mesh, in its local space
+class MeshRaycaster {
+
+public:
+	bool Build(const std::vector<glm::vec3>& positions, const std::vector<unsigned int>& indices);
+	bool Raycast(const glm::vec3& origin, const glm::vec3& direction, float& distance) const;
+
+	size_t TriangleCount() const { return gTriangleCount; }
+
+private:
+	// Four triangles side by side (first vertex and the two edges from it),
+	// tested against a ray at once. Unused lanes have zero edges and never hit.
+	struct Packet {
+		float v0x[4], v0y[4], v0z[4];
+		float e1x[4], e1y[4], e1z[4];
+		float e2x[4], e2y[4], e2z[4];
+	};
+
+	static bool IntersectPacket(const Packet& packet, const glm::vec3& origin, const glm::vec3& direction, float& distance);
+
+	std::vector<Packet> gPackets;
+	std::vector<AABB> gPacketBounds;	// Kept alive for gBVH; a built raycaster must not be moved
+	BVH gBVH;							// Over the packets
+	size_t gTriangleCount = 0;
+};
+
+class Picking {
+
+public:
+	// Triangle raycaster of every mesh, indexed like the scene's meshes
+	std::vector<MeshRaycaster> gMeshes;
+
+public:
+	int Pick(const BVH& objects, const std::vector<glm::mat4>& world, const std::vector<int>& objectMesh,
+		const glm::vec3& origin, const glm::vec3& direction, float& distance) const;
+
+	static void ScreenRay(float x, float y, float width, float height, const glm::mat4& viewProjection,
+		glm::vec3& origin, glm::vec3& direction);
+};
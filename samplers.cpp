@@ -0,0 +1,112 @@
+///////////////////////////////////////////////////////////////////////////////
+// samplers.cpp
+// ========
+// registry of sampler objects with named filtering presets that can be bound
+// per texture unit independently of the texture objects
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#include "samplers.h"
+
+#include <cstring>
+
+namespace {
+	// Filtering state and requested anisotropy for each preset, in Preset order
+	struct PresetDesc {
+		const char* name;
+		GLint minFilter;
+		GLint magFilter;
+		GLfloat anisotropy;
+	};
+
+	const PresetDesc PRESETS[Samplers::PRESET_COUNT] = {
+		{ "point",		GL_NEAREST,					GL_NEAREST,	1.0f },
+		{ "bilinear",	GL_LINEAR_MIPMAP_NEAREST,	GL_LINEAR,	1.0f },
+		{ "trilinear",	GL_LINEAR_MIPMAP_LINEAR,	GL_LINEAR,	1.0f },
+		{ "aniso2x",	GL_LINEAR_MIPMAP_LINEAR,	GL_LINEAR,	2.0f },
+		{ "aniso4x",	GL_LINEAR_MIPMAP_LINEAR,	GL_LINEAR,	4.0f },
+		{ "aniso8x",	GL_LINEAR_MIPMAP_LINEAR,	GL_LINEAR,	8.0f },
+		{ "aniso16x",	GL_LINEAR_MIPMAP_LINEAR,	GL_LINEAR,	16.0f },
+	};
+}
+
+///////////////////////////////////////////////////
+//	CreateSamplers()
+//
+//	Create one sampler object per preset. Anisotropy
+//	is clamped to what the driver reports, so the
+//	anisotropic presets degrade to trilinear when the
+//	extension is missing.
+///////////////////////////////////////////////////
+void Samplers::CreateSamplers() {
+	gMaxAnisotropy = 1.0f;
+	if (GLEW_EXT_texture_filter_anisotropic || GLEW_ARB_texture_filter_anisotropic)
+		glGetFloatv(GL_MAX_TEXTURE_MAX_ANISOTROPY_EXT, &gMaxAnisotropy);
+
+	glGenSamplers(PRESET_COUNT, gSamplers);
+
+	for (int i = 0; i < PRESET_COUNT; i++) {
+		const PresetDesc& desc = PRESETS[i];
+
+		glSamplerParameteri(gSamplers[i], GL_TEXTURE_WRAP_S, GL_REPEAT);
+		glSamplerParameteri(gSamplers[i], GL_TEXTURE_WRAP_T, GL_REPEAT);
+		glSamplerParameteri(gSamplers[i], GL_TEXTURE_MIN_FILTER, desc.minFilter);
+		glSamplerParameteri(gSamplers[i], GL_TEXTURE_MAG_FILTER, desc.magFilter);
+
+		if (gMaxAnisotropy > 1.0f) {
+			GLfloat anisotropy = desc.anisotropy < gMaxAnisotropy ? desc.anisotropy : gMaxAnisotropy;
+			glSamplerParameterf(gSamplers[i], GL_TEXTURE_MAX_ANISOTROPY_EXT, anisotropy);
+		}
+	}
+}
+
+///////////////////////////////////////////////////
+//	DestroySamplers()
+//
+//	Destroy the created sampler objects
+///////////////////////////////////////////////////
+void Samplers::DestroySamplers() {
+	glDeleteSamplers(PRESET_COUNT, gSamplers);
+}
+
+///////////////////////////////////////////////////
+//	Bind(GLuint, Preset)
+//
+//	unit: texture unit index (0 for GL_TEXTURE0)
+//	preset: filtering preset to sample that unit with
+//
+//	The sampler overrides the filtering and wrapping
+//	state stored in whichever texture is bound to the unit
+///////////////////////////////////////////////////
+void Samplers::Bind(GLuint unit, Preset preset) const {
+	glBindSampler(unit, gSamplers[preset]);
+}
+
+///////////////////////////////////////////////////
+//	Unbind(GLuint)
+//
+//	Restore the texture's own sampling state on the unit
+///////////////////////////////////////////////////
+void Samplers::Unbind(GLuint unit) const {
+	glBindSampler(unit, 0);
+}
+
+const char* Samplers::PresetName(Preset preset) {
+	return PRESETS[preset].name;
+}
+
+///////////////////////////////////////////////////
+//	FindPreset(const char*, Preset&)
+//
+//	Look up a preset by its name ("point", "trilinear",
+//	"aniso8x", ...). Returns false if the name is unknown.
+///////////////////////////////////////////////////
+bool Samplers::FindPreset(const char* name, Preset& preset) {
+	for (int i = 0; i < PRESET_COUNT; i++) {
+		if (strcmp(PRESETS[i].name, name) == 0) {
+			preset = (Preset)i;
+			return true;
+		}
+	}
+	return false;
+}
@@ -0,0 +1,41 @@
+///////////////////////////////////////////////////////////////////////////////
+// samplers.h
+// ========
+// registry of sampler objects with named filtering presets that can be bound
+// per texture unit independently of the texture objects
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include "GL/glew.h"
+
+class Samplers {
+
+public:
+
+	// Named filtering presets
+	enum Preset {
+		POINT,				// nearest texel, no mip sampling
+		BILINEAR,			// linear texels, nearest mip level
+		TRILINEAR,			// linear texels, linear blend between mip levels
+		ANISOTROPIC_2X,		// trilinear plus 2x anisotropic filtering
+		ANISOTROPIC_4X,		// trilinear plus 4x anisotropic filtering
+		ANISOTROPIC_8X,		// trilinear plus 8x anisotropic filtering
+		ANISOTROPIC_16X,	// trilinear plus 16x anisotropic filtering
+		PRESET_COUNT
+	};
+
+	GLuint gSamplers[PRESET_COUNT];	// Sampler object for each preset
+	GLfloat gMaxAnisotropy;			// Largest anisotropy the driver supports (1 if unsupported)
+
+public:
+	void CreateSamplers();
+	void DestroySamplers();
+
+	void Bind(GLuint unit, Preset preset) const;
+	void Unbind(GLuint unit) const;
+
+	static const char* PresetName(Preset preset);
+	static bool FindPreset(const char* name, Preset& preset);
+};
@@ -0,0 +1,345 @@
+///////////////////////////////////////////////////////////////////////////////
+// scene.cpp
+// ========
+// data-driven scene description: textures, materials, lights and objects read
+// from a text file into flat, contiguous arrays
+//
+// The file is read one line at a time. Blank lines and lines starting with
+// '#' are ignored; every other line is one record:
+//
+//	texture  <name> <image file>
+//	material <name> <texture name | -> <sampler preset> <r> <g> <b> [unlit]
+//	light    <x> <y> <z> <r> <g> <b>
+//	object   <name> <mesh> <material> <x> <y> <z> <sx> <sy> <sz> [<rx> <ry> <rz>] [parent <object>]
+//	model    <name> <gltf file> <x> <y> <z> <sx> <sy> <sz> [<rx> <ry> <rz>] [parent <object>]
+//
+// A mesh is one of the built-in shapes or the path of a Wavefront .obj file.
+// Textures, materials and parent objects must be declared before they are
+// used. Object rotations are in degrees, applied about Z, then X, then Y. The
+// transform of an object with a parent is relative to the parent.
+//
+// Models are only recorded here: the renderer imports the .glb or .gltf
+// file and adds its textures, materials and one object per mesh primitive
+// of every node (named <model>/<node>), placed by the model's transform.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#include "scene.h"
+#include "shadervariants.h"
+
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+
+namespace {
+	const int MAX_TOKENS = 16;
+
+	// Split a line into whitespace separated tokens, in place
+	int Tokenize(char* line, char* tokens[], int maxTokens) {
+		int count = 0;
+		char* p = line;
+		while (*p) {
+			while (*p == ' ' || *p == '\t' || *p == '\r')
+				p++;
+			if (!*p || *p == '#')
+				break;
+			if (count == maxTokens)
+				return maxTokens + 1;
+
+			tokens[count++] = p;
+			while (*p && *p != ' ' && *p != '\t' && *p != '\r')
+				p++;
+			if (*p)
+				*p++ = '\0';
+		}
+		return count;
+	}
+
+	bool ParseFloats(char* tokens[], int count, float* values) {
+		for (int i = 0; i < count; i++) {
+			char* end;
+			values[i] = strtof(tokens[i], &end);
+			if (end == tokens[i] || *end)
+				return false;
+		}
+		return true;
+	}
+
+	int FindName(const std::vector<std::string>& names, const char* name) {
+		for (size_t i = 0; i < names.size(); i++)
+			if (names[i] == name)
+				return (int)i;
+		return -1;
+	}
+
+	// Optional trailing "parent <object>", removed from the token count
+	const char* TakeParent(char* tokens[], int& count) {
+		if (count < 2 || strcmp(tokens[count - 2], "parent") != 0)
+			return nullptr;
+		count -= 2;
+		return tokens[count + 1];
+	}
+
+	// Degrees about Z, then X, then Y
+	glm::quat Orientation(const float rotation[3]) {
+		return glm::angleAxis(glm::radians(rotation[1]), glm::vec3(0.0f, 1.0f, 0.0f)) *
+			glm::angleAxis(glm::radians(rotation[0]), glm::vec3(1.0f, 0.0f, 0.0f)) *
+			glm::angleAxis(glm::radians(rotation[2]), glm::vec3(0.0f, 0.0f, 1.0f));
+	}
+
+	void ReportError(const char* filename, int line, const char* message) {
+		std::cout << "ERROR::SCENE::PARSE_FAILED " << filename << ":" << line << ": " << message << std::endl;
+	}
+}
+
+///////////////////////////////////////////////////
+//	FindObject(const char*)
+//
+//	Returns the most recently declared object with the
+//	given name, or -1. Searching backwards finds parents
+//	quickly, since they are usually declared just before
+//	their children.
+///////////////////////////////////////////////////
+int Scene::FindObject(const char* name) const {
+	for (size_t i = gObjectName.size(); i-- > 0;)
+		if (strcmp(ObjectName(i), name) == 0)
+			return (int)i;
+	return -1;
+}
+
+int Scene::FindOrAdd(std::vector<std::string>& names, const char* name) {
+	int found = FindName(names, name);
+	if (found >= 0)
+		return found;
+
+	names.push_back(name);
+	return (int)names.size() - 1;
+}
+
+///////////////////////////////////////////////////
+//	AddTexture(const char*, const char*)
+//
+//	Returns the index of the new texture, or -1 if the
+//	name is taken
+///////////////////////////////////////////////////
+int Scene::AddTexture(const char* name, const char* filename) {
+	if (FindName(gTextureNames, name) >= 0)
+		return -1;
+	gTextureNames.push_back(name);
+	gTextureFiles.push_back(filename);
+	return (int)gTextureFiles.size() - 1;
+}
+
+///////////////////////////////////////////////////
+//	AddMaterial(const char*, const Material&)
+//
+//	Returns the index of the new material, or -1 if the
+//	name is taken
+///////////////////////////////////////////////////
+int Scene::AddMaterial(const char* name, const Material& material) {
+	if (FindName(gMaterialNames, name) >= 0)
+		return -1;
+	gMaterialNames.push_back(name);
+	gMaterials.push_back(material);
+	return (int)gMaterials.size() - 1;
+}
+
+///////////////////////////////////////////////////
+//	AddObject(const char*, const char*, int, ...)
+//
+//	mesh: mesh name, added to gMeshNames on first use
+//	material: index into gMaterials
+//	parent: object the transform is relative to, or -1
+//
+//	Returns the index of the new object. Its world
+//	matrix is computed by the next gTransforms.Update().
+///////////////////////////////////////////////////
+int Scene::AddObject(const char* name, const char* mesh, int material, const glm::vec3& position,
+	const glm::quat& rotation, const glm::vec3& scale, int parent) {
+	gObjectName.push_back((unsigned int)gNames.size());
+	gNames.append(name);
+	gNames.push_back('\0');
+
+	gObjectMesh.push_back(FindOrAdd(gMeshNames, mesh));
+	gObjectMaterial.push_back(material);
+	return gTransforms.Add(position, rotation, scale, parent);
+}
+
+///////////////////////////////////////////////////
+//	Clear()
+//
+//	Remove everything loaded so far
+///////////////////////////////////////////////////
+void Scene::Clear() {
+	gMeshNames.clear();
+	gTextureFiles.clear();
+	gMaterials.clear();
+	gLights.clear();
+	gModels.clear();
+	gObjectMesh.clear();
+	gObjectMaterial.clear();
+	gTransforms.Clear();
+	gObjectName.clear();
+	gNames.clear();
+	gMaterialNames.clear();
+	gTextureNames.clear();
+}
+
+///////////////////////////////////////////////////
+//	Load(const char*)
+//
+//	filename: scene description to read
+//
+//	Appends the records of the file to the scene.
+//	Returns false (after reporting the offending line)
+//	if the file cannot be read or is malformed.
+///////////////////////////////////////////////////
+bool Scene::Load(const char* filename) {
+	std::ifstream file(filename);
+	if (!file) {
+		std::cout << "ERROR::SCENE::FILE_NOT_FOUND " << filename << std::endl;
+		return false;
+	}
+
+	std::string line;
+	char* tokens[MAX_TOKENS];
+	int lineNumber = 0;
+
+	while (std::getline(file, line)) {
+		lineNumber++;
+
+		int count = Tokenize(&line[0], tokens, MAX_TOKENS);
+		if (count == 0)
+			continue;
+		if (count > MAX_TOKENS) {
+			ReportError(filename, lineNumber, "too many fields");
+			return false;
+		}
+
+		const char* kind = tokens[0];
+
+		if (strcmp(kind, "object") == 0) {
+			const char* parentName = TakeParent(tokens, count);
+
+			float values[9];
+			float rotation[3] = { 0.0f, 0.0f, 0.0f };
+			if ((count != 13 && count != 16) || !ParseFloats(tokens + 4, 9, values) ||
+				(count == 16 && !ParseFloats(tokens + 13, 3, rotation))) {
+				ReportError(filename, lineNumber, "expected: object <name> <mesh> <material> <x> <y> <z> <sx> <sy> <sz> [<rx> <ry> <rz>] [parent <object>]");
+				return false;
+			}
+
+			int material = FindName(gMaterialNames, tokens[3]);
+			if (material < 0) {
+				ReportError(filename, lineNumber, "unknown material");
+				return false;
+			}
+
+			int parent = -1;
+			if (parentName) {
+				parent = FindObject(parentName);
+				if (parent < 0) {
+					ReportError(filename, lineNumber, "unknown parent object");
+					return false;
+				}
+			}
+
+			AddObject(tokens[1], tokens[2], material, glm::vec3(values[0], values[1], values[2]), Orientation(rotation),
+				glm::vec3(values[3], values[4], values[5]), parent);
+		}
+		else if (strcmp(kind, "model") == 0) {
+			const char* parentName = TakeParent(tokens, count);
+
+			float values[9];
+			float rotation[3] = { 0.0f, 0.0f, 0.0f };
+			if ((count != 12 && count != 15) || !ParseFloats(tokens + 3, 9, values) ||
+				(count == 15 && !ParseFloats(tokens + 12, 3, rotation))) {
+				ReportError(filename, lineNumber, "expected: model <name> <gltf file> <x> <y> <z> <sx> <sy> <sz> [<rx> <ry> <rz>] [parent <object>]");
+				return false;
+			}
+
+			Model model;
+			model.name = tokens[1];
+			model.filename = tokens[2];
+			model.position = glm::vec3(values[0], values[1], values[2]);
+			model.rotation = Orientation(rotation);
+			model.scale = glm::vec3(values[3], values[4], values[5]);
+			model.parent = -1;
+			if (parentName) {
+				model.parent = FindObject(parentName);
+				if (model.parent < 0) {
+					ReportError(filename, lineNumber, "unknown parent object");
+					return false;
+				}
+			}
+			gModels.push_back(model);
+		}
+		else if (strcmp(kind, "material") == 0) {
+			float color[3];
+			bool unlit = count == 8 && strcmp(tokens[7], "unlit") == 0;
+			Samplers::Preset sampler;
+			if ((count != 7 && !unlit) || !ParseFloats(tokens + 4, 3, color)) {
+				ReportError(filename, lineNumber, "expected: material <name> <texture | -> <sampler> <r> <g> <b> [unlit]");
+				return false;
+			}
+			if (!Samplers::FindPreset(tokens[3], sampler)) {
+				ReportError(filename, lineNumber, "unknown sampler preset");
+				return false;
+			}
+
+			Material material;
+			material.texture = -1;
+			material.sampler = sampler;
+			material.color = glm::vec3(color[0], color[1], color[2]);
+			material.features = unlit ? 0 : SHADER_LIT;
+
+			if (strcmp(tokens[2], "-") != 0) {
+				material.texture = FindName(gTextureNames, tokens[2]);
+				if (material.texture < 0) {
+					ReportError(filename, lineNumber, "unknown texture");
+					return false;
+				}
+				material.features |= SHADER_TEXTURED;
+			}
+
+			if (AddMaterial(tokens[1], material) < 0) {
+				ReportError(filename, lineNumber, "material declared twice");
+				return false;
+			}
+		}
+		else if (strcmp(kind, "texture") == 0) {
+			if (count != 3) {
+				ReportError(filename, lineNumber, "expected: texture <name> <file>");
+				return false;
+			}
+			if (AddTexture(tokens[1], tokens[2]) < 0) {
+				ReportError(filename, lineNumber, "texture declared twice");
+				return false;
+			}
+		}
+		else if (strcmp(kind, "light") == 0) {
+			float values[6];
+			if (count != 7 || !ParseFloats(tokens + 1, 6, values)) {
+				ReportError(filename, lineNumber, "expected: light <x> <y> <z> <r> <g> <b>");
+				return false;
+			}
+
+			Light light;
+			light.position = glm::vec3(values[0], values[1], values[2]);
+			light.color = glm::vec3(values[3], values[4], values[5]);
+			gLights.push_back(light);
+		}
+		else {
+			ReportError(filename, lineNumber, "unknown record type");
+			return false;
+		}
+	}
+
+	// World matrices are computed once here and then only when something moves
+	gTransforms.Update();
+
+	std::cout << "INFO: Loaded scene " << filename << " (" << ObjectCount() << " objects, "
+		<< gMaterials.size() << " materials, " << gLights.size() << " lights)" << std::endl;
+	return true;
+}
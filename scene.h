@@ -0,0 +1,79 @@
+///////////////////////////////////////////////////////////////////////////////
+// scene.h
+// ========
+// data-driven scene description: textures, materials, lights and objects read
+// from a text file into flat, contiguous arrays
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include "glm/glm.hpp"
+#include "samplers.h"
+#include "transforms.h"
+
+#include <string>
+#include <vector>
+
+class Scene {
+
+public:
+	// Surface appearance shared by many objects
+	struct Material {
+		int texture;				// Index into gTextureFiles, -1 for untextured
+		Samplers::Preset sampler;	// Filtering used for the texture
+		glm::vec3 color;			// Base color (untextured variants)
+		unsigned int features;		// ShaderFeature bits of the variant to draw with
+	};
+
+	// Point light
+	struct Light {
+		glm::vec3 position;
+		glm::vec3 color;
+	};
+
+	// Placement of a glTF model; its nodes become objects when the model is imported
+	struct Model {
+		std::string name;
+		std::string filename;
+		glm::vec3 position;
+		glm::quat rotation;
+		glm::vec3 scale;
+		int parent;					// Object the model is relative to, or -1
+	};
+
+	// Resources referenced by name in the file, in order of first appearance
+	std::vector<std::string> gMeshNames;
+	std::vector<std::string> gTextureFiles;
+	std::vector<Material> gMaterials;
+	std::vector<Light> gLights;
+	std::vector<Model> gModels;
+
+	// Per-object data, one entry per object, all indexed by object number
+	std::vector<int> gObjectMesh;			// Index into gMeshNames
+	std::vector<int> gObjectMaterial;		// Index into gMaterials
+	std::vector<unsigned int> gObjectName;	// Offset of the object's name in gNames
+
+	// Object transforms; object i owns transform i
+	Transforms gTransforms;
+
+public:
+	bool Load(const char* filename);
+	void Clear();
+
+	int AddTexture(const char* name, const char* filename);
+	int AddMaterial(const char* name, const Material& material);
+	int AddObject(const char* name, const char* mesh, int material, const glm::vec3& position,
+		const glm::quat& rotation, const glm::vec3& scale, int parent = -1);
+
+	size_t ObjectCount() const { return gObjectMesh.size(); }
+	const char* ObjectName(size_t object) const { return gNames.c_str() + gObjectName[object]; }
+	int FindObject(const char* name) const;
+
+private:
+	int FindOrAdd(std::vector<std::string>& names, const char* name);
+
+	std::string gNames;						// All object names, '\0' separated
+	std::vector<std::string> gMaterialNames;
+	std::vector<std::string> gTextureNames;
+};
@@ -0,0 +1,166 @@
+///////////////////////////////////////////////////////////////////////////////
+// shadercache.cpp
+// ========
+// on-disk cache of linked program binaries so shaders are only compiled from
+// GLSL source the first time a given source/driver combination is seen
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#include "shadercache.h"
+
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <vector>
+
+namespace {
+	const unsigned int CACHE_MAGIC = 0x42504C47;	// "GLPB"
+	const unsigned int CACHE_VERSION = 1;
+
+	// Fixed-size header written in front of every program binary
+	struct CacheHeader {
+		unsigned int magic;
+		unsigned int version;
+		unsigned long long key;
+		GLenum binaryFormat;
+		GLint binaryLength;
+	};
+
+	// 64-bit FNV-1a, continued across several strings (including their terminators)
+	unsigned long long HashString(unsigned long long hash, const char* text) {
+		const unsigned char* p = (const unsigned char*)text;
+		do {
+			hash ^= *p;
+			hash *= 1099511628211ULL;
+		} while (*p++);
+		return hash;
+	}
+}
+
+///////////////////////////////////////////////////
+//	Initialize(const char*)
+//
+//	directory: folder where program binaries are stored
+//
+//	Must be called with a current GL context. The driver
+//	vendor/renderer/version string becomes part of every
+//	key, so a driver update invalidates the whole cache.
+///////////////////////////////////////////////////
+void ShaderCache::Initialize(const char* directory) {
+	gDirectory = directory;
+
+	GLint formats = 0;
+	glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+	gEnabled = formats > 0;
+	if (!gEnabled) {
+		std::cout << "INFO: Program binaries unsupported, shader cache disabled" << std::endl;
+		return;
+	}
+
+	gDriver = std::string((const char*)glGetString(GL_VENDOR)) + "|" +
+		(const char*)glGetString(GL_RENDERER) + "|" +
+		(const char*)glGetString(GL_VERSION);
+
+	std::error_code error;
+	std::filesystem::create_directories(gDirectory, error);
+	if (error) {
+		std::cout << "WARNING: Cannot create shader cache folder " << gDirectory << std::endl;
+		gEnabled = false;
+	}
+}
+
+unsigned long long ShaderCache::Hash(const char* vtxShaderSource, const char* fragShaderSource, const char* defines) const {
+	unsigned long long hash = 14695981039346656037ULL;
+	hash = HashString(hash, vtxShaderSource);
+	hash = HashString(hash, fragShaderSource);
+	hash = HashString(hash, defines);
+	hash = HashString(hash, gDriver.c_str());
+	return hash;
+}
+
+std::string ShaderCache::PathFor(unsigned long long key) const {
+	char name[32];
+	snprintf(name, sizeof(name), "%016llx.bin", key);
+	return gDirectory + "/" + name;
+}
+
+///////////////////////////////////////////////////
+//	Load(const char*, const char*, const char*, GLuint)
+//
+//	programId: freshly created program object to load into
+//
+//	Returns true if a cached binary was found and the
+//	driver accepted it. On false the caller compiles
+//	from source as usual; a rejected binary is
+//	overwritten by the next Store().
+///////////////////////////////////////////////////
+bool ShaderCache::Load(const char* vtxShaderSource, const char* fragShaderSource, const char* defines, GLuint programId) const {
+	if (!gEnabled)
+		return false;
+
+	unsigned long long key = Hash(vtxShaderSource, fragShaderSource, defines);
+	std::ifstream file(PathFor(key), std::ios::binary);
+	if (!file)
+		return false;
+
+	CacheHeader header;
+	if (!file.read((char*)&header, sizeof(header)) ||
+		header.magic != CACHE_MAGIC || header.version != CACHE_VERSION ||
+		header.key != key || header.binaryLength <= 0)
+		return false;
+
+	std::vector<char> binary(header.binaryLength);
+	if (!file.read(binary.data(), binary.size()))
+		return false;
+
+	glProgramBinary(programId, header.binaryFormat, binary.data(), header.binaryLength);
+
+	GLint success = 0;
+	glGetProgramiv(programId, GL_LINK_STATUS, &success);
+	return success != 0;
+}
+
+///////////////////////////////////////////////////
+//	Store(const char*, const char*, const char*, GLuint)
+//
+//	programId: successfully linked program, created with
+//		GL_PROGRAM_BINARY_RETRIEVABLE_HINT set
+//
+//	Writes the program binary to disk. Failures are not
+//	fatal; the program is simply compiled again next run.
+///////////////////////////////////////////////////
+void ShaderCache::Store(const char* vtxShaderSource, const char* fragShaderSource, const char* defines, GLuint programId) const {
+	if (!gEnabled)
+		return;
+
+	GLint length = 0;
+	glGetProgramiv(programId, GL_PROGRAM_BINARY_LENGTH, &length);
+	if (length <= 0)
+		return;
+
+	CacheHeader header;
+	header.magic = CACHE_MAGIC;
+	header.version = CACHE_VERSION;
+	header.key = Hash(vtxShaderSource, fragShaderSource, defines);
+
+	std::vector<char> binary(length);
+	glGetProgramBinary(programId, length, &header.binaryLength, &header.binaryFormat, binary.data());
+	if (header.binaryLength <= 0)
+		return;
+
+	// Write to a temporary name first so a crash never leaves a truncated entry behind
+	std::string path = PathFor(header.key);
+	std::string tempPath = path + ".tmp";
+	{
+		std::ofstream file(tempPath, std::ios::binary | std::ios::trunc);
+		if (!file.write((const char*)&header, sizeof(header)) ||
+			!file.write(binary.data(), header.binaryLength))
+			return;
+	}
+
+	std::error_code error;
+	std::filesystem::rename(tempPath, path, error);
+	if (error)
+		std::filesystem::remove(tempPath, error);
+}
@@ -0,0 +1,32 @@
+///////////////////////////////////////////////////////////////////////////////
+// shadercache.h
+// ========
+// on-disk cache of linked program binaries so shaders are only compiled from
+// GLSL source the first time a given source/driver combination is seen
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include "GL/glew.h"
+
+#include <string>
+
+class ShaderCache {
+
+public:
+	void Initialize(const char* directory);
+
+	bool Load(const char* vtxShaderSource, const char* fragShaderSource, const char* defines, GLuint programId) const;
+	void Store(const char* vtxShaderSource, const char* fragShaderSource, const char* defines, GLuint programId) const;
+
+	bool IsEnabled() const { return gEnabled; }
+
+private:
+	unsigned long long Hash(const char* vtxShaderSource, const char* fragShaderSource, const char* defines) const;
+	std::string PathFor(unsigned long long key) const;
+
+	std::string gDirectory;		// Folder holding one file per cached program
+	std::string gDriver;		// Vendor, renderer and version strings of the current context
+	bool gEnabled = false;		// False when the driver exposes no program binary formats
+};
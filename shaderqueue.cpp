@@ -0,0 +1,421 @@
+///////////////////////////////////////////////////////////////////////////////
+// shaderqueue.cpp
+// ========
+// shader build queue: every compile and link is submitted up front and
+// completion is polled, so programs build in parallel on the driver's
+// compiler threads (GL_KHR_parallel_shader_compile) or, without the
+// extension, on a background context
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#include "shaderqueue.h"
+#include "shadercache.h"
+
+#include <iostream>
+
+namespace {
+	// Insert the defines right after the #version line, followed by a #line
+	// directive so compiler errors still report the original line numbers
+	std::string InjectDefines(const char* source, const char* defines) {
+		std::string text(source);
+		if (!defines[0])
+			return text;
+
+		size_t version = text.find("#version");
+		if (version == std::string::npos)
+			return defines + text;
+
+		size_t lineEnd = text.find('\n', version);
+		if (lineEnd == std::string::npos) {
+			text += '\n';
+			lineEnd = text.size() - 1;
+		}
+
+		int versionLine = 1;
+		for (size_t i = 0; i < version; i++)
+			if (text[i] == '\n')
+				versionLine++;
+
+		text.insert(lineEnd + 1, std::string(defines) + "#line " + std::to_string(versionLine + 1) + "\n");
+		return text;
+	}
+}
+
+///////////////////////////////////////////////////
+//	Initialize(GLFWwindow*, const ShaderCache*)
+//
+//	window: main window, whose context must be current
+//	cache: program binary cache consulted before compiling (may be null)
+//
+//	Uses the driver's own compiler threads when
+//	GL_KHR_parallel_shader_compile is exposed. Otherwise
+//	creates a hidden window sharing the main context and a
+//	thread that compiles submitted programs on it.
+///////////////////////////////////////////////////
+bool ShaderBuildQueue::Initialize(GLFWwindow* window, const ShaderCache* cache) {
+	gCache = cache;
+	gParallel = GLEW_KHR_parallel_shader_compile || GLEW_ARB_parallel_shader_compile;
+
+	if (gParallel) {
+		// Let the driver use as many compiler threads as it likes
+		if (GLEW_KHR_parallel_shader_compile)
+			glMaxShaderCompilerThreadsKHR(0xFFFFFFFF);
+		else
+			glMaxShaderCompilerThreadsARB(0xFFFFFFFF);
+
+		std::cout << "INFO: Shaders build on driver compiler threads" << std::endl;
+		return true;
+	}
+
+	// The background context must be created like the main one to be shareable
+	glfwDefaultWindowHints();
+	glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+#ifdef __APPLE__
+	glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
+#endif
+	gWorkerWindow = glfwCreateWindow(1, 1, "", NULL, window);
+	glfwDefaultWindowHints();
+
+	if (gWorkerWindow == NULL) {
+		std::cout << "ERROR::SHADER::QUEUE::CONTEXT_CREATION_FAILED" << std::endl;
+		return false;
+	}
+
+	gWorker = std::thread(&ShaderBuildQueue::WorkerMain, this);
+
+	std::cout << "INFO: Shaders build on a background context" << std::endl;
+	return true;
+}
+
+///////////////////////////////////////////////////
+//	Shutdown()
+//
+//	Stop the background context and delete any program
+//	whose build was never collected
+///////////////////////////////////////////////////
+void ShaderBuildQueue::Shutdown() {
+	if (gWorker.joinable()) {
+		{
+			std::lock_guard<std::mutex> lock(gMutex);
+			gStopping = true;
+		}
+		gJobReady.notify_all();
+		gWorker.join();
+	}
+
+	std::vector<Result> finished;
+	for (PendingBuild& build : gPending)
+		finished.push_back(Finish(build));
+	gPending.clear();
+	Poll(finished);
+
+	for (const Result& result : finished)
+		UDestroyShaderProgram(result.programId);
+
+	if (gWorkerWindow) {
+		glfwDestroyWindow(gWorkerWindow);
+		gWorkerWindow = nullptr;
+	}
+}
+
+///////////////////////////////////////////////////
+//	Submit(const std::string&, const std::string&, const std::string&)
+//
+//	Start building a program and return a ticket that
+//	identifies it in the results of Poll()/WaitAny().
+//	No compile or link status is queried here, so the
+//	driver is free to keep working in the background.
+///////////////////////////////////////////////////
+unsigned int ShaderBuildQueue::Submit(const std::string& vtxShaderSource, const std::string& fragShaderSource, const std::string& defines) {
+	unsigned int ticket = gNextTicket++;
+
+	if (!gParallel) {
+		{
+			std::lock_guard<std::mutex> lock(gMutex);
+			gJobs.push_back({ ticket, vtxShaderSource, fragShaderSource, defines });
+			gInFlight++;
+		}
+		gJobReady.notify_one();
+		return ticket;
+	}
+
+	PendingBuild build;
+	build.ticket = ticket;
+	build.programId = glCreateProgram();
+	build.vertexShaderId = 0;
+	build.fragmentShaderId = 0;
+
+	// A cached binary needs no compilation at all
+	if (gCache && gCache->Load(vtxShaderSource.c_str(), fragShaderSource.c_str(), defines.c_str(), build.programId)) {
+		gPending.push_back(build);
+		return ticket;
+	}
+
+	build.vtxSource = vtxShaderSource;
+	build.fragSource = fragShaderSource;
+	build.defines = defines;
+
+	std::string vtxText = InjectDefines(vtxShaderSource.c_str(), defines.c_str());
+	std::string fragText = InjectDefines(fragShaderSource.c_str(), defines.c_str());
+	const char* vtxSource = vtxText.c_str();
+	const char* fragSource = fragText.c_str();
+
+	build.vertexShaderId = glCreateShader(GL_VERTEX_SHADER);
+	build.fragmentShaderId = glCreateShader(GL_FRAGMENT_SHADER);
+	glShaderSource(build.vertexShaderId, 1, &vtxSource, NULL);
+	glShaderSource(build.fragmentShaderId, 1, &fragSource, NULL);
+	glCompileShader(build.vertexShaderId);
+	glCompileShader(build.fragmentShaderId);
+
+	glAttachShader(build.programId, build.vertexShaderId);
+	glAttachShader(build.programId, build.fragmentShaderId);
+
+	if (gCache && gCache->IsEnabled())
+		glProgramParameteri(build.programId, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+
+	glLinkProgram(build.programId);
+
+	gPending.push_back(build);
+	return ticket;
+}
+
+///////////////////////////////////////////////////
+//	Finish(PendingBuild&)
+//
+//	Collect the status of a build issued on the main
+//	context. Blocks if the driver has not finished it yet.
+///////////////////////////////////////////////////
+ShaderBuildQueue::Result ShaderBuildQueue::Finish(PendingBuild& build) {
+	Result result = { build.ticket, build.programId };
+
+	// Loaded from the binary cache, already validated by ShaderCache::Load()
+	if (!build.vertexShaderId)
+		return result;
+
+	int success = 0;
+	char infoLog[512];
+
+	glGetProgramiv(build.programId, GL_LINK_STATUS, &success);
+	if (!success) {
+		// Find out which stage failed now that querying it no longer stalls
+		int vtxCompiled = 0;
+		int fragCompiled = 0;
+		glGetShaderiv(build.vertexShaderId, GL_COMPILE_STATUS, &vtxCompiled);
+		glGetShaderiv(build.fragmentShaderId, GL_COMPILE_STATUS, &fragCompiled);
+
+		if (!vtxCompiled) {
+			glGetShaderInfoLog(build.vertexShaderId, sizeof(infoLog), NULL, infoLog);
+			std::cout << "ERROR::SHADER::VERTEX::COMPILATION_FAILED\n" << build.defines << infoLog << std::endl;
+		}
+		else if (!fragCompiled) {
+			glGetShaderInfoLog(build.fragmentShaderId, sizeof(infoLog), NULL, infoLog);
+			std::cout << "ERROR::SHADER::FRAGMENT::COMPILATION_FAILED\n" << build.defines << infoLog << std::endl;
+		}
+		else {
+			glGetProgramInfoLog(build.programId, sizeof(infoLog), NULL, infoLog);
+			std::cout << "ERROR::SHADER::PROGRAM::LINKING_FAILED\n" << build.defines << infoLog << std::endl;
+		}
+	}
+
+	glDetachShader(build.programId, build.vertexShaderId);
+	glDetachShader(build.programId, build.fragmentShaderId);
+	glDeleteShader(build.vertexShaderId);
+	glDeleteShader(build.fragmentShaderId);
+
+	if (!success) {
+		UDestroyShaderProgram(build.programId);
+		result.programId = 0;
+	}
+	else if (gCache) {
+		gCache->Store(build.vtxSource.c_str(), build.fragSource.c_str(), build.defines.c_str(), build.programId);
+	}
+
+	return result;
+}
+
+///////////////////////////////////////////////////
+//	Poll(std::vector<Result>&)
+//
+//	finished: receives every build that completed since
+//		the last call
+//
+//	Never blocks. Call from the main thread.
+///////////////////////////////////////////////////
+void ShaderBuildQueue::Poll(std::vector<Result>& finished) {
+	for (size_t i = 0; i < gPending.size();) {
+		GLint complete = GL_TRUE;
+		if (gPending[i].vertexShaderId)
+			glGetProgramiv(gPending[i].programId, GL_COMPLETION_STATUS_KHR, &complete);
+
+		if (complete) {
+			finished.push_back(Finish(gPending[i]));
+			gPending[i] = gPending.back();
+			gPending.pop_back();
+		}
+		else {
+			i++;
+		}
+	}
+
+	std::lock_guard<std::mutex> lock(gMutex);
+	finished.insert(finished.end(), gResults.begin(), gResults.end());
+	gResults.clear();
+}
+
+///////////////////////////////////////////////////
+//	WaitAny(std::vector<Result>&)
+//
+//	Like Poll(), but blocks until at least one build has
+//	finished (or nothing is left in flight)
+///////////////////////////////////////////////////
+void ShaderBuildQueue::WaitAny(std::vector<Result>& finished) {
+	size_t before = finished.size();
+	Poll(finished);
+	if (finished.size() != before)
+		return;
+
+	if (!gPending.empty()) {
+		finished.push_back(Finish(gPending.front()));
+		gPending.erase(gPending.begin());
+		return;
+	}
+
+	{
+		std::unique_lock<std::mutex> lock(gMutex);
+		gResultReady.wait(lock, [this] { return !gResults.empty() || gInFlight == 0; });
+	}
+	Poll(finished);
+}
+
+size_t ShaderBuildQueue::PendingCount() {
+	std::lock_guard<std::mutex> lock(gMutex);
+	return gPending.size() + gInFlight;
+}
+
+void ShaderBuildQueue::WorkerMain() {
+	glfwMakeContextCurrent(gWorkerWindow);
+
+	for (;;) {
+		Job job;
+		{
+			std::unique_lock<std::mutex> lock(gMutex);
+			gJobReady.wait(lock, [this] { return gStopping || !gJobs.empty(); });
+			if (gStopping)
+				break;
+			job = gJobs.front();
+			gJobs.pop_front();
+		}
+
+		GLuint programId = 0;
+		if (!UCreateShaderProgram(job.vtxSource.c_str(), job.fragSource.c_str(), job.defines.c_str(), gCache, programId)) {
+			UDestroyShaderProgram(programId);
+			programId = 0;
+		}
+
+		// The program must be complete before another context may use it
+		glFinish();
+
+		{
+			std::lock_guard<std::mutex> lock(gMutex);
+			gResults.push_back({ job.ticket, programId });
+			gInFlight--;
+		}
+		gResultReady.notify_all();
+	}
+
+	glfwMakeContextCurrent(NULL);
+}
+
+
+// Implements the UCreateShaders function
+bool UCreateShaderProgram(const char* vtxShaderSource, const char* fragShaderSource, const char* defines, const ShaderCache* cache, GLuint& programId)
+{
+	// Compilation and linkage error reporting
+	int success = 0;
+	char infoLog[512];
+
+	// Create a Shader program object.
+	programId = glCreateProgram();
+
+	// Skip compilation entirely if this driver already linked these sources on a previous run
+	if (cache && cache->Load(vtxShaderSource, fragShaderSource, defines, programId))
+		return true;
+
+	// Specialize the sources for this variant
+	std::string vtxText = InjectDefines(vtxShaderSource, defines);
+	std::string fragText = InjectDefines(fragShaderSource, defines);
+	const char* vtxSource = vtxText.c_str();
+	const char* fragSource = fragText.c_str();
+
+	// Create the vertex and fragment shader objects
+	GLuint vertexShaderId = glCreateShader(GL_VERTEX_SHADER);
+	GLuint fragmentShaderId = glCreateShader(GL_FRAGMENT_SHADER);
+
+	// Retrive the shader source
+	glShaderSource(vertexShaderId, 1, &vtxSource, NULL);
+	glShaderSource(fragmentShaderId, 1, &fragSource, NULL);
+
+	// Compile the vertex shader, and print compilation errors (if any)
+	glCompileShader(vertexShaderId); // compile the vertex shader
+	// check for shader compile errors
+	glGetShaderiv(vertexShaderId, GL_COMPILE_STATUS, &success);
+	if (!success)
+	{
+		glGetShaderInfoLog(vertexShaderId, 512, NULL, infoLog);
+		std::cout << "ERROR::SHADER::VERTEX::COMPILATION_FAILED\n" << defines << infoLog << std::endl;
+
+		glDeleteShader(vertexShaderId);
+		glDeleteShader(fragmentShaderId);
+		return false;
+	}
+
+	glCompileShader(fragmentShaderId); // compile the fragment shader
+	// check for shader compile errors
+	glGetShaderiv(fragmentShaderId, GL_COMPILE_STATUS, &success);
+	if (!success)
+	{
+		glGetShaderInfoLog(fragmentShaderId, sizeof(infoLog), NULL, infoLog);
+		std::cout << "ERROR::SHADER::FRAGMENT::COMPILATION_FAILED\n" << defines << infoLog << std::endl;
+
+		glDeleteShader(vertexShaderId);
+		glDeleteShader(fragmentShaderId);
+		return false;
+	}
+
+	// Attached compiled shaders to the shader program
+	glAttachShader(programId, vertexShaderId);
+	glAttachShader(programId, fragmentShaderId);
+
+	// Ask the driver to keep the binary around so it can be written to the cache
+	if (cache && cache->IsEnabled())
+		glProgramParameteri(programId, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+
+	glLinkProgram(programId);   // links the shader program
+
+	// The linked program keeps its own copy of the code
+	glDetachShader(programId, vertexShaderId);
+	glDetachShader(programId, fragmentShaderId);
+	glDeleteShader(vertexShaderId);
+	glDeleteShader(fragmentShaderId);
+
+	// check for linking errors
+	glGetProgramiv(programId, GL_LINK_STATUS, &success);
+	if (!success)
+	{
+		glGetProgramInfoLog(programId, sizeof(infoLog), NULL, infoLog);
+		std::cout << "ERROR::SHADER::PROGRAM::LINKING_FAILED\n" << defines << infoLog << std::endl;
+
+		return false;
+	}
+
+	if (cache)
+		cache->Store(vtxShaderSource, fragShaderSource, defines, programId);
+
+	return true;
+}
+
+
+void UDestroyShaderProgram(GLuint programId)
+{
+	glDeleteProgram(programId);
+}
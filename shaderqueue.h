@@ -0,0 +1,85 @@
+///////////////////////////////////////////////////////////////////////////////
+// shaderqueue.h
+// ========
+// shader build queue: every compile and link is submitted up front and
+// completion is polled, so programs build in parallel on the driver's
+// compiler threads (GL_KHR_parallel_shader_compile) or, without the
+// extension, on a background context
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include "GL/glew.h"
+#include "GLFW/glfw3.h"
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+class ShaderCache;
+
+class ShaderBuildQueue {
+
+public:
+	// A finished build handed back to the caller
+	struct Result {
+		unsigned int ticket;	// Value returned by Submit()
+		GLuint programId;		// Linked program, or 0 if the build failed
+	};
+
+	bool Initialize(GLFWwindow* window, const ShaderCache* cache);
+	void Shutdown();
+
+	unsigned int Submit(const std::string& vtxShaderSource, const std::string& fragShaderSource, const std::string& defines);
+	void Poll(std::vector<Result>& finished);
+	void WaitAny(std::vector<Result>& finished);
+
+	bool IsParallel() const { return gParallel; }
+	size_t PendingCount();
+
+private:
+	// Build issued on the main context that the driver is still working on
+	struct PendingBuild {
+		unsigned int ticket;
+		GLuint programId;
+		GLuint vertexShaderId;
+		GLuint fragmentShaderId;
+		std::string vtxSource;
+		std::string fragSource;
+		std::string defines;
+	};
+
+	// Build handed to the background context
+	struct Job {
+		unsigned int ticket;
+		std::string vtxSource;
+		std::string fragSource;
+		std::string defines;
+	};
+
+	Result Finish(PendingBuild& build);
+	void WorkerMain();
+
+	const ShaderCache* gCache = nullptr;
+	bool gParallel = false;					// Driver compiles asynchronously; no worker thread
+	unsigned int gNextTicket = 1;
+
+	std::vector<PendingBuild> gPending;		// Parallel path, main thread only
+
+	GLFWwindow* gWorkerWindow = nullptr;	// Hidden window owning the shared background context
+	std::thread gWorker;
+	std::mutex gMutex;
+	std::condition_variable gJobReady;
+	std::condition_variable gResultReady;
+	std::deque<Job> gJobs;					// Guarded by gMutex
+	std::vector<Result> gResults;			// Guarded by gMutex
+	size_t gInFlight = 0;					// Jobs queued or compiling, guarded by gMutex
+	bool gStopping = false;					// Guarded by gMutex
+};
+
+bool UCreateShaderProgram(const char* vtxShaderSource, const char* fragShaderSource, const char* defines, const ShaderCache* cache, GLuint& programId);
+void UDestroyShaderProgram(GLuint programId);
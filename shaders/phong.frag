@@ -0,0 +1,95 @@
+#version 400 core
+// Features are switched on by the #defines ShaderVariants injects after the #version line
+out vec4 FragColor;
+
+#ifdef TEXTURED
+  in vec2 TexCoord;
+
+ uniform sampler2D m_texture;
+#endif
+
+uniform vec3 color;
+
+#ifdef LIT
+in vec3 vertexNormal; // For incoming normals
+in vec3 vertexFragmentPos; // For incoming fragment position
+
+// Uniform / Global variables for  light color, light position, and camera/view position
+
+uniform vec3 lightColor[LIGHT_COUNT];
+
+uniform vec3 lightPos[LIGHT_COUNT];
+
+uniform vec3 viewPosition;
+
+#ifdef NORMAL_MAPPED
+uniform sampler2D normalMap;
+
+// Perturb the interpolated normal with a tangent-space normal map, building the
+// tangent frame from screen-space derivatives since the meshes carry no tangents
+vec3 perturbNormal(vec3 norm)
+{
+	vec3 dp1 = dFdx(vertexFragmentPos);
+	vec3 dp2 = dFdy(vertexFragmentPos);
+	vec2 duv1 = dFdx(TexCoord);
+	vec2 duv2 = dFdy(TexCoord);
+
+	vec3 dp2perp = cross(dp2, norm);
+	vec3 dp1perp = cross(norm, dp1);
+	vec3 tangent = dp2perp * duv1.x + dp1perp * duv2.x;
+	vec3 bitangent = dp2perp * duv1.y + dp1perp * duv2.y;
+	float invmax = inversesqrt(max(dot(tangent, tangent), dot(bitangent, bitangent)));
+
+	vec3 mapped = texture(normalMap, TexCoord).xyz * 2.0 - 1.0;
+	return normalize(mat3(tangent * invmax, bitangent * invmax, norm) * mapped);
+}
+#endif
+
+vec3 phongLight(vec3 norm, vec3 mlightColor, vec3 mlightPosition)
+{
+	/*Phong lighting model calculations to generate ambient, diffuse, and specular components*/
+
+   //Calculate Ambient lighting*/
+	const float ambientStrength = 0.1f; // Set ambient or global lighting strength
+	vec3 ambient = ambientStrength * mlightColor; // Generate ambient light color
+
+	//Calculate Diffuse lighting*/
+	vec3 lightDirection = normalize(mlightPosition - vertexFragmentPos); // Calculate distance (light direction) between light source and fragments/pixels on cube
+	float impact = max(dot(norm, lightDirection), 0.0);// Calculate diffuse impact by generating dot product of normal and light
+	vec3 diffuse = impact * mlightColor; // Generate diffuse light color
+
+	//Calculate Specular lighting*/
+	const float specularIntensity = 0.8f; // Set specular light strength
+	const float highlightSize = 16.0f; // Set specular highlight size
+	vec3 viewDir = normalize(viewPosition - vertexFragmentPos); // Calculate view direction
+	vec3 reflectDir = reflect(-lightDirection, norm);// Calculate reflection vector
+	//Calculate specular component
+	float specularComponent = pow(max(dot(viewDir, reflectDir), 0.0), highlightSize);
+	vec3 specular = specularIntensity * specularComponent * mlightColor;
+
+	// Calculate phong result
+	vec3 phong = (ambient + diffuse + specular);
+	return phong;
+}
+#endif
+
+void main()
+{
+#ifdef LIT
+    vec3 norm = normalize(vertexNormal); // Normalize vectors to 1 unit
+#ifdef NORMAL_MAPPED
+    norm = perturbNormal(norm);
+#endif
+    vec3 phong = vec3(0.0);
+    for (int i = 0; i < LIGHT_COUNT; i++)
+        phong += phongLight(norm, lightColor[i], lightPos[i]);
+#else
+    vec3 phong = vec3(1.0);
+#endif
+
+#ifdef TEXTURED
+    FragColor = vec4(phong, 1.0f) * texture(m_texture, TexCoord);
+#else
+    FragColor = vec4(phong * color, 1.0f);
+#endif
+}
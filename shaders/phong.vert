@@ -0,0 +1,47 @@
+#version 400 core
+// Features are switched on by the #defines ShaderVariants injects after the #version line
+  layout (location = 0) in vec3 aPos;
+#ifdef LIT
+  layout (location = 1) in vec3 normal;
+#endif
+#ifdef TEXTURED
+  layout (location = 2) in vec2 Tex;
+#endif
+#ifdef INSTANCED
+  layout (location = 3) in mat4 instanceModel; // occupies locations 3-6
+#endif
+
+#ifdef TEXTURED
+  out vec2 TexCoord;
+#endif
+  uniform mat4 Proj;
+#ifndef INSTANCED
+  uniform mat4 Model;
+#endif
+  uniform mat4 View;
+
+#ifdef LIT
+out vec3 vertexNormal; // For incoming normals
+out vec3 vertexFragmentPos; // For outgoing color / pixels to fragment shader
+#endif
+
+
+  void main()
+  {
+#ifdef INSTANCED
+     mat4 model = instanceModel;
+#else
+     mat4 model = Model;
+#endif
+
+#ifdef TEXTURED
+     TexCoord = vec2(Tex);
+#endif
+     gl_Position = Proj * View * model * vec4(aPos.x, aPos.y, aPos.z, 1.0);
+
+#ifdef LIT
+     vertexNormal = mat3(transpose(inverse(model))) * normal; // get normal vectors in world space only and exclude normal translation properties
+
+     vertexFragmentPos = vec3(model * vec4(aPos, 1.0f)); // Gets fragment / pixel position in world space only (exclude view and projection)
+#endif
+}
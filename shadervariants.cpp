@@ -0,0 +1,198 @@
+///////////////////////////////////////////////////////////////////////////////
+// shadervariants.cpp
+// ========
+// shader permutations: one GLSL source pair specialized at compile time by
+// injected #defines, with variants built lazily through the shader build queue
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#include "shadervariants.h"
+
+#include <iostream>
+
+///////////////////////////////////////////////////
+//	Initialize(GLFWwindow*, const char*, const char*, const ShaderCache*, GpuResources*)
+//
+//	window: main window, whose context must be current
+//	vtxShaderSource, fragShaderSource: uber-shader sources with #ifdef'd features
+//	cache: program binary cache consulted before compiling (may be null)
+//	resources: pool the linked programs are added to
+///////////////////////////////////////////////////
+bool ShaderVariants::Initialize(GLFWwindow* window, const char* vtxShaderSource, const char* fragShaderSource, const ShaderCache* cache,
+	GpuResources* resources) {
+	gResources = resources;
+	gVertexSource = vtxShaderSource;
+	gFragmentSource = fragShaderSource;
+	return gQueue.Initialize(window, cache);
+}
+
+///////////////////////////////////////////////////
+//	Shutdown()
+//
+//	Destroy every variant, including builds still in flight.
+//	Linked programs go back to the pool, which deletes them
+//	once the GPU is done with them.
+///////////////////////////////////////////////////
+void ShaderVariants::Shutdown() {
+	gQueue.Shutdown();
+
+	for (auto& entry : gVariants)
+		gResources->Destroy(entry.second.program);
+	gVariants.clear();
+	gTickets.clear();
+}
+
+unsigned int ShaderVariants::Key(unsigned int features, int lightCount) {
+	return features | ((unsigned int)lightCount << 16);
+}
+
+///////////////////////////////////////////////////
+//	Defines(unsigned int, int)
+//
+//	Build the #define block for a feature mask
+///////////////////////////////////////////////////
+std::string ShaderVariants::Defines(unsigned int features, int lightCount) {
+	std::string defines;
+	if (features & SHADER_TEXTURED)
+		defines += "#define TEXTURED\n";
+	if (features & SHADER_LIT)
+		defines += "#define LIT\n";
+	if (features & SHADER_INSTANCED)
+		defines += "#define INSTANCED\n";
+	// Normal maps are addressed with the mesh UVs, so they need a textured variant
+	if ((features & SHADER_NORMAL_MAPPED) && (features & SHADER_TEXTURED))
+		defines += "#define NORMAL_MAPPED\n";
+	defines += "#define LIGHT_COUNT " + std::to_string(lightCount) + "\n";
+	return defines;
+}
+
+void ShaderVariants::Request(unsigned int key, unsigned int features, int lightCount) {
+	Variant& variant = gVariants[key];
+	if (!variant.program.IsNull() || variant.ticket || variant.failed)
+		return;
+
+	variant.features = features;
+	variant.lightCount = lightCount;
+	variant.ticket = gQueue.Submit(gVertexSource, gFragmentSource, Defines(features, lightCount));
+	gTickets[variant.ticket] = key;
+}
+
+///////////////////////////////////////////////////
+//	Get(unsigned int, int)
+//
+//	features: mask of ShaderFeature bits
+//	lightCount: number of lights compiled into the variant
+//
+//	Returns the linked program, or 0 while it is still
+//	building (the first call submits the build). Callers
+//	fall back to an already available variant until then.
+///////////////////////////////////////////////////
+GLuint ShaderVariants::Get(unsigned int features, int lightCount) {
+	lightCount = lightCount < 1 ? 1 : (lightCount > MAX_SHADER_LIGHTS ? MAX_SHADER_LIGHTS : lightCount);
+	unsigned int key = Key(features, lightCount);
+
+	auto found = gVariants.find(key);
+	if (found != gVariants.end() && !found->second.program.IsNull())
+		return gResources->Program(found->second.program);
+
+	Request(key, features, lightCount);
+	return 0;
+}
+
+///////////////////////////////////////////////////
+//	GetBlocking(unsigned int, int)
+//
+//	Like Get(), but waits for the build to finish.
+//	Returns 0 only if the variant failed to build.
+///////////////////////////////////////////////////
+GLuint ShaderVariants::GetBlocking(unsigned int features, int lightCount) {
+	lightCount = lightCount < 1 ? 1 : (lightCount > MAX_SHADER_LIGHTS ? MAX_SHADER_LIGHTS : lightCount);
+	unsigned int key = Key(features, lightCount);
+
+	Request(key, features, lightCount);
+
+	std::vector<ShaderBuildQueue::Result> finished;
+	while (gVariants[key].ticket) {
+		finished.clear();
+		gQueue.WaitAny(finished);
+		Collect(finished);
+	}
+	return gResources->Program(gVariants[key].program);
+}
+
+///////////////////////////////////////////////////
+//	Prefetch(unsigned int, int)
+//
+//	Submit a variant that will be needed soon without
+//	waiting for it. Submitting everything up front lets
+//	the builds overlap.
+///////////////////////////////////////////////////
+void ShaderVariants::Prefetch(unsigned int features, int lightCount) {
+	Get(features, lightCount);
+}
+
+///////////////////////////////////////////////////
+//	Poll()
+//
+//	Pick up variants the build queue has finished.
+//	Call once per frame from the main thread.
+///////////////////////////////////////////////////
+void ShaderVariants::Poll() {
+	std::vector<ShaderBuildQueue::Result> finished;
+	gQueue.Poll(finished);
+	Collect(finished);
+}
+
+///////////////////////////////////////////////////
+//	Reload(const char*, const char*)
+//
+//	vtxShaderSource, fragShaderSource: edited uber-shader sources
+//
+//	Rebuild every variant in use from new sources. Each
+//	variant keeps drawing with its current program until
+//	the rebuild links; Poll() then swaps it in between
+//	frames. A rebuild that fails leaves the old program.
+///////////////////////////////////////////////////
+void ShaderVariants::Reload(const char* vtxShaderSource, const char* fragShaderSource) {
+	gVertexSource = vtxShaderSource;
+	gFragmentSource = fragShaderSource;
+
+	for (auto& entry : gVariants) {
+		Variant& variant = entry.second;
+
+		// A rebuild superseded by this one is discarded when it lands
+		if (variant.ticket)
+			gTickets.erase(variant.ticket);
+
+		variant.failed = false;
+		variant.ticket = gQueue.Submit(gVertexSource, gFragmentSource, Defines(variant.features, variant.lightCount));
+		gTickets[variant.ticket] = entry.first;
+	}
+}
+
+void ShaderVariants::Collect(const std::vector<ShaderBuildQueue::Result>& finished) {
+	for (const ShaderBuildQueue::Result& result : finished) {
+		auto ticket = gTickets.find(result.ticket);
+		if (ticket == gTickets.end()) {
+			// Superseded by a later Reload(); never drawn with, so it goes at once
+			UDestroyShaderProgram(result.programId);
+			continue;
+		}
+
+		Variant& variant = gVariants[ticket->second];
+		variant.ticket = 0;
+		gTickets.erase(ticket);
+
+		if (result.programId) {
+			// Frames already submitted may still draw with the old program
+			gResources->Destroy(variant.program);
+			variant.program = gResources->AddProgram(result.programId);
+		}
+		else if (!variant.program.IsNull()) {
+			std::cout << "WARNING: Shader rebuild failed, keeping the previous program" << std::endl;
+		}
+		else {
+			variant.failed = true;
+		}
+	}
+}
@@ -0,0 +1,67 @@
+///////////////////////////////////////////////////////////////////////////////
+// shadervariants.h
+// ========
+// shader permutations: one GLSL source pair specialized at compile time by
+// injected #defines, with variants built lazily through the shader build queue
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include "GL/glew.h"
+#include "GLFW/glfw3.h"
+#include "gpuresources.h"
+#include "shaderqueue.h"
+
+#include <map>
+#include <string>
+#include <vector>
+
+// Feature bits selecting a shader variant; each one becomes a #define in the source
+enum ShaderFeature {
+	SHADER_TEXTURED = 1 << 0,		// sample m_texture with the vertex UVs
+	SHADER_LIT = 1 << 1,			// Phong lighting from LIGHT_COUNT point lights
+	SHADER_INSTANCED = 1 << 2,		// per-instance model matrix in attributes 3-6 instead of the Model uniform
+	SHADER_NORMAL_MAPPED = 1 << 3,	// perturb normals with normalMap (texture unit 1)
+};
+
+const int MAX_SHADER_LIGHTS = 8;
+
+class ShaderVariants {
+
+public:
+	bool Initialize(GLFWwindow* window, const char* vtxShaderSource, const char* fragShaderSource, const ShaderCache* cache,
+		GpuResources* resources);
+	void Shutdown();
+
+	GLuint Get(unsigned int features, int lightCount = 1);
+	GLuint GetBlocking(unsigned int features, int lightCount = 1);
+	void Prefetch(unsigned int features, int lightCount = 1);
+	void Poll();
+
+	void Reload(const char* vtxShaderSource, const char* fragShaderSource);
+
+	static std::string Defines(unsigned int features, int lightCount);
+
+private:
+	// Build state of one permutation
+	struct Variant {
+		ProgramHandle program;		// Linked program, null until ready or if the build failed
+		unsigned int ticket = 0;	// Build queue ticket while a build or rebuild is in flight
+		unsigned int features = 0;
+		int lightCount = 1;
+		bool failed = false;		// Compilation or linking failed; never retried
+	};
+
+	static unsigned int Key(unsigned int features, int lightCount);
+	void Request(unsigned int key, unsigned int features, int lightCount);
+	void Collect(const std::vector<ShaderBuildQueue::Result>& finished);
+
+	ShaderBuildQueue gQueue;
+	std::string gVertexSource;
+	std::string gFragmentSource;
+
+	std::map<unsigned int, Variant> gVariants;		// Keyed by Key(features, lightCount)
+	std::map<unsigned int, unsigned int> gTickets;	// Build ticket -> variant key
+	GpuResources* gResources = nullptr;				// Owns the linked programs and defers their deletion
+};
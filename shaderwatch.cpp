@@ -0,0 +1,164 @@
+///////////////////////////////////////////////////////////////////////////////
+// shaderwatch.cpp
+// ========
+// watches the shader folder for edits so programs can be rebuilt without
+// restarting (inotify on Linux, modification time polling elsewhere)
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#include "shaderwatch.h"
+
+#include <fstream>
+#include <iostream>
+#include <sstream>
+
+#ifdef __linux__
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif
+
+namespace {
+	// Edits are reported once the folder has been quiet this long, so an
+	// editor that writes a file in several steps triggers a single rebuild
+	const double SETTLE_TIME = 0.15;
+
+	// How often modification times are compared when inotify is unavailable
+	const double SCAN_INTERVAL = 0.5;
+
+	// Editors also drop swap and backup files next to the sources; only
+	// shader extensions count as edits
+	bool IsShaderFile(const std::string& name) {
+		std::string extension = std::filesystem::path(name).extension().string();
+		return extension == ".vert" || extension == ".frag" || extension == ".glsl" || extension == ".comp";
+	}
+}
+
+///////////////////////////////////////////////////
+//	Initialize(const char*)
+//
+//	directory: folder holding the shader sources
+///////////////////////////////////////////////////
+bool ShaderWatcher::Initialize(const char* directory) {
+	gDirectory = directory;
+
+#ifdef __linux__
+	gNotifyFd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+	if (gNotifyFd >= 0) {
+		// Editors commonly save by writing a temporary file and renaming it over the original
+		gWatch = inotify_add_watch(gNotifyFd, directory, IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE);
+		if (gWatch >= 0)
+			return true;
+
+		close(gNotifyFd);
+		gNotifyFd = -1;
+	}
+#endif
+
+	std::error_code error;
+	if (!std::filesystem::is_directory(gDirectory, error)) {
+		std::cout << "WARNING: Shader folder " << gDirectory << " not found, hot reload disabled" << std::endl;
+		return false;
+	}
+
+	ScanTimestamps(false);
+	return true;
+}
+
+///////////////////////////////////////////////////
+//	Shutdown()
+//
+//	Stop watching the folder
+///////////////////////////////////////////////////
+void ShaderWatcher::Shutdown() {
+#ifdef __linux__
+	if (gNotifyFd >= 0) {
+		inotify_rm_watch(gNotifyFd, gWatch);
+		close(gNotifyFd);
+		gNotifyFd = -1;
+		gWatch = -1;
+	}
+#endif
+	gTimestamps.clear();
+}
+
+///////////////////////////////////////////////////
+//	Poll(double, std::vector<std::string>&)
+//
+//	time: current time in seconds (glfwGetTime())
+//	changed: receives the paths of the edited files
+//
+//	Returns true once after a burst of edits has settled.
+//	Never blocks, so it is safe to call every frame.
+///////////////////////////////////////////////////
+bool ShaderWatcher::Poll(double time, std::vector<std::string>& changed) {
+#ifdef __linux__
+	if (gNotifyFd >= 0) {
+		alignas(inotify_event) char buffer[4096];
+		ssize_t length;
+		while ((length = read(gNotifyFd, buffer, sizeof(buffer))) > 0) {
+			for (char* p = buffer; p < buffer + length;) {
+				const inotify_event* event = (const inotify_event*)p;
+				if (event->len && IsShaderFile(event->name)) {
+					gChanged.insert(event->name);
+					gLastEvent = time;
+				}
+				p += sizeof(inotify_event) + event->len;
+			}
+		}
+	}
+	else
+#endif
+	if (time - gLastScan >= SCAN_INTERVAL) {
+		gLastScan = time;
+		const bool before = !gChanged.empty();
+		ScanTimestamps(true);
+		if (!gChanged.empty() && !before)
+			gLastEvent = time;
+	}
+
+	if (!gChanged.empty() && time - gLastEvent >= SETTLE_TIME) {
+		changed.clear();
+		for (const std::string& name : gChanged)
+			changed.push_back(gDirectory + "/" + name);
+		gChanged.clear();
+		return true;
+	}
+	return false;
+}
+
+void ShaderWatcher::ScanTimestamps(bool report) {
+	std::error_code error;
+	for (const auto& entry : std::filesystem::directory_iterator(gDirectory, error)) {
+		std::string name = entry.path().filename().string();
+		if (!IsShaderFile(name))
+			continue;
+
+		std::filesystem::file_time_type stamp = entry.last_write_time(error);
+		if (error)
+			continue;
+
+		auto found = gTimestamps.find(name);
+		if (found == gTimestamps.end() || found->second != stamp) {
+			gTimestamps[name] = stamp;
+			if (report)
+				gChanged.insert(name);
+		}
+	}
+}
+
+///////////////////////////////////////////////////
+//	ReadFile(const char*, std::string&)
+//
+//	Load a whole text file. Returns false if it cannot
+//	be opened (e.g. while an editor is replacing it).
+///////////////////////////////////////////////////
+bool ShaderWatcher::ReadFile(const char* filename, std::string& text) {
+	std::ifstream file(filename, std::ios::binary);
+	if (!file)
+		return false;
+
+	std::ostringstream contents;
+	contents << file.rdbuf();
+	text = contents.str();
+	return true;
+}
@@ -0,0 +1,39 @@
+///////////////////////////////////////////////////////////////////////////////
+// shaderwatch.h
+// ========
+// watches the shader folder for edits so programs can be rebuilt without
+// restarting (inotify on Linux, modification time polling elsewhere)
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <filesystem>
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+
+class ShaderWatcher {
+
+public:
+	bool Initialize(const char* directory);
+	void Shutdown();
+
+	bool Poll(double time, std::vector<std::string>& changed);
+
+	static bool ReadFile(const char* filename, std::string& text);
+
+private:
+	void ScanTimestamps(bool report);
+
+	std::string gDirectory;
+	int gNotifyFd = -1;			// inotify descriptor (Linux only)
+	int gWatch = -1;			// inotify watch on gDirectory (Linux only)
+
+	std::set<std::string> gChanged;	// Files edited and not yet reported
+	double gLastEvent = 0.0;	// Time of the most recent edit, for debouncing
+	double gLastScan = 0.0;		// Time of the last timestamp scan (polling fallback)
+
+	std::map<std::string, std::filesystem::file_time_type> gTimestamps;	// Polling fallback
+};
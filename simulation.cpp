@@ -0,0 +1,268 @@
+///////////////////////////////////////////////////////////////////////////////
+// simulation.cpp
+// ========
+// fixed-timestep simulation of the camera and object transforms, decoupled
+// from the render rate, optionally running on its own thread
+//
+// The simulation always advances in steps of TIMESTEP, so movement does not
+// depend on the frame rate. It keeps its last two states; the renderer draws
+// a blend of the two according to how far it is into the next step.
+//
+// Object transforms are copied into the states once. After that, only the
+// transforms a tick lists in gCurrent.moved are carried over, published and
+// blended, so a static scene costs nothing per tick or per frame. Only the
+// camera moves in Tick() so far. A tick that moves an object writes its entry
+// in gCurrent.positions, rotations or scales and appends its index to
+// gCurrent.moved.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#include "simulation.h"
+
+#include <GLFW/glfw3.h>
+
+#include <chrono>
+#include <iostream>
+
+const double Simulation::TIMESTEP = 1.0 / 60.0;
+
+namespace {
+	// Movement speed change per second while the speed is ramping (0.75 per
+	// frame at the 60 frames per second the ramp was tuned at)
+	const float SPEED_CHANGE_RATE = 45.0f;
+
+	// After a stall (breakpoint, window drag) the simulation skips ahead
+	// rather than running a burst of ticks to catch up
+	const double MAX_CATCH_UP = 0.25;
+}
+
+///////////////////////////////////////////////////
+//	Initialize(const Camera&, const Transforms&, double, bool)
+//
+//	camera, transforms: initial state
+//	time: current time, as returned by glfwGetTime()
+//	threaded: tick on a thread of its own instead of in Advance()
+///////////////////////////////////////////////////
+bool Simulation::Initialize(const Camera& camera, const Transforms& transforms, double time, bool threaded) {
+	gCurrent.camera = camera;
+	gCurrent.positions = transforms.gPositions;
+	gCurrent.rotations = transforms.gRotations;
+	gCurrent.scales = transforms.gScales;
+	gCurrent.moved.clear();
+	gCurrent.time = time;
+	gPrevious = gCurrent;
+	gUnsettled.clear();
+
+	gAccumulator = 0.0;
+	gLastTime = time;
+	gInput = SimulationInput();
+
+	if (threaded) {
+		gPublishedPrevious = gPrevious;
+		gPublishedCurrent = gCurrent;
+		gStopping = false;
+		gThread = std::thread(&Simulation::ThreadMain, this);
+		std::cout << "INFO: Simulation running on its own thread at " << 1.0 / TIMESTEP << " Hz" << std::endl;
+	}
+	return true;
+}
+
+///////////////////////////////////////////////////
+//	Shutdown()
+//
+//	Stop the simulation thread, if any
+///////////////////////////////////////////////////
+void Simulation::Shutdown() {
+	if (!gThread.joinable())
+		return;
+
+	{
+		std::lock_guard<std::mutex> lock(gInputMutex);
+		gStopping = true;
+	}
+	gThread.join();
+}
+
+///////////////////////////////////////////////////
+//	SetInput(const SimulationInput&)
+//
+//	Main thread. Key states replace the previous ones;
+//	mouse offsets add up until a tick consumes them.
+///////////////////////////////////////////////////
+void Simulation::SetInput(const SimulationInput& input) {
+	std::lock_guard<std::mutex> lock(gInputMutex);
+	gInput.movement = input.movement;
+	gInput.speedChange = input.speedChange;
+	gInput.lookX += input.lookX;
+	gInput.lookY += input.lookY;
+}
+
+// Returns false once the simulation is shutting down
+bool Simulation::TakeInput(SimulationInput& input) {
+	std::lock_guard<std::mutex> lock(gInputMutex);
+	input = gInput;
+	gInput.lookX = 0.0f;
+	gInput.lookY = 0.0f;
+	return !gStopping;
+}
+
+///////////////////////////////////////////////////
+//	Advance(double)
+//
+//	time: current time, as returned by glfwGetTime()
+//
+//	Runs every tick that is due (none when threaded).
+//	Returns how far the render time is between the last
+//	two states, from 0 (previous) to 1 (current).
+///////////////////////////////////////////////////
+float Simulation::Advance(double time) {
+	if (gThread.joinable()) {
+		// Ticks happen at wall clock time, so the current state is as old as
+		// the time since its tick; draw that far past the previous state
+		std::lock_guard<std::mutex> lock(gStateMutex);
+		double alpha = (time - gPublishedCurrent.time) / TIMESTEP;
+		return alpha < 0.0 ? 0.0f : alpha > 1.0 ? 1.0f : (float)alpha;
+	}
+
+	double elapsed = time - gLastTime;
+	gLastTime = time;
+	gAccumulator += elapsed < MAX_CATCH_UP ? elapsed : MAX_CATCH_UP;
+
+	SimulationInput input;
+	while (gAccumulator >= TIMESTEP) {
+		TakeInput(input);
+		Tick(input);
+		gUnsettled.insert(gUnsettled.end(), gCurrent.moved.begin(), gCurrent.moved.end());
+		gAccumulator -= TIMESTEP;
+	}
+
+	return (float)(gAccumulator / TIMESTEP);
+}
+
+///////////////////////////////////////////////////
+//	Interpolate(float, Camera&, Transforms&)
+//
+//	alpha: blend factor returned by Advance()
+//	camera, transforms: receive the blended state
+//
+//	Only the transforms still blending (moved by the last
+//	tick) and those moved since the previous call are
+//	visited, so a scene where nothing moves costs nothing.
+///////////////////////////////////////////////////
+void Simulation::Interpolate(float alpha, Camera& camera, Transforms& transforms) {
+	std::unique_lock<std::mutex> lock(gStateMutex, std::defer_lock);
+	const SimulationState* previous = &gPrevious;
+	const SimulationState* current = &gCurrent;
+	if (gThread.joinable()) {
+		lock.lock();
+		previous = &gPublishedPrevious;
+		current = &gPublishedCurrent;
+	}
+
+	// a + (b - a) * t rather than glm::mix, so equal endpoints give exactly b
+	const Camera& from = previous->camera;
+	const Camera& to = current->camera;
+	camera.Position = from.Position + (to.Position - from.Position) * alpha;
+	camera.Yaw = from.Yaw + (to.Yaw - from.Yaw) * alpha;
+	camera.Pitch = from.Pitch + (to.Pitch - from.Pitch) * alpha;
+	camera.MovementSpeed = to.MovementSpeed;
+	camera.ProcessMouseMovement(0.0f, 0.0f);	// Recomputes Front, Right and Up from the angles
+
+	const size_t count = transforms.Count() < current->positions.size() ? transforms.Count() : current->positions.size();
+	auto blend = [&](int t) {
+		const size_t i = (size_t)t;
+		if (i >= count)
+			return;
+
+		glm::vec3 position = previous->positions[i] + (current->positions[i] - previous->positions[i]) * alpha;
+		if (position != transforms.gPositions[i])
+			transforms.SetPosition(t, position);
+
+		glm::quat rotation = previous->rotations[i] == current->rotations[i] ? current->rotations[i] :
+			glm::slerp(previous->rotations[i], current->rotations[i], alpha);
+		if (rotation != transforms.gRotations[i])
+			transforms.SetRotation(t, rotation);
+
+		glm::vec3 scale = previous->scales[i] + (current->scales[i] - previous->scales[i]) * alpha;
+		if (scale != transforms.gScales[i])
+			transforms.SetScale(t, scale);
+	};
+
+	for (const int t : current->moved)
+		blend(t);
+	for (const int t : gUnsettled)
+		blend(t);
+	gUnsettled.clear();
+}
+
+///////////////////////////////////////////////////
+//	Tick(const SimulationInput&)
+//
+//	Advance the simulation by one TIMESTEP
+///////////////////////////////////////////////////
+void Simulation::Tick(const SimulationInput& input) {
+	// The states differ only in the camera and the transforms the last tick moved
+	for (const int t : gCurrent.moved) {
+		gPrevious.positions[t] = gCurrent.positions[t];
+		gPrevious.rotations[t] = gCurrent.rotations[t];
+		gPrevious.scales[t] = gCurrent.scales[t];
+	}
+	gPrevious.moved.swap(gCurrent.moved);
+	gCurrent.moved.clear();
+	gPrevious.camera = gCurrent.camera;
+	gPrevious.time = gCurrent.time;
+
+	const float deltaTime = (float)TIMESTEP;
+	Camera& camera = gCurrent.camera;
+
+	if (input.lookX != 0.0f || input.lookY != 0.0f)
+		camera.ProcessMouseMovement(input.lookX, input.lookY);
+
+	for (int direction = FORWARD; direction <= DOWN; direction++)
+		if (input.movement & (1u << direction))
+			camera.ProcessKeyboard((Camera_Movement)direction, deltaTime);
+
+	camera.MovementSpeed += input.speedChange * SPEED_CHANGE_RATE * deltaTime;
+
+	gCurrent.time += TIMESTEP;
+}
+
+void Simulation::ThreadMain() {
+	SimulationInput input;
+	for (;;) {
+		double now = glfwGetTime();
+		double due = gCurrent.time + TIMESTEP;
+		if (now < due)
+			std::this_thread::sleep_for(std::chrono::duration<double>(due - now));
+		else if (now - due > MAX_CATCH_UP)
+			gCurrent.time = now - TIMESTEP;
+
+		if (!TakeInput(input))
+			break;
+		Tick(input);
+		Publish();
+	}
+}
+
+// Threaded mode: copy what the last tick changed for the renderer. Entries differ
+// from the published ones only where this tick or the one before moved them.
+void Simulation::Publish() {
+	std::lock_guard<std::mutex> lock(gStateMutex);
+	for (const std::vector<int>* moved : { &gPrevious.moved, &gCurrent.moved }) {
+		for (const int t : *moved) {
+			gPublishedPrevious.positions[t] = gPrevious.positions[t];
+			gPublishedPrevious.rotations[t] = gPrevious.rotations[t];
+			gPublishedPrevious.scales[t] = gPrevious.scales[t];
+			gPublishedCurrent.positions[t] = gCurrent.positions[t];
+			gPublishedCurrent.rotations[t] = gCurrent.rotations[t];
+			gPublishedCurrent.scales[t] = gCurrent.scales[t];
+		}
+	}
+	gPublishedPrevious.moved = gPrevious.moved;
+	gPublishedCurrent.moved = gCurrent.moved;
+	gPublishedPrevious.camera = gPrevious.camera;
+	gPublishedCurrent.camera = gCurrent.camera;
+	gPublishedPrevious.time = gPrevious.time;
+	gPublishedCurrent.time = gCurrent.time;
+	gUnsettled.insert(gUnsettled.end(), gCurrent.moved.begin(), gCurrent.moved.end());
+}
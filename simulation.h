@@ -0,0 +1,76 @@
+///////////////////////////////////////////////////////////////////////////////
+// simulation.h
+// ========
+// fixed-timestep simulation of the camera and object transforms, decoupled
+// from the render rate, optionally running on its own thread
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include "camera.h"
+#include "transforms.h"
+
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Input sampled by the main thread and consumed by the next tick
+struct SimulationInput {
+	unsigned int movement = 0;	// Bit (1 << Camera_Movement) for every movement key held
+	float lookX = 0.0f;			// Mouse offsets accumulated since the last tick
+	float lookY = 0.0f;
+	int speedChange = 0;		// +1 / -1 while the movement speed is ramping up / down
+};
+
+// Everything a tick advances, and the renderer interpolates between
+struct SimulationState {
+	Camera camera;
+	std::vector<glm::vec3> positions;	// Local transform components, one entry per transform
+	std::vector<glm::quat> rotations;
+	std::vector<glm::vec3> scales;
+	std::vector<int> moved;				// Transforms the tick that made this state wrote
+	double time = 0.0;					// Simulated time this state corresponds to
+};
+
+class Simulation {
+
+public:
+	static const double TIMESTEP;		// Seconds per tick
+
+	bool Initialize(const Camera& camera, const Transforms& transforms, double time, bool threaded);
+	void Shutdown();
+
+	void SetInput(const SimulationInput& input);
+	float Advance(double time);
+	void Interpolate(float alpha, Camera& camera, Transforms& transforms);
+
+	bool IsThreaded() const { return gThread.joinable(); }
+
+private:
+	void Tick(const SimulationInput& input);
+	void Publish();
+	bool TakeInput(SimulationInput& input);
+	void ThreadMain();
+
+	// Tick side: the last two states
+	SimulationState gPrevious;
+	SimulationState gCurrent;
+	double gAccumulator = 0.0;
+	double gLastTime = 0.0;
+
+	// Threaded mode: copies published after every tick for the renderer to read
+	SimulationState gPublishedPrevious;
+	SimulationState gPublishedCurrent;
+	std::mutex gStateMutex;
+
+	// Transforms moved by the ticks since the last Interpolate(), which must
+	// settle on their final value even if no later tick moves them
+	std::vector<int> gUnsettled;			// Guarded by gStateMutex when threaded
+
+	SimulationInput gInput;
+	std::mutex gInputMutex;
+
+	std::thread gThread;
+	bool gStopping = false;		// Guarded by gInputMutex
+};
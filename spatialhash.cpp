@@ -0,0 +1,292 @@
+///////////////////////////////////////////////////////////////////////////////
+// spatialhash.cpp
+// ========
+// spatial hash over a uniform grid: objects are filed under the world cell of
+// their center, in one open addressing table with no per-object allocations,
+// so moving objects is O(1) and nothing is ever rebuilt
+//
+// Every object sits in exactly one cell, the one holding the center of its
+// bounding box, and the objects of a cell form a doubly linked list threaded
+// through per-object arrays. Objects no larger than a cell reach at most
+// half a cell past their own, so queries widen their box by that much.
+// Anything larger is kept in a separate short list that every query scans.
+//
+// Cells that empty keep their slot (and are reused if something moves back
+// in); they are dropped when the table grows and is rehashed.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#include "spatialhash.h"
+
+#include <cmath>
+
+namespace {
+	const size_t INITIAL_CELLS = 256;
+
+	// Occupied slots per table slot before the table doubles
+	const float MAX_LOAD = 0.5f;
+
+	// Coordinates are packed 21 bits per axis
+	const int COORDINATE_BIAS = 1 << 20;
+	const int COORDINATE_MASK = (1 << 21) - 1;
+
+	bool Overlaps(const AABB& a, const AABB& b) {
+		return a.min.x <= b.max.x && a.max.x >= b.min.x &&
+			a.min.y <= b.max.y && a.max.y >= b.min.y &&
+			a.min.z <= b.max.z && a.max.z >= b.min.z;
+	}
+}
+
+///////////////////////////////////////////////////
+//	Initialize(float)
+//
+//	cellSize: edge of a grid cell, about the size of
+//	the typical object. Removes everything.
+///////////////////////////////////////////////////
+void SpatialHash::Initialize(float cellSize) {
+	gCellSize = cellSize > 0.0f ? cellSize : 1.0f;
+	gInverseCellSize = 1.0f / gCellSize;
+	Clear();
+}
+
+///////////////////////////////////////////////////
+//	Clear()
+//
+//	Remove every object, keeping the memory
+///////////////////////////////////////////////////
+void SpatialHash::Clear() {
+	gCells.assign(INITIAL_CELLS, Cell{ EMPTY_KEY, -1 });
+	gUsedCells = 0;
+	gCellKey.assign(gCellKey.size(), NOT_STORED);
+	gLarge.clear();
+	gCount = 0;
+}
+
+uint64_t SpatialHash::PackKey(int x, int y, int z) {
+	return ((uint64_t)((x + COORDINATE_BIAS) & COORDINATE_MASK) << 42) |
+		((uint64_t)((y + COORDINATE_BIAS) & COORDINATE_MASK) << 21) |
+		(uint64_t)((z + COORDINATE_BIAS) & COORDINATE_MASK);
+}
+
+uint64_t SpatialHash::CellKey(const glm::vec3& point) const {
+	return PackKey((int)std::floor(point.x * gInverseCellSize),
+		(int)std::floor(point.y * gInverseCellSize),
+		(int)std::floor(point.z * gInverseCellSize));
+}
+
+// Slot holding key, or the empty slot where it would go
+size_t SpatialHash::FindSlot(uint64_t key) const {
+	const size_t mask = gCells.size() - 1;
+	size_t slot = (size_t)((key * 0x9E3779B97F4A7C15ull) >> 32) & mask;
+	while (gCells[slot].key != key && gCells[slot].key != EMPTY_KEY)
+		slot = (slot + 1) & mask;
+	return slot;
+}
+
+int SpatialHash::FindCell(uint64_t key) const {
+	const size_t slot = FindSlot(key);
+	return gCells[slot].key == key ? gCells[slot].head : -1;
+}
+
+// Double the table, leaving out the cells that emptied
+void SpatialHash::Grow() {
+	std::vector<Cell> old;
+	old.swap(gCells);
+
+	size_t live = 0;
+	for (const Cell& cell : old)
+		if (cell.key != EMPTY_KEY && cell.head >= 0)
+			live++;
+
+	size_t size = INITIAL_CELLS;
+	while (size * MAX_LOAD <= live * 2)
+		size *= 2;
+
+	gCells.assign(size, Cell{ EMPTY_KEY, -1 });
+	gUsedCells = 0;
+	for (const Cell& cell : old) {
+		if (cell.key == EMPTY_KEY || cell.head < 0)
+			continue;
+		gCells[FindSlot(cell.key)] = cell;
+		gUsedCells++;
+	}
+}
+
+///////////////////////////////////////////////////
+//	Insert(int, const AABB&)
+//
+//	object: non-negative id; ids index flat arrays, so
+//	they should be dense (scene object numbers are)
+//	bounds: world space box of the object
+//
+//	Inserting an object that is already stored moves it
+///////////////////////////////////////////////////
+void SpatialHash::Insert(int object, const AABB& bounds) {
+	if (object < 0)
+		return;
+	if (Contains(object))
+		Remove(object);
+
+	if (object >= (int)gCellKey.size()) {
+		const size_t size = object + 1;
+		gCellKey.resize(size, NOT_STORED);
+		gNext.resize(size, -1);
+		gPrevious.resize(size, -1);
+		gLargeSlot.resize(size, -1);
+		gBounds.resize(size);
+	}
+
+	gBounds[object] = bounds;
+	gCount++;
+
+	const glm::vec3 size = bounds.max - bounds.min;
+	if (size.x > gCellSize || size.y > gCellSize || size.z > gCellSize) {
+		gCellKey[object] = LARGE_KEY;
+		gLargeSlot[object] = (int)gLarge.size();
+		gLarge.push_back(object);
+		return;
+	}
+
+	if (gUsedCells + 1 > gCells.size() * MAX_LOAD)
+		Grow();
+
+	const uint64_t key = CellKey((bounds.min + bounds.max) * 0.5f);
+	Cell& cell = gCells[FindSlot(key)];
+	if (cell.key == EMPTY_KEY) {
+		cell.key = key;
+		cell.head = -1;
+		gUsedCells++;
+	}
+
+	gCellKey[object] = key;
+	gPrevious[object] = -1;
+	gNext[object] = cell.head;
+	if (cell.head >= 0)
+		gPrevious[cell.head] = object;
+	cell.head = object;
+}
+
+void SpatialHash::Unlink(int object) {
+	const uint64_t key = gCellKey[object];
+	if (key == LARGE_KEY) {
+		// Swap with the last large object
+		const int slot = gLargeSlot[object];
+		gLarge[slot] = gLarge.back();
+		gLargeSlot[gLarge[slot]] = slot;
+		gLarge.pop_back();
+		gLargeSlot[object] = -1;
+		return;
+	}
+
+	if (gPrevious[object] >= 0)
+		gNext[gPrevious[object]] = gNext[object];
+	else
+		gCells[FindSlot(key)].head = gNext[object];
+	if (gNext[object] >= 0)
+		gPrevious[gNext[object]] = gPrevious[object];
+}
+
+///////////////////////////////////////////////////
+//	Remove(int)
+//
+//	Take an object out; unknown objects are ignored
+///////////////////////////////////////////////////
+void SpatialHash::Remove(int object) {
+	if (!Contains(object))
+		return;
+
+	Unlink(object);
+	gCellKey[object] = NOT_STORED;
+	gCount--;
+}
+
+///////////////////////////////////////////////////
+//	Update(int, const AABB&)
+//
+//	An object moved. Costs a store when it stays in the
+//	same cell; otherwise it is moved to its new cell.
+///////////////////////////////////////////////////
+void SpatialHash::Update(int object, const AABB& bounds) {
+	if (!Contains(object)) {
+		Insert(object, bounds);
+		return;
+	}
+
+	const glm::vec3 size = bounds.max - bounds.min;
+	const bool large = size.x > gCellSize || size.y > gCellSize || size.z > gCellSize;
+	if (!large && gCellKey[object] == CellKey((bounds.min + bounds.max) * 0.5f)) {
+		gBounds[object] = bounds;
+		return;
+	}
+	if (large && gCellKey[object] == LARGE_KEY) {
+		gBounds[object] = bounds;
+		return;
+	}
+
+	Remove(object);
+	Insert(object, bounds);
+}
+
+void SpatialHash::AppendMatches(int head, const AABB& box, std::vector<int>& results) const {
+	for (int object = head; object >= 0; object = gNext[object])
+		if (Overlaps(gBounds[object], box))
+			results.push_back(object);
+}
+
+///////////////////////////////////////////////////
+//	QueryBox(const AABB&, std::vector<int>&)
+//
+//	Appends every object whose box overlaps box. Visits
+//	the cells under the box, widened by half a cell, or
+//	every stored cell if that is fewer.
+///////////////////////////////////////////////////
+void SpatialHash::QueryBox(const AABB& box, std::vector<int>& results) const {
+	for (int object : gLarge)
+		if (Overlaps(gBounds[object], box))
+			results.push_back(object);
+
+	const float margin = gCellSize * 0.5f;
+	const glm::vec3 low = (box.min - glm::vec3(margin)) * gInverseCellSize;
+	const glm::vec3 high = (box.max + glm::vec3(margin)) * gInverseCellSize;
+	const int x0 = (int)std::floor(low.x), x1 = (int)std::floor(high.x);
+	const int y0 = (int)std::floor(low.y), y1 = (int)std::floor(high.y);
+	const int z0 = (int)std::floor(low.z), z1 = (int)std::floor(high.z);
+
+	const double cellCount = (double)(x1 - x0 + 1) * (y1 - y0 + 1) * (z1 - z0 + 1);
+	if (cellCount > (double)gUsedCells) {
+		for (const Cell& cell : gCells)
+			if (cell.key != EMPTY_KEY)
+				AppendMatches(cell.head, box, results);
+		return;
+	}
+
+	for (int x = x0; x <= x1; x++)
+		for (int y = y0; y <= y1; y++)
+			for (int z = z0; z <= z1; z++)
+				AppendMatches(FindCell(PackKey(x, y, z)), box, results);
+}
+
+///////////////////////////////////////////////////
+//	QuerySphere(const glm::vec3&, float, std::vector<int>&)
+//
+//	Appends every object whose box comes within radius
+//	of center
+///////////////////////////////////////////////////
+void SpatialHash::QuerySphere(const glm::vec3& center, float radius, std::vector<int>& results) const {
+	AABB box;
+	box.min = center - glm::vec3(radius);
+	box.max = center + glm::vec3(radius);
+
+	const size_t first = results.size();
+	QueryBox(box, results);
+
+	// Drop the box corners that are out of reach
+	size_t kept = first;
+	for (size_t i = first; i < results.size(); i++) {
+		const AABB& bounds = gBounds[results[i]];
+		const glm::vec3 outside = glm::max(glm::max(bounds.min - center, center - bounds.max), glm::vec3(0.0f));
+		if (glm::dot(outside, outside) <= radius * radius)
+			results[kept++] = results[i];
+	}
+	results.resize(kept);
+}
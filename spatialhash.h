@@ -0,0 +1,70 @@
+///////////////////////////////////////////////////////////////////////////////
+// spatialhash.h
+// ========
+// spatial hash over a uniform grid: objects are filed under the world cell of
+// their center, in one open addressing table with no per-object allocations,
+// so moving objects is O(1) and nothing is ever rebuilt
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include "glm/glm.hpp"
+#include "culling.h"
+
+#include <cstdint>
+#include <vector>
+
+class SpatialHash {
+
+public:
+	void Initialize(float cellSize);
+	void Clear();
+
+	void Insert(int object, const AABB& bounds);
+	void Remove(int object);
+	void Update(int object, const AABB& bounds);
+
+	void QueryBox(const AABB& box, std::vector<int>& results) const;
+	void QuerySphere(const glm::vec3& center, float radius, std::vector<int>& results) const;
+
+	bool Contains(int object) const { return object >= 0 && object < (int)gCellKey.size() && gCellKey[object] != NOT_STORED; }
+	size_t Count() const { return gCount; }
+	size_t CellCount() const { return gUsedCells; }
+
+private:
+	static constexpr uint64_t EMPTY_KEY = ~0ull;		// Table slot never used
+	static constexpr uint64_t NOT_STORED = ~0ull - 1;	// Object not in the hash
+	static constexpr uint64_t LARGE_KEY = ~0ull - 2;	// Object kept in gLarge
+
+	// One grid cell: the head of a list of objects linked through gNext
+	struct Cell {
+		uint64_t key;
+		int head;
+	};
+
+	uint64_t CellKey(const glm::vec3& point) const;
+	static uint64_t PackKey(int x, int y, int z);
+	size_t FindSlot(uint64_t key) const;
+	int FindCell(uint64_t key) const;
+	void Grow();
+	void Unlink(int object);
+	void AppendMatches(int head, const AABB& box, std::vector<int>& results) const;
+
+	float gCellSize = 1.0f;
+	float gInverseCellSize = 1.0f;
+
+	std::vector<Cell> gCells;			// Power of two size, linear probing
+	size_t gUsedCells = 0;				// Slots with a key, including cells that emptied
+
+	// Per object, indexed by object number
+	std::vector<uint64_t> gCellKey;		// Cell the object is filed under
+	std::vector<int> gNext;				// Next object in the same cell, -1 at the end
+	std::vector<int> gPrevious;			// Previous object in the same cell, -1 at the head
+	std::vector<int> gLargeSlot;		// Position in gLarge, for objects too large for a cell
+	std::vector<AABB> gBounds;
+
+	// Objects larger than a cell; few, and checked by every query
+	std::vector<int> gLarge;
+	size_t gCount = 0;
+};
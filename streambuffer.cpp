@@ -0,0 +1,146 @@
+///////////////////////////////////////////////////////////////////////////////
+// streambuffer.cpp
+// ========
+// ring buffer for per-frame dynamic data: a persistently mapped buffer split
+// into frame regions that are reused once the GPU is done with them
+//
+// With ARB_buffer_storage the buffer stays mapped (persistent, coherent) for
+// its whole life, so writing an allocation is a plain memcpy and the driver
+// never has to synchronize. A fence per region guarantees the GPU has
+// finished reading a region before the CPU writes it again. Without buffer
+// storage, allocations are written to system memory and uploaded with
+// glBufferSubData by Flush().
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#include "streambuffer.h"
+
+#include <iostream>
+
+///////////////////////////////////////////////////
+//	Initialize(GLsizeiptr)
+//
+//	regionSize: bytes available per frame
+///////////////////////////////////////////////////
+bool StreamBuffer::Initialize(GLsizeiptr regionSize) {
+	gRegionSize = regionSize;
+	gRegion = 0;
+	gOffset = gFlushed = 0;
+
+	const GLsizeiptr totalSize = regionSize * REGION_COUNT;
+
+	glGenBuffers(1, &gBuffer);
+	glBindBuffer(GL_ARRAY_BUFFER, gBuffer);
+
+	if (GLEW_VERSION_4_4 || GLEW_ARB_buffer_storage) {
+		const GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+		glBufferStorage(GL_ARRAY_BUFFER, totalSize, nullptr, flags);
+		gMapped = (unsigned char*)glMapBufferRange(GL_ARRAY_BUFFER, 0, totalSize, flags);
+		if (!gMapped)
+			std::cout << "WARNING: Persistent mapping of the stream buffer failed, using glBufferSubData" << std::endl;
+	}
+
+	if (!gMapped) {
+		// Storage may already be immutable; start over with a mutable buffer
+		glDeleteBuffers(1, &gBuffer);
+		glGenBuffers(1, &gBuffer);
+		glBindBuffer(GL_ARRAY_BUFFER, gBuffer);
+		glBufferData(GL_ARRAY_BUFFER, totalSize, nullptr, GL_STREAM_DRAW);
+		gStaging.resize(totalSize);
+	}
+
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+	return true;
+}
+
+///////////////////////////////////////////////////
+//	Shutdown()
+//
+//	Release the buffer and fences
+///////////////////////////////////////////////////
+void StreamBuffer::Shutdown() {
+	for (GLsync& fence : gFences) {
+		if (fence)
+			glDeleteSync(fence);
+		fence = 0;
+	}
+
+	if (gMapped) {
+		glBindBuffer(GL_ARRAY_BUFFER, gBuffer);
+		glUnmapBuffer(GL_ARRAY_BUFFER);
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
+		gMapped = nullptr;
+	}
+
+	glDeleteBuffers(1, &gBuffer);
+	gBuffer = 0;
+	gStaging.clear();
+}
+
+///////////////////////////////////////////////////
+//	BeginFrame()
+//
+//	Move on to the next region, first waiting until the
+//	GPU has finished the frame that last used it (with
+//	three regions that is normally long done)
+///////////////////////////////////////////////////
+void StreamBuffer::BeginFrame() {
+	gRegion = (gRegion + 1) % REGION_COUNT;
+	gOffset = gFlushed = 0;
+
+	GLsync& fence = gFences[gRegion];
+	if (fence) {
+		while (glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000) == GL_TIMEOUT_EXPIRED)
+			;
+		glDeleteSync(fence);
+		fence = 0;
+	}
+}
+
+///////////////////////////////////////////////////
+//	Allocate(GLsizeiptr, GLsizeiptr, GLintptr&)
+//
+//	size: bytes needed
+//	alignment: power of two the offset must be a multiple of
+//	offset: receives the allocation's offset in Buffer()
+//
+//	Returns where to write the data, valid until Flush()
+//	or EndFrame(), or nullptr when this frame's region
+//	is full (draw that data another way).
+///////////////////////////////////////////////////
+void* StreamBuffer::Allocate(GLsizeiptr size, GLsizeiptr alignment, GLintptr& offset) {
+	GLsizeiptr start = (gOffset + alignment - 1) & ~(alignment - 1);
+	if (start + size > gRegionSize)
+		return nullptr;
+
+	gOffset = start + size;
+	offset = gRegion * gRegionSize + start;
+	return (gMapped ? gMapped : gStaging.data()) + offset;
+}
+
+///////////////////////////////////////////////////
+//	Flush()
+//
+//	Make everything allocated so far visible to draws
+//	issued from now on. Nothing to do for the coherent
+//	persistent mapping.
+///////////////////////////////////////////////////
+void StreamBuffer::Flush() {
+	if (gMapped || gOffset == gFlushed)
+		return;
+
+	const GLintptr base = gRegion * gRegionSize;
+	glBindBuffer(GL_ARRAY_BUFFER, gBuffer);
+	glBufferSubData(GL_ARRAY_BUFFER, base + gFlushed, gOffset - gFlushed, gStaging.data() + base + gFlushed);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+	gFlushed = gOffset;
+}
+
+///////////////////////////////////////////////////
+//	EndFrame()
+//
+//	Call after the last draw reading this frame's region
+///////////////////////////////////////////////////
+void StreamBuffer::EndFrame() {
+	gFences[gRegion] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+}
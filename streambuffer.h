@@ -0,0 +1,44 @@
+///////////////////////////////////////////////////////////////////////////////
+// streambuffer.h
+// ========
+// ring buffer for per-frame dynamic data: a persistently mapped buffer split
+// into frame regions that are reused once the GPU is done with them
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include "GL/glew.h"
+
+#include <vector>
+
+class StreamBuffer {
+
+public:
+	// Frames of data in flight: one being written, up to two being read by the GPU
+	static const int REGION_COUNT = 3;
+
+public:
+	bool Initialize(GLsizeiptr regionSize);
+	void Shutdown();
+
+	void BeginFrame();
+	void* Allocate(GLsizeiptr size, GLsizeiptr alignment, GLintptr& offset);
+	void Flush();
+	void EndFrame();
+
+	GLuint Buffer() const { return gBuffer; }
+	bool IsPersistent() const { return gMapped != nullptr; }
+	GLsizeiptr RegionSize() const { return gRegionSize; }
+
+private:
+	GLuint gBuffer = 0;
+	unsigned char* gMapped = nullptr;			// Whole buffer, when persistently mapped
+	std::vector<unsigned char> gStaging;		// Stand-in for gMapped without buffer storage
+
+	GLsizeiptr gRegionSize = 0;
+	int gRegion = 0;							// Region written this frame
+	GLsizeiptr gOffset = 0;						// Bytes allocated in it so far
+	GLsizeiptr gFlushed = 0;					// Bytes of it already uploaded (staging path)
+	GLsync gFences[REGION_COUNT] = {};			// Signaled when the GPU is done reading a region
+};
@@ -0,0 +1,392 @@
+///////////////////////////////////////////////////////////////////////////////
+// texturestreaming.cpp
+// ========
+// streamed textures: each starts with only its small mip levels resident,
+// finer levels are decoded on a background thread and uploaded within a
+// per-frame byte budget as objects using them come close to the camera
+//
+// Textures use mutable storage with GL_TEXTURE_BASE_LEVEL set to the finest
+// resident level, so levels are added and removed one at a time without
+// reallocating the texture or changing its name. Until its image has been
+// decoded a texture is a single grey texel.
+//
+// Every frame the caller requests, per visible object, how much of the
+// texture's UV range one screen pixel covers. The finest level requested
+// is uploaded (coarse to fine, the largest shortfall first) while the frame's
+// upload budget lasts; the small tail levels are always uploaded as soon as
+// they are decoded. Levels finer than what is requested are dropped after a
+// delay, so a texture does not bounce between levels at a boundary. The
+// decoded image is kept for a while after its last upload and then freed; if
+// it is needed again the file is decoded again.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#include "texturestreaming.h"
+#include "gpumemory.h"
+
+#include "stb_image.h"
+
+#include <cmath>
+#include <cstring>
+#include <iostream>
+
+namespace {
+	// Levels at most this many texels on a side are resident as soon as they are decoded
+	const int TAIL_SIZE = 64;
+
+	// Frames a finer level stays resident after it was last requested
+	const unsigned int DROP_DELAY_FRAMES = 120;
+
+	// Frames a decoded image is kept after its last upload
+	const unsigned int KEEP_DECODED_FRAMES = 300;
+
+	double Megabytes(size_t bytes) {
+		return bytes / (1024.0 * 1024.0);
+	}
+}
+
+///////////////////////////////////////////////////
+//	Initialize(GpuResources*, GpuMemory*, size_t)
+//
+//	resources: owns the streamed textures
+//	memory: told about every change in resident size, or
+//	nullptr; uploads stop at its budget
+//	uploadBudget: bytes of finer levels uploaded per frame
+///////////////////////////////////////////////////
+bool TextureStreamer::Initialize(GpuResources* resources, GpuMemory* memory, size_t uploadBudget) {
+	gResources = resources;
+	gMemory = memory;
+	gUploadBudget = uploadBudget;
+	gStopping = false;
+	gLoader = std::thread(&TextureStreamer::LoaderMain, this);
+	return true;
+}
+
+///////////////////////////////////////////////////
+//	Shutdown()
+//
+//	Stop the loader thread. The textures themselves
+//	belong to whoever holds their handles.
+///////////////////////////////////////////////////
+void TextureStreamer::Shutdown() {
+	if (gLoader.joinable()) {
+		{
+			std::lock_guard<std::mutex> lock(gMutex);
+			gStopping = true;
+		}
+		gWork.notify_all();
+		gLoader.join();
+	}
+
+	gQueue.clear();
+	gDecoded.clear();
+	gTextures.clear();
+}
+
+///////////////////////////////////////////////////
+//	Add(const char*, TextureHandle&, bool)
+//
+//	filename: image to stream
+//	texture: receives the handle, valid right away
+//	flip: upload the bottom row first, as the built-in
+//	meshes' uvs expect (glTF uvs start at the top)
+//
+//	Only reads the image header; the image itself is
+//	decoded on the loader thread. Returns false if the
+//	header cannot be read.
+///////////////////////////////////////////////////
+bool TextureStreamer::Add(const char* filename, TextureHandle& texture, bool flip) {
+	int width, height, channels;
+	if (!stbi_info(filename, &width, &height, &channels)) {
+		std::cout << "ERROR::TEXTURE::LOAD_FAILED " << filename << std::endl;
+		return false;
+	}
+
+	Texture entry;
+	entry.filename = filename;
+	entry.width = width;
+	entry.height = height;
+	entry.levels = 1;
+	while (LevelSize(width, entry.levels - 1) > 1 || LevelSize(height, entry.levels - 1) > 1)
+		entry.levels++;
+	entry.tail = 0;
+	while (LevelSize(width, entry.tail) > TAIL_SIZE || LevelSize(height, entry.tail) > TAIL_SIZE)
+		entry.tail++;
+	entry.flip = flip;
+	entry.resident = entry.levels;
+	entry.requested = entry.levels;
+	entry.lastNeeded = gFrame;
+	entry.lastUploaded = gFrame;
+	entry.loading = true;
+	entry.failed = false;
+	entry.changed = false;
+
+	// Placeholder in the 1x1 level, replaced when the tail arrives
+	const unsigned char grey[4] = { 128, 128, 128, 255 };
+	GLuint textureId;
+	glGenTextures(1, &textureId);
+	glBindTexture(GL_TEXTURE_2D, textureId);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, entry.levels - 1);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, entry.levels - 1);
+	glTexImage2D(GL_TEXTURE_2D, entry.levels - 1, GL_RGBA8, 1, 1, 0, GL_RGBA, GL_UNSIGNED_BYTE, grey);
+	glBindTexture(GL_TEXTURE_2D, 0);
+
+	entry.handle = gResources->AddTexture(textureId);
+	texture = entry.handle;
+
+	{
+		std::lock_guard<std::mutex> lock(gMutex);
+		gQueue.push_back({ (int)gTextures.size(), entry.filename, width, height, entry.levels, flip });
+	}
+	gWork.notify_one();
+	gTextures.push_back(entry);
+
+	if (gMemory)
+		gMemory->TrackTexture(texture, MEMORY_TEXTURES, false);
+	return true;
+}
+
+///////////////////////////////////////////////////
+//	Request(int, float)
+//
+//	texture: index in the order of Add()
+//	uvPerPixel: texture coordinate units one screen
+//	pixel covers where the texture is drawn
+//
+//	Call for every visible use of a texture each frame,
+//	before Update(); the finest request wins
+///////////////////////////////////////////////////
+void TextureStreamer::Request(int texture, float uvPerPixel) {
+	Texture& entry = gTextures[texture];
+	const float texelsPerPixel = uvPerPixel * (float)(entry.width > entry.height ? entry.width : entry.height);
+
+	int level = texelsPerPixel > 1.0f ? (int)std::floor(std::log2(texelsPerPixel)) : 0;
+	if (level > entry.levels - 1)
+		level = entry.levels - 1;
+	if (level < entry.requested)
+		entry.requested = level;
+}
+
+///////////////////////////////////////////////////
+//	Update()
+//
+//	Once per frame, after the requests: takes in what the
+//	loader decoded, queues decodes, uploads and drops
+//	levels, and starts the next frame's requests
+///////////////////////////////////////////////////
+void TextureStreamer::Update() {
+	{
+		std::lock_guard<std::mutex> lock(gMutex);
+		gCollected.swap(gDecoded);
+	}
+	for (Decoded& decoded : gCollected) {
+		Texture& texture = gTextures[decoded.texture];
+		texture.loading = false;
+		if (decoded.pixels.empty()) {
+			std::cout << "ERROR::TEXTURE::DECODE_FAILED " << texture.filename << std::endl;
+			texture.failed = true;
+			continue;
+		}
+		texture.pixels.swap(decoded.pixels);
+		texture.lastUploaded = gFrame;
+	}
+	gCollected.clear();
+
+	// Over the memory budget, levels that are not needed go without waiting
+	const bool overBudget = gMemory && gMemory->Budget() && gMemory->Total() > gMemory->Budget();
+
+	for (Texture& texture : gTextures) {
+		if (texture.failed)
+			continue;
+
+		const int needed = texture.requested < texture.tail ? texture.requested : texture.tail;
+		if (texture.requested <= texture.resident)
+			texture.lastNeeded = gFrame;
+
+		if (needed < texture.resident && texture.pixels.empty() && !texture.loading) {
+			{
+				std::lock_guard<std::mutex> lock(gMutex);
+				gQueue.push_back({ (int)(&texture - gTextures.data()), texture.filename, texture.width, texture.height, texture.levels, texture.flip });
+			}
+			gWork.notify_one();
+			texture.loading = true;
+		}
+		else if (needed > texture.resident && (overBudget || gFrame - texture.lastNeeded > DROP_DELAY_FRAMES)) {
+			DropLevels(texture, needed);
+		}
+
+		// The tail goes up right away, whatever the budget
+		if (!texture.pixels.empty())
+			while (texture.resident > texture.tail)
+				UploadLevel(texture, texture.resident - 1);
+	}
+
+	// Finer levels, largest shortfall first, until the budget is spent (at least one level
+	// per frame, so levels larger than the budget still arrive)
+	size_t budget = gUploadBudget;
+	bool uploaded = false;
+	for (;;) {
+		Texture* next = nullptr;
+		int shortfall = 0;
+		for (Texture& texture : gTextures) {
+			if (texture.pixels.empty() || texture.requested >= texture.resident)
+				continue;
+			if (texture.resident - texture.requested > shortfall) {
+				shortfall = texture.resident - texture.requested;
+				next = &texture;
+			}
+		}
+		if (!next)
+			break;
+
+		const int level = next->resident - 1;
+		const size_t bytes = (size_t)LevelSize(next->width, level) * LevelSize(next->height, level) * 4;
+		if (uploaded && bytes > budget)
+			break;
+		if (gMemory && gMemory->Budget() && gMemory->Total() + bytes > gMemory->Budget())
+			break;
+
+		UploadLevel(*next, level);
+		budget -= bytes < budget ? bytes : budget;
+		uploaded = true;
+	}
+
+	for (Texture& texture : gTextures) {
+		if (texture.changed && gMemory)
+			gMemory->TrackTexture(texture.handle, MEMORY_TEXTURES, false);
+		texture.changed = false;
+
+		// Nothing left to upload for a while: free the decoded image
+		const int needed = texture.requested < texture.tail ? texture.requested : texture.tail;
+		if (!texture.pixels.empty() && texture.resident <= needed && gFrame - texture.lastUploaded > KEEP_DECODED_FRAMES)
+			MipChain().swap(texture.pixels);
+
+		texture.requested = texture.levels;
+	}
+	gFrame++;
+}
+
+void TextureStreamer::UploadLevel(Texture& texture, int level) {
+	const int width = LevelSize(texture.width, level);
+	const int height = LevelSize(texture.height, level);
+
+	glBindTexture(GL_TEXTURE_2D, gResources->Texture(texture.handle));
+	glTexImage2D(GL_TEXTURE_2D, level, GL_RGBA8, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, texture.pixels[level].data());
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, level);
+	glBindTexture(GL_TEXTURE_2D, 0);
+
+	texture.resident = level;
+	texture.lastUploaded = gFrame;
+	texture.changed = true;
+	gUploadedBytes += (size_t)width * height * 4;
+}
+
+// Make level the finest resident one and free the storage of the levels above it
+void TextureStreamer::DropLevels(Texture& texture, int level) {
+	glBindTexture(GL_TEXTURE_2D, gResources->Texture(texture.handle));
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, level);
+	for (int finer = texture.resident; finer < level; finer++)
+		glTexImage2D(GL_TEXTURE_2D, finer, GL_RGBA8, 0, 0, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+	glBindTexture(GL_TEXTURE_2D, 0);
+
+	texture.resident = level;
+	texture.changed = true;
+}
+
+///////////////////////////////////////////////////
+//	Decode(const std::string&, int, int, int, bool, MipChain&)
+//
+//	Loader thread. Reads the image (flipped if asked, so
+//	the first row is the bottom one) and box filters
+//	the rest of the mip chain from it. Returns false if
+//	the file cannot be decoded or changed size since Add().
+///////////////////////////////////////////////////
+bool TextureStreamer::Decode(const std::string& filename, int width, int height, int levels, bool flip, MipChain& pixels) {
+	int imageWidth, imageHeight, channels;
+	unsigned char* image = stbi_load(filename.c_str(), &imageWidth, &imageHeight, &channels, 4);
+	if (!image)
+		return false;
+	if (imageWidth != width || imageHeight != height) {
+		stbi_image_free(image);
+		return false;
+	}
+
+	pixels.resize(levels);
+	const size_t rowBytes = (size_t)width * 4;
+	pixels[0].resize(rowBytes * height);
+	for (int y = 0; y < height; y++)
+		memcpy(&pixels[0][y * rowBytes], image + (size_t)(flip ? height - 1 - y : y) * rowBytes, rowBytes);
+	stbi_image_free(image);
+
+	for (int level = 1; level < levels; level++) {
+		const int sourceWidth = LevelSize(width, level - 1);
+		const int sourceHeight = LevelSize(height, level - 1);
+		const int levelWidth = LevelSize(width, level);
+		const int levelHeight = LevelSize(height, level);
+		const unsigned char* source = pixels[level - 1].data();
+		pixels[level].resize((size_t)levelWidth * levelHeight * 4);
+		unsigned char* target = pixels[level].data();
+
+		// Odd sizes repeat the last row or column
+		for (int y = 0; y < levelHeight; y++) {
+			const int y0 = 2 * y < sourceHeight ? 2 * y : sourceHeight - 1;
+			const int y1 = 2 * y + 1 < sourceHeight ? 2 * y + 1 : sourceHeight - 1;
+			for (int x = 0; x < levelWidth; x++) {
+				const int x0 = 2 * x < sourceWidth ? 2 * x : sourceWidth - 1;
+				const int x1 = 2 * x + 1 < sourceWidth ? 2 * x + 1 : sourceWidth - 1;
+				for (int c = 0; c < 4; c++) {
+					const int sum = source[((size_t)y0 * sourceWidth + x0) * 4 + c] + source[((size_t)y0 * sourceWidth + x1) * 4 + c] +
+						source[((size_t)y1 * sourceWidth + x0) * 4 + c] + source[((size_t)y1 * sourceWidth + x1) * 4 + c];
+					target[((size_t)y * levelWidth + x) * 4 + c] = (unsigned char)((sum + 2) / 4);
+				}
+			}
+		}
+	}
+	return true;
+}
+
+void TextureStreamer::LoaderMain() {
+	for (;;) {
+		Job job;
+		{
+			std::unique_lock<std::mutex> lock(gMutex);
+			gWork.wait(lock, [this] { return gStopping || !gQueue.empty(); });
+			if (gStopping)
+				break;
+			job = gQueue.front();
+			gQueue.pop_front();
+		}
+
+		Decoded decoded;
+		decoded.texture = job.texture;
+		if (!Decode(job.filename, job.width, job.height, job.levels, job.flip, decoded.pixels))
+			decoded.pixels.clear();
+
+		{
+			std::lock_guard<std::mutex> lock(gMutex);
+			gDecoded.push_back(std::move(decoded));
+		}
+	}
+}
+
+void TextureStreamer::Report() const {
+	size_t resident = 0, full = 0;
+	for (const Texture& texture : gTextures) {
+		for (int level = 0; level < texture.levels; level++) {
+			const size_t bytes = (size_t)LevelSize(texture.width, level) * LevelSize(texture.height, level) * 4;
+			full += bytes;
+			if (level >= texture.resident)
+				resident += bytes;
+		}
+	}
+
+	const std::streamsize precision = std::cout.precision(1);
+	std::cout << std::fixed << "INFO: Texture streaming: " << gTextures.size() << " textures, " << Megabytes(resident)
+		<< " of " << Megabytes(full) << " MB resident, " << Megabytes(gUploadedBytes) << " MB uploaded"
+		<< std::defaultfloat << std::endl;
+	std::cout.precision(precision);
+}
@@ -0,0 +1,99 @@
+///////////////////////////////////////////////////////////////////////////////
+// texturestreaming.h
+// ========
+// streamed textures: each starts with only its small mip levels resident,
+// finer levels are decoded on a background thread and uploaded within a
+// per-frame byte budget as objects using them come close to the camera
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include "GL/glew.h"
+#include "gpuresources.h"
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+class GpuMemory;
+
+class TextureStreamer {
+
+public:
+	bool Initialize(GpuResources* resources, GpuMemory* memory, size_t uploadBudget);
+	void Shutdown();
+
+	bool Add(const char* filename, TextureHandle& texture, bool flip = true);
+
+	void Request(int texture, float uvPerPixel);
+	void Update();
+
+	void Report() const;
+
+	size_t Count() const { return gTextures.size(); }
+
+private:
+	// Decoded image with its whole mip chain, level 0 first (RGBA8)
+	typedef std::vector<std::vector<unsigned char>> MipChain;
+
+	struct Texture {
+		std::string filename;
+		TextureHandle handle;
+		int width;
+		int height;
+		int levels;					// Levels of the full mip chain
+		int tail;					// Finest level that is always resident
+		bool flip;					// Stored bottom row first; false for images whose uvs start at the top
+		int resident;				// Finest resident level; levels while only the placeholder is
+		int requested;				// Finest level requested this frame; levels if not seen
+		unsigned int lastNeeded;	// Last frame the resident levels were all requested
+		unsigned int lastUploaded;	// Last frame a level was uploaded
+		bool loading;				// Queued for or being decoded
+		bool failed;				// Could not be decoded; keeps its placeholder
+		bool changed;				// Resident levels changed during this Update()
+		MipChain pixels;			// Decoded levels, kept until everything requested is resident
+	};
+
+	// Image for the loader thread to decode
+	struct Job {
+		int texture;
+		std::string filename;
+		int width;
+		int height;
+		int levels;
+		bool flip;
+	};
+
+	// Decode handed back by the loader thread
+	struct Decoded {
+		int texture;
+		MipChain pixels;
+	};
+
+	static int LevelSize(int size, int level) { return size >> level > 0 ? size >> level : 1; }
+	static bool Decode(const std::string& filename, int width, int height, int levels, bool flip, MipChain& pixels);
+
+	void UploadLevel(Texture& texture, int level);
+	void DropLevels(Texture& texture, int level);
+	void LoaderMain();
+
+	GpuResources* gResources = nullptr;
+	GpuMemory* gMemory = nullptr;				// Kept up to date with the resident sizes, if set
+	size_t gUploadBudget = 0;					// Bytes uploaded per frame beyond the tails
+
+	std::vector<Texture> gTextures;
+	unsigned int gFrame = 0;
+	size_t gUploadedBytes = 0;					// Since startup, for the report
+
+	std::thread gLoader;
+	std::mutex gMutex;
+	std::condition_variable gWork;
+	std::deque<Job> gQueue;						// Guarded by gMutex
+	std::vector<Decoded> gDecoded;				// Guarded by gMutex
+	std::vector<Decoded> gCollected;			// Swapped with gDecoded, so collecting does not allocate
+	bool gStopping = false;						// Guarded by gMutex
+};
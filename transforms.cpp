@@ -0,0 +1,238 @@
+///////////////////////////////////////////////////////////////////////////////
+// transforms.cpp
+// ========
+// structure-of-arrays transform store: local position/rotation/scale and
+// parent links, with world matrices only recomputed for dirty transforms
+// (optionally spread over the job system)
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#include "transforms.h"
+#include "jobs.h"
+
+#include <algorithm>
+
+namespace {
+	// Transforms per job; below this a batch is not worth handing to another thread
+	const unsigned int UPDATE_GRAIN = 256;
+
+	// Local matrix = translate * rotate * scale, without the three matrix products
+	inline glm::mat4 Compose(const glm::vec3& position, const glm::quat& rotation, const glm::vec3& scale) {
+		glm::mat4 local = glm::mat4_cast(rotation);
+		local[0] *= scale.x;
+		local[1] *= scale.y;
+		local[2] *= scale.z;
+		local[3] = glm::vec4(position, 1.0f);
+		return local;
+	}
+}
+
+///////////////////////////////////////////////////
+//	Add(const glm::vec3&, const glm::quat&, const glm::vec3&, int)
+//
+//	parent: existing transform this one is relative to, or -1
+//
+//	Returns the index of the new transform. Its world
+//	matrix is computed by the next Update().
+///////////////////////////////////////////////////
+int Transforms::Add(const glm::vec3& position, const glm::quat& rotation, const glm::vec3& scale, int parent) {
+	int transform = (int)gParents.size();
+
+	gPositions.push_back(position);
+	gRotations.push_back(rotation);
+	gScales.push_back(scale);
+	gParents.push_back(parent);
+	gWorld.push_back(glm::mat4(1.0f));
+	gDirty.push_back(0);
+	gOrder.push_back(transform);
+
+	// Appending keeps parents before children, but not grouped by depth
+	if (parent >= 0)
+		gHasChildren = true;
+	gHierarchyChanged = true;
+
+	MarkDirty(transform);
+	return transform;
+}
+
+///////////////////////////////////////////////////
+//	Clear()
+//
+//	Remove every transform
+///////////////////////////////////////////////////
+void Transforms::Clear() {
+	gPositions.clear();
+	gRotations.clear();
+	gScales.clear();
+	gParents.clear();
+	gWorld.clear();
+	gDirty.clear();
+	gDirtyList.clear();
+	gOrder.clear();
+	gLevelStart.clear();
+	gHierarchyChanged = false;
+	gHasChildren = false;
+	gUpdated.clear();
+}
+
+void Transforms::MarkDirty(int transform) {
+	if (!gDirty[transform]) {
+		gDirty[transform] = 1;
+		gDirtyList.push_back(transform);
+	}
+}
+
+void Transforms::SetPosition(int transform, const glm::vec3& position) {
+	gPositions[transform] = position;
+	MarkDirty(transform);
+}
+
+void Transforms::SetRotation(int transform, const glm::quat& rotation) {
+	gRotations[transform] = rotation;
+	MarkDirty(transform);
+}
+
+void Transforms::SetScale(int transform, const glm::vec3& scale) {
+	gScales[transform] = scale;
+	MarkDirty(transform);
+}
+
+///////////////////////////////////////////////////
+//	SetParent(int, int)
+//
+//	Re-parent a transform, keeping its local components.
+//	Links that would create a cycle are ignored.
+///////////////////////////////////////////////////
+void Transforms::SetParent(int transform, int parent) {
+	for (int ancestor = parent; ancestor >= 0; ancestor = gParents[ancestor])
+		if (ancestor == transform)
+			return;
+
+	gParents[transform] = parent;
+	if (parent >= 0)
+		gHasChildren = true;
+
+	gHierarchyChanged = true;
+	MarkDirty(transform);
+}
+
+///////////////////////////////////////////////////
+//	SortHierarchy()
+//
+//	Rebuild gOrder so every parent comes before its
+//	children: a stable counting sort by depth. All
+//	transforms of one depth are contiguous, so a level
+//	can be updated in parallel once the one above it is.
+///////////////////////////////////////////////////
+void Transforms::SortHierarchy() {
+	const int count = (int)gParents.size();
+	gDepth.assign(count, -1);
+
+	int maxDepth = 0;
+	for (int t = 0; t < count; t++) {
+		// Walk up until a transform with a known depth (or a root) is found
+		int depth = 0;
+		int ancestor = gParents[t];
+		while (ancestor >= 0 && gDepth[ancestor] < 0) {
+			depth++;
+			ancestor = gParents[ancestor];
+		}
+		depth += ancestor >= 0 ? gDepth[ancestor] + 1 : 0;
+
+		// Fill in the chain that was just walked
+		for (int node = t; node >= 0 && gDepth[node] < 0; node = gParents[node])
+			gDepth[node] = depth--;
+
+		maxDepth = std::max(maxDepth, gDepth[t]);
+	}
+
+	std::vector<int> start(maxDepth + 2, 0);
+	for (int t = 0; t < count; t++)
+		start[gDepth[t] + 1]++;
+	for (int d = 1; d <= maxDepth + 1; d++)
+		start[d] += start[d - 1];
+	gLevelStart = start;
+
+	gOrder.resize(count);
+	for (int t = 0; t < count; t++)
+		gOrder[start[gDepth[t]]++] = t;
+
+	gHierarchyChanged = false;
+}
+
+///////////////////////////////////////////////////
+//	Update(JobSystem*)
+//
+//	jobs: spreads the work over its threads, or nullptr
+//
+//	Recompute the world matrix of every dirty transform
+//	and of everything below it in the hierarchy. Costs
+//	nothing when no transform changed. LastUpdated()
+//	then lists the transforms that were recomputed.
+///////////////////////////////////////////////////
+void Transforms::Update(JobSystem* jobs) {
+	gUpdated.clear();
+	if (gDirtyList.empty())
+		return;
+
+	if (!gHasChildren) {
+		// Flat scene: every dirty transform is independent of the others
+		auto updateDirty = [this](unsigned int begin, unsigned int end) {
+			for (unsigned int i = begin; i < end; i++) {
+				const int t = gDirtyList[i];
+				gWorld[t] = Compose(gPositions[t], gRotations[t], gScales[t]);
+				gDirty[t] = 0;
+			}
+		};
+		if (jobs)
+			jobs->ParallelFor((unsigned int)gDirtyList.size(), UPDATE_GRAIN, updateDirty);
+		else
+			updateDirty(0, (unsigned int)gDirtyList.size());
+
+		gUpdated.swap(gDirtyList);
+		gDirtyList.clear();
+		return;
+	}
+
+	if (gHierarchyChanged)
+		SortHierarchy();
+
+	// Parents are visited first, so a dirty parent has already flagged
+	// (and recomputed) itself by the time its children are reached. Within
+	// a level no transform depends on another, so each level is split into
+	// jobs and the levels run one after the other.
+	auto updateRange = [this](unsigned int begin, unsigned int end) {
+		for (unsigned int i = begin; i < end; i++) {
+			const int t = gOrder[i];
+			const int parent = gParents[t];
+			if (parent >= 0 && gDirty[parent])
+				gDirty[t] = 1;
+			if (!gDirty[t])
+				continue;
+
+			glm::mat4 local = Compose(gPositions[t], gRotations[t], gScales[t]);
+			gWorld[t] = parent >= 0 ? gWorld[parent] * local : local;
+		}
+	};
+
+	for (size_t level = 0; level + 1 < gLevelStart.size(); level++) {
+		const unsigned int begin = (unsigned int)gLevelStart[level];
+		const unsigned int end = (unsigned int)gLevelStart[level + 1];
+		if (jobs)
+			jobs->ParallelFor(end - begin, UPDATE_GRAIN, [&updateRange, begin](unsigned int first, unsigned int last) {
+				updateRange(begin + first, begin + last);
+			});
+		else
+			updateRange(begin, end);
+	}
+
+	// The walk above already touched every transform, so collecting the
+	// recomputed ones (and clearing their flags) costs no more than it did
+	for (const int t : gOrder) {
+		if (gDirty[t]) {
+			gUpdated.push_back(t);
+			gDirty[t] = 0;
+		}
+	}
+	gDirtyList.clear();
+}
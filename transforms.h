@@ -0,0 +1,58 @@
+///////////////////////////////////////////////////////////////////////////////
+// transforms.h
+// ========
+// structure-of-arrays transform store: local position/rotation/scale and
+// parent links, with world matrices only recomputed for dirty transforms
+// (optionally spread over the job system)
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include "glm/glm.hpp"
+#include "glm/gtc/quaternion.hpp"
+
+#include <vector>
+
+class JobSystem;
+
+class Transforms {
+
+public:
+	// Local transform components, one entry per transform
+	std::vector<glm::vec3> gPositions;
+	std::vector<glm::quat> gRotations;
+	std::vector<glm::vec3> gScales;
+	std::vector<int> gParents;				// Parent transform, -1 for roots
+
+	// Cached world matrices, valid after Update()
+	std::vector<glm::mat4> gWorld;
+
+public:
+	int Add(const glm::vec3& position, const glm::quat& rotation, const glm::vec3& scale, int parent = -1);
+	void Clear();
+
+	void SetPosition(int transform, const glm::vec3& position);
+	void SetRotation(int transform, const glm::quat& rotation);
+	void SetScale(int transform, const glm::vec3& scale);
+	void SetParent(int transform, int parent);
+
+	void Update(JobSystem* jobs = nullptr);
+
+	size_t Count() const { return gParents.size(); }
+	size_t LastUpdateCount() const { return gUpdated.size(); }
+	const std::vector<int>& LastUpdated() const { return gUpdated; }
+
+private:
+	void MarkDirty(int transform);
+	void SortHierarchy();
+
+	std::vector<unsigned char> gDirty;		// Local transform changed since the last Update()
+	std::vector<int> gDirtyList;			// Transforms flagged in gDirty, in no particular order
+	std::vector<int> gOrder;				// All transforms, parents before children
+	std::vector<int> gLevelStart;			// gOrder offset of each hierarchy depth, plus the total
+	std::vector<int> gDepth;				// Scratch space for SortHierarchy()
+	bool gHierarchyChanged = false;			// gOrder must be rebuilt
+	bool gHasChildren = false;				// Any transform has a parent
+	std::vector<int> gUpdated;				// Transforms whose world matrix the last Update() recomputed
+};